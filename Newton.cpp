@@ -25,6 +25,7 @@
     - speaker
     - battery-backed RTC
     - 32k EEPROM
+    - RF transmitter and receiver modules (packet radio)
 
   No warranty is provided with this software and users should refer to
   the schematic provided with the board before running any code.
@@ -33,6 +34,213 @@
 
 #include "Arduino.h"
 #include "Newton.h"
+#ifndef __NO_SLEEP
+#include <avr/sleep.h>
+#endif
+
+#ifdef __NEWTON_STATS
+/*****************************************************************************
+ * Instrumentation
+ * 
+ * Each public EEPROM and RTC function starts with STATS_CALL(), which
+ * times the call and charges it, with the bus traffic it causes, to a
+ * subsystem.  Only the outermost call is counted: Stats_Current is the
+ * subsystem being charged, or STATS_NONE between calls.  Without
+ * __NEWTON_STATS the macros are empty.
+ */
+#define STATS_NONE 0xFF
+
+static Newton_Stats Stats[STATS_SUBSYSTEMS];
+static unsigned int Stats_Micros[STATS_SUBSYSTEMS];   // uS of Blocked not yet a whole mS.
+static byte Stats_Current = STATS_NONE;
+
+class Stats_Scope{
+  private:
+    byte Subsystem;                       // STATS_NONE if nested in another call.
+    unsigned long Start;
+  public:
+    Stats_Scope(byte Charge_To){
+      Subsystem = STATS_NONE;
+      if(Stats_Current!=STATS_NONE) return;
+      Subsystem = Stats_Current = Charge_To;
+      Start = micros();
+      }
+    ~Stats_Scope(){
+      if(Subsystem==STATS_NONE) return;
+      unsigned long Time = micros()-Start;
+      Newton_Stats &S = Stats[Subsystem];
+      S.Calls++;
+      if(Time>S.Worst) S.Worst = Time;
+      Time += Stats_Micros[Subsystem];
+      S.Blocked += Time/1000;
+      Stats_Micros[Subsystem] = Time%1000;
+      Stats_Current = STATS_NONE;
+      }
+  };
+
+static void Stats_Bus(byte Bytes, bool Nak){
+  if(Stats_Current==STATS_NONE) return;
+  Newton_Stats &S = Stats[Stats_Current];
+  S.Transactions++;
+  S.Bytes += Bytes;
+  if(Nak) S.Naks++;
+}
+
+#define STATS_CALL(Subsystem)   Stats_Scope Stats_Here(Subsystem)
+#define STATS_BUS(Bytes,Nak)    Stats_Bus(Bytes,Nak)
+#define STATS_TIMEOUT()         do { if(Stats_Current!=STATS_NONE) Stats[Stats_Current].Timeouts++; } while(0)
+
+/*****************************************************************************
+ * bool _Newton::Get_Stats(byte Subsystem, Newton_Stats *Stats)
+ * 
+ * Copies the counters of a subsystem (STATS_EEPROM ... STATS_ALARMS).
+ * Returns false if there is no such subsystem.
+ */
+bool _Newton::Get_Stats(byte Subsystem, Newton_Stats *Copy)
+{
+  if(Subsystem>=STATS_SUBSYSTEMS) return(false);
+  *Copy = Stats[Subsystem];
+  return(true);
+}
+
+/*****************************************************************************
+ * void _Newton::Reset_Stats()
+ * 
+ * Sets every counter to zero.
+ */
+void _Newton::Reset_Stats()
+{
+  memset(Stats,0,sizeof(Stats));
+  memset(Stats_Micros,0,sizeof(Stats_Micros));
+}
+
+/*****************************************************************************
+ * void _Newton::Print_Stats()
+ * 
+ * Prints the counters to Serial (which must have been started), one line
+ * per subsystem:
+ * 
+ *   stats   calls   ms  worst(us)  xfers  bytes  naks  timeouts
+ *   EEPROM  12      45  3572       150    410   118   0
+ */
+void _Newton::Print_Stats()
+{
+  static const char *const Names[STATS_SUBSYSTEMS] = {"EEPROM","Log","Config","RTC","Alarms"};
+
+  Serial.println(F("stats\tcalls\tms\tworst(us)\txfers\tbytes\tnaks\ttimeouts"));
+  for(byte i=0;i<STATS_SUBSYSTEMS;i++)
+    {
+    Serial.print(Names[i]);               Serial.print('\t');
+    Serial.print(Stats[i].Calls);         Serial.print('\t');
+    Serial.print(Stats[i].Blocked);       Serial.print('\t');
+    Serial.print(Stats[i].Worst);         Serial.print('\t');
+    Serial.print(Stats[i].Transactions);  Serial.print('\t');
+    Serial.print(Stats[i].Bytes);         Serial.print('\t');
+    Serial.print(Stats[i].Naks);          Serial.print('\t');
+    Serial.println(Stats[i].Timeouts);
+    }
+}
+#else
+#define STATS_CALL(Subsystem)
+#define STATS_BUS(Bytes,Nak)    do { (void)(Bytes); (void)(Nak); } while(0)
+#define STATS_TIMEOUT()
+#endif
+
+#ifndef __NO_SLEEP
+// Events that end Sleep_Until_Event() (WAKE_...), recorded by the
+// interrupts that detect them.
+static volatile byte Wake_Events;
+#define WAKE(Event)   (Wake_Events |= (Event))
+#else
+#define WAKE(Event)
+#endif
+
+#ifdef __NEWTON_RADIO
+// While the radio runs, Timer1 overflows Radio_Rate times a second (its
+// sample rate, 0 when it is off) and every Radio_Divider'th overflow is a
+// tick of the software timers.
+static unsigned int Radio_Rate;
+static unsigned int Radio_Divider = 1;
+static unsigned int Radio_Count = 1;
+static void Radio_Tick();
+#endif
+
+#if !defined(__NO_RTC) || !defined(__NO_EEPROM)
+// Bus clock set by Set_Bus_Clock() (the RTC is never run above
+// RTC_MAX_CLOCK), the clock the TWI is set to now (0 after Wire.begin(),
+// which sets its own) and the transactions that have timed out.
+static unsigned long Bus_Clock = I2C_FAST;
+static unsigned long Bus_Clock_Now;
+static unsigned int Bus_Timeouts;
+
+// Selects the fastest clock a device allows, if the TWI is not already
+// set to it, before a transaction with it.
+static void Bus_Select(byte Address)
+{
+  unsigned long Clock = Bus_Clock;
+  if(Address==RTC_ADDRESS && Clock>RTC_MAX_CLOCK) Clock = RTC_MAX_CLOCK;
+  if(Clock!=Bus_Clock_Now)
+    {
+    Wire.setClock(Clock);
+    Bus_Clock_Now = Clock;
+    }
+}
+
+// Drives an I2C line low, or releases it to the pull-ups, as an open-drain
+// output would, then waits half a 100 kHz clock period.
+static void Bus_Line(byte Pin, byte Level)
+{
+  if(Level==LOW)
+    {
+    digitalWrite(Pin,LOW);
+    pinMode(Pin,OUTPUT);
+    }
+  else
+    pinMode(Pin,INPUT_PULLUP);
+  delayMicroseconds(5);
+}
+
+// A transaction that timed out (a device holding SDA or SCL low) is counted
+// and the bus is freed for the next one.
+static void Bus_Timeout()
+{
+  #ifdef WIRE_HAS_TIMEOUT
+  Wire.clearWireTimeoutFlag();
+  #endif
+  STATS_TIMEOUT();
+  Bus_Timeouts++;
+  Newton.Bus_Recover();
+}
+
+// Starts a transaction with a device, then ends it after Bytes data bytes,
+// or reads Count bytes, counting the traffic when __NEWTON_STATS is defined.
+// Results are as for the Wire calls (5 is a timeout).
+static inline void Bus_Begin(byte Address)
+{
+  Bus_Select(Address);
+  Wire.beginTransmission(Address);
+}
+
+static inline byte Bus_End(byte Bytes)
+{
+  byte Result = Wire.endTransmission();
+  bool Failed = Result==2 || Result==5;
+  STATS_BUS(Failed ? 1 : 1+Bytes, Failed || Result==3);
+  if(Result==5) Bus_Timeout();
+  return(Result);
+}
+
+static inline byte Bus_Request(byte Address, byte Count)
+{
+  Bus_Select(Address);
+  byte Received = Wire.requestFrom(Address,Count);
+  STATS_BUS(1+Received, Received!=Count);
+  #ifdef WIRE_HAS_TIMEOUT
+  if(Received!=Count && Wire.getWireTimeoutFlag()) Bus_Timeout();
+  #endif
+  return(Received);
+}
+#endif
 
 _Newton::_Newton(){
   #ifndef __NO_LEDS
@@ -48,8 +256,20 @@ _Newton::_Newton(){
   pinMode(SW2,INPUT_PULLUP);
   #endif
 
-  #if !defined(__NO_RTC) || !defined(_NO_EEPROM)
+  #if !defined(__NO_RTC) || !defined(__NO_EEPROM)
+  // Without a timeout a device holding the bus low would stop the board
+  // for good (cores older than 1.8.13 have none).
   Wire.begin();
+  #ifdef WIRE_HAS_TIMEOUT
+  Wire.setWireTimeout(I2C_TIMEOUT,true);
+  #endif
+  #endif
+
+  #if !defined(__NO_LEDS) || !defined(__NO_SWITCHES)
+  // Timer0 is already running for millis() and overflows every 1.024 mS.
+  // Its compare-A interrupt is free and is used as the system tick.
+  OCR0A = 0x80;
+  TIMSK0 |= (1 << OCIE0A);
   #endif
   
   // Use the compile time and date to intitalize the Real-Time clock.
@@ -62,421 +282,4004 @@ _Newton::_Newton(){
   //  }
   }
 
+#if !defined(__NO_LEDS) || !defined(__NO_SWITCHES)
+ISR(TIMER0_COMPA_vect)      // System tick (976.5625 Hz, see MS_TO_TICKS()).
+{
+  Newton.Tick();
+}
+#endif
+
+#ifndef __NO_LEDS
+ISR(TIMER0_COMPB_vect)      // LED dimmer (software PWM).
+{
+  Newton.LED_PWM_Tick();
+}
+#endif
+
+/*****************************************************************************
+ * void _Newton::Tick()
+ * 
+ * Services the background tasks of the library.  It is called from the
+ * system tick interrupt and must never block.
+ */
+void _Newton::Tick(){
+  #ifndef __NO_LEDS
+  LED_Update(0);
+  LED_Update(1);
+  LED_Update(2);
+  #endif
+
+  #ifndef __NO_SWITCHES
+  Debounce_Switch(0,_SW1_ACTIVE);
+  Debounce_Switch(1,_SW2_ACTIVE);
+  #endif
+}
+
 #ifndef __NO_LEDS
-ISR(TIMER1_OVF_vect)        // interrupt service routine 
+/*****************************************************************************
+ * void _Newton::Flash_Status_LED()
+ * 
+ * Lights the status LED for FLASH_TIME mS.  The LED is turned off by the
+ * pattern engine, so this returns immediately and is safe to call from an
+ * interrupt service routine.
+ */
+void _Newton::Flash_Status_LED(){
+  static const unsigned int Flash[1] = {FLASH_TIME};
+  LED_Start(2,Flash,1,false);
+}
+#endif
+
+#ifndef __NO_TIMERS
+ISR(TIMER1_OVF_vect)        // Software timer tick and radio bit clock.
 {
-  TCNT1 = TIMER1_CTR;   // preload timer
+  Newton.Timer_Tick();
+}
+
+/*****************************************************************************
+ * bool _Newton::Begin_Timers(unsigned int Tick_Rate)
+ * 
+ * Starts the hardware tick (Timer1) that drives the software timers, at
+ * Tick_Rate interrupts per second.  The smallest prescaler that can reach
+ * the rate is chosen (for the finest resolution) and the counter is
+ * preloaded so that it overflows after the right number of counts.  Timer
+ * periods are rounded to whole ticks.  Returns false if the rate cannot be
+ * produced from the CPU clock.
+ *
+ * While the radio runs (see Begin_Radio()) Timer1 overflows at its sample
+ * rate instead, and Tick_Rate must divide that rate.
+ */
+bool _Newton::Begin_Timers(unsigned int Tick_Rate){
+  static const unsigned int Prescalers[5] = {1, 8, 64, 256, 1024};
+  if(Tick_Rate==0) return(false);
+
+  unsigned int Rate = Tick_Rate;
+  #ifdef __NEWTON_RADIO
+  if(Radio_Rate)
+    {
+    if(Radio_Rate%Tick_Rate) return(false);
+    Rate = Radio_Rate;
+    }
+  #endif
+
+  byte Select;
+  unsigned long Counts = 0;
+  for(Select=0;Select<5;Select++)
+    {
+    Counts = F_CPU/((unsigned long)Prescalers[Select]*Rate);
+    if(Counts<=65536UL) break;
+    }
+  if(Select==5 || Counts<2) return(false);
+
+  byte Status = SREG;
+  cli();
+  if(Timer_Rate==0)
+    {
+    for(byte i=0;i<TIMER_WHEEL_SLOTS;i++) Timer_Wheel[i] = TIMER_NONE;
+    for(byte i=0;i<TIMER_COUNT;i++) Timers[i].Slot = TIMER_NONE;
+    }
+  Timer_Rate = Tick_Rate;
+  Timer1_Preload = 65536UL-Counts;
+  #ifdef __NEWTON_RADIO
+  Radio_Divider = Radio_Count = Rate/Tick_Rate;
+  #endif
+  TCCR1A = 0;
+  TCCR1B = 0;
+  TCNT1 = Timer1_Preload;   // preload timer
+  TCCR1B = Select+1;        // CS12:CS10 select the prescaler
+  TIMSK1 |= (1 << TOIE1);   // enable timer overflow interrupt
+  SREG = Status;
+  return(true);
+}
+
+/*****************************************************************************
+ * byte _Newton::Timer_Start(Timer_Callback Callback, unsigned long Period,
+ *                           byte Mode)
+ * 
+ * Starts a software timer that calls Callback after Period mS.  Mode is
+ * TIMER_ONE_SHOT or TIMER_PERIODIC (repeat every Period mS), optionally
+ * combined with TIMER_IN_ISR.  By default the call is deferred: the timer
+ * only records that it expired and the callback is made from
+ * Service_Timers(), which should be called from loop().  With TIMER_IN_ISR
+ * the callback is made directly from the interrupt and must be short and
+ * must not block.  The tick is started at TIMER_TICK_RATE if Begin_Timers()
+ * has not been called.  Returns the timer number, or TIMER_NONE if every
+ * timer is in use.  A one-shot timer is released once its callback has run.
+ */
+byte _Newton::Timer_Start(Timer_Callback Callback, unsigned long Period, byte Mode){
+  if(!Callback) return(TIMER_NONE);
+  if(Timer_Rate==0 && !Begin_Timers(TIMER_TICK_RATE)) return(TIMER_NONE);
+
+  byte Status = SREG;
+  cli();
+  byte Id;
+  for(Id=0;Id<TIMER_COUNT;Id++)
+    if(!Timers[Id].Callback) break;
+  if(Id<TIMER_COUNT)
+    {
+    Soft_Timer &Timer = Timers[Id];
+    Timer.Callback = Callback;
+    Timer.Flags = Mode;
+    Timer.Pending = 0;
+    Timer.Period = Timer_Ticks(Period);
+    Timer_Insert(Id,Timer.Period);
+    }
+  else
+    Id = TIMER_NONE;
+  SREG = Status;
+  return(Id);
+}
+
+/*****************************************************************************
+ * void _Newton::Timer_Cancel(byte Id)
+ * 
+ * Stops a timer and releases it.  Expiries not yet passed to the callback
+ * are discarded.
+ */
+void _Newton::Timer_Cancel(byte Id){
+  if(Id>=TIMER_COUNT || !Timers[Id].Callback) return;
+  byte Status = SREG;
+  cli();
+  Timer_Remove(Id);
+  Timers[Id].Pending = 0;
+  Timers[Id].Callback = NULL;
+  SREG = Status;
+}
+
+/*****************************************************************************
+ * void _Newton::Timer_Reschedule(byte Id, unsigned long Period)
+ * 
+ * Restarts a timer with a new period (mS), counted from now.  A one-shot
+ * timer that has already expired is armed again.
+ */
+void _Newton::Timer_Reschedule(byte Id, unsigned long Period){
+  if(Id>=TIMER_COUNT || !Timers[Id].Callback) return;
+  byte Status = SREG;
+  cli();
+  Timer_Remove(Id);
+  Timers[Id].Period = Timer_Ticks(Period);
+  Timer_Insert(Id,Timers[Id].Period);
+  SREG = Status;
+}
+
+/*****************************************************************************
+ * void _Newton::Service_Timers()
+ * 
+ * Makes the callbacks of timers that have expired since the last call
+ * (once per expiry).  Call this from loop(); the callbacks then run outside
+ * interrupt context and may use delay(), Serial, the I2C bus, etc.
+ */
+void _Newton::Service_Timers(){
+  for(byte Id=0;Id<TIMER_COUNT;Id++)
+    {
+    if(!Timers[Id].Pending) continue;
+    byte Status = SREG;
+    cli();
+    byte Count = Timers[Id].Pending;
+    Timers[Id].Pending = 0;
+    Timer_Callback Callback = Timers[Id].Callback;
+    // A one-shot timer is released once its last expiry is taken.
+    if(!(Timers[Id].Flags & TIMER_PERIODIC) && Timers[Id].Slot==TIMER_NONE)
+      Timers[Id].Callback = NULL;
+    SREG = Status;
+    while(Count--)
+      Callback();
+    }
+}
+
+/*****************************************************************************
+ * void _Newton::Set_Alarm_Time()
+ * byte _Newton::Set_Alarm_Time(Timer_Callback Function, unsigned long Period)
+ * 
+ * Calls a function routinely: every Period mS, from loop() through
+ * Service_Timers().  Without arguments, the status LED is flashed every
+ * ALARM_PERIOD mS (directly from the interrupt, so Service_Timers() is not
+ * needed).  Returns the timer number as Timer_Start() does.
+ */
+#ifndef __NO_LEDS
+static void Flash_Alarm(){
   Newton.Flash_Status_LED();
 }
+#endif
+
+void _Newton::Set_Alarm_Time(){
+  #ifndef __NO_LEDS
+  Timer_Start(Flash_Alarm,ALARM_PERIOD,TIMER_PERIODIC | TIMER_IN_ISR);
+  #endif
+}
+
+byte _Newton::Set_Alarm_Time(Timer_Callback Function, unsigned long Period){
+  return(Timer_Start(Function,Period,TIMER_PERIODIC));
+}
+
+/*****************************************************************************
+ * void _Newton::Timer_Tick()
+ * 
+ * Called from the Timer1 overflow interrupt.  The preload is added to the
+ * counter (rather than written to it) so the counts that elapsed before the
+ * interrupt was serviced are kept and the tick does not drift.  The wheel
+ * then advances one slot and only the timers in that slot are examined:
+ * those with turns left count down, the others expire.  While the radio
+ * runs every overflow samples it, and only some advance the wheel.
+ */
+void _Newton::Timer_Tick(){
+  TCNT1 += Timer1_Preload;
+  #ifdef __NEWTON_RADIO
+  if(Radio_Rate)
+    {
+    Radio_Tick();
+    if(--Radio_Count) return;
+    Radio_Count = Radio_Divider;
+    }
+  #endif
+
+  Timer_Position = (Timer_Position+1) & (TIMER_WHEEL_SLOTS-1);
+  byte Id = Timer_Wheel[Timer_Position];
+  while(Id!=TIMER_NONE)
+    {
+    Soft_Timer &Timer = Timers[Id];
+    byte Next = Timer.Next;
+    if(Timer.Rounds>0)
+      Timer.Rounds--;
+    else
+      {
+      Timer_Remove(Id);
+      if(Timer.Flags & TIMER_PERIODIC)
+        Timer_Insert(Id,Timer.Period);
+      WAKE(WAKE_TIMER);
+      if(Timer.Flags & TIMER_IN_ISR)
+        {
+        Timer_Callback Callback = Timer.Callback;
+        if(!(Timer.Flags & TIMER_PERIODIC)) Timer.Callback = NULL;
+        Callback();
+        }
+      else if(Timer.Pending<255)
+        Timer.Pending++;
+      }
+    Id = Next;
+    }
+}
+
+/*****************************************************************************
+ * void _Newton::Timer_Insert(byte Id, unsigned long Ticks)
+ * void _Newton::Timer_Remove(byte Id)
+ * 
+ * Support functions linking a timer into the wheel slot where it expires
+ * (Ticks from now) and unlinking it again.  Both take constant time.  They
+ * must be called with interrupts disabled.
+ */
+void _Newton::Timer_Insert(byte Id, unsigned long Ticks){
+  Soft_Timer &Timer = Timers[Id];
+  byte Slot = (Timer_Position+Ticks) & (TIMER_WHEEL_SLOTS-1);
+  Timer.Rounds = (Ticks-1)/TIMER_WHEEL_SLOTS;
+  Timer.Slot = Slot;
+  Timer.Prev = TIMER_NONE;
+  Timer.Next = Timer_Wheel[Slot];
+  if(Timer.Next!=TIMER_NONE) Timers[Timer.Next].Prev = Id;
+  Timer_Wheel[Slot] = Id;
+}
+
+void _Newton::Timer_Remove(byte Id){
+  Soft_Timer &Timer = Timers[Id];
+  if(Timer.Slot==TIMER_NONE) return;
+  if(Timer.Prev!=TIMER_NONE)
+    Timers[Timer.Prev].Next = Timer.Next;
+  else
+    Timer_Wheel[Timer.Slot] = Timer.Next;
+  if(Timer.Next!=TIMER_NONE) Timers[Timer.Next].Prev = Timer.Prev;
+  Timer.Slot = TIMER_NONE;
+}
+
+/*****************************************************************************
+ * unsigned long _Newton::Timer_Ticks(unsigned long Period)
+ * 
+ * Converts a period in mS to ticks (at least one), without overflowing for
+ * long periods.
+ */
+unsigned long _Newton::Timer_Ticks(unsigned long Period){
+  unsigned long Ticks = (Period/1000)*Timer_Rate + ((Period%1000)*Timer_Rate+500)/1000;
+  return((Ticks>0) ? Ticks : 1);
+}
+#endif
+
+
+/*#######################################################################  
+     _____    _                          
+    / ____|  | |                         
+   | (___    | |    ___     ___    _ __  
+    \___ \   | |   / _ \   / _ \  | '_ \ 
+    ____) |  | |  |  __/  |  __/  | |_) |
+   |_____/   |_|   \___|   \___|  | .__/ 
+                                  | |    
+                                  |_|    
+  #######################################################################*/
+#ifndef __NO_SLEEP
+ISR(PCINT0_vect)            // SW2 (wakes the CPU from sleep).
+{
+  Newton.Pin_Change();
+}
+
+ISR(PCINT2_vect)            // SW1 and SQW (wake the CPU from sleep).
+{
+  Newton.Pin_Change();
+}
+
+// Time awake and asleep (whole mS, and uS not yet a whole mS), and the
+// number of wake-ups, since Reset_Sleep_Stats().
+static unsigned long Sleep_Awake, Sleep_Asleep, Sleep_Wakes;
+static unsigned int Sleep_Awake_Micros, Sleep_Asleep_Micros;
+static unsigned long Sleep_Mark;          // micros() when the CPU last woke.
+static bool Sleep_Deep;                   // Asleep in power-down.
+static bool Sleep_SQW_High;               // Level of SQW before the wake-up.
+
+static void Sleep_Count(unsigned long *Total, unsigned int *Micros, unsigned long Elapsed){
+  Elapsed += *Micros;
+  *Total += Elapsed/1000;
+  *Micros = Elapsed%1000;
+}
+
+// Enables the pin-change interrupt of a pin, forgetting earlier changes,
+// or disables it.
+static void Wake_Pin(byte Pin, bool Enable){
+  volatile byte *Mask = digitalPinToPCMSK(Pin);
+  byte Group = 1<<digitalPinToPCICRbit(Pin);
+  if(Enable)
+    {
+    *Mask |= 1<<digitalPinToPCMSKbit(Pin);
+    PCIFR = Group;
+    PCICR |= Group;
+    }
+  else
+    {
+    *Mask &= ~(1<<digitalPinToPCMSKbit(Pin));
+    if(!*Mask) PCICR &= ~Group;
+    }
+}
+
+/*****************************************************************************
+ * byte _Newton::Sleep_Until_Event(byte Mode)
+ * 
+ * Stops the CPU until something happens that the sketch may need to act
+ * on, rather than polling the switches and the time in loop().  Returns
+ * the events since the last call (at once if there already are some):
+ * WAKE_SWITCH when a switch event is waiting (see Get_Switch_Event()),
+ * WAKE_CLOCK for each second pulse from the RTC (only when its SQW pin was
+ * given to Begin_Time_Cache()), WAKE_TIMER when a software timer has
+ * expired, such as the one started by Set_Alarm_Time(), and WAKE_RADIO
+ * when a packet has been received (see Radio_Receive()).
+ *
+ * In SLEEP_IDLE the timers keep running: the system tick wakes the CPU
+ * every 1.024 mS, and it goes straight back to sleep unless one of these
+ * events occurred.  SLEEP_POWER_DOWN stops every clock and draws far less
+ * current, but only the switches and SQW can wake it; millis() and the
+ * software timers stand still meanwhile.  Idle is used instead while the
+ * tick has work to do (an LED pattern or dimming, a sound effect, or a
+ * switch held down or being debounced) and while the radio is on, whose
+ * interrupt wakes the CPU at its sample rate.  The ADC, SPI and an unused
+ * Timer1 are switched off while the CPU sleeps.
+ */
+byte _Newton::Sleep_Until_Event(byte Mode){
+  for(;;)
+    {
+    cli();
+    byte Events = Wake_Events;
+    if(Events)
+      {
+      Wake_Events = 0;
+      sei();
+      return(Events);
+      }
+    // The pins are watched before the tick is checked, so a change in
+    // between still wakes the CPU.  Without any, power-down would never end.
+    bool Watching = Wake_Pins(true);
+    Sleep_Deep = (Mode==SLEEP_POWER_DOWN && Watching && !Tick_Busy());
+    #ifndef __NO_RTC
+    unsigned long Edges = Clock_Edges;
+    #endif
+    unsigned long Start = micros();
+    Sleep_Count(&Sleep_Awake,&Sleep_Awake_Micros,Start-Sleep_Mark);
+
+    byte ADC_Control = ADCSRA;
+    byte Power_Reduction = PRR;
+    ADCSRA &= ~(1<<ADEN);                 // The ADC must be off before its clock is.
+    #ifndef __NO_TIMERS
+    PRR |= (1<<PRADC) | (1<<PRSPI) | (Timer_Rate ? 0 : (1<<PRTIM1));
+    #else
+    PRR |= (1<<PRADC) | (1<<PRSPI);     // Timer1 belongs to the sketch.
+    #endif
+    set_sleep_mode(Sleep_Deep ? SLEEP_MODE_PWR_DOWN : SLEEP_MODE_IDLE);
+    sleep_enable();
+    if(Sleep_Deep) sleep_bod_disable();
+    sei();                                // The instruction after sei() runs before any
+    sleep_cpu();                          // interrupt, so no wake-up can be missed.
+    sleep_disable();
+    PRR = Power_Reduction;
+    ADCSRA = ADC_Control;
+
+    cli();
+    Wake_Pins(false);
+    Sleep_Mark = micros();
+    Sleep_Count(&Sleep_Asleep,&Sleep_Asleep_Micros,Sleep_Mark-Start);
+    #ifndef __NO_RTC
+    // millis() stood still in power-down; the SQW edges counted meanwhile
+    // give the time asleep to the second.
+    if(Sleep_Deep) Sleep_Asleep += (Clock_Edges-Edges)*1000UL;
+    #endif
+    Sleep_Deep = false;
+    Sleep_Wakes++;
+    sei();
+    }
+  }
+
+/*****************************************************************************
+ * void _Newton::Get_Sleep_Stats(unsigned long *Awake, unsigned long *Asleep,
+ *                               unsigned long *Wakes)
+ * void _Newton::Reset_Sleep_Stats()
+ * 
+ * Report the mS spent awake and asleep in Sleep_Until_Event(), and the
+ * times the CPU woke, since start-up or Reset_Sleep_Stats().  Time in
+ * power-down is only known when the RTC's SQW output is used (see
+ * Sleep_Until_Event()); otherwise it is missing from both counts.
+ */
+void _Newton::Get_Sleep_Stats(unsigned long *Awake, unsigned long *Asleep, unsigned long *Wakes){
+  byte Status = SREG;
+  cli();
+  unsigned long Awake_Total = Sleep_Awake;
+  unsigned int Awake_Micros = Sleep_Awake_Micros;
+  Sleep_Count(&Awake_Total,&Awake_Micros,micros()-Sleep_Mark);
+  *Awake = Awake_Total;
+  *Asleep = Sleep_Asleep;
+  *Wakes = Sleep_Wakes;
+  SREG = Status;
+  }
+
+void _Newton::Reset_Sleep_Stats(){
+  byte Status = SREG;
+  cli();
+  Sleep_Awake = Sleep_Asleep = Sleep_Wakes = 0;
+  Sleep_Awake_Micros = Sleep_Asleep_Micros = 0;
+  Sleep_Mark = micros();
+  SREG = Status;
+  }
+
+/*****************************************************************************
+ * void _Newton::Pin_Change()
+ * 
+ * Called from the pin-change interrupts, which are enabled while the CPU
+ * sleeps.  Waking it is all they need to do, except for SQW: INT0/INT1
+ * only see edges while the I/O clock runs, so the falling edge that ends a
+ * power-down is counted here instead.
+ */
+void _Newton::Pin_Change(){
+  #ifndef __NO_RTC
+  if(Sleep_Deep && Clock_Sqw)
+    {
+    bool High = digitalRead(Clock_SQW_Pin);
+    if(Sleep_SQW_High && !High) Clock_Edge();
+    Sleep_SQW_High = High;
+    }
+  #endif
+  }
+
+/*****************************************************************************
+ * bool _Newton::Tick_Busy()
+ * void _Newton::Wake_Pins(bool Enable)
+ * 
+ * Support functions for Sleep_Until_Event(): whether the system tick, the
+ * speaker or the radio has work to do (so power-down, which stops the
+ * timers, cannot be used), and watching the switches and SQW for a change while asleep
+ * (false if there are none to watch).
+ */
+bool _Newton::Tick_Busy(){
+  #ifndef __NO_LEDS
+  if(LED_PWM) return(true);
+  for(byte i=0;i<3;i++)
+    if(LED_Channels[i].Steps || LED_Channels[i].Step) return(true);
+  #endif
+  #ifndef __NO_SPEAKER
+  if(Sound_Playing()) return(true);
+  #endif
+  #ifndef __NO_SWITCHES
+  byte Active = (_SW1_ACTIVE ? 0x01 : 0) | (_SW2_ACTIVE ? 0x02 : 0);
+  if(Switch_Stable || Active!=Switch_Stable) return(true);
+  #endif
+  #ifdef __NEWTON_RADIO
+  if(Radio_Rate) return(true);
+  #endif
+  return(false);
+  }
+
+bool _Newton::Wake_Pins(bool Enable){
+  bool Watching = false;
+  #if defined(__NO_SWITCHES) && defined(__NO_RTC)
+  (void)Enable;
+  #endif
+  #ifndef __NO_SWITCHES
+  Wake_Pin(SW1,Enable);
+  Wake_Pin(SW2,Enable);
+  Watching = true;
+  #endif
+  #ifndef __NO_RTC
+  if(Clock_Sqw)
+    {
+    Sleep_SQW_High = digitalRead(Clock_SQW_Pin);
+    Wake_Pin(Clock_SQW_Pin,Enable);
+    Watching = true;
+    }
+  #endif
+  return(Watching);
+  }
+#endif
+
+/*#######################################################################  
+    _____                  _    _           
+   |  __ \                | |  (_)          
+   | |__) |    __ _     __| |   _     ___   
+   |  _  /    / _` |   / _` |  | |   / _ \  
+   | | \ \   | (_| |  | (_| |  | |  | (_) | 
+   |_|  \_\   \__,_|   \__,_|  |_|   \___/  
+                                            
+  #######################################################################*/
+#ifdef __NEWTON_RADIO
+/*
+ * Packets are sent by switching the transmitter's carrier on for a 1 and
+ * off for a 0 (on-off keying).  Each byte goes out as two 6-bit symbols,
+ * high nibble first and least significant bit first (4b6b coding).  Every
+ * symbol has three 1s and three 0s, which keeps the receiver's slicer
+ * balanced, and edges come often enough to keep its clock in step.  A
+ * packet is:
+ *
+ *    preamble   RADIO_PREAMBLE words of alternating bits, during which the
+ *               receiver settles
+ *    sync       RADIO_SYNC, 12 bits that are not a pair of symbols
+ *    length     1 to RADIO_MAX_PAYLOAD
+ *    payload
+ *    CRC        CRC-16/CCITT of the length and payload, high byte first
+ *
+ * Both ends are clocked by the Timer1 interrupt at RADIO_SAMPLES times the
+ * bit rate.  The transmitter changes its pin every RADIO_SAMPLES ticks.
+ * The receiver samples its pin on every tick and counts the 1s of each bit;
+ * a software PLL (a ramp that wraps once per bit) moves the bit boundary
+ * towards the edges it sees, so the two clocks need not match exactly.
+ */
+#define RADIO_SAMPLES       8       // Ticks per bit.
+#define RADIO_PREAMBLE      4       // 12-bit words before the sync word.
+#define RADIO_PREAMBLE_WORD 0xAAA
+#define RADIO_SYNC          0xB38
+#define RADIO_RAMP          160     // PLL ramp length (one bit).
+#define RADIO_RAMP_STEP     (RADIO_RAMP/RADIO_SAMPLES)
+#define RADIO_RAMP_ADJUST   5       // Taken off or added to a step at an edge.
+#define RADIO_TX_IDLE       0xFF    // Radio_Tx_Step when no packet is being sent.
+
+static const byte Radio_Symbols[16] PROGMEM = {
+  0x0D, 0x0E, 0x13, 0x15, 0x16, 0x19, 0x1A, 0x1C,
+  0x23, 0x25, 0x26, 0x29, 0x2A, 0x2C, 0x32, 0x34};
+
+// Transmitter.  Radio_Send() appends packets (the length, then the payload)
+// to Radio_Tx_Buffer and the interrupt takes them from Radio_Tx_Tail.
+static byte Radio_Tx_Buffer[RADIO_TX_BUFFER];
+static volatile byte Radio_Tx_Head;         // Written only by Radio_Send().
+static volatile byte Radio_Tx_Tail;         // Written only by the interrupt.
+static byte Radio_Tx_Step;                  // Preamble or sync word being sent, or RADIO_TX_IDLE.
+static byte Radio_Tx_Left;                  // Bytes of the packet to send, including the CRC.
+static uint16_t Radio_Tx_CRC;
+static uint16_t Radio_Tx_Word;              // Bits still to send, the next in bit 0.
+static volatile byte Radio_Tx_Bits;
+static byte Radio_Tx_Sample;                // Ticks until the next bit.
+
+// Receiver.  A packet is stored from Radio_Rx_Head as it arrives and is
+// only seen by Radio_Receive() once its CRC is good and Radio_Rx_Head has
+// been moved past it.
+static byte Radio_Rx_Buffer[RADIO_RX_BUFFER];
+static volatile byte Radio_Rx_Head;         // Written only by the interrupt.
+static volatile byte Radio_Rx_Tail;         // Written only by Radio_Receive().
+static byte Radio_Rx_Write;                 // Where the next byte of the packet goes.
+static bool Radio_Rx_Active;                // Sync word seen, receiving a packet.
+static byte Radio_Rx_Left;                  // Bytes of the packet to come, 0 before its length.
+static uint16_t Radio_Rx_CRC;
+static uint16_t Radio_Rx_Bits;              // The last 12 bits, the newest in bit 11.
+static byte Radio_Rx_Count;                 // Bits of the byte being received.
+static byte Radio_Rx_Ramp;
+static byte Radio_Rx_Ones;                  // Samples of the current bit that were 1.
+static bool Radio_Rx_Last;                  // The previous sample.
+
+static volatile unsigned long Radio_Sent;
+static volatile unsigned long Radio_Received;
+static volatile unsigned long Radio_Errors;
+static volatile unsigned long Radio_Overruns;
+
+// CRC-16/CCITT of one more byte (as Memory_CRC()).  Run over a packet and
+// its CRC, it gives 0.
+static uint16_t Radio_CRC(uint16_t CRC, byte Value)
+{
+  CRC ^= (uint16_t)Value<<8;
+  for(byte Bit=0;Bit<8;Bit++)
+    CRC = (CRC & 0x8000) ? (CRC<<1)^0x1021 : CRC<<1;
+  return(CRC);
+}
+
+// The nibble a 6-bit symbol stands for, or 0xFF if it is not a symbol.
+static byte Radio_Decode(byte Symbol)
+{
+  for(byte i=0;i<16;i++)
+    if(pgm_read_byte(&Radio_Symbols[i])==Symbol) return(i);
+  return(0xFF);
+}
+
+// Loads the next 12 bits to send into Radio_Tx_Word, or turns the carrier
+// off and leaves Radio_Tx_Bits at 0 if there is nothing to send.
+static void Radio_Tx_Load()
+{
+  if(Radio_Tx_Step==RADIO_TX_IDLE)
+    {
+    if(Radio_Tx_Tail==Radio_Tx_Head)
+      {
+      FastPin<RF_TX>::Low();
+      return;
+      }
+    Radio_Tx_Step = 0;
+    }
+  if(Radio_Tx_Step<RADIO_PREAMBLE)
+    {
+    Radio_Tx_Word = RADIO_PREAMBLE_WORD;
+    Radio_Tx_Step++;
+    }
+  else if(Radio_Tx_Step==RADIO_PREAMBLE)
+    {
+    Radio_Tx_Word = RADIO_SYNC;
+    Radio_Tx_Left = Radio_Tx_Buffer[Radio_Tx_Tail]+3;
+    Radio_Tx_CRC = 0xFFFF;
+    Radio_Tx_Step++;
+    }
+  else
+    {
+    byte Value;
+    if(Radio_Tx_Left>2)
+      {
+      Value = Radio_Tx_Buffer[Radio_Tx_Tail];
+      Radio_Tx_Tail = (Radio_Tx_Tail+1) & (RADIO_TX_BUFFER-1);
+      Radio_Tx_CRC = Radio_CRC(Radio_Tx_CRC,Value);
+      }
+    else
+      Value = (Radio_Tx_Left==2) ? Radio_Tx_CRC>>8 : Radio_Tx_CRC;
+    Radio_Tx_Word = pgm_read_byte(&Radio_Symbols[Value>>4]) |
+                    (uint16_t)pgm_read_byte(&Radio_Symbols[Value & 0x0F])<<6;
+    if(--Radio_Tx_Left==0)
+      {
+      Radio_Tx_Step = RADIO_TX_IDLE;
+      Radio_Sent++;
+      }
+    }
+  Radio_Tx_Bits = 12;
+}
+
+// Takes a byte that has been received (in Radio_Rx_Bits).
+static void Radio_Rx_Byte()
+{
+  byte High = Radio_Decode(Radio_Rx_Bits & 0x3F);
+  byte Low = Radio_Decode(Radio_Rx_Bits>>6);
+  Radio_Rx_Active = false;
+  if(High==0xFF || Low==0xFF)
+    {
+    Radio_Errors++;
+    return;
+    }
+  byte Value = (High<<4) | Low;
+  Radio_Rx_CRC = Radio_CRC(Radio_Rx_CRC,Value);
+  if(Radio_Rx_Left==0)
+    {
+    if(Value==0 || Value>RADIO_MAX_PAYLOAD)
+      {
+      Radio_Errors++;
+      return;
+      }
+    if(((Radio_Rx_Tail-Radio_Rx_Head-1) & (RADIO_RX_BUFFER-1)) <= Value)
+      {
+      Radio_Overruns++;
+      return;
+      }
+    Radio_Rx_Buffer[Radio_Rx_Head] = Value;
+    Radio_Rx_Write = (Radio_Rx_Head+1) & (RADIO_RX_BUFFER-1);
+    Radio_Rx_Left = Value+2;
+    }
+  else
+    {
+    if(Radio_Rx_Left>2)
+      {
+      Radio_Rx_Buffer[Radio_Rx_Write] = Value;
+      Radio_Rx_Write = (Radio_Rx_Write+1) & (RADIO_RX_BUFFER-1);
+      }
+    if(--Radio_Rx_Left==0)
+      {
+      if(Radio_Rx_CRC)
+        Radio_Errors++;
+      else
+        {
+        Radio_Rx_Head = Radio_Rx_Write;
+        Radio_Received++;
+        WAKE(WAKE_RADIO);
+        }
+      return;
+      }
+    }
+  Radio_Rx_Active = true;
+}
+
+/*****************************************************************************
+ * static void Radio_Tick()
+ * 
+ * Called from the Timer1 interrupt RADIO_SAMPLES times per bit while the
+ * radio runs.  Sends the next bit when one is due, and takes a sample of
+ * the receiver.  When the PLL's ramp wraps the bit is decided by the
+ * majority of its samples and shifted into Radio_Rx_Bits, which is watched
+ * for the sync word and then taken 12 bits at a time.
+ */
+static void Radio_Tick()
+{
+  if(--Radio_Tx_Sample==0)
+    {
+    Radio_Tx_Sample = RADIO_SAMPLES;
+    if(!Radio_Tx_Bits) Radio_Tx_Load();
+    if(Radio_Tx_Bits)
+      {
+      FastPin<RF_TX>::Write(Radio_Tx_Word & 1);
+      Radio_Tx_Word >>= 1;
+      Radio_Tx_Bits--;
+      }
+    }
+
+  bool Sample = FastPin<RF_RX>::Read();
+  if(Sample) Radio_Rx_Ones++;
+  if(Sample!=Radio_Rx_Last)
+    {
+    // An edge late in the ramp means the bits come early: catch up.
+    Radio_Rx_Ramp += (Radio_Rx_Ramp<RADIO_RAMP/2) ? RADIO_RAMP_STEP-RADIO_RAMP_ADJUST
+                                                  : RADIO_RAMP_STEP+RADIO_RAMP_ADJUST;
+    Radio_Rx_Last = Sample;
+    }
+  else
+    Radio_Rx_Ramp += RADIO_RAMP_STEP;
+  if(Radio_Rx_Ramp<RADIO_RAMP) return;
+
+  Radio_Rx_Ramp -= RADIO_RAMP;
+  Radio_Rx_Bits = (Radio_Rx_Bits>>1) | (Radio_Rx_Ones>RADIO_SAMPLES/2 ? 0x800 : 0);
+  Radio_Rx_Ones = 0;
+  if(!Radio_Rx_Active)
+    {
+    if(Radio_Rx_Bits==RADIO_SYNC)
+      {
+      Radio_Rx_Active = true;
+      Radio_Rx_Count = 0;
+      Radio_Rx_Left = 0;
+      Radio_Rx_CRC = 0xFFFF;
+      }
+    }
+  else if(++Radio_Rx_Count==12)
+    {
+    Radio_Rx_Count = 0;
+    Radio_Rx_Byte();
+    }
+}
+
+/*****************************************************************************
+ * bool _Newton::Begin_Radio(unsigned int Bit_Rate)
+ * void _Newton::End_Radio()
+ * 
+ * Start and stop the packet radio: an ASK/OOK transmitter module on RF_TX
+ * and a receiver module on RF_RX, at Bit_Rate bits per second
+ * (RADIO_MIN_RATE to RADIO_MAX_RATE, the same at both ends).  While it runs
+ * Timer1 interrupts at 8 times the bit rate and also drives the software
+ * timers, so 8*Bit_Rate must be a multiple of their tick rate
+ * (see Begin_Timers()); the timers are started at TIMER_TICK_RATE if they
+ * were not already.  Returns false if the rate cannot be used.  Packets
+ * waiting to be sent or read are discarded by both.
+ */
+bool _Newton::Begin_Radio(unsigned int Bit_Rate){
+  if(Bit_Rate<RADIO_MIN_RATE || Bit_Rate>RADIO_MAX_RATE) return(false);
+  FastPin<RF_TX>::Low();
+  FastPin<RF_TX>::Output();
+  FastPin<RF_RX>::Input(false);
+
+  byte Status = SREG;
+  cli();
+  unsigned int Old_Rate = Radio_Rate;
+  Radio_Tx_Head = Radio_Tx_Tail = 0;
+  Radio_Tx_Step = RADIO_TX_IDLE;
+  Radio_Tx_Bits = 0;
+  Radio_Tx_Sample = RADIO_SAMPLES;
+  Radio_Rx_Head = Radio_Rx_Tail = 0;
+  Radio_Rx_Active = false;
+  Radio_Rx_Bits = 0;
+  Radio_Rx_Ramp = Radio_Rx_Ones = 0;
+  Radio_Rate = Bit_Rate*RADIO_SAMPLES;
+  bool Started = Begin_Timers(Timer_Rate ? Timer_Rate : TIMER_TICK_RATE);
+  if(!Started) Radio_Rate = Old_Rate;
+  SREG = Status;
+  return(Started);
+}
+
+void _Newton::End_Radio(){
+  if(!Radio_Rate) return;
+  byte Status = SREG;
+  cli();
+  Radio_Rate = 0;
+  Radio_Tx_Head = Radio_Tx_Tail;
+  Radio_Rx_Tail = Radio_Rx_Head;
+  FastPin<RF_TX>::Low();
+  Begin_Timers(Timer_Rate);
+  SREG = Status;
+}
+
+/*****************************************************************************
+ * bool _Newton::Radio_Send(const void *Data, byte Length)
+ * bool _Newton::Radio_Busy()
+ * 
+ * Radio_Send() queues a packet of 1 to RADIO_MAX_PAYLOAD bytes and returns
+ * at once; the interrupt sends it after those queued before.  Returns false
+ * if the radio is not running or RADIO_TX_BUFFER has no room for it (each
+ * packet takes its length plus one).  Radio_Busy() is true until every
+ * queued packet has been sent.  Nothing tells whether a packet arrived:
+ * the receiver must answer if that matters.
+ */
+bool _Newton::Radio_Send(const void *Data, byte Length){
+  if(!Radio_Rate || Length==0 || Length>RADIO_MAX_PAYLOAD) return(false);
+  byte Head = Radio_Tx_Head;
+  if(((Radio_Tx_Tail-Head-1) & (RADIO_TX_BUFFER-1)) <= Length) return(false);
+
+  const byte *Bytes = (const byte *)Data;
+  Radio_Tx_Buffer[Head] = Length;
+  for(byte i=0;i<Length;i++)
+    {
+    Head = (Head+1) & (RADIO_TX_BUFFER-1);
+    Radio_Tx_Buffer[Head] = Bytes[i];
+    }
+  Radio_Tx_Head = (Head+1) & (RADIO_TX_BUFFER-1);
+  return(true);
+}
+
+bool _Newton::Radio_Busy(){
+  byte Status = SREG;
+  cli();
+  bool Busy = Radio_Rate && (Radio_Tx_Head!=Radio_Tx_Tail || Radio_Tx_Step!=RADIO_TX_IDLE || Radio_Tx_Bits);
+  SREG = Status;
+  return(Busy);
+}
+
+/*****************************************************************************
+ * byte _Newton::Radio_Receive(void *Data, byte Size)
+ * 
+ * Copies the oldest packet received into Data and returns its length, or
+ * returns 0 if there is none.  Only packets whose CRC was good are kept.
+ * A packet longer than Size is cut short.  When RADIO_RX_BUFFER is full,
+ * further packets are lost (and counted as overruns) until one is read.
+ * Sleep_Until_Event() returns WAKE_RADIO when a packet arrives.
+ */
+byte _Newton::Radio_Receive(void *Data, byte Size){
+  byte Tail = Radio_Rx_Tail;
+  if(Tail==Radio_Rx_Head) return(0);
+
+  byte *Bytes = (byte *)Data;
+  byte Length = Radio_Rx_Buffer[Tail];
+  for(byte i=0;i<Length;i++)
+    {
+    Tail = (Tail+1) & (RADIO_RX_BUFFER-1);
+    if(i<Size) Bytes[i] = Radio_Rx_Buffer[Tail];
+    }
+  Radio_Rx_Tail = (Tail+1) & (RADIO_RX_BUFFER-1);
+  return(Length<Size ? Length : Size);
+}
+
+/*****************************************************************************
+ * void _Newton::Get_Radio_Stats(unsigned long *Sent, unsigned long *Received,
+ *                               unsigned long *Errors, unsigned long *Overruns)
+ * 
+ * Reports the packets sent and received since start-up, those that arrived
+ * damaged (a bad symbol, length or CRC) and those lost because the receive
+ * buffer was full.  Packets whose sync word was missed are not seen at all.
+ */
+void _Newton::Get_Radio_Stats(unsigned long *Sent, unsigned long *Received, unsigned long *Errors,
+                              unsigned long *Overruns){
+  byte Status = SREG;
+  cli();
+  *Sent = Radio_Sent;
+  *Received = Radio_Received;
+  *Errors = Radio_Errors;
+  *Overruns = Radio_Overruns;
+  SREG = Status;
+}
+#endif
+
+
+/*####################################################################### 
+    _    _                                                        
+   | |  | |                                                       
+   | |  | |  ___    ___   _ __                                    
+   | |  | | / __|  / _ \ | '__|                                   
+   | |__| | \__ \ |  __/ | |                                      
+    \____/  |___/  \___| |_|             __                       
+   |_   _|         | |                  / _|                      
+     | |    _ __   | |_    ___   _ __  | |_    __ _    ___    ___ 
+     | |   | '_ \  | __|  / _ \ | '__| |  _|  / _` |  / __|  / _ \
+    _| |_  | | | | | |_  |  __/ | |    | |   | (_| | | (__  |  __/
+   |_____| |_| |_|  \__|  \___| |_|    |_|    \__,_|  \___|  \___|
+                                                                  
+ #######################################################################*/
+
+#ifndef __NO_LEDS
+/*****************************************************************************
+ * void _Newton::LED1_Indicator(bool Value)
+ * 
+ * This is a high level function call that allows a user to turn LED1 on or
+ * off.  Any pattern running on the LED is stopped.
+ */
+void _Newton::LED1_Indicator(bool Value){
+  LED_Start(0,NULL,0,false);
+  if(Value==ON)
+    _LED1_ON;
+  else
+    _LED1_OFF;
+  }
+
+/*****************************************************************************
+ * void _Newton::LED2_Indicator(bool Value)
+ * 
+ * This is a high level function call that allows a user to turn LED2 on or
+ * off.  Any pattern running on the LED is stopped.
+ */
+void _Newton::LED2_Indicator(bool Value){
+  LED_Start(1,NULL,0,false);
+  if(Value==ON)
+    _LED2_ON;
+  else
+    _LED2_OFF;
+  }
+
+/*****************************************************************************
+ * void _Newton::Status_Indicator(bool Value)
+ * 
+ * This is a high level function call that allows a user to turn the status 
+ * LED on or off.  Any pattern running on the LED is stopped.
+ */
+void _Newton::Status_Indicator(bool Value){
+  LED_Start(2,NULL,0,false);
+  if(Value==ON)
+    _STATUS_ON;
+  else
+    _STATUS_OFF;
+  }
+
+/*****************************************************************************
+ * void _Newton::LED_Indicators(bool Led1, bool Led2, bool Status)
+ * 
+ * Turns all three LEDs on or off at once, stopping any patterns.  LED1 and
+ * LED2 are on the same port, so they change together.
+ */
+void _Newton::LED_Indicators(bool Led1, bool Led2, bool Status){
+  for(byte i=0;i<3;i++)
+    LED_Start(i,NULL,0,false);
+  FastPins<LED1,LED2,LED_STATUS>::Write((Led1 ? 0x01 : 0)|(Led2 ? 0x02 : 0)|(Status ? 0x04 : 0));
+  }
+
+/*****************************************************************************
+ * void _Newton::LED_Blink(byte Led, unsigned int On_Time,
+ *                         unsigned int Off_Time)
+ * 
+ * Blinks an LED (LED1, LED2 or LED_STATUS) in the background: on for
+ * On_Time mS, then off for Off_Time mS, repeatedly.
+ */
+void _Newton::LED_Blink(byte Led, unsigned int On_Time, unsigned int Off_Time){
+  byte Index = LED_Index(Led);
+  if(Index>2) return;
+  LED_Start(Index,NULL,0,false);
+  LED_Channels[Index].Blink[0] = On_Time;
+  LED_Channels[Index].Blink[1] = Off_Time;
+  LED_Start(Index,LED_Channels[Index].Blink,2,true);
+  }
+
+/*****************************************************************************
+ * void _Newton::LED_Heartbeat(byte Led)
+ * 
+ * Shows a "heartbeat" (a double blink once per second) on an LED in the
+ * background.
+ */
+void _Newton::LED_Heartbeat(byte Led){
+  static const unsigned int Heartbeat[4] = {50, 150, 50, 750};
+  LED_Pattern(Led,Heartbeat,4,true);
+  }
+
+/*****************************************************************************
+ * void _Newton::LED_Pattern(byte Led, const unsigned int *Steps, byte Count,
+ *                           bool Repeat)
+ * 
+ * Shows a custom sequence on an LED in the background.  Steps holds Count
+ * durations in mS, alternately on and off, starting with on.  The array is
+ * used in place and must remain valid while the pattern runs.  If Repeat is
+ * false the LED is turned off at the end of the sequence.
+ */
+void _Newton::LED_Pattern(byte Led, const unsigned int *Steps, byte Count, bool Repeat){
+  byte Index = LED_Index(Led);
+  if(Index>2) return;
+  LED_Start(Index,Steps,Count,Repeat);
+  }
+
+/*****************************************************************************
+ * void _Newton::LED_Stop(byte Led)
+ * 
+ * Stops any pattern running on an LED and turns it off.
+ */
+void _Newton::LED_Stop(byte Led){
+  byte Index = LED_Index(Led);
+  if(Index>2) return;
+  LED_Start(Index,NULL,0,false);
+  LED_Write(Index,LOW);
+  }
+
+/*****************************************************************************
+ * void _Newton::LED_Brightness(byte Led, byte Level)
+ * void _Newton::LED_Fade(byte Led, byte Level, unsigned int Time)
+ * void _Newton::LED_Breathe(byte Led, unsigned int Period)
+ * 
+ * Dim an LED in the background.  LED_Brightness() sets the brightness at
+ * once, LED_Fade() changes it gradually from the present brightness to
+ * Level over Time mS, and LED_Breathe() fades the LED up and down
+ * continuously, once every Period mS.  Level runs from 0 (off) to 255
+ * (fully on) and is corrected for the eye's response, so equal changes of
+ * Level look like equal changes of brightness.  Any pattern running on the
+ * LED is stopped, and a pattern or indicator call ends the dimming.
+ *
+ * The three LEDs share one software PWM run by the Timer0 compare-B
+ * interrupt, so analogWrite() cannot be used on pin 5 while an LED is
+ * dimmed.
+ */
+void _Newton::LED_Brightness(byte Led, byte Level){
+  byte Index = LED_Index(Led);
+  if(Index>2) return;
+  LED_Fade_Start(Index,Level,0,false);
+  }
+
+void _Newton::LED_Fade(byte Led, byte Level, unsigned int Time){
+  byte Index = LED_Index(Led);
+  if(Index>2) return;
+  LED_Fade_Start(Index,Level,Time,false);
+  }
+
+void _Newton::LED_Breathe(byte Led, unsigned int Period){
+  byte Index = LED_Index(Led);
+  if(Index>2) return;
+  LED_Fade_Start(Index,255,Period/2,true);
+  }
+
+/*****************************************************************************
+ * void _Newton::LED_Fade_Start(byte Index, byte Level, unsigned int Time,
+ *                              bool Breathe)
+ * 
+ * Starts a channel fading to Level over Time mS (at once if Time is 0).  A
+ * breathing channel changes at the rate of a full-range fade over Time mS.
+ * The fade starts from the brightness shown now: the dimmed level, or fully
+ * on or off as the pin was left by an indicator or pattern.
+ */
+void _Newton::LED_Fade_Start(byte Index, byte Level, unsigned int Time, bool Breathe){
+  LED_Channel &Channel = LED_Channels[Index];
+  byte Status = SREG;
+  cli();
+  unsigned int From = Channel.Level;
+  if(!(LED_PWM & (1<<Index)))
+    {
+    switch(Index)
+      {
+      case 0: From = FastPin<LED1>::Read() ? 0xFF00 : 0; break;
+      case 1: From = FastPin<LED2>::Read() ? 0xFF00 : 0; break;
+      case 2: From = FastPin<LED_STATUS>::Read() ? 0xFF00 : 0; break;
+      }
+    }
+  LED_Start(Index,NULL,0,false);
+  unsigned int Goal = (unsigned int)Level<<8;
+  unsigned int Change = Breathe ? 0xFF00 : ((Goal>From) ? Goal-From : From-Goal);
+  Channel.Target = Level;
+  Channel.Breathe = Breathe;
+  if(Time==0)
+    {
+    From = Goal;
+    Channel.Step = Breathe ? Change : 0;
+    }
+  else
+    {
+    unsigned long Ticks = MS_TO_TICKS(Time);
+    Channel.Step = (Change+Ticks-1)/Ticks;    // Rounded up so the fade ends in time.
+    }
+  Channel.Level = From;
+  LED_Dim(Index);
+  SREG = Status;
+  }
+
+/*****************************************************************************
+ * void _Newton::LED_Start(byte Index, const unsigned int *Steps, byte Count,
+ *                         bool Repeat)
+ * 
+ * Loads a pattern into a channel and shows its first step.  The system tick
+ * also uses the channel, so interrupts are held off while it changes; this
+ * keeps the function safe to call from an interrupt service routine.  A
+ * NULL pattern leaves the channel idle.  Any dimming of the LED ends.
+ */
+void _Newton::LED_Start(byte Index, const unsigned int *Steps, byte Count, bool Repeat){
+  LED_Channel &Channel = LED_Channels[Index];
+  byte Status = SREG;
+  cli();
+  Channel.Step = 0;
+  Channel.Breathe = false;
+  LED_PWM &= ~(1<<Index);
+  if(!LED_PWM) TIMSK0 &= ~(1<<OCIE0B);
+  Channel.Steps = (Count>0) ? Steps : NULL;
+  Channel.Count = Count;
+  Channel.Index = 0;
+  Channel.Repeat = Repeat;
+  if(Channel.Steps)
+    {
+    Channel.Remaining = MS_TO_TICKS(Steps[0]);
+    LED_Write(Index,HIGH);
+    }
+  SREG = Status;
+  }
+
+/*****************************************************************************
+ * void _Newton::LED_Update(byte Index)
+ * 
+ * Called from the system tick.  Counts down the current step of a channel
+ * and moves to the next one when it expires, so the cost per LED is
+ * constant no matter how long or complex the pattern is.  A fading channel
+ * instead moves its brightness one step towards the target.
+ */
+void _Newton::LED_Update(byte Index){
+  LED_Channel &Channel = LED_Channels[Index];
+  if(Channel.Step)
+    {
+    unsigned int Goal = (unsigned int)Channel.Target<<8;
+    if(Channel.Level<Goal)
+      Channel.Level = (Goal-Channel.Level>Channel.Step) ? Channel.Level+Channel.Step : Goal;
+    else
+      Channel.Level = (Channel.Level-Goal>Channel.Step) ? Channel.Level-Channel.Step : Goal;
+    if(Channel.Level==Goal)
+      {
+      if(Channel.Breathe)
+        Channel.Target = ~Channel.Target;
+      else
+        Channel.Step = 0;
+      }
+    LED_Dim(Index);
+    return;
+    }
+  if(!Channel.Steps) return;
+  if(Channel.Remaining>1)
+    {
+    Channel.Remaining--;
+    return;
+    }
+  if(++Channel.Index>=Channel.Count)
+    {
+    if(!Channel.Repeat)
+      {
+      Channel.Steps = NULL;
+      LED_Write(Index,LOW);
+      return;
+      }
+    Channel.Index = 0;
+    }
+  Channel.Remaining = MS_TO_TICKS(Channel.Steps[Channel.Index]);
+  LED_Write(Index,!(Channel.Index & 1));
+  }
+
+/*****************************************************************************
+ * byte _Newton::LED_Index(byte Led)
+ * void _Newton::LED_Write(byte Index, bool Value)
+ * 
+ * Support functions converting an LED pin number to its pattern engine
+ * channel (0xFF for a pin that is not an LED) and lighting the LED of a
+ * channel.
+ */
+byte _Newton::LED_Index(byte Led){
+  switch(Led)
+    {
+    case LED1:       return(0);
+    case LED2:       return(1);
+    case LED_STATUS: return(2);
+    }
+  return(0xFF);
+  }
+
+void _Newton::LED_Write(byte Index, bool Value){
+  switch(Index)
+    {
+    case 0: FastPin<LED1>::Write(Value); break;
+    case 1: FastPin<LED2>::Write(Value); break;
+    case 2: FastPin<LED_STATUS>::Write(Value); break;
+    }
+  }
+
+/*****************************************************************************
+ * void _Newton::LED_Dim(byte Index)
+ * void _Newton::LED_PWM_Tick()
+ * 
+ * The LED dimmer.  It uses bit-angle modulation: each Timer0 cycle (1.024
+ * mS) is cut into segments of 128, 64, 32 ... 4 counts, one for each bit of
+ * a channel's 6-bit duty, and during each segment an LED is lit if that bit
+ * of its duty is set.  LED_Dim() looks up the duty for a channel's
+ * brightness (LED_Gamma[]) and stores its bits in the segment's plane;
+ * LED_PWM_Tick() then writes one plane to the pins per segment.  The
+ * interrupt therefore runs 7 times per cycle, whatever the brightness and
+ * however many LEDs are dimmed or fading.  A channel faded fully on or off
+ * leaves the PWM and its pin is written directly; the interrupt is turned
+ * off when no channel uses it.  Both must be called with interrupts
+ * disabled.
+ */
+// round(63*(Level/255)^2.2)
+static const byte LED_Gamma[256] PROGMEM = {
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1,
+   1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2,
+   2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3,
+   3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5,
+   5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7,
+   7, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9,10,10,10,10,
+  10,11,11,11,11,11,12,12,12,12,12,13,13,13,13,14,
+  14,14,14,15,15,15,15,16,16,16,16,17,17,17,17,18,
+  18,18,18,19,19,19,20,20,20,20,21,21,21,22,22,22,
+  23,23,23,24,24,24,25,25,25,25,26,26,26,27,27,28,
+  28,28,29,29,29,30,30,30,31,31,31,32,32,33,33,33,
+  34,34,35,35,35,36,36,37,37,37,38,38,39,39,39,40,
+  40,41,41,42,42,42,43,43,44,44,45,45,46,46,46,47,
+  47,48,48,49,49,50,50,51,51,52,52,53,53,54,54,55,
+  55,56,56,57,57,58,58,59,59,60,60,61,61,62,62,63
+  };
+
+// Timer0 counts at which the segments start: bit 5 of the duty first, down
+// to bit 0, then 4 counts with every LED off.  The long segment spans the
+// system tick (OCR0A) so that a late tick does not delay a segment.
+static const byte PWM_Start[PWM_BITS+1] = {64, 192, 0, 32, 48, 56, 60};
+
+void _Newton::LED_Dim(byte Index){
+  LED_Channel &Channel = LED_Channels[Index];
+  byte Bit = 1<<Index;
+  byte Level = Channel.Level>>8;
+  if(!Channel.Step && (Level==0 || Level==255))
+    {
+    LED_PWM &= ~Bit;
+    if(!LED_PWM) TIMSK0 &= ~(1<<OCIE0B);
+    LED_Write(Index,Level);
+    return;
+    }
+  byte Duty = pgm_read_byte(&LED_Gamma[Level]);
+  for(byte i=0;i<PWM_BITS;i++)
+    {
+    if(Duty & (1<<i))
+      LED_Planes[i] |= Bit;
+    else
+      LED_Planes[i] &= ~Bit;
+    }
+  if(!LED_PWM)
+    {
+    LED_Segment = 0;
+    OCR0B = PWM_Start[0];
+    TIMSK0 |= (1<<OCIE0B);
+    }
+  LED_PWM |= Bit;
+  }
+
+void _Newton::LED_PWM_Tick(){
+  byte Segment = LED_Segment;
+  for(;;)
+    {
+    byte Start = PWM_Start[Segment];
+    FastPins<LED1,LED2,LED_STATUS>::Write((Segment<PWM_BITS) ? LED_Planes[PWM_BITS-1-Segment] : 0, LED_PWM);
+    Segment = (Segment<PWM_BITS) ? Segment+1 : 0;
+    OCR0B = PWM_Start[Segment];
+    // If this interrupt was held up past the start of the next segment,
+    // show that segment now rather than a whole cycle late.
+    if((byte)(TCNT0-Start) < (byte)(PWM_Start[Segment]-Start)) break;
+    }
+  LED_Segment = Segment;
+  }
+#endif
+
+#ifndef __NO_SWITCHES
+/*****************************************************************************
+ * bool _Newton::SW1_Status()
+ * 
+ * Returns a value of true or false based on whether or not SW1 has been
+ * pressed.  The switch is sampled in the background by the system tick and
+ * a change is only accepted once it has been stable for DEBOUNCE_TIME mS
+ * (switch debouncing), so this returns immediately.
+ */
+bool _Newton::SW1_Status(){
+  return(Switch_Stable & 0x01);
+  }
+
+/*****************************************************************************
+ * bool _Newton::SW2_Status()
+ * 
+ * Returns a value of true or false based on whether or not SW2 has been
+ * pressed.  The switch is sampled in the background by the system tick and
+ * a change is only accepted once it has been stable for DEBOUNCE_TIME mS
+ * (switch debouncing), so this returns immediately.
+ */
+bool _Newton::SW2_Status(){
+  return(Switch_Stable & 0x02);
+  }
+
+/*****************************************************************************
+ * bool _Newton::Get_Switch_Event(byte *Switch, byte *Event)
+ * 
+ * Retrieves the oldest switch event not yet read.  Switch is set to SW1 or
+ * SW2 and Event to SW_PRESS, SW_RELEASE or SW_LONG_PRESS (reported once
+ * when the switch has been held for LONG_PRESS_TIME mS).  Returns false if
+ * no event is waiting.  Events are kept even if they happen between calls,
+ * so short presses are not missed by a slow loop.
+ */
+bool _Newton::Get_Switch_Event(byte *Switch, byte *Event){
+  byte Tail = Switch_Tail;
+  if(Tail==Switch_Head) return(false);
+  byte Entry = Switch_Queue[Tail];
+  *Switch = (Entry>>4) ? SW2 : SW1;
+  *Event = Entry & 0x0F;
+  Switch_Tail = (Tail+1) & (SWITCH_QUEUE_SIZE-1);
+  return(true);
+  }
+
+/*****************************************************************************
+ * void _Newton::Debounce_Switch(byte Index, bool Active)
+ * 
+ * Called from the system tick with the raw state of a switch.  The stable
+ * state only changes after the input has disagreed with it for
+ * DEBOUNCE_TIME mS of samples; press, release and long press events
+ * are queued as they are recognized.
+ */
+void _Newton::Debounce_Switch(byte Index, bool Active){
+  byte Mask = 1<<Index;
+  bool Stable = Switch_Stable & Mask;
+
+  if(Active==Stable)
+    Switch_Count[Index] = 0;
+  else if(++Switch_Count[Index]>=MS_TO_TICKS(DEBOUNCE_TIME))
+    {
+    Switch_Count[Index] = 0;
+    Switch_Stable ^= Mask;
+    Stable = Active;
+    Switch_Held[Index] = 0;
+    Queue_Switch_Event(Index,Active ? SW_PRESS : SW_RELEASE);
+    }
+
+  if(Stable && Switch_Held[Index]<MS_TO_TICKS(LONG_PRESS_TIME))
+    if(++Switch_Held[Index]==MS_TO_TICKS(LONG_PRESS_TIME))
+      Queue_Switch_Event(Index,SW_LONG_PRESS);
+  }
+
+/*****************************************************************************
+ * void _Newton::Queue_Switch_Event(byte Index, byte Event)
+ * 
+ * Adds an event to the queue read by Get_Switch_Event().  Only the system
+ * tick writes the head and only the reader writes the tail, so no locking
+ * is needed.  If the queue is full the event is dropped.
+ */
+void _Newton::Queue_Switch_Event(byte Index, byte Event){
+  byte Head = Switch_Head;
+  byte Next = (Head+1) & (SWITCH_QUEUE_SIZE-1);
+  if(Next==Switch_Tail) return;
+  Switch_Queue[Head] = (Index<<4) | Event;
+  Switch_Head = Next;
+  WAKE(WAKE_SWITCH);
+  }
+#endif
+
+#ifndef __NO_SPEAKER
+// The speaker is driven by Timer2 in CTC mode: its compare-A interrupt
+// toggles SPKR every half period and, every SWEEP_UPDATE cycles of a sweep,
+// moves the frequency on and reloads the compare value.  Nothing else is
+// done per step, so the waveform runs on unbroken from one step to the
+// next.  The Arduino tone() function also uses Timer2, so it cannot be
+// used in the same sketch (define __NO_SPEAKER for that).
+ISR(TIMER2_COMPA_vect)      // Speaker waveform and sweeps.
+{
+  Newton.Speaker_Tick();
+}
+
+// Timer2 prescalers, as shifts, for CS22:CS20 = 1 to 7.
+static const byte Timer2_Shifts[7] = {0, 3, 5, 6, 7, 8, 10};
+
+// log2(1+i/64) and 2^(-i/64), scaled by 32768, for Tone_Log2() and
+// Tone_Half_Cycles().
+static const uint16_t Log2_Table[65] PROGMEM = {
+      0,   733,  1455,  2166,  2866,  3556,  4236,  4907,
+   5568,  6220,  6863,  7498,  8124,  8742,  9352,  9954,
+  10549, 11136, 11716, 12289, 12855, 13415, 13968, 14514,
+  15055, 15589, 16117, 16639, 17156, 17667, 18173, 18673,
+  19168, 19658, 20143, 20623, 21098, 21568, 22034, 22495,
+  22952, 23404, 23852, 24296, 24736, 25172, 25604, 26031,
+  26455, 26876, 27292, 27705, 28114, 28520, 28922, 29321,
+  29717, 30109, 30498, 30884, 31267, 31647, 32024, 32397,
+  32768
+  };
+
+static const uint16_t Exp2_Table[65] PROGMEM = {
+  32768, 32415, 32066, 31720, 31379, 31041, 30706, 30376,
+  30048, 29725, 29405, 29088, 28774, 28464, 28158, 27855,
+  27554, 27258, 26964, 26674, 26386, 26102, 25821, 25543,
+  25268, 24995, 24726, 24460, 24196, 23936, 23678, 23423,
+  23170, 22921, 22674, 22430, 22188, 21949, 21713, 21479,
+  21247, 21019, 20792, 20568, 20347, 20127, 19911, 19696,
+  19484, 19274, 19066, 18861, 18658, 18457, 18258, 18061,
+  17867, 17674, 17484, 17296, 17109, 16925, 16743, 16562,
+  16384
+  };
+
+/*****************************************************************************
+ * static unsigned long Tone_Log2(unsigned long Value)
+ * static unsigned long Tone_Half_Cycles(unsigned long Pitch)
+ * 
+ * Pitch arithmetic for sweeps, without division: the pitch of a frequency
+ * is log2 of it in 1/65536 octaves, so an exponential sweep moves it by
+ * equal steps.  Tone_Log2() returns log2(Value) in these units (Value must
+ * not be 0) and Tone_Half_Cycles() the CPU cycles in half a period of the
+ * frequency with the given pitch.  Both interpolate between the 65 entries
+ * of a table, which keeps them within 0.1% (under 2 cents).
+ */
+static unsigned long Tone_Log2(unsigned long Value){
+  unsigned long Octave = 31;
+  while(!(Value & 0x80000000UL))
+    {
+    Value <<= 1;
+    Octave--;
+    }
+  byte Index = (Value>>25) & 0x3F;
+  unsigned int Fraction = (Value>>15) & 0x3FF;
+  unsigned int Low = pgm_read_word(&Log2_Table[Index]);
+  unsigned int High = pgm_read_word(&Log2_Table[Index+1]);
+  unsigned int Part = Low + (unsigned int)(((unsigned long)(High-Low)*Fraction)>>10);
+  return((Octave<<16) + ((unsigned long)Part<<1));
+}
+
+static unsigned long Tone_Half_Cycles(unsigned long Pitch){
+  byte Octave = Pitch>>16;
+  byte Index = (Pitch>>10) & 0x3F;
+  unsigned int Fraction = Pitch & 0x3FF;
+  unsigned int Low = pgm_read_word(&Exp2_Table[Index]);
+  unsigned int High = pgm_read_word(&Exp2_Table[Index+1]);
+  unsigned int Part = Low - (unsigned int)(((unsigned long)(Low-High)*Fraction)>>10);
+  // F_CPU/2 * 2^-Pitch, with Part/32768 = 2^-(the fraction of an octave).
+  return(((F_CPU/64)*(Part>>3) + (1UL<<(Octave+6))) >> (Octave+7));
+}
+
+/*****************************************************************************
+ * void _Newton::Beep()
+ * 
+ * Produces a tone at the speaker at a set frequency and and for a set period
+ * beore returning to silence.
+ */
+void _Newton::Beep(){
+  Tone_Play(BEEP_FREQ,BEEP_FREQ,BEEP_TIME,0);
+}
+
+/*****************************************************************************
+ * void _Newton::Beep(int Duration)
+ * 
+ * Produces a tone at the speaker at a set frequency(Hz) and for a specified
+ * period (mS) beore returning to silence.
+ */
+void _Newton::Beep(int Duration){
+  Tone_Play(BEEP_FREQ,BEEP_FREQ,Duration,0);
+}
+
+/*****************************************************************************
+ * void _Newton::Beep(int Frequency, int Duration)
+ * 
+ * Produces a tone at the speaker at a given frequency(Hz) and for a
+ * specified period(mS) beore returning to silence.
+ */
+void _Newton::Beep(int Frequency, int Duration){
+  Tone_Play(Frequency,Frequency,Duration,0);
+}
+
+/*****************************************************************************
+ * void _Newton::Tone(int Frequency)
+ * 
+ * Produces a continuous tone at the speaker at a given frequency(Hz).
+ */
+void _Newton::Tone(int Frequency){
+  Tone_Play(Frequency,Frequency,0,0);
+}
+
+/*****************************************************************************
+ * void _Newton::Tone(int Frequency, int Duration))
+ * 
+ * Produces a continuous tone at the speaker at a given frequency(Hz) and for
+ * a given duration(mS).
+ */
+void _Newton::Tone(int Frequency, int Duration){
+  Tone_Play(Frequency,Frequency,Duration,0);
+}
+
+/*****************************************************************************
+ * void _Newton::Sweep(int From, int To, int Duration, byte Shape)
+ * 
+ * Sweeps the tone at the speaker from one frequency(Hz) to another over
+ * Duration(mS), by equal steps in Hz (SWEEP_LINEAR) or in pitch
+ * (SWEEP_EXPONENTIAL, which sounds even to the ear), then falls silent.  A
+ * short sweep makes a chirp.
+ */
+void _Newton::Sweep(int From, int To, int Duration, byte Shape){
+  if(Duration<=0) return;
+  Tone_Play(From,To,Duration,Shape);
+}
+
+/*****************************************************************************
+ * void _Newton::Tone_Play(int From, int To, int Duration, byte Sweep)
+ * 
+ * Common part of Beep(), Tone() and Sweep(): the sound starts at once, in
+ * place of the sound effect playing if there is one (effects still queued
+ * follow it).  A Duration of 0 plays until Silence() and a Frequency of 0
+ * or less stops the speaker.
+ */
+void _Newton::Tone_Play(int From, int To, int Duration, byte Sweep){
+  byte Status = SREG;
+  cli();
+  Tone_Playing.Steps = NULL;
+  if(From<=0)
+    Tone_Stop();
+  else
+    {
+    Tone_Start(From,To>0 ? To : From,Duration>0 ? Duration : 0,Sweep);
+    TCNT2 = 0;              // The new compare value may be below the count.
+    }
+  SREG = Status;
+}
+
+/*****************************************************************************
+ * void _Newton::Silence()
+ * 
+ * Unconditionally stops any tones being produced at the speaker.  The sound
+ * effect being played and any effects waiting to be played are cancelled.
+ */
+void _Newton::Silence(){
+  byte Status = SREG;
+  cli();
+  Tone_Playing.Steps = NULL;
+  Tone_Tail = Tone_Head;
+  Tone_Stop();
+  SREG = Status;
+}
+
+// UP_SQUEAK: a fast sweep from 100 Hz to 10 kHz, then 10 kHz for 100 mS.
+static const Tone_Step Up_Squeak[] PROGMEM = {
+  {  100,  48, 10000, SWEEP_LINEAR}, {10000, 100,     0, 0}
+  };
+
+// DOWN_SQUEAK: a fast sweep from 10 kHz to 100 Hz, then 100 Hz for 100 mS.
+static const Tone_Step Down_Squeak[] PROGMEM = {
+  {10000,  48,   100, SWEEP_LINEAR}, {  100, 100,     0, 0}
+  };
+
+// ALARM: a sweep up and back down followed by a pause, played ten times.
+static const Tone_Step Alarm[] PROGMEM = {
+  {  100,  20, 10000, SWEEP_LINEAR}, {10000,   3,     0, 0}, {10000,  27,   500, SWEEP_LINEAR},
+  {  500,  30,     0, 0}, {    0, 220,     0, 0}
+  };
+
+/*****************************************************************************
+ * void _Newton::Sound_Effect(int Effect)
+ * 
+ * This function produces various auditory special effects at the speaker. 
+ * The effect is played in the background, so this returns immediately; if
+ * another effect is playing, this one follows it.
+ */
+void _Newton::Sound_Effect(int Effect){
+  switch(Effect)
+    {
+    case UP_SQUEAK:
+      Play_Effect(Up_Squeak,sizeof(Up_Squeak)/sizeof(Tone_Step),1);
+      break;
+    case DOWN_SQUEAK:
+      Play_Effect(Down_Squeak,sizeof(Down_Squeak)/sizeof(Tone_Step),1);
+      break;
+    case ALARM:
+      Play_Effect(Alarm,sizeof(Alarm)/sizeof(Tone_Step),10);
+      break;
+    };
+}
+
+/*****************************************************************************
+ * bool _Newton::Play_Effect(const Tone_Step *Steps, byte Count, byte Repeat)
+ * 
+ * Queues a user-defined sound effect: Count steps stored in PROGMEM (see
+ * Tone_Step), played Repeat times, or until Silence() if Repeat is 0.  The
+ * effect is played in the background by the Timer2 interrupt after any
+ * effects already queued and after a Beep(), Tone() or Sweep() that is
+ * playing.  Returns false if the queue is full.
+ */
+bool _Newton::Play_Effect(const Tone_Step *Steps, byte Count, byte Repeat){
+  if(Count==0) return(true);
+  byte Head = Tone_Head;
+  byte Next = (Head+1) & (TONE_QUEUE_SIZE-1);
+  if(Next==Tone_Tail) return(false);
+  Tone_Queue[Head].Steps = Steps;
+  Tone_Queue[Head].Count = Count;
+  Tone_Queue[Head].Repeat = Repeat;
+  byte Status = SREG;
+  cli();
+  Tone_Head = Next;
+  if(!Tone_Active) Tone_Next();
+  SREG = Status;
+  return(true);
+}
+
+/*****************************************************************************
+ * bool _Newton::Sound_Playing()
+ * 
+ * Returns true while a sound effect, a beep, a tone or a sweep is playing or
+ * an effect is waiting to be played.
+ */
+bool _Newton::Sound_Playing(){
+  return(Tone_Active || Tone_Tail!=Tone_Head);
+}
+
+/*****************************************************************************
+ * void _Newton::Speaker_Tick()
+ * 
+ * Called from the Timer2 compare interrupt at every half period of the
+ * tone (or every few mS of a rest).  Toggles the speaker, counts down the
+ * step and, during a sweep, moves the frequency on by one update for every
+ * SWEEP_UPDATE cycles that have passed.  At the end of the step the next
+ * step, repetition or queued effect is started.
+ */
+void _Newton::Speaker_Tick(){
+  if(Tone_Sounding) FastPin<SPKR>::Toggle();
+  unsigned long Interval = Tone_Interval;
+  if(Tone_Left)
+    {
+    if(Tone_Left<=Interval)
+      {
+      Tone_Next();
+      return;
+      }
+    Tone_Left -= Interval;
+    if(!Tone_Sounding && Tone_Left<Interval) Tone_Set_Interval(Tone_Left);
+    }
+  if(!Tone_Sweep) return;
+
+  Tone_Wait -= Interval;
+  if(Tone_Wait>0) return;
+  do
+    {
+    Tone_Value += Tone_Slope;
+    Tone_Wait += SWEEP_UPDATE;
+    }
+  while(Tone_Wait<=0);
+  unsigned long Pitch = Tone_Value>>8;
+  if(Tone_Sweep==SWEEP_LINEAR) Pitch = Tone_Log2(Tone_Value)-(16UL<<16);
+  Tone_Set_Interval(Tone_Half_Cycles(Pitch));
+}
+
+/*****************************************************************************
+ * void _Newton::Tone_Next()
+ * 
+ * Moves on to the next step of the effect being played, the next
+ * repetition or the next queued effect, and stops Timer2 when there is
+ * nothing left to play.  Interrupts must be off.
+ */
+void _Newton::Tone_Next(){
+  if(Tone_Playing.Steps && ++Tone_Index>=Tone_Playing.Count)
+    {
+    Tone_Index = 0;
+    if(Tone_Playing.Repeat==1)
+      Tone_Playing.Steps = NULL;
+    else if(Tone_Playing.Repeat>1)
+      Tone_Playing.Repeat--;
+    }
+
+  if(!Tone_Playing.Steps)
+    {
+    byte Tail = Tone_Tail;
+    if(Tail==Tone_Head)                    // The last effect has finished.
+      {
+      Tone_Stop();
+      return;
+      }
+    Tone_Playing = Tone_Queue[Tail];
+    Tone_Tail = (Tail+1) & (TONE_QUEUE_SIZE-1);
+    Tone_Index = 0;
+    }
+
+  const Tone_Step *Step = Tone_Playing.Steps+Tone_Index;
+  unsigned int Duration = pgm_read_word(&Step->Duration);
+  Tone_Start(pgm_read_word(&Step->Frequency),pgm_read_word(&Step->Sweep_To),
+             Duration ? Duration : 1,pgm_read_byte(&Step->Sweep));
+}
+
+/*****************************************************************************
+ * void _Newton::Tone_Start(unsigned int From, unsigned int To,
+ *                          unsigned int Duration, byte Sweep)
+ * 
+ * Starts a step: a rest if From is 0, a steady tone, or a sweep from From
+ * to To.  A Duration(mS) of 0 plays until stopped.  The division and
+ * logarithms a sweep needs are done here, once, so that the interrupt
+ * only adds.  Timer2 is started if it is not already running, otherwise
+ * it runs on, so that there is no gap between steps.  Interrupts must be
+ * off.
+ */
+void _Newton::Tone_Start(unsigned int From, unsigned int To, unsigned int Duration, byte Sweep){
+  Tone_Left = Duration*(F_CPU/1000UL);
+  Tone_Sweep = 0;
+  Tone_Sounding = From!=0;
+  if(!Tone_Sounding)
+    {
+    FastPin<SPKR>::Low();
+    Tone_Set_Interval(Tone_Left);
+    }
+  else
+    {
+    if(From<SPEAKER_MIN_FREQ) From = SPEAKER_MIN_FREQ;
+    if(To<SPEAKER_MIN_FREQ) To = SPEAKER_MIN_FREQ;
+    if(!Sweep || To==From || !Duration)
+      Tone_Set_Interval((F_CPU/2+From/2)/From);
+    else
+      {
+      unsigned long Target;
+      if(Sweep==SWEEP_LINEAR)
+        {
+        Tone_Value = (unsigned long)From<<16;
+        Target = (unsigned long)To<<16;
+        }
+      else
+        {
+        Tone_Value = (Tone_Log2((unsigned long)From<<16)-(16UL<<16))<<8;
+        Target = (Tone_Log2((unsigned long)To<<16)-(16UL<<16))<<8;
+        }
+      long Updates = Tone_Left/SWEEP_UPDATE;
+      Tone_Slope = (long)(Target-Tone_Value)/(Updates ? Updates : 1);
+      Tone_Wait = SWEEP_UPDATE;
+      Tone_Sweep = Sweep;
+      Tone_Set_Interval((F_CPU/2+From/2)/From);
+      }
+    }
+
+  if(!Tone_Active)
+    {
+    FastPin<SPKR>::Low();
+    FastPin<SPKR>::Output();
+    TCCR2A = (1 << WGM21);  // CTC: count up to OCR2A, then start again
+    TCNT2 = 0;
+    TIFR2 = (1 << OCF2A);
+    TIMSK2 |= (1 << OCIE2A);
+    Tone_Active = true;
+    }
+}
+
+/*****************************************************************************
+ * void _Newton::Tone_Stop()
+ * 
+ * Stops Timer2 and leaves the speaker pin low (so that no current flows
+ * through the speaker).  Interrupts must be off.
+ */
+void _Newton::Tone_Stop(){
+  TIMSK2 &= ~(1 << OCIE2A);
+  TCCR2B = 0;
+  FastPin<SPKR>::Low();
+  Tone_Active = false;
+}
+
+/*****************************************************************************
+ * void _Newton::Tone_Set_Interval(unsigned long Cycles)
+ * 
+ * Sets the time to the next Timer2 interrupt, in CPU cycles.  The smallest
+ * prescaler that can count it is chosen (for the finest resolution) and
+ * the interval actually produced is kept in Tone_Interval.  Intervals
+ * longer than the 1024 x 256 cycles Timer2 can count are cut short.
+ */
+void _Newton::Tone_Set_Interval(unsigned long Cycles){
+  byte Select = 0;
+  while(Select<6 && Cycles>(256UL<<Timer2_Shifts[Select])) Select++;
+  byte Shift = Timer2_Shifts[Select];
+  unsigned long Counts = (Cycles+((1UL<<Shift)>>1))>>Shift;
+  if(Counts>256) Counts = 256;
+  if(Counts==0) Counts = 1;
+  Tone_Interval = Counts<<Shift;
+  OCR2A = Counts-1;
+  if(TCCR2B!=Select+1) TCCR2B = Select+1;   // CS22:CS20 select the prescaler
+}
+#endif
+
+/*#######################################################################  
+    ______   ______   _____    _____     ____    __  __ 
+   |  ____| |  ____| |  __ \  |  __ \   / __ \  |  \/  |
+   | |__    | |__    | |__) | | |__) | | |  | | | \  / |
+   |  __|   |  __|   |  ___/  |  _  /  | |  | | | |\/| |
+   | |____  | |____  | |      | | \ \  | |__| | | |  | |
+   |______| |______| |_|      |_|  \_\  \____/  |_|  |_|
+   |  \/  |                                             
+   | \  / |   ___   _ __ ___     ___    _ __   _   _    
+   | |\/| |  / _ \ | '_ ` _ \   / _ \  | '__| | | | |   
+   | |  | | |  __/ | | | | | | | (_) | | |    | |_| |   
+   |_|  |_|  \___| |_| |_| |_|  \___/  |_|     \__, |   
+                                                __/ |   
+                                               |___/    
+  #######################################################################*/
+#ifndef __NO_EEPROM
+// The Wire library buffers at most BUFFER_LENGTH bytes per transaction.  On
+// writes, two of them are taken by the memory address.
+#ifdef BUFFER_LENGTH
+#define EEPROM_WRITE_CHUNK (BUFFER_LENGTH-2)
+#define EEPROM_READ_CHUNK  BUFFER_LENGTH
+#else
+#define EEPROM_WRITE_CHUNK 30
+#define EEPROM_READ_CHUNK  32
+#endif
+
+/*****************************************************************************
+ * void _Newton::Memory_Write(byte Data, unsigned long Address)
+ * 
+ * An abstract interface to the EEPROM via the I2C bus.  This function will
+ * copy the given data to the specified location in the EEPROM memory.  The
+ * memory unit is organized as 32k * 8.  Address validtion is not performed by
+ * this function.
+ */
+void _Newton::Memory_Write(byte Data, unsigned long Address)
+{
+  STATS_CALL(STATS_EEPROM);
+  Bus_Drain();                             // Finish any queued transactions first.
+  Bus_Begin(EEPROM_ADDRESS);               // Initiate I2C communication to device number 0x50 (hard-wired address).
+  Wire.write(Address>>8);                  // Upper 8-bits of address.
+  Wire.write(Address&0xFF);                // Lower 8-bits of address.
+  Wire.write(Data);                        // 8-bits of data.
+  Bus_End(3);                              // Terminate I2C communication.
+  Memory_Wait_Ready();                     // Wait for the internal write cycle to finish.
+}
+
+/*****************************************************************************
+ * bool _Newton::Memory_Write_Block(const byte *Data, size_t Length,
+ *                                  unsigned long Address)
+ * 
+ * Copies a block of data to the EEPROM starting at the specified location.
+ * The EEPROM programs a whole page (EEPROM_PAGE_SIZE bytes) in a single
+ * write cycle, so the block is split on page boundaries and each piece is
+ * sent in as few transactions as the Wire buffer allows.  Rather than
+ * waiting a fixed 5 mS after each write, the EEPROM is polled until it
+ * acknowledges again.  Returns false if the device stops responding.
+ */
+bool _Newton::Memory_Write_Block(const byte *Data, size_t Length, unsigned long Address)
+{
+  STATS_CALL(STATS_EEPROM);
+  Bus_Drain();
+  while(Length>0)
+    {
+    // Bytes left in the current page, limited by the Wire buffer (which also
+    // holds the two address bytes).
+    size_t Count = EEPROM_PAGE_SIZE - (Address % EEPROM_PAGE_SIZE);
+    if(Count>EEPROM_WRITE_CHUNK) Count = EEPROM_WRITE_CHUNK;
+    if(Count>Length) Count = Length;
+
+    Bus_Begin(EEPROM_ADDRESS);
+    Wire.write(Address>>8);
+    Wire.write(Address&0xFF);
+    Wire.write(Data,Count);
+    if(Bus_End(2+Count)!=0) return(false);
+    if(!Memory_Wait_Ready()) return(false);
+
+    Data += Count;
+    Address += Count;
+    Length -= Count;
+    }
+  return(true);
+}
+
+/*****************************************************************************
+ * bool _Newton::Memory_Wait_Ready()
+ * 
+ * Acknowledge polling.  While the EEPROM is busy with an internal write cycle
+ * it does not acknowledge its address, so an empty transaction is repeated
+ * until it does.  This returns as soon as the write is done (typically well
+ * under the 5 mS worst case).  Returns false after EEPROM_WRITE_TIMEOUT mS.
+ */
+bool _Newton::Memory_Wait_Ready()
+{
+  unsigned long Start = millis();
+  do
+    {
+    Bus_Begin(EEPROM_ADDRESS);
+    if(Bus_End(0)==0) return(true);
+    }
+  while(millis()-Start < EEPROM_WRITE_TIMEOUT);
+  STATS_TIMEOUT();
+  return(false);
+}
+
+/*****************************************************************************
+ * byte _Newton::Memory_Read(unsigned long Address)
+ * 
+ * An abstract interface to the EEPROM via the I2C bus.  This function will
+ * return the data at specified location in the EEPROM memory.  The memory
+ * unit is organized as 32k * 8.  Address validtion is not performed by this
+ * function.  If the EEPROM does not respond, 0xFF (the erased value) is
+ * returned; use Memory_Read_Block() when the error must be detected.
+ */
+byte _Newton::Memory_Read(unsigned long Address)
+{
+  STATS_CALL(STATS_EEPROM);
+  byte Data;
+  
+  if(!Memory_Read_Block(&Data,1,Address))
+    Data = 0xFF;
+  return(Data);
+}
+
+/*****************************************************************************
+ * bool _Newton::Memory_Read_Block(byte *Data, size_t Length,
+ *                                 unsigned long Address)
+ * 
+ * Copies a block of the EEPROM starting at the specified location into RAM.
+ * The address is sent once and the data is then streamed with sequential
+ * reads (the EEPROM advances its address after every byte), in pieces no
+ * larger than the Wire buffer.  Returns false if the EEPROM does not
+ * respond or returns fewer bytes than requested; the buffer contents are
+ * then undefined.
+ */
+bool _Newton::Memory_Read_Block(byte *Data, size_t Length, unsigned long Address)
+{
+  STATS_CALL(STATS_EEPROM);
+  Bus_Drain();
+  Bus_Begin(EEPROM_ADDRESS);               // Initiate I2C communication to device number 0x50 (hard-wired address).
+  Wire.write(Address>>8);                  // Upper 8-bits of address.
+  Wire.write(Address&0xFF);                // Lower 8-bits of address.
+  if(Bus_End(2)!=0) return(false);
+
+  while(Length>0)
+    {
+    byte Count = (Length>EEPROM_READ_CHUNK) ? EEPROM_READ_CHUNK : Length;
+    if(Bus_Request(EEPROM_ADDRESS,Count)!=Count) return(false);
+    for(byte i=0;i<Count;i++)
+      *Data++ = Wire.read();
+    Length -= Count;
+    }
+  return(true);
+}
+
+#ifdef __NEWTON_LOG
+/*****************************************************************************
+ * bool _Newton::Begin_Log(unsigned long Start, unsigned long End)
+ * 
+ * Opens the data log kept in the EEPROM from Start up to (not including)
+ * End, both page aligned.  By default the log uses everything from 0x1000;
+ * Begin_Log(0,EEPROM_SIZE) spreads it over the whole chip when nothing else
+ * is stored there.  Records are written in turn around the whole area, so
+ * every page wears at the same rate, and when it is full the oldest
+ * records are overwritten.  The end of the log is found by a bisection of
+ * the record numbers (about a dozen record reads) rather than a scan of
+ * the chip.  Returns false if the EEPROM does not respond.
+ */
+bool _Newton::Begin_Log(unsigned long Start, unsigned long End)
+{
+  STATS_CALL(STATS_LOG);
+  Log_Record Record;
+
+  Log_Start = Start;
+  Log_Capacity = (End-Start)/LOG_RECORD_SIZE;
+  Log_Next = 1;
+  Log_Pending = 0;
+  if(Log_Capacity==0 || !Memory_Read_Block((byte *)&Record,LOG_RECORD_SIZE,Start)) return(false);
+
+  if(!Log_Slot_Read(0,&Record))
+    {
+    // Slot 0 is blank or was being written when power failed: the newest
+    // record, if there is one, is in the last slot.
+    if(Log_Slot_Read(Log_Capacity-1,&Record)) Log_Next = Record.Sequence+1;
+    return(true);
+    }
+
+  // Slots 0 to Low hold consecutive numbers; slot High does not (or is past the end).
+  unsigned long First = Record.Sequence;
+  unsigned int Low = 0, High = Log_Capacity;
+  while(High-Low>1)
+    {
+    unsigned int Mid = Low+(High-Low)/2;
+    if(Log_Slot_Read(Mid,&Record) && Record.Sequence==First+Mid) Low = Mid;
+    else High = Mid;
+    }
+  Log_Next = First+Low+1;
+  return(true);
+}
+
+/*****************************************************************************
+ * bool _Newton::Log_Append(const void *Data, byte Length)
+ * bool _Newton::Log_Append(unsigned long Time, const void *Data, byte Length)
+ * 
+ * Adds a record of up to LOG_DATA_SIZE bytes to the log, stamped with the
+ * RTC's time (or with Time).  Records are held in RAM until a page of the
+ * EEPROM is filled and then written in one write cycle, so call
+ * Log_Flush() before power is removed.  Returns false if the data does not
+ * fit or a write fails.
+ */
+bool _Newton::Log_Append(const void *Data, byte Length)
+{
+  STATS_CALL(STATS_LOG);
+  #ifndef __NO_RTC
+  return(Log_Append(Get_Epoch(),Data,Length));
+  #else
+  return(Log_Append(0,Data,Length));
+  #endif
+}
+
+bool _Newton::Log_Append(unsigned long Time, const void *Data, byte Length)
+{
+  STATS_CALL(STATS_LOG);
+  if(Log_Capacity==0 || Length>LOG_DATA_SIZE) return(false);
+
+  Log_Record &Record = Log_Buffer[Log_Pending++];
+  Record.Sequence = Log_Next++;
+  Record.Time = Time;
+  memset(Record.Data,0,LOG_DATA_SIZE);
+  memcpy(Record.Data,Data,Length);
+  Record.CRC = Memory_CRC((const byte *)&Record,LOG_RECORD_SIZE-2);
+
+  // Write the buffer when it reaches the end of a page.
+  if((Log_Next-1)%Log_Capacity%(EEPROM_PAGE_SIZE/LOG_RECORD_SIZE)==0) return(Log_Flush());
+  return(true);
+}
+
+/*****************************************************************************
+ * bool _Newton::Log_Flush()
+ * 
+ * Writes the records held in RAM to the EEPROM.  Returns false if the
+ * write fails (the records are then lost).
+ */
+bool _Newton::Log_Flush()
+{
+  STATS_CALL(STATS_LOG);
+  if(Log_Pending==0) return(true);
+  unsigned int Slot = (Log_Next-1-Log_Pending)%Log_Capacity;
+  byte Count = Log_Pending;
+  Log_Pending = 0;
+  return(Memory_Write_Block((const byte *)Log_Buffer,Count*LOG_RECORD_SIZE,Log_Start+(unsigned long)Slot*LOG_RECORD_SIZE));
+}
+
+/*****************************************************************************
+ * unsigned long _Newton::Log_Count()
+ * 
+ * Returns the number of records in the log.
+ */
+unsigned long _Newton::Log_Count()
+{
+  return(Log_Next-1<Log_Capacity ? Log_Next-1 : Log_Capacity);
+}
+
+/*****************************************************************************
+ * bool _Newton::Log_Read(unsigned long Index, Log_Record *Record)
+ * 
+ * Reads a record, 0 being the oldest and Log_Count()-1 the newest.  Returns
+ * false if there is no such record or it is damaged.
+ */
+bool _Newton::Log_Read(unsigned long Index, Log_Record *Record)
+{
+  STATS_CALL(STATS_LOG);
+  unsigned long Count = Log_Count();
+  if(Index>=Count) return(false);
+  return(Log_Load(Log_Next-Count+Index,Record));
+}
+
+/*****************************************************************************
+ * unsigned long _Newton::Log_Find(unsigned long Time)
+ * 
+ * Returns the index of the oldest record stamped at or after Time, or
+ * Log_Count() if there is none, by bisection of the log (which assumes the
+ * clock has not been set back while logging).  A range of times is read
+ * with Log_Read() from Log_Find(From) until a record is later than To.
+ */
+unsigned long _Newton::Log_Find(unsigned long Time)
+{
+  STATS_CALL(STATS_LOG);
+  Log_Record Record;
+  unsigned long Low = 0, High = Log_Count();
+
+  while(Low<High)
+    {
+    unsigned long Mid = Low+(High-Low)/2;
+    if(!Log_Read(Mid,&Record) || Record.Time<Time) Low = Mid+1;
+    else High = Mid;
+    }
+  return(Low);
+}
+
+/*****************************************************************************
+ * bool _Newton::Log_Load(unsigned long Sequence, Log_Record *Record)
+ * 
+ * Reads the record with a given number from RAM or from its slot.
+ */
+bool _Newton::Log_Load(unsigned long Sequence, Log_Record *Record)
+{
+  unsigned long Buffered = Log_Next-Log_Pending;
+  if(Sequence>=Buffered)
+    {
+    *Record = Log_Buffer[Sequence-Buffered];
+    return(true);
+    }
+  return(Log_Slot_Read((Sequence-1)%Log_Capacity,Record) && Record->Sequence==Sequence);
+}
+
+/*****************************************************************************
+ * bool _Newton::Log_Slot_Read(unsigned int Slot, Log_Record *Record)
+ * 
+ * Reads a slot of the log.  Returns false if it does not hold a complete
+ * record belonging to that slot (it is blank, damaged or unreadable).
+ */
+bool _Newton::Log_Slot_Read(unsigned int Slot, Log_Record *Record)
+{
+  if(!Memory_Read_Block((byte *)Record,LOG_RECORD_SIZE,Log_Start+(unsigned long)Slot*LOG_RECORD_SIZE)) return(false);
+  return(Record->CRC==Memory_CRC((const byte *)Record,LOG_RECORD_SIZE-2) &&
+         Record->Sequence!=0 && (Record->Sequence-1)%Log_Capacity==Slot);
+}
+
+#endif
+
+/*****************************************************************************
+ * uint16_t _Newton::Memory_CRC(const byte *Data, byte Length, uint16_t CRC)
+ * 
+ * CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF unless another is
+ * given) used to check records stored in the EEPROM.
+ */
+uint16_t _Newton::Memory_CRC(const byte *Data, byte Length, uint16_t CRC)
+{
+  while(Length--)
+    {
+    CRC ^= (uint16_t)(*Data++)<<8;
+    for(byte Bit=0;Bit<8;Bit++)
+      CRC = (CRC & 0x8000) ? (CRC<<1)^0x1021 : CRC<<1;
+    }
+  return(CRC);
+}
+
+#ifdef __NEWTON_LOG
+static_assert(sizeof(Log_Record)==LOG_RECORD_SIZE, "Log_Record must match LOG_RECORD_SIZE");
+#endif
+
+#ifdef __NEWTON_CONFIG
+#define CONFIG_BANK_SIZE  ((CONFIG_END-CONFIG_START)/2)
+#define CONFIG_HEADER     4         // 'K', 'V', generation (2 bytes).
+#define CONFIG_ENTRY_SIZE (2+CONFIG_KEY_SIZE+CONFIG_VALUE_SIZE+2)
+#define CONFIG_REMOVED    0xFF      // Value length of an entry that removes a key.
+
+/*****************************************************************************
+ * bool _Newton::Begin_Config()
+ * 
+ * Opens the config store, a set of named values (keys of up to
+ * CONFIG_KEY_SIZE characters, values of up to CONFIG_VALUE_SIZE bytes) kept
+ * in the EEPROM from CONFIG_START to CONFIG_END.  The stored entries are read
+ * once here to build an index in RAM, so that a lookup is then a single
+ * burst read.  Returns false if the EEPROM does not respond.
+ */
+bool _Newton::Begin_Config()
+{
+  STATS_CALL(STATS_CONFIG);
+  byte Header[2][CONFIG_HEADER];
+  bool Valid[2];
+
+  Config_Generation = 0;
+  for(byte Bank=0;Bank<2;Bank++)
+    {
+    if(!Memory_Read_Block(Header[Bank],CONFIG_HEADER,Config_Address(Bank,0))) return(false);
+    Valid[Bank] = (Header[Bank][0]=='K' && Header[Bank][1]=='V');
+    }
+  memset(Config_Index,0,sizeof(Config_Index));
+  Config_Used = CONFIG_HEADER;
+
+  if(!Valid[0] && !Valid[1])
+    {
+    // A new store: start bank 0 at generation 1.
+    byte New_Header[CONFIG_HEADER] = {'K','V',1,0};
+    if(!Memory_Write_Block(New_Header,CONFIG_HEADER,Config_Address(0,0))) return(false);
+    Config_Bank = 0;
+    Config_Generation = 1;
+    return(true);
+    }
+
+  // Use the newer bank (generations wrap around, skipping 0).
+  uint16_t Generation[2];
+  for(byte Bank=0;Bank<2;Bank++)
+    Generation[Bank] = Header[Bank][2] | (Header[Bank][3]<<8);
+  Config_Bank = (!Valid[0] || (Valid[1] && (int16_t)(Generation[1]-Generation[0])>0)) ? 1 : 0;
+  Config_Generation = Generation[Config_Bank];
+  return(Config_Scan());
+}
+
+/*****************************************************************************
+ * bool _Newton::Config_Get(const char *Key, void *Value, byte Size)
+ * 
+ * Copies the value stored under Key into Value (of Size bytes).  Returns
+ * false if there is no such key or its value is larger than Size.  The
+ * cost is one burst read of the entry (a few mS); Get_Config_Stats()
+ * reports the longest taken.
+ */
+bool _Newton::Config_Get(const char *Key, void *Value, byte Size)
+{
+  STATS_CALL(STATS_CONFIG);
+  unsigned long Start = micros();
+  byte Entry[CONFIG_ENTRY_SIZE];
+  byte Key_Length = strlen(Key);
+
+  bool Found = Config_Find(Key,Key_Length,Entry)<CONFIG_KEYS && Entry[1]<=Size;
+  if(Found) memcpy(Value,Entry+2+Key_Length,Entry[1]);
+
+  unsigned long Time = micros()-Start;
+  if(Time>Config_Get_Max) Config_Get_Max = Time;
+  return(Found);
+}
+
+/*****************************************************************************
+ * bool _Newton::Config_Set(const char *Key, const void *Value, byte Length)
+ * 
+ * Stores a value under Key.  The new entry is written after the others and
+ * the old one is left in place, so a reset during the write leaves the old
+ * value.  Nothing is written if the value is unchanged.  The cost is one
+ * read and one write of the entry, unless the bank is full: it is then
+ * compacted first, which takes as long as copying every value (see
+ * Config_Free() and Config_Compact() to do that at a convenient time).
+ * Returns false if the key or value is too long, CONFIG_KEYS keys are
+ * already stored or the EEPROM does not respond.
+ */
+bool _Newton::Config_Set(const char *Key, const void *Value, byte Length)
+{
+  STATS_CALL(STATS_CONFIG);
+  unsigned long Start = micros();
+  byte Entry[CONFIG_ENTRY_SIZE];
+  byte Key_Length = strlen(Key);
+  bool Done = false;
+
+  if(Config_Generation!=0 && Key_Length>0 && Key_Length<=CONFIG_KEY_SIZE && Length<=CONFIG_VALUE_SIZE)
+    {
+    byte Slot = Config_Find(Key,Key_Length,Entry);
+    if(Slot<CONFIG_KEYS && Entry[1]==Length && memcmp(Entry+2+Key_Length,Value,Length)==0)
+      Done = true;
+    else
+      {
+      Entry[0] = Key_Length;
+      Entry[1] = Length;
+      memcpy(Entry+2,Key,Key_Length);
+      memcpy(Entry+2+Key_Length,Value,Length);
+      Done = Config_Append(Entry,Slot);
+      }
+    }
+
+  unsigned long Time = micros()-Start;
+  if(Time>Config_Set_Max) Config_Set_Max = Time;
+  return(Done);
+}
+
+/*****************************************************************************
+ * bool _Newton::Config_Remove(const char *Key)
+ * 
+ * Removes a key.  Returns false if there is no such key or the EEPROM does
+ * not respond.
+ */
+bool _Newton::Config_Remove(const char *Key)
+{
+  STATS_CALL(STATS_CONFIG);
+  byte Entry[CONFIG_ENTRY_SIZE];
+  byte Key_Length = strlen(Key);
+
+  byte Slot = Config_Find(Key,Key_Length,Entry);
+  if(Slot>=CONFIG_KEYS) return(false);
+  Entry[1] = CONFIG_REMOVED;
+  return(Config_Append(Entry,Slot));
+}
+
+/*****************************************************************************
+ * bool _Newton::Config_Compact()
+ * 
+ * Copies the current value of every key to the other bank, which then
+ * becomes the active one, freeing the space taken by old values.  The new
+ * bank's header is written last, so a reset part way through leaves the
+ * old bank in use.
+ */
+bool _Newton::Config_Compact()
+{
+  STATS_CALL(STATS_CONFIG);
+  byte Other = Config_Bank^1;
+  uint16_t Generation = Config_Generation+1;
+  if(Generation==0) Generation = 1;
+
+  byte Header[CONFIG_HEADER] = {0xFF,0xFF,0xFF,0xFF};
+  if(!Memory_Write_Block(Header,CONFIG_HEADER,Config_Address(Other,0))) return(false);
+
+  uint16_t Offsets[CONFIG_KEYS];
+  uint16_t Used = CONFIG_HEADER;
+  for(byte Slot=0;Slot<CONFIG_KEYS;Slot++)
+    {
+    if(Config_Index[Slot].Offset<=1) continue;
+    byte Entry[CONFIG_ENTRY_SIZE];
+    byte Length = Config_Index[Slot].Length;
+    if(!Config_Read_Entry(Slot,Entry)) return(false);
+    uint16_t CRC = Memory_CRC(Entry,Length-2,Generation);
+    Entry[Length-2] = CRC;
+    Entry[Length-1] = CRC>>8;
+    if(!Memory_Write_Block(Entry,Length,Config_Address(Other,Used))) return(false);
+    Offsets[Slot] = Used;
+    Used += Length;
+    }
+
+  Header[0] = 'K';
+  Header[1] = 'V';
+  Header[2] = Generation;
+  Header[3] = Generation>>8;
+  if(!Memory_Write_Block(Header,CONFIG_HEADER,Config_Address(Other,0))) return(false);
+
+  Config_Bank = Other;
+  Config_Generation = Generation;
+  Config_Used = Used;
+  for(byte Slot=0;Slot<CONFIG_KEYS;Slot++)
+    if(Config_Index[Slot].Offset>1) Config_Index[Slot].Offset = Offsets[Slot];
+  return(true);
+}
+
+/*****************************************************************************
+ * unsigned int _Newton::Config_Free()
+ * 
+ * Returns the bytes left in the active bank.  Each Config_Set() takes the
+ * length of the key and value plus 4 bytes; when they run out the next
+ * Config_Set() compacts the store.
+ */
+unsigned int _Newton::Config_Free()
+{
+  return(Config_Generation ? CONFIG_BANK_SIZE-Config_Used : 0);
+}
+
+/*****************************************************************************
+ * void _Newton::Get_Config_Stats(unsigned long *Get_Max, unsigned long *Set_Max)
+ * 
+ * Reports the longest Config_Get() and Config_Set() so far, in uS.
+ */
+void _Newton::Get_Config_Stats(unsigned long *Get_Max, unsigned long *Set_Max)
+{
+  *Get_Max = Config_Get_Max;
+  *Set_Max = Config_Set_Max;
+}
+
+/*****************************************************************************
+ * bool _Newton::Config_Scan()
+ * 
+ * Builds the index by reading the entries of the active bank in order, up
+ * to the first that is blank, incomplete or from an earlier generation.
+ */
+bool _Newton::Config_Scan()
+{
+  byte Entry[CONFIG_ENTRY_SIZE];
+  byte Found[CONFIG_ENTRY_SIZE];
+
+  while(Config_Used+2<=CONFIG_BANK_SIZE)
+    {
+    if(!Memory_Read_Block(Entry,2,Config_Address(Config_Bank,Config_Used))) return(false);
+    byte Key_Length = Entry[0];
+    byte Value_Length = (Entry[1]==CONFIG_REMOVED) ? 0 : Entry[1];
+    byte Length = 2+Key_Length+Value_Length+2;
+    if(Key_Length==0 || Key_Length>CONFIG_KEY_SIZE || Value_Length>CONFIG_VALUE_SIZE ||
+       Config_Used+Length>CONFIG_BANK_SIZE) break;
+    if(!Memory_Read_Block(Entry,Length,Config_Address(Config_Bank,Config_Used))) return(false);
+    if((Entry[Length-2] | (Entry[Length-1]<<8))!=Memory_CRC(Entry,Length-2,Config_Generation)) break;
+
+    const char *Key = (const char *)Entry+2;
+    byte Slot = Config_Find(Key,Key_Length,Found);
+    if(Entry[1]==CONFIG_REMOVED)
+      {
+      if(Slot<CONFIG_KEYS) Config_Index[Slot].Offset = 1;
+      }
+    else
+      {
+      if(Slot>=CONFIG_KEYS) Slot = Config_Free_Slot(Key,Key_Length);
+      if(Slot>=CONFIG_KEYS) break;
+      Config_Index[Slot].Offset = Config_Used;
+      Config_Index[Slot].Hash = Config_Hash(Key,Key_Length);
+      Config_Index[Slot].Length = Length;
+      }
+    Config_Used += Length;
+    }
+  return(true);
+}
+
+/*****************************************************************************
+ * bool _Newton::Config_Append(byte *Entry, byte Slot)
+ * 
+ * Adds the CRC to an entry, writes it after the others (compacting the
+ * store first if there is no room) and points the index at it.  Slot is the
+ * key's place in the index, or CONFIG_KEYS for a new key.
+ */
+bool _Newton::Config_Append(byte *Entry, byte Slot)
+{
+  const char *Key = (const char *)Entry+2;
+  byte Key_Length = Entry[0];
+  byte Length = 2+Key_Length+(Entry[1]==CONFIG_REMOVED ? 0 : Entry[1])+2;
+
+  if(Slot>=CONFIG_KEYS)
+    {
+    Slot = Config_Free_Slot(Key,Key_Length);
+    if(Slot>=CONFIG_KEYS) return(false);
+    }
+  if(Config_Used+Length>CONFIG_BANK_SIZE && (!Config_Compact() || Config_Used+Length>CONFIG_BANK_SIZE))
+    return(false);
+
+  uint16_t CRC = Memory_CRC(Entry,Length-2,Config_Generation);
+  Entry[Length-2] = CRC;
+  Entry[Length-1] = CRC>>8;
+  if(!Memory_Write_Block(Entry,Length,Config_Address(Config_Bank,Config_Used))) return(false);
+
+  if(Entry[1]==CONFIG_REMOVED)
+    Config_Index[Slot].Offset = 1;
+  else
+    {
+    Config_Index[Slot].Offset = Config_Used;
+    Config_Index[Slot].Hash = Config_Hash(Key,Key_Length);
+    Config_Index[Slot].Length = Length;
+    }
+  Config_Used += Length;
+  return(true);
+}
+
+/*****************************************************************************
+ * byte _Newton::Config_Find(const char *Key, byte Key_Length, byte *Entry)
+ * 
+ * Looks a key up in the index, reading the entries whose hash matches into
+ * Entry until the key itself matches.  Returns its slot, or CONFIG_KEYS if
+ * it is not stored.
+ */
+byte _Newton::Config_Find(const char *Key, byte Key_Length, byte *Entry)
+{
+  uint16_t Hash = Config_Hash(Key,Key_Length);
+
+  for(byte i=0;i<CONFIG_KEYS;i++)
+    {
+    byte Slot = (Hash+i)&(CONFIG_KEYS-1);
+    if(Config_Index[Slot].Offset==0) break;
+    if(Config_Index[Slot].Offset==1 || Config_Index[Slot].Hash!=Hash) continue;
+    if(Config_Read_Entry(Slot,Entry) && Entry[0]==Key_Length && memcmp(Entry+2,Key,Key_Length)==0)
+      return(Slot);
+    }
+  return(CONFIG_KEYS);
+}
+
+/*****************************************************************************
+ * byte _Newton::Config_Free_Slot(const char *Key, byte Key_Length)
+ * 
+ * Returns the first unused slot of the index for a new key, or CONFIG_KEYS
+ * if the index is full.
+ */
+byte _Newton::Config_Free_Slot(const char *Key, byte Key_Length)
+{
+  uint16_t Hash = Config_Hash(Key,Key_Length);
+
+  for(byte i=0;i<CONFIG_KEYS;i++)
+    {
+    byte Slot = (Hash+i)&(CONFIG_KEYS-1);
+    if(Config_Index[Slot].Offset<=1) return(Slot);
+    }
+  return(CONFIG_KEYS);
+}
+
+/*****************************************************************************
+ * bool _Newton::Config_Read_Entry(byte Slot, byte *Entry)
+ * 
+ * Reads the entry a slot of the index points at, checking its CRC.
+ */
+bool _Newton::Config_Read_Entry(byte Slot, byte *Entry)
+{
+  byte Length = Config_Index[Slot].Length;
+  if(!Memory_Read_Block(Entry,Length,Config_Address(Config_Bank,Config_Index[Slot].Offset))) return(false);
+  return((Entry[Length-2] | (Entry[Length-1]<<8))==Memory_CRC(Entry,Length-2,Config_Generation));
+}
+
+/*****************************************************************************
+ * unsigned long _Newton::Config_Address(byte Bank, uint16_t Offset)
+ * 
+ * EEPROM address of an offset in a bank.
+ */
+unsigned long _Newton::Config_Address(byte Bank, uint16_t Offset)
+{
+  return(CONFIG_START+(unsigned long)Bank*CONFIG_BANK_SIZE+Offset);
+}
+
+/*****************************************************************************
+ * uint16_t _Newton::Config_Hash(const char *Key, byte Length)
+ * 
+ * Hash of a key (djb2, 16 bits).
+ */
+uint16_t _Newton::Config_Hash(const char *Key, byte Length)
+{
+  uint16_t Hash = 5381;
+  while(Length--)
+    Hash = Hash*33+(byte)*Key++;
+  return(Hash);
+}
+#endif
+#endif
+
+/*#######################################################################  
+     _____   ___      _____        ____
+    |_   _| |__ \    / ____|      / __ \
+      | |      ) |  | |          | |  | |   _   _     ___    _   _     ___
+      | |     / /   | |          | |  | |  | | | |   / _ \  | | | |   / _ \
+     _| |_   / /_   | |____      | |__| |  | |_| |  |  __/  | |_| |  |  __/
+    |_____| |____|   \_____|      \___\_\   \__,_|   \___|   \__,_|   \___|
+                                                                        
+  #######################################################################*/
+#if !defined(__NO_RTC) || !defined(__NO_EEPROM)
+#ifdef __NEWTON_ASYNC_BUS
+#define BUS_EEPROM_READ   0       // Transaction types.
+#define BUS_EEPROM_WRITE  1
+#define BUS_RTC_READ      2
+#define BUS_ADDRESS       0       // Phases: sending the address to read from,
+#define BUS_TRANSFER      1       // moving data,
+#define BUS_POLL          2       // waiting for an EEPROM write cycle.
+
+#ifndef __NO_EEPROM
+/*****************************************************************************
+ * byte _Newton::Memory_Read_Async(byte *Data, unsigned int Length,
+ *                                 unsigned long Address, Bus_Callback Done)
+ * 
+ * Queues a read of Length bytes of the EEPROM, from Address into Data, and
+ * returns at once with a handle, or BUS_NONE if BUS_QUEUE_SIZE transactions
+ * are already queued.  Service_Bus() then reads the data a piece at a time.
+ * When it has finished, Done (if given) is called with the handle and the
+ * result; otherwise Bus_Status() reports it.  Data must not be used until
+ * then.
+ */
+byte _Newton::Memory_Read_Async(byte *Data, unsigned int Length, unsigned long Address, Bus_Callback Done)
+{
+  return(Bus_Submit(BUS_EEPROM_READ,Data,Length,Address,Done));
+}
+
+/*****************************************************************************
+ * byte _Newton::Memory_Write_Async(const byte *Data, unsigned int Length,
+ *                                  unsigned long Address, Bus_Callback Done)
+ * 
+ * Queues a write of Length bytes from Data to the EEPROM at Address, as
+ * Memory_Read_Async().  The data is written in the same pieces as by
+ * Memory_Write_Block(), but the write cycle that follows each piece is
+ * waited for by polling the EEPROM once per call of Service_Bus() instead
+ * of blocking.  Data must be kept unchanged until the write is done.
+ */
+byte _Newton::Memory_Write_Async(const byte *Data, unsigned int Length, unsigned long Address, Bus_Callback Done)
+{
+  return(Bus_Submit(BUS_EEPROM_WRITE,(byte *)Data,Length,Address,Done));
+}
+#endif
+
+#ifndef __NO_RTC
+/*****************************************************************************
+ * byte _Newton::Get_Current_Time_Values_Async(byte *Values, Bus_Callback Done)
+ * 
+ * Queues a read of the RTC into Values (7 bytes: second, minute, hour, day
+ * of week, day of month, month and year, in decimal), as
+ * Memory_Read_Async().  The RTC is read even if the time cache is on
+ * (Get_Current_Time_Values() does not block then anyway).
+ */
+byte _Newton::Get_Current_Time_Values_Async(byte *Values, Bus_Callback Done)
+{
+  return(Bus_Submit(BUS_RTC_READ,Values,7,0,Done));
+}
+#endif
+
+/*****************************************************************************
+ * byte _Newton::Bus_Status(byte Handle)
+ * 
+ * Returns BUS_PENDING while a transaction is queued, then BUS_DONE or
+ * BUS_FAILED once, after which the handle is free to be reused (and
+ * BUS_UNUSED is returned).  Handles of transactions queued with a callback
+ * are freed as the callback is made.
+ */
+byte _Newton::Bus_Status(byte Handle)
+{
+  if(Handle>=BUS_QUEUE_SIZE) return(BUS_UNUSED);
+  byte Status = Bus_Queue[Handle].Status;
+  if(Status==BUS_DONE || Status==BUS_FAILED)
+    Bus_Queue[Handle].Status = BUS_UNUSED;
+  return(Status);
+}
+
+/*****************************************************************************
+ * bool _Newton::Service_Bus()
+ * 
+ * Runs the queue of asynchronous transactions.  It should be called from
+ * loop(); each call makes at most one bus transaction (a piece of a read or
+ * write, or a single poll of an EEPROM that is busy writing) and so blocks
+ * for at most about 3 mS.  Completion callbacks are made from here.
+ * Returns true while transactions are still queued.
+ * 
+ * The blocking functions (Memory_Read() etc.) first finish everything that
+ * is queued, so the two can be mixed.  Wire's own interrupt handler owns the
+ * TWI hardware, so the queue is run from loop() rather than from a second
+ * interrupt handler.
+ */
+bool _Newton::Service_Bus()
+{
+  if(Bus_Head==Bus_Tail) return(false);
+
+  byte Handle = Bus_Order[Bus_Head&(BUS_QUEUE_SIZE-1)];
+  Bus_Transfer &T = Bus_Queue[Handle];
+  byte Device = (T.Type==BUS_RTC_READ) ? RTC_ADDRESS : EEPROM_ADDRESS;
+  unsigned int Count;
+  bool Ok = true;
+  STATS_CALL(Device==RTC_ADDRESS ? STATS_RTC : STATS_EEPROM);
+
+  switch(T.Phase)
+    {
+    case BUS_ADDRESS:
+      Bus_Begin(Device);
+      if(Device==EEPROM_ADDRESS) Wire.write(T.Address>>8);
+      Wire.write(T.Address&0xFF);
+      Ok = Bus_End(Device==EEPROM_ADDRESS ? 2 : 1)==0;
+      T.Phase = BUS_TRANSFER;
+      break;
+
+    case BUS_TRANSFER:
+      #ifndef __NO_EEPROM
+      if(T.Type==BUS_EEPROM_WRITE)
+        {
+        Count = EEPROM_PAGE_SIZE-(T.Address%EEPROM_PAGE_SIZE);
+        if(Count>EEPROM_WRITE_CHUNK) Count = EEPROM_WRITE_CHUNK;
+        if(Count>T.Remaining) Count = T.Remaining;
+        Bus_Begin(EEPROM_ADDRESS);
+        Wire.write(T.Address>>8);
+        Wire.write(T.Address&0xFF);
+        Wire.write(T.Data,Count);
+        Ok = Bus_End(2+Count)==0;
+        T.Phase = BUS_POLL;
+        T.Poll_Start = millis();
+        }
+      else
+      #endif
+        {
+        Count = T.Remaining;
+        #ifndef __NO_EEPROM
+        if(Count>EEPROM_READ_CHUNK) Count = EEPROM_READ_CHUNK;
+        #endif
+        Ok = Bus_Request(Device,Count)==Count;
+        for(byte i=0;i<Count;i++)
+          T.Data[i] = Wire.read();
+        }
+      T.Data += Count;
+      T.Address += Count;
+      T.Remaining -= Count;
+      break;
+
+    case BUS_POLL:
+      Bus_Begin(EEPROM_ADDRESS);
+      if(Bus_End(0)==0)
+        T.Phase = BUS_TRANSFER;
+      else if(millis()-T.Poll_Start>=EEPROM_WRITE_TIMEOUT)
+        {
+        STATS_TIMEOUT();
+        Ok = false;
+        }
+      break;
+    }
+  if(Ok && (T.Remaining>0 || T.Phase!=BUS_TRANSFER)) return(true);
+
+  #ifndef __NO_RTC
+  if(Ok && T.Type==BUS_RTC_READ)
+    {
+    // A few of these need masks because certain bits are control bits.
+    byte *Values = T.Data-7;
+    Values[0] &= 0x7f;
+    Values[2] &= 0x3f;
+    for(byte i=0;i<7;i++)
+      Values[i] = BCD_To_Decimal(Values[i]);
+    }
+  #endif
+
+  Bus_Head++;
+  T.Status = Ok ? BUS_DONE : BUS_FAILED;
+  if(T.Callback)
+    {
+    T.Status = BUS_UNUSED;
+    T.Callback(Handle,Ok);
+    }
+  return(Bus_Head!=Bus_Tail);
+}
+
+/*****************************************************************************
+ * byte _Newton::Bus_Submit(byte Type, byte *Data, unsigned int Length,
+ *                          unsigned int Address, Bus_Callback Callback)
+ * 
+ * Support function adding a transaction to the queue.  Returns its handle,
+ * or BUS_NONE if the queue is full.
+ */
+byte _Newton::Bus_Submit(byte Type, byte *Data, unsigned int Length, unsigned int Address, Bus_Callback Callback)
+{
+  if(Length==0) return(BUS_NONE);
+  for(byte Handle=0;Handle<BUS_QUEUE_SIZE;Handle++)
+    {
+    Bus_Transfer &T = Bus_Queue[Handle];
+    if(T.Status!=BUS_UNUSED) continue;
+    T.Data = Data;
+    T.Address = Address;
+    T.Remaining = Length;
+    T.Callback = Callback;
+    T.Type = Type;
+    T.Phase = (Type==BUS_EEPROM_WRITE) ? BUS_TRANSFER : BUS_ADDRESS;
+    T.Status = BUS_PENDING;
+    Bus_Order[Bus_Tail++&(BUS_QUEUE_SIZE-1)] = Handle;
+    return(Handle);
+    }
+  return(BUS_NONE);
+}
+
+/*****************************************************************************
+ * void _Newton::Bus_Drain()
+ * 
+ * Finishes every queued transaction.  Called by the blocking functions
+ * before they use the bus.
+ */
+void _Newton::Bus_Drain()
+{
+  while(Service_Bus()) ;
+}
+#endif
+
+/*****************************************************************************
+ * bool _Newton::Set_Bus_Clock(unsigned long Clock)
+ * 
+ * Sets the I2C clock in Hz: I2C_FAST (400 kHz, the default) or I2C_STANDARD
+ * (100 kHz, for long wires or weak pull-ups), or anything in between.  The
+ * EEPROM is rated for 400 kHz but the DS1307 only for 100 kHz, so the clock
+ * is lowered for each RTC transaction and raised again for the next EEPROM
+ * one.  Returns false, leaving the clock as it was, if Clock is faster than
+ * the devices allow or slower than I2C_MIN_CLOCK.
+ */
+bool _Newton::Set_Bus_Clock(unsigned long Clock)
+{
+  #ifndef __NO_EEPROM
+  if(Clock<I2C_MIN_CLOCK || Clock>EEPROM_MAX_CLOCK) return(false);
+  #else
+  if(Clock<I2C_MIN_CLOCK || Clock>RTC_MAX_CLOCK) return(false);
+  #endif
+  Bus_Clock = Clock;
+  return(true);
+}
+
+/*****************************************************************************
+ * bool _Newton::Bus_Recover()
+ * 
+ * Frees an I2C bus held by a device.  A device that was part way through
+ * sending a byte when the board was reset keeps SDA low until it has
+ * clocked out the rest of the byte, and every transaction after that
+ * fails.  With the TWI turned off, SCL is pulsed by hand (up to 9 times)
+ * until SDA is released, a STOP condition is sent and the TWI is started
+ * again.  This is done after any transaction that times out (each is
+ * abandoned after I2C_TIMEOUT uS).  Returns false if the bus is still held.
+ */
+bool _Newton::Bus_Recover()
+{
+  Wire.end();
+  pinMode(SDA,INPUT_PULLUP);
+  pinMode(SCL,INPUT_PULLUP);
+  for(byte i=0;i<9 && digitalRead(SDA)==LOW;i++)
+    {
+    Bus_Line(SCL,LOW);
+    Bus_Line(SCL,HIGH);
+    }
+  // STOP: SDA goes high while SCL is high.
+  Bus_Line(SCL,LOW);
+  Bus_Line(SDA,LOW);
+  Bus_Line(SCL,HIGH);
+  Bus_Line(SDA,HIGH);
+  bool Free = digitalRead(SDA)==HIGH && digitalRead(SCL)==HIGH;
+
+  Wire.begin();
+  #ifdef WIRE_HAS_TIMEOUT
+  Wire.setWireTimeout(I2C_TIMEOUT,true);
+  #endif
+  Bus_Clock_Now = 0;
+  return(Free);
+}
+
+/*****************************************************************************
+ * unsigned int _Newton::Get_Bus_Timeouts()
+ * 
+ * Returns the number of I2C transactions that have timed out (and so were
+ * followed by Bus_Recover()) since the board was started.
+ */
+unsigned int _Newton::Get_Bus_Timeouts()
+{
+  return(Bus_Timeouts);
+}
+#endif
+
+/*#######################################################################  
+    _______                                       __                 
+   |__   __|                                     / _|                
+      | |      _ __     __ _    _ __     ___    | |_     ___    _ __ 
+      | |     | '__|   / _` |  | '_ \   / __|   |  _|   / _ \  | '__|
+      | |     | |     | (_| |  | | | |  \__ \   | |    |  __/  | |   
+      |_|     |_|      \__,_|  |_| |_|  |___/   |_|     \___|  |_|   
+                                                                     
+  #######################################################################*/
+#if !defined(__NO_EEPROM) && defined(__NEWTON_ASYNC_BUS)
+#define TRANSFER_FREE       0     // Buffer states.
+#define TRANSFER_RECEIVING  1
+#define TRANSFER_READING    2
+#define TRANSFER_FULL       3
+#define TRANSFER_WRITING    4
+
+/*****************************************************************************
+ * Memory_Transfer::Memory_Transfer(Stream &Serial_Port)
+ * 
+ * Serves bulk transfers over Serial_Port, which must already be started
+ * and must report the room in its transmit buffer (availableForWrite(), as
+ * HardwareSerial does).
+ */
+Memory_Transfer::Memory_Transfer(Stream &Serial_Port) : Port(Serial_Port)
+{
+  for(byte b=0;b<2;b++)
+    {
+    State[b] = TRANSFER_FREE;
+    Handle[b] = BUS_NONE;
+    }
+  Next_Read = Next_Send = 0;
+  Read_Left = Request_Left = 0;
+  Request = false;
+  Reply = 0;
+  Ack_Buffer = 2;
+  Finish = Finished = Write_Failed = false;
+  Tx_Length = 0;
+  Rx_Position = 0;
+  Rx_Buffer = 2;
+  Frames_Sent = Frames_Received = Errors = 0;
+}
+
+/*****************************************************************************
+ * bool Memory_Transfer::Service()
+ * 
+ * Runs the transfer: takes in what the host has sent, moves the EEPROM
+ * queue on by a transaction (Service_Bus()) and sends what fits in the
+ * serial transmit buffer.  It never waits for the serial port and blocks
+ * for at most one bus transaction, so it should be called from loop() as
+ * often as possible.  Returns true while a transfer is in progress.
+ */
+bool Memory_Transfer::Service()
+{
+  if(Rx_Position>0 && millis()-Rx_Start>=TRANSFER_TIMEOUT)
+    Receive_Reset();
+  while(Port.available()>0)
+    Receive(Port.read());
+  Run_Bus();
+  Send();
+  return(Rx_Position>0 || Read_Left>0 || Request || Reply!=0 || Ack_Buffer<2 || Finish ||
+         Tx_Length>0 || State[0]!=TRANSFER_FREE || State[1]!=TRANSFER_FREE);
+}
+
+/*****************************************************************************
+ * void Memory_Transfer::Receive(byte Value)
+ * 
+ * Support function taking in one byte of a frame.  The data of a write
+ * goes straight into a free buffer and the CRC is worked out as the bytes
+ * arrive, so a frame needs no room of its own.
+ */
+void Memory_Transfer::Receive(byte Value)
+{
+  if(Rx_Position==0)
+    {
+    if(Value!=TRANSFER_SYNC) return;          // Look for the start of a frame.
+    Rx_Start = millis();
+    Rx_CRC = 0xFFFF;
+    Rx_Position++;
+    return;
+    }
+
+  byte Count = Rx_Header[4];
+  if(Rx_Position<5)
+    {
+    Rx_Header[Rx_Position] = Value;
+    Rx_CRC = _Newton::Memory_CRC(&Value,1,Rx_CRC);
+    if(++Rx_Position<5) return;
+    if(Value>TRANSFER_CHUNK)
+      {
+      Errors++;
+      Receive_Reset();
+      return;
+      }
+    Rx_Buffer = 2;
+    if(Rx_Header[1]==TRANSFER_WRITE)
+      for(byte b=0;b<2;b++)
+        if(State[b]==TRANSFER_FREE)
+          {
+          State[b] = TRANSFER_RECEIVING;
+          Rx_Buffer = b;
+          break;
+          }
+    return;
+    }
+
+  if(Rx_Position<5+Count)
+    {
+    if(Rx_Buffer<2) Data[Rx_Buffer][Rx_Position-5] = Value;
+    Rx_Value = (Rx_Value<<8) | Value;
+    Rx_CRC = _Newton::Memory_CRC(&Value,1,Rx_CRC);
+    Rx_Position++;
+    }
+  else if(Rx_Position==5+Count)
+    {
+    Rx_Header[0] = Value;
+    Rx_Position++;
+    }
+  else
+    {
+    if(Rx_CRC==(((uint16_t)Rx_Header[0]<<8) | Value))
+      {
+      Frames_Received++;
+      Accept();
+      }
+    else
+      {
+      // The host sends the next write or finish only when answered.
+      Errors++;
+      if(Rx_Header[1]==TRANSFER_WRITE || Rx_Header[1]==TRANSFER_FINISH)
+        {
+        Reply = TRANSFER_NAK;
+        Reply_Address = ((unsigned int)Rx_Header[2]<<8) | Rx_Header[3];
+        }
+      }
+    Receive_Reset();
+    }
+}
+
+/*****************************************************************************
+ * void Memory_Transfer::Receive_Reset()
+ * 
+ * Support function dropping the frame being received (if any), so that the
+ * next TRANSFER_SYNC starts a new one.
+ */
+void Memory_Transfer::Receive_Reset()
+{
+  if(Rx_Buffer<2 && State[Rx_Buffer]==TRANSFER_RECEIVING)
+    State[Rx_Buffer] = TRANSFER_FREE;
+  Rx_Buffer = 2;
+  Rx_Position = 0;
+}
+
+/*****************************************************************************
+ * void Memory_Transfer::Accept()
+ * 
+ * Support function acting on a frame received intact.
+ */
+void Memory_Transfer::Accept()
+{
+  unsigned int Frame_Address = ((unsigned int)Rx_Header[2]<<8) | Rx_Header[3];
+  byte Count = Rx_Header[4];
+  byte b = Rx_Buffer;
+
+  switch(Rx_Header[1])
+    {
+    case TRANSFER_READ:
+      Request_Address = Frame_Address;
+      Request_Left = (Count==2 && Frame_Address<EEPROM_SIZE) ? Rx_Value : 0;
+      if(Request_Left>EEPROM_SIZE-Frame_Address) Request_Left = EEPROM_SIZE-Frame_Address;
+      Request = true;
+      break;
+
+    case TRANSFER_WRITE:
+      Reply = TRANSFER_NAK;
+      Reply_Address = Frame_Address;
+      if(b>=2 || Count==0 || (unsigned long)Frame_Address+Count>EEPROM_SIZE) break;
+      Handle[b] = Newton.Memory_Write_Async(Data[b],Count,Frame_Address);
+      if(Handle[b]==BUS_NONE) break;
+      State[b] = TRANSFER_WRITING;
+      Address[b] = Frame_Address;
+      Length[b] = Count;
+      Reply = 0;
+      Ack_Buffer = b;
+      if(Finished) Write_Failed = Finished = false;
+      break;
+
+    case TRANSFER_FINISH:
+      Finish = true;
+      break;
+    }
+}
+
+/*****************************************************************************
+ * void Memory_Transfer::Run_Bus()
+ * 
+ * Support function moving the EEPROM side on: collects the transactions
+ * that have finished, starts a new read once the last one is out of the
+ * buffers, and queues the read of the next chunk into the buffer that was
+ * sent last.
+ */
+void Memory_Transfer::Run_Bus()
+{
+  Newton.Service_Bus();
+  for(byte b=0;b<2;b++)
+    {
+    if(State[b]!=TRANSFER_READING && State[b]!=TRANSFER_WRITING) continue;
+    byte Status = Newton.Bus_Status(Handle[b]);
+    if(Status==BUS_PENDING) continue;
+    if(State[b]==TRANSFER_READING)
+      {
+      State[b] = TRANSFER_FULL;
+      if(Status==BUS_FAILED) Handle[b] = BUS_FAILED;
+      }
+    else
+      {
+      State[b] = TRANSFER_FREE;
+      if(Status==BUS_FAILED) Write_Failed = true;
+      }
+    }
+
+  if(Request && State[0]!=TRANSFER_READING && State[1]!=TRANSFER_READING && Tx_Length==0)
+    {
+    for(byte b=0;b<2;b++)
+      if(State[b]==TRANSFER_FULL) State[b] = TRANSFER_FREE;
+    Read_Address = Request_Address;
+    Read_Left = Request_Left;
+    Next_Send = Next_Read;
+    Request = false;
+    }
+
+  if(Read_Left>0 && !Request && State[Next_Read]==TRANSFER_FREE)
+    {
+    byte Count = (Read_Left>TRANSFER_CHUNK) ? TRANSFER_CHUNK : Read_Left;
+    Handle[Next_Read] = Newton.Memory_Read_Async(Data[Next_Read],Count,Read_Address);
+    if(Handle[Next_Read]==BUS_NONE) return;
+    State[Next_Read] = TRANSFER_READING;
+    Address[Next_Read] = Read_Address;
+    Length[Next_Read] = Count;
+    Read_Address += Count;
+    Read_Left -= Count;
+    Next_Read ^= 1;
+    }
+}
+
+/*****************************************************************************
+ * bool Memory_Transfer::Next_Frame()
+ * 
+ * Support function choosing the next frame to send: an answer to the host
+ * first, then the next chunk read (unless a new read is waiting to replace
+ * it).  An ACK of a write is held back until the other buffer is free for
+ * the frame the host will send next.
+ */
+bool Memory_Transfer::Next_Frame()
+{
+  if(Reply==0 && Ack_Buffer<2 && State[Ack_Buffer^1]!=TRANSFER_WRITING)
+    {
+    Reply = TRANSFER_ACK;
+    Reply_Address = Address[Ack_Buffer];
+    Ack_Buffer = 2;
+    }
+  if(Reply!=0)
+    {
+    Start_Frame(Reply,Reply_Address,2,0);
+    Reply = 0;
+    return(true);
+    }
+  if(Finish && Ack_Buffer==2 && State[0]!=TRANSFER_WRITING && State[1]!=TRANSFER_WRITING)
+    {
+    // The answer is repeated for a FINISH sent again, until the next write.
+    Start_Frame(Write_Failed ? TRANSFER_NAK : TRANSFER_ACK,0,2,0);
+    Finish = false;
+    Finished = true;
+    return(true);
+    }
+  if(Request || State[Next_Send]!=TRANSFER_FULL) return(false);
+
+  if(Handle[Next_Send]==BUS_FAILED)
+    {
+    // The EEPROM stopped answering: the host is told where and the read ends.
+    Start_Frame(TRANSFER_NAK,Address[Next_Send],2,0);
+    State[Next_Send] = TRANSFER_FREE;
+    Read_Left = 0;
+    }
+  else
+    Start_Frame(TRANSFER_DATA,Address[Next_Send],Next_Send,Length[Next_Send]);
+  Next_Send ^= 1;
+  return(true);
+}
+
+/*****************************************************************************
+ * void Memory_Transfer::Start_Frame(byte Type, unsigned int Frame_Address,
+ *                                   byte Buffer, byte Count)
+ * 
+ * Support function preparing a frame with Count bytes of Data[Buffer].
+ */
+void Memory_Transfer::Start_Frame(byte Type, unsigned int Frame_Address, byte Buffer, byte Count)
+{
+  Tx_Header[0] = TRANSFER_SYNC;
+  Tx_Header[1] = Type;
+  Tx_Header[2] = Frame_Address>>8;
+  Tx_Header[3] = Frame_Address&0xFF;
+  Tx_Header[4] = Count;
+  Tx_CRC = _Newton::Memory_CRC(Tx_Header+1,4);
+  if(Count>0) Tx_CRC = _Newton::Memory_CRC(Data[Buffer],Count,Tx_CRC);
+  Tx_Buffer = Buffer;
+  Tx_Position = 0;
+  Tx_Length = 5+Count+2;
+}
+
+/*****************************************************************************
+ * void Memory_Transfer::Send()
+ * 
+ * Support function writing frames to the serial port for as long as its
+ * transmit buffer has room.  A data buffer is freed for the next read as
+ * soon as its frame is out.
+ */
+void Memory_Transfer::Send()
+{
+  while(Port.availableForWrite()>0)
+    {
+    if(Tx_Length==0 && !Next_Frame()) return;
+    byte Value;
+    if(Tx_Position<5)
+      Value = Tx_Header[Tx_Position];
+    else if(Tx_Position<Tx_Length-2)
+      Value = Data[Tx_Buffer][Tx_Position-5];
+    else if(Tx_Position==Tx_Length-2)
+      Value = Tx_CRC>>8;
+    else
+      Value = Tx_CRC&0xFF;
+    Port.write(Value);
+    if(++Tx_Position==Tx_Length)
+      {
+      Tx_Length = 0;
+      Frames_Sent++;
+      if(Tx_Buffer<2 && State[Tx_Buffer]==TRANSFER_FULL) State[Tx_Buffer] = TRANSFER_FREE;
+      }
+    }
+}
+#endif
+
+/*#######################################################################  
+    _____                   _            _______   _                    
+   |  __ \                 | |          |__   __| (_)                   
+   | |__) |   ___    __ _  | |  ______     | |     _   _ __ ___     ___ 
+   |  _  /   / _ \  / _` | | | |______|    | |    | | | '_ ` _ \   / _ \
+   | | \ \  |  __/ | (_| | | |             | |    | | | | | | | | |  __/
+   |_|__\_\  \___|  \__,_| |_|  _          |_|    |_| |_| |_| |_|  \___|
+    / ____| | |                | |                                      
+   | |      | |   ___     ___  | | __                                   
+   | |      | |  / _ \   / __| | |/ /                                   
+   | |____  | | | (_) | | (__  |   <                                    
+    \_____| |_|  \___/   \___| |_|\_\                                   
+                                                                        
+  #######################################################################*/
+#ifndef __NO_RTC
+/*****************************************************************************
+ * byte _Newton::Decimal_To_BCD(byte Decimal_Value)
+ * 
+ * A support function used to interpret decimal values for the real-time clock.
+ * This function will convert a BCD value from 0 to 99 (unvalidated) and 
+ * convert it to its corresponding decimal value.  Both values are byte encoded.
+ */
+ byte _Newton::Decimal_To_BCD(byte Decimal_Value)
+{
+  byte BCD_Value = (Decimal_Value/10*16) + (Decimal_Value%10);
+  return(BCD_Value);
+}
+
+/*****************************************************************************
+ * byte _Newton::BCD_To_Decimal(byte BCD_Value)
+ * 
+ * A support function used to interpret BCD values from the real-time clock.
+ * This function will convert a decimal value from 0 to 99 (unvalidated) and
+ * convert it to its corresponding BCD value.  Both values are byte encoded.
+ */
+byte _Newton::BCD_To_Decimal(byte BCD_Value)
+{
+  byte Decimal_Value = (BCD_Value/16*10) + (BCD_Value%16);
+  return(Decimal_Value);
+}
+
+
+
+void _Newton::Set_Current_Time_Values(  byte second, byte minute, byte hour, byte dayOfWeek,
+                byte dayOfMonth, byte month, byte year)
+{
+   STATS_CALL(STATS_RTC);
+   Bus_Drain();
+   Bus_Begin(RTC_ADDRESS);
+   Wire.write(0);
+   Wire.write(Decimal_To_BCD(second));    // 0 to bit 7 starts the clock
+   Wire.write(Decimal_To_BCD(minute));
+   Wire.write(Decimal_To_BCD(hour));      // If you want 12 hour am/pm you need to set
+                                   // bit 6 (also need to change readDateDs1307)
+   Wire.write(Decimal_To_BCD(dayOfWeek));
+   Wire.write(Decimal_To_BCD(dayOfMonth));
+   Wire.write(Decimal_To_BCD(month));
+   Wire.write(Decimal_To_BCD(year));
+   Bus_End(8);
+
+   // Reload the cached time (if used) from the new setting.
+   if(Clock_Resync_Interval) Sync_Clock(false);
+   #ifdef __NEWTON_ALARMS
+   Alarm_Wait = 0;                        // Check the alarms against the new time.
+   #endif
+}
+
+/*****************************************************************************
+ * bool _Newton::Get_Current_Time_Values(byte *second, byte *minute,
+ *                                       byte *hour, byte *dayOfWeek,
+ *                                       byte *dayOfMonth, byte *month,
+ *                                       byte *year)
+ * 
+ * Reads the time (from the cache if Begin_Time_Cache() is in use) in
+ * decimal.  Returns false if the RTC does not respond; every value is then
+ * set to 0.
+ */
+bool _Newton::Get_Current_Time_Values(  byte *second, byte *minute, byte *hour, byte *dayOfWeek,
+                byte *dayOfMonth, byte *month, byte *year)
+{
+  STATS_CALL(STATS_RTC);
+  byte Values[7];
+
+  if(!(Clock_Resync_Interval ? Update_Clock() : Read_Clock(Values)))
+    {
+    *second = *minute = *hour = *dayOfWeek = *dayOfMonth = *month = *year = 0;
+    return(false);
+    }
+  if(Clock_Resync_Interval)
+    Epoch_To_Date(Clock_Epoch,&Values[0],&Values[1],&Values[2],&Values[3],&Values[4],&Values[5],&Values[6]);
+
+  *second     = Values[0];
+  *minute     = Values[1];
+  *hour       = Values[2];
+  *dayOfWeek  = Values[3];
+  *dayOfMonth = Values[4];
+  *month      = Values[5];
+  *year       = Values[6];
+  return(true);
+}
+
+/*****************************************************************************
+ * bool _Newton::Read_Clock(byte *Values)
+ * 
+ * Reads the time from the RTC into Values, in register order (second,
+ * minute, hour, day of week, day of month, month, year) and in decimal.
+ * Returns false if the RTC does not respond.
+ */
+bool _Newton::Read_Clock(byte *Values)
+{
+  Bus_Drain();
+
+// Reset the register pointer
+  Bus_Begin(RTC_ADDRESS);
+  Wire.write(0);
+  Bus_End(1);
+  
+  if(Bus_Request(RTC_ADDRESS,7)!=7) return(false);
+
+  // A few of these need masks because certain bits are control bits
+  Values[0] = BCD_To_Decimal(Wire.read() & 0x7f);
+  Values[1] = BCD_To_Decimal(Wire.read());
+  Values[2] = BCD_To_Decimal(Wire.read() & 0x3f);  // Need to change this if 12 hour am/pm
+  Values[3] = BCD_To_Decimal(Wire.read());
+  Values[4] = BCD_To_Decimal(Wire.read());
+  Values[5] = BCD_To_Decimal(Wire.read());
+  Values[6] = BCD_To_Decimal(Wire.read());
+  return(true);
+}
+
+/*****************************************************************************
+ * void _Newton::Begin_Time_Cache(unsigned int Resync_Interval, int SQW_Pin)
+ * 
+ * Keeps a copy of the time in RAM so that Get_Current_Time_Values() and
+ * Get_Time() cost no bus traffic.  The copy is advanced locally and only
+ * re-read from the RTC every Resync_Interval seconds (0 turns the cache off
+ * again).  If the DS1307 SQW/OUT pin is wired to an external interrupt pin
+ * (SQW_Pin), the RTC's 1 Hz square wave is enabled and each falling edge
+ * (which coincides with the seconds update) advances the copy, keeping it
+ * in step with the RTC.  Otherwise millis() is used: the copy is aligned to
+ * the RTC's seconds once here (waiting up to one second) and any drift of
+ * the CPU clock is corrected at each resync.  Until the RTC has answered
+ * once the time is reported as missing, as it is without the cache.
+ */
+void _Newton::Begin_Time_Cache(unsigned int Resync_Interval, int SQW_Pin)
+{
+  STATS_CALL(STATS_RTC);
+  if(Clock_Sqw)
+    detachInterrupt(digitalPinToInterrupt(Clock_SQW_Pin));
+  Clock_Sqw = false;
+  Clock_Valid = false;
+  Clock_Resync_Interval = Resync_Interval;
+  Clock_Resyncs = 0;
+  Clock_Drift = 0;
+  if(Resync_Interval==0) return;
+
+  if(SQW_Pin>=0 && digitalPinToInterrupt(SQW_Pin)!=NOT_AN_INTERRUPT)
+    {
+    Bus_Drain();
+    Bus_Begin(RTC_ADDRESS);
+    Wire.write(0x07);                      // Control register:
+    Wire.write(0x10);                      // SQWE, 1 Hz.
+    Bus_End(2);
+    pinMode(SQW_Pin,INPUT_PULLUP);         // SQW/OUT is open drain.
+    Clock_SQW_Pin = SQW_Pin;
+    Clock_Sqw = true;
+    attachInterrupt(digitalPinToInterrupt(SQW_Pin),Clock_Edge,FALLING);
+    }
+  else
+    {
+    // Wait for the seconds register to change so that millis() counts
+    // whole seconds from the same instant as the RTC.
+    byte First[7], Now[7];
+    unsigned long Start = millis();
+    if(Read_Clock(First))
+      while(Read_Clock(Now) && Now[0]==First[0] && millis()-Start<1100) ;
+    }
+  Sync_Clock(false);
+}
+
+/*****************************************************************************
+ * void _Newton::Get_Time_Cache_Stats(unsigned long *Resyncs, long *Drift)
+ * 
+ * Reports how many times the cached time has been re-read from the RTC and
+ * the total correction (in seconds, positive if the copy had fallen behind
+ * the RTC) applied by those reads.
+ */
+void _Newton::Get_Time_Cache_Stats(unsigned long *Resyncs, long *Drift)
+{
+  *Resyncs = Clock_Resyncs;
+  *Drift = Clock_Drift;
+}
+
+/*****************************************************************************
+ * bool _Newton::Update_Clock()
+ * 
+ * Advances the cached time by the seconds counted since the last update
+ * (SQW edges or millis()), and re-reads the RTC when the resync interval
+ * has passed.  Until the RTC has been read once the RTC is tried on every
+ * update; returns false while it has not been.
+ */
+bool _Newton::Update_Clock()
+{
+  unsigned long Elapsed;
+
+  if(Clock_Sqw)
+    {
+    unsigned long Edges = Clock_Edge_Count();
+    Elapsed = Edges-Clock_Edges_Counted;
+    Clock_Edges_Counted = Edges;
+    }
+  else
+    {
+    Elapsed = (millis()-Clock_Millis)/1000;
+    Clock_Millis += Elapsed*1000;
+    }
 
-void _Newton::Flash_Status_LED(){
-  Newton.Status_Indicator(ON); delay(400);
-  Newton.Status_Indicator(OFF);
+  if(Elapsed)
+    {
+    Clock_Epoch += Elapsed;
+    Clock_Age = (Elapsed<Clock_Resync_Interval-Clock_Age) ? Clock_Age+Elapsed : Clock_Resync_Interval;
+    }
+  // In millis() mode the RTC is read in the second half of a counted second,
+  // where a drift of the CPU clock either way shows up soonest.
+  if(!Clock_Valid)
+    Sync_Clock(false);
+  else if(Clock_Age>=Clock_Resync_Interval && (Clock_Sqw || millis()-Clock_Millis>=500))
+    Sync_Clock(true);
+  return(Clock_Valid);
 }
-#endif
 
 /*****************************************************************************
- * void Set_Alarm_Time()
+ * bool _Newton::Sync_Clock(bool Count_Drift)
  * 
- * This function will initialize a hardware timer to interrupt on
- * overflow.  When this happens, the interrupt service routine will call
- * a specified function routinely.  WORK IN PROGRESS.
+ * Re-reads the cached time from the RTC.  When Count_Drift is set, the
+ * difference between the cached and the actual time is added to the drift
+ * total.  In millis() mode the counting phase is kept unless the copy was
+ * found to be wrong, in which case counting restarts from now.  If the RTC
+ * does not respond the copy keeps running and the read is retried on the
+ * next update.
  */
-void _Newton::Set_Alarm_Time(){
-  noInterrupts();           // disable all interrupts
-  TCCR1A = 0;
-  TCCR1B = 0;
+bool _Newton::Sync_Clock(bool Count_Drift)
+{
+  byte Values[7];
+  unsigned long Edges = Clock_Edge_Count();
 
-  // Set timer1_counter to the correct value for our interrupt interval
-  //timer1_counter = 64911;   // preload timer 65536-16MHz/256/100Hz
-  //timer1_counter = 64286;   // preload timer 65536-16MHz/256/50Hz
-  TCNT1 = TIMER1_CTR;   // preload timer
-  TCCR1B |= (1 << CS12);    // 256 prescaler 
-  TIMSK1 |= (1 << TOIE1);   // enable timer overflow interrupt
-  interrupts();             // enable all interrupts
+  if(!Read_Clock(Values)) return(false);
+  if(Clock_Sqw && Clock_Edge_Count()!=Edges)    // The seconds changed during the read.
+    {
+    Edges = Clock_Edge_Count();
+    if(!Read_Clock(Values)) return(false);
+    }
+
+  unsigned long Epoch = Date_To_Epoch(Values[0],Values[1],Values[2],Values[4],Values[5],Values[6]);
+  long Drift = (long)(Epoch-Clock_Epoch);
+  if(Count_Drift) Clock_Drift += Drift;
+
+  if(Clock_Sqw)
+    Clock_Edges_Counted = Edges;
+  else if(Drift!=0 || !Count_Drift)
+    Clock_Millis = millis();
+
+  Clock_Epoch = Epoch;
+  Clock_Age = 0;
+  Clock_Valid = true;
+  Clock_Resyncs++;
+  return(true);
 }
 
+/*****************************************************************************
+ * void _Newton::Clock_Edge()
+ * unsigned long _Newton::Clock_Edge_Count()
+ * 
+ * External interrupt on the falling edge of the RTC's 1 Hz square wave, and
+ * the edges it has counted.  The count is four bytes, so it is read with
+ * the interrupt held off: an edge between the bytes would otherwise leave
+ * it out by 256 or more.
+ */
+void _Newton::Clock_Edge()
+{
+  Newton.Clock_Edges++;
+  WAKE(WAKE_CLOCK);
+}
 
-/*####################################################################### 
-    _    _                                                        
-   | |  | |                                                       
-   | |  | |  ___    ___   _ __                                    
-   | |  | | / __|  / _ \ | '__|                                   
-   | |__| | \__ \ |  __/ | |                                      
-    \____/  |___/  \___| |_|             __                       
-   |_   _|         | |                  / _|                      
-     | |    _ __   | |_    ___   _ __  | |_    __ _    ___    ___ 
-     | |   | '_ \  | __|  / _ \ | '__| |  _|  / _` |  / __|  / _ \
-    _| |_  | | | | | |_  |  __/ | |    | |   | (_| | | (__  |  __/
-   |_____| |_| |_|  \__|  \___| |_|    |_|    \__,_|  \___|  \___|
-                                                                  
- #######################################################################*/
+unsigned long _Newton::Clock_Edge_Count()
+{
+  byte Status = SREG;
+  cli();
+  unsigned long Edges = Clock_Edges;
+  SREG = Status;
+  return(Edges);
+}
 
-#ifndef __NO_LEDS
 /*****************************************************************************
- * void _Newton::LED1_Indicator(bool Value)
+ * void _Newton::Initialize_Time_Date()
  * 
- * This is a high level function call that allows a user to turn LED1 on or
- * off.
+ * Sets the RTC to the time this file was compiled.  The build time is
+ * parsed by the compiler (see BUILD_EPOCH), so nothing is done at run time.
  */
-void _Newton::LED1_Indicator(bool Value){
-  if(Value==ON)
-    digitalWrite(LED1,HIGH);
-  else
-    digitalWrite(LED1,LOW);
-  }
+void _Newton::Initialize_Time_Date()
+{
+  STATS_CALL(STATS_RTC);
+  static_assert(BUILD_EPOCH>0, "__DATE__/__TIME__ must be parsed at compile time");
+  Set_Epoch(BUILD_EPOCH);
+}
 
 /*****************************************************************************
- * void _Newton::LED2_Indicator(bool Value)
+ * unsigned long _Newton::Get_Epoch()
  * 
- * This is a high level function call that allows a user to turn LED2 on or
- * off.
+ * Returns the current time in seconds since 2000-01-01 00:00:00, or 0 if
+ * the RTC does not respond.  Times are then compared and added with
+ * ordinary integer arithmetic.
  */
-void _Newton::LED2_Indicator(bool Value){
-  if(Value==ON)
-    digitalWrite(LED2,HIGH);
-  else
-    digitalWrite(LED2,LOW);
-  }
+unsigned long _Newton::Get_Epoch()
+{
+  STATS_CALL(STATS_RTC);
+  byte Values[7];
+
+  if(Clock_Resync_Interval)
+    return(Update_Clock() ? Clock_Epoch : 0);
+  if(!Read_Clock(Values)) return(0);
+  return(Date_To_Epoch(Values[0],Values[1],Values[2],Values[4],Values[5],Values[6]));
+}
 
 /*****************************************************************************
- * void _Newton::Status_Indicator(bool Value)
+ * void _Newton::Set_Epoch(unsigned long Epoch)
  * 
- * This is a high level function call that allows a user to turn the status 
- * LED on or off.
+ * Sets the RTC from a time in seconds since 2000-01-01 00:00:00, including
+ * the day of the week.
  */
-void _Newton::Status_Indicator(bool Value){
-  if(Value==ON)
-    digitalWrite(LED_STATUS,HIGH);
-  else
-    digitalWrite(LED_STATUS,LOW);
-  }
+void _Newton::Set_Epoch(unsigned long Epoch)
+{
+  STATS_CALL(STATS_RTC);
+  byte Second, Minute, Hour, DayOfWeek, Day, Month, Year;
+
+  Epoch_To_Date(Epoch,&Second,&Minute,&Hour,&DayOfWeek,&Day,&Month,&Year);
+  Set_Current_Time_Values(Second,Minute,Hour,DayOfWeek,Day,Month,Year);
+}
+
+// As for the EEPROM, the Wire buffer limits a transaction; on writes one
+// byte of it is taken by the register number.
+#ifdef BUFFER_LENGTH
+#define NVRAM_WRITE_CHUNK (BUFFER_LENGTH-1)
+#define NVRAM_READ_CHUNK  BUFFER_LENGTH
+#else
+#define NVRAM_WRITE_CHUNK 31
+#define NVRAM_READ_CHUNK  32
 #endif
 
-#ifndef __NO_SWITCHES
 /*****************************************************************************
- * bool _Newton::SW1_Status()
+ * bool _Newton::NVRAM_Read(byte *Data, byte Length, byte Address)
  * 
- * Returns a value of true or false based on whether or not SW1 has been
- * pressed. The reading is done after a short period of time to allow for the 
- * mechanical parts to settle in a position (switch debouncing).
+ * Copies Length bytes of the RTC's battery-backed RAM, from Address (0 to
+ * NVRAM_SIZE-1), into Data.  The register number is sent once and the bytes
+ * are then streamed (the DS1307 advances its register pointer after each
+ * one), so up to NVRAM_READ_CHUNK bytes take a single read.  There is no
+ * write cycle to wait for, as there is with the EEPROM.  Returns false if
+ * the range does not fit in the NVRAM (the pointer would wrap round to the
+ * clock registers) or the RTC does not respond.
  */
-bool _Newton::SW1_Status(){
-  delay(DEBOUNCE_TIME);
-  return(!digitalRead(SW1));
-  }
+bool _Newton::NVRAM_Read(byte *Data, byte Length, byte Address)
+{
+  STATS_CALL(STATS_RTC);
+  if(Address>NVRAM_SIZE || Length>NVRAM_SIZE-Address) return(false);
+  Bus_Drain();
+  Bus_Begin(RTC_ADDRESS);
+  Wire.write(NVRAM_START+Address);
+  if(Bus_End(1)!=0) return(false);
+
+  while(Length>0)
+    {
+    byte Count = (Length>NVRAM_READ_CHUNK) ? NVRAM_READ_CHUNK : Length;
+    if(Bus_Request(RTC_ADDRESS,Count)!=Count) return(false);
+    for(byte i=0;i<Count;i++)
+      *Data++ = Wire.read();
+    Length -= Count;
+    }
+  return(true);
+}
 
 /*****************************************************************************
- * bool _Newton::SW2_Status()
+ * bool _Newton::NVRAM_Write(const byte *Data, byte Length, byte Address)
  * 
- * Returns a value of true or false based on whether or not SW2 has been
- * pressed. The reading is done after a short period of time to allow for the 
- * mechanical parts to settle in a position (switch debouncing).
+ * Copies Length bytes from Data to the RTC's battery-backed RAM, from
+ * Address (0 to NVRAM_SIZE-1).  Up to NVRAM_WRITE_CHUNK bytes are sent in a
+ * single transaction, and the RAM takes them at once: the call returns as
+ * soon as the bus is done, and the RAM does not wear.  Returns false if the
+ * range does not fit in the NVRAM or the RTC does not respond.
  */
-bool _Newton::SW2_Status(){
-  delay(DEBOUNCE_TIME);
-  return(!digitalRead(SW2));
-  }
+bool _Newton::NVRAM_Write(const byte *Data, byte Length, byte Address)
+{
+  STATS_CALL(STATS_RTC);
+  if(Address>NVRAM_SIZE || Length>NVRAM_SIZE-Address) return(false);
+  Bus_Drain();
+  while(Length>0)
+    {
+    byte Count = (Length>NVRAM_WRITE_CHUNK) ? NVRAM_WRITE_CHUNK : Length;
+    Bus_Begin(RTC_ADDRESS);
+    Wire.write(NVRAM_START+Address);
+    Wire.write(Data,Count);
+    if(Bus_End(1+Count)!=0) return(false);
+    Data += Count;
+    Address += Count;
+    Length -= Count;
+    }
+  return(true);
+}
+
 #endif
 
-#ifndef __NO_SPEAKER
 /*****************************************************************************
- * void _Newton::Beep()
+ * void _Newton::Epoch_To_Date(unsigned long Epoch, byte *second, ...)
  * 
- * Produces a tone at the speaker at a set frequency and and for a set period
- * beore returning to silence.
+ * Splits a time in seconds since 2000-01-01 00:00:00 into calendar fields
+ * (the inverse of Date_To_Epoch()).  Every fourth year from 2000 is a leap
+ * year, so the year comes from the 1461-day cycle, and the month and day
+ * from a March-based year in which the months follow a fixed 153-day
+ * pattern, leaving February (and its leap day) at the end.
  */
-void _Newton::Beep(){
-  tone(SPKR,BEEP_FREQ,BEEP_TIME);
+void _Newton::Epoch_To_Date(unsigned long Epoch, byte *second, byte *minute, byte *hour,
+                            byte *dayOfWeek, byte *dayOfMonth, byte *month, byte *year)
+{
+  *second = Epoch%60;
+  Epoch /= 60;
+  *minute = Epoch%60;
+  Epoch /= 60;
+  *hour = Epoch%24;
+
+  unsigned int Days = Epoch/24;
+  *dayOfWeek = (Days+6)%7+1;
+
+  // Count from 1996-03-01 so that each leap day ends its 1461-day cycle.
+  Days += 1401;
+  unsigned int Cycle_Day = Days%1461;
+  byte Year_Of_Cycle = (Cycle_Day-Cycle_Day/1460)/365;
+  unsigned int Day_Of_Year = Cycle_Day-365*Year_Of_Cycle;
+  byte Month_Index = (5*Day_Of_Year+2)/153;                  // 0 = March.
+
+  *dayOfMonth = Day_Of_Year-(153*Month_Index+2)/5+1;
+  *month = Month_Index<10 ? Month_Index+3 : Month_Index-9;
+  *year = (Days/1461)*4+Year_Of_Cycle+(Month_Index>=10)-4;
 }
 
+// The text formats: the text with '#' for each digit, and where the month,
+// day, year, hour, minute and second are in it.
+struct Time_Layout{
+  char Text[TIME_TEXT_SIZE];
+  byte Length;
+  byte Field[6];
+  };
+
+static const Time_Layout Time_Layouts[2] PROGMEM = {
+  {"##/##/## ##:##:##",   17, {0, 3, 6, 9, 12, 15}},
+  {"20##-##-##T##:##:##", 19, {5, 8, 2, 11, 14, 17}}
+  };
+
+#define TIME_EPOCH_END  _Newton::Date_To_Epoch(0,0,0,1,1,100)   // 2100-01-01 00:00:00
+
 /*****************************************************************************
- * void _Newton::Beep(int Duration)
+ * static byte Time_Text(char *Text, size_t Size, byte Format,
+ *                       const byte *Fields)
  * 
- * Produces a tone at the speaker at a set frequency(Hz) and for a specified
- * period (mS) beore returning to silence.
+ * Writes the month, day, year (0-99), hour, minute and second in Fields
+ * into Text as a text format, with the NUL.  Returns the characters
+ * written without the NUL, or 0 if Size is too small.
  */
-void _Newton::Beep(int Duration){
-  tone(SPKR,BEEP_FREQ,Duration);
+static byte Time_Text(char *Text, size_t Size, byte Format, const byte *Fields){
+  if(Format>TIME_FORMAT_ISO) return(0);
+  const Time_Layout *Layout = &Time_Layouts[Format];
+  byte Length = pgm_read_byte(&Layout->Length);
+  if(Size<=Length) return(0);
+
+  for(byte i=0;i<=Length;i++) Text[i] = pgm_read_byte(&Layout->Text[i]);
+  for(byte i=0;i<6;i++)
+    {
+    char *Digits = Text+pgm_read_byte(&Layout->Field[i]);
+    Digits[0] = '0'+Fields[i]/10;
+    Digits[1] = '0'+Fields[i]%10;
+    }
+  return(Length);
 }
 
 /*****************************************************************************
- * void _Newton::Beep(int Frequency, int Duration)
+ * byte _Newton::Format_Time(unsigned long Epoch, char *Text, size_t Size,
+ *                           byte Format)
  * 
- * Produces a tone at the speaker at a given frequency(Hz) and for a
- * specified period(mS) beore returning to silence.
+ * Writes a time in seconds since 2000-01-01 00:00:00 into a buffer of Size
+ * characters, as text (TIME_FORMAT_US or TIME_FORMAT_ISO, with the NUL) or
+ * as the 4 bytes of TIME_FORMAT_BINARY.  Returns the characters or bytes
+ * written (without the NUL), or 0 if the buffer is too small, the format
+ * is unknown or the time is past 2099.  Nothing is written beyond Size.
  */
-void _Newton::Beep(int Frequency, int Duration){
-  tone(SPKR,Frequency,Duration);
+byte _Newton::Format_Time(unsigned long Epoch, char *Text, size_t Size, byte Format){
+  if(Epoch>=TIME_EPOCH_END) return(0);
+  if(Format==TIME_FORMAT_BINARY)
+    {
+    if(Size<4) return(0);
+    for(byte i=0;i<4;i++) Text[i] = Epoch>>(24-8*i);
+    return(4);
+    }
+
+  byte Fields[6], DayOfWeek;
+  Epoch_To_Date(Epoch,&Fields[5],&Fields[4],&Fields[3],&DayOfWeek,&Fields[1],&Fields[0],&Fields[2]);
+  return(Time_Text(Text,Size,Format,Fields));
 }
 
 /*****************************************************************************
- * void _Newton::Tone(int Frequency)
+ * byte _Newton::Parse_Time(const char *Text, size_t Length, byte Format,
+ *                          unsigned long *Epoch)
  * 
- * Produces a continuous tone at the speaker at a given frequency(Hz).
+ * Reads a time written in Format from the first Length characters of Text
+ * (which need not end with a NUL) into seconds since 2000-01-01 00:00:00.
+ * Every character is checked: the digits must be digits and the rest must
+ * be as in the format, except that ISO 8601 times may have a space for the
+ * 'T' and a 'Z' at the end.  Then every field is checked against the
+ * calendar.  Returns TIME_OK, leaving *Epoch alone otherwise:
+ *   TIME_TOO_SHORT  - Length is less than the format needs.
+ *   TIME_BAD_FORMAT - a character is wrong, or there are too many.
+ *   TIME_BAD_VALUE  - a field is out of range (including 31/04 and 29/02
+ *                     outside leap years, and binary times past 2099).
  */
-void _Newton::Tone(int Frequency){
-  tone(SPKR,Frequency);
+byte _Newton::Parse_Time(const char *Text, size_t Length, byte Format, unsigned long *Epoch){
+  if(Format==TIME_FORMAT_BINARY)
+    {
+    if(Length<4) return(TIME_TOO_SHORT);
+    if(Length>4) return(TIME_BAD_FORMAT);
+    unsigned long Value = 0;
+    for(byte i=0;i<4;i++) Value = (Value<<8) | (byte)Text[i];
+    if(Value>=TIME_EPOCH_END) return(TIME_BAD_VALUE);
+    *Epoch = Value;
+    return(TIME_OK);
+    }
+  if(Format>TIME_FORMAT_ISO) return(TIME_BAD_FORMAT);
+
+  const Time_Layout *Layout = &Time_Layouts[Format];
+  byte Size = pgm_read_byte(&Layout->Length);
+  if(Length<Size) return(TIME_TOO_SHORT);
+  if(Length>Size && !(Format==TIME_FORMAT_ISO && Length==Size+1U && Text[Size]=='Z'))
+    return(TIME_BAD_FORMAT);
+  for(byte i=0;i<Size;i++)
+    {
+    char Expected = pgm_read_byte(&Layout->Text[i]);
+    if(Expected=='#' ? (Text[i]<'0' || Text[i]>'9') : (Text[i]!=Expected && !(Expected=='T' && Text[i]==' ')))
+      return(TIME_BAD_FORMAT);
+    }
+
+  byte Fields[6];
+  for(byte i=0;i<6;i++)
+    {
+    const char *Digits = Text+pgm_read_byte(&Layout->Field[i]);
+    Fields[i] = (Digits[0]-'0')*10+(Digits[1]-'0');
+    }
+  byte Month = Fields[0], Day = Fields[1], Year = Fields[2];
+  if(Month<1 || Month>12 || Day<1 || Day>Days_Before_Month(Month+1,Year)-Days_Before_Month(Month,Year) ||
+     Fields[3]>23 || Fields[4]>59 || Fields[5]>59)
+    return(TIME_BAD_VALUE);
+  *Epoch = Date_To_Epoch(Fields[5],Fields[4],Fields[3],Day,Month,Year);
+  return(TIME_OK);
 }
 
+#ifndef __NO_RTC
+#ifdef __NEWTON_ALARMS
 /*****************************************************************************
- * void _Newton::Tone(int Frequency, int Duration))
+ * void _Newton::Begin_Alarms(Alarm_Callback Handler, bool Persist)
  * 
- * Produces a continuous tone at the speaker at a given frequency(Hz) and for
- * a given duration(mS).
+ * Starts the alarm scheduler.  Handler is called from Service_Alarms() with
+ * the event number of each alarm that expires.  If Persist is set, the
+ * alarm table is kept in the EEPROM: alarms saved before a reset are loaded
+ * here and any that expired while the board was off are called on the next
+ * Service_Alarms() (once, however many repeats were missed).  Repeats
+ * shorter than ALARM_CATCH_UP are resumed without being caught up, so that
+ * they do not wear the EEPROM by saving every expiry (if the RTC does not
+ * respond they are left for Service_Alarms() to bring up to date).  If the
+ * EEPROM fails part way, the alarms loaded before it are kept.
  */
-void _Newton::Tone(int Frequency, int Duration){
-  tone(SPKR,Frequency,Duration);
+void _Newton::Begin_Alarms(Alarm_Callback Handler, bool Persist)
+{
+  STATS_CALL(STATS_ALARMS);
+  Alarm_Handler = Handler;
+  Alarm_Persist = Persist;
+  Alarm_Wait = 0;
+
+  #ifndef __NO_EEPROM
+  if(!Persist) return;
+  unsigned long Now = Get_Epoch();
+  for(byte Id=0;Id<ALARM_COUNT;Id++)
+    {
+    byte Record[10];
+    if(!Memory_Read_Block(Record,sizeof(Record),ALARM_EEPROM_ADDRESS+Id*sizeof(Record))) break;
+
+    // The last byte is a check on the others; blank or cancelled entries fail it.
+    byte Check = 0xA5;
+    for(byte i=0;i<9;i++) Check ^= Record[i];
+    Alarms[Id].Used = (Check==Record[9]);
+    if(!Alarms[Id].Used) continue;
+    memcpy(&Alarms[Id].Time,Record,4);
+    memcpy(&Alarms[Id].Period,Record+4,4);
+    Alarms[Id].Event = Record[8];
+    if(Now && Alarms[Id].Period && Alarms[Id].Period<ALARM_CATCH_UP && Alarms[Id].Time<=Now)
+      Alarms[Id].Time += ((Now-Alarms[Id].Time)/Alarms[Id].Period+1)*Alarms[Id].Period;
+    }
+  Alarm_Sort();
+  #endif
 }
 
 /*****************************************************************************
- * void _Newton::Silence()
+ * byte _Newton::Alarm_At(unsigned long Epoch, byte Event)
  * 
- * Unconditionally stops any tones being produced at the speaker.
+ * Sets a single alarm for a time in epoch seconds (see Get_Epoch()).
+ * Returns the alarm's number, or ALARM_NONE if all alarms are in use.
  */
-void _Newton::Silence(){
-  noTone(SPKR);
+byte _Newton::Alarm_At(unsigned long Epoch, byte Event)
+{
+  STATS_CALL(STATS_ALARMS);
+  return(Alarm_Add(Epoch,0,Event));
 }
 
 /*****************************************************************************
- * void _Newton::Sound_Effect(int Effect)
+ * byte _Newton::Alarm_Daily(byte Hour, byte Minute, byte Event)
  * 
- * This function produces various auditory special effects at the speaker. 
+ * Sets an alarm that expires every day at Hour:Minute.  Returns ALARM_NONE
+ * if Hour (0-23) or Minute (0-59) is out of range, all alarms are in use or
+ * the RTC does not respond (the time of day is then unknown).
  */
-void _Newton::Sound_Effect(int Effect){
-  switch(Effect)
-    {
-    case UP_SQUEAK:
-      for(int f=100;f<=10000;f+=10)
-        tone(SPKR,f,100);
-      break;
-    case DOWN_SQUEAK:
-      for(int f=10000;f>=100;f-=10)
-        tone(SPKR,f,100);
-      break;
-    case ALARM:
-      for(int i=1;i<=10;i++)
-        {
-          for(int f=100;f<=10000;f+=100)
-            tone(SPKR,f,20);
-          for(int f=10000;f>=500;f-=50)
-            tone(SPKR,f,30);
-          delay(250);
-        }
-      break;
-    };
+byte _Newton::Alarm_Daily(byte Hour, byte Minute, byte Event)
+{
+  STATS_CALL(STATS_ALARMS);
+  if(Hour>23 || Minute>59) return(ALARM_NONE);
+  unsigned long Now = Get_Epoch();
+  if(Now==0) return(ALARM_NONE);         // No RTC.
+  unsigned long Time = Now-Now%SECONDS_PER_DAY+Hour*3600UL+Minute*60U;
+  if(Time<=Now) Time += SECONDS_PER_DAY;
+  return(Alarm_Add(Time,SECONDS_PER_DAY,Event));
 }
-#endif
 
-/*#######################################################################  
-    ______   ______   _____    _____     ____    __  __ 
-   |  ____| |  ____| |  __ \  |  __ \   / __ \  |  \/  |
-   | |__    | |__    | |__) | | |__) | | |  | | | \  / |
-   |  __|   |  __|   |  ___/  |  _  /  | |  | | | |\/| |
-   | |____  | |____  | |      | | \ \  | |__| | | |  | |
-   |______| |______| |_|      |_|  \_\  \____/  |_|  |_|
-   |  \/  |                                             
-   | \  / |   ___   _ __ ___     ___    _ __   _   _    
-   | |\/| |  / _ \ | '_ ` _ \   / _ \  | '__| | | | |   
-   | |  | | |  __/ | | | | | | | (_) | | |    | |_| |   
-   |_|  |_|  \___| |_| |_| |_|  \___/  |_|     \__, |   
-                                                __/ |   
-                                               |___/    
-  #######################################################################*/
-#ifndef __NO_EEPROM
 /*****************************************************************************
- * void _Newton::Memory_Write(byte Data, unsigned long Address)
+ * byte _Newton::Alarm_Weekly(byte DayOfWeek, byte Hour, byte Minute, byte Event)
  * 
- * An abstract interface to the EEPROM via the I2C bus.  This function will
- * copy the given data to the specified location in the EEPROM memory.  The
- * memory unit is organized as 32k * 8.  Address validtion is not performed by
- * this function.
+ * Sets an alarm that expires every week on DayOfWeek (1-7, from Sunday) at
+ * Hour:Minute.  Returns ALARM_NONE as Alarm_Daily() does, and if DayOfWeek
+ * is out of range.
  */
-void _Newton::Memory_Write(byte Data, unsigned long Address)
+byte _Newton::Alarm_Weekly(byte DayOfWeek, byte Hour, byte Minute, byte Event)
 {
-  Wire.beginTransmission(EEPROM_ADDRESS);   // Initiate I2C communication to device number 0x50 (hard-wired address).
-  Wire.write(Address>>8);                  // Upper 8-bits of address.
-  Wire.write(Address&0xFF);                // Lower 8-bits of address.
-  Wire.write(Data);                        // 8-bits of data.
-  Wire.endTransmission();                  // Terminate I2C communication.
-  delay(5);
+  STATS_CALL(STATS_ALARMS);
+  if(DayOfWeek<1 || DayOfWeek>7 || Hour>23 || Minute>59) return(ALARM_NONE);
+  unsigned long Now = Get_Epoch();
+  if(Now==0) return(ALARM_NONE);
+  unsigned long Time = Now-Now%SECONDS_PER_DAY+((DayOfWeek+7-Day_Of_Week(Now))%7)*SECONDS_PER_DAY
+                       +Hour*3600UL+Minute*60U;
+  if(Time<=Now) Time += 7*SECONDS_PER_DAY;
+  return(Alarm_Add(Time,7*SECONDS_PER_DAY,Event));
 }
 
 /*****************************************************************************
- * void _Newton::Memory_Read(unsigned long Address)
+ * byte _Newton::Alarm_Every(unsigned int Minutes, byte Event)
  * 
- * An abstract interface to the EEPROM via the I2C bus.  This function will
- * return the data at specified location in the EEPROM memory.  The memory
- * unit is organized as 32k * 8.  Address validtion is not performed by this
- * function.
+ * Sets an alarm that expires every Minutes minutes, starting from now.
+ * Returns ALARM_NONE as Alarm_Daily() does.
  */
-byte _Newton::Memory_Read(unsigned long Address)
+byte _Newton::Alarm_Every(unsigned int Minutes, byte Event)
 {
-  byte Data;
-  
-  Wire.beginTransmission(EEPROM_ADDRESS);   // Initiate I2C communication to device number 0x50 (hard-wired address).
-  Wire.write(Address>>8);                  // Upper 8-bits of address.
-  Wire.write(Address&0xFF);                // Lower 8-bits of address.
-  Wire.endTransmission();                  // Terminate I2C communication.
-  
-  Wire.requestFrom(EEPROM_ADDRESS,1);       // Request data from the EEPROM.
-  if(Wire.available())                     // If there is data available, then retrieve it.
-    Data = Wire.read();  
-  return(Data);
+  STATS_CALL(STATS_ALARMS);
+  if(Minutes==0) return(ALARM_NONE);
+  unsigned long Now = Get_Epoch();
+  if(Now==0) return(ALARM_NONE);
+  return(Alarm_Add(Now+Minutes*60UL,Minutes*60UL,Event));
 }
-#endif
-/*#######################################################################  
-    _____                   _            _______   _                    
-   |  __ \                 | |          |__   __| (_)                   
-   | |__) |   ___    __ _  | |  ______     | |     _   _ __ ___     ___ 
-   |  _  /   / _ \  / _` | | | |______|    | |    | | | '_ ` _ \   / _ \
-   | | \ \  |  __/ | (_| | | |             | |    | | | | | | | | |  __/
-   |_|__\_\  \___|  \__,_| |_|  _          |_|    |_| |_| |_| |_|  \___|
-    / ____| | |                | |                                      
-   | |      | |   ___     ___  | | __                                   
-   | |      | |  / _ \   / __| | |/ /                                   
-   | |____  | | | (_) | | (__  |   <                                    
-    \_____| |_|  \___/   \___| |_|\_\                                   
-                                                                        
-  #######################################################################*/
-#ifndef __NO_RTC
+
 /*****************************************************************************
- * byte _Newton::Decimal_To_BCD(byte Decimal_Value)
+ * void _Newton::Alarm_Cancel(byte Id)
  * 
- * A support function used to interpret decimal values for the real-time clock.
- * This function will convert a BCD value from 0 to 99 (unvalidated) and 
- * convert it to its corresponding decimal value.  Both values are byte encoded.
+ * Removes an alarm (and its saved copy).
  */
- byte _Newton::Decimal_To_BCD(byte Decimal_Value)
+void _Newton::Alarm_Cancel(byte Id)
 {
-  byte BCD_Value = (Decimal_Value/10*16) + (Decimal_Value%10);
-  return(BCD_Value);
+  STATS_CALL(STATS_ALARMS);
+  if(Id>=ALARM_COUNT || !Alarms[Id].Used) return;
+  Alarms[Id].Used = false;
+  Alarm_Sort();
+  Alarm_Save(Id);
 }
 
 /*****************************************************************************
- * byte _Newton::BCD_To_Decimal(byte BCD_Value)
+ * void _Newton::Service_Alarms()
  * 
- * A support function used to interpret BCD values from the real-time clock.
- * This function will convert a decimal value from 0 to 99 (unvalidated) and
- * convert it to its corresponding BCD value.  Both values are byte encoded.
+ * Calls the alarm handler for each alarm that has expired.  It should be
+ * called often from loop().  Only the soonest alarm is compared with the
+ * time, and the RTC is not read again until it is due (or ALARM_RECHECK
+ * seconds have passed, in case the clock has been changed), so calling
+ * this costs almost nothing.  An alarm whose time has passed is never
+ * missed, however late this is called.
  */
-byte _Newton::BCD_To_Decimal(byte BCD_Value)
+void _Newton::Service_Alarms()
 {
-  byte Decimal_Value = (BCD_Value/16*10) + (BCD_Value%16);
-  return(Decimal_Value);
-}
+  STATS_CALL(STATS_ALARMS);
+  if(Alarm_Active==0 || millis()-Alarm_Wait_Start<Alarm_Wait) return;
 
+  unsigned long Now = Get_Epoch();
+  Alarm_Wait_Start = millis();
+  Alarm_Wait = 1000;
+  if(Now==0) return;                     // No RTC; try again later.
 
+  while(Alarm_Active && Alarms[Alarm_Order[0]].Time<=Now)
+    {
+    byte Id = Alarm_Order[0];
+    byte Event = Alarms[Id].Event;
+    if(Alarms[Id].Period)
+      {
+      Alarms[Id].Time += ((Now-Alarms[Id].Time)/Alarms[Id].Period+1)*Alarms[Id].Period;
+      if(Alarms[Id].Period>=ALARM_CATCH_UP) Alarm_Save(Id);
+      }
+    else
+      {
+      Alarms[Id].Used = false;
+      Alarm_Save(Id);
+      }
+    Alarm_Sort();
+    if(Alarm_Handler) Alarm_Handler(Event);
+    }
 
-void _Newton::Set_Current_Time_Values(  byte second, byte minute, byte hour, byte dayOfWeek,
-                byte dayOfMonth, byte month, byte year)
-{
-   Wire.beginTransmission(RTC_ADDRESS);
-   Wire.write(0);
-   Wire.write(Decimal_To_BCD(second));    // 0 to bit 7 starts the clock
-   Wire.write(Decimal_To_BCD(minute));
-   Wire.write(Decimal_To_BCD(hour));      // If you want 12 hour am/pm you need to set
-                                   // bit 6 (also need to change readDateDs1307)
-   Wire.write(Decimal_To_BCD(dayOfWeek));
-   Wire.write(Decimal_To_BCD(dayOfMonth));
-   Wire.write(Decimal_To_BCD(month));
-   Wire.write(Decimal_To_BCD(year));
-   Wire.endTransmission();
+  if(Alarm_Active)
+    {
+    unsigned long Wait = Alarms[Alarm_Order[0]].Time-Now;
+    Alarm_Wait = (Wait<ALARM_RECHECK ? Wait : ALARM_RECHECK)*1000UL;
+    }
 }
 
-void _Newton::Get_Current_Time_Values(  byte *second, byte *minute, byte *hour, byte *dayOfWeek,
-                byte *dayOfMonth, byte *month, byte *year)
+/*****************************************************************************
+ * byte _Newton::Alarm_Add(unsigned long Time, unsigned long Period, byte Event)
+ * 
+ * Fills a free alarm and saves it.
+ */
+byte _Newton::Alarm_Add(unsigned long Time, unsigned long Period, byte Event)
 {
-// Reset the register pointer
-  Wire.beginTransmission(RTC_ADDRESS);
-  Wire.write(0);
-  Wire.endTransmission();
-  
-  Wire.requestFrom(RTC_ADDRESS, 7);
+  for(byte Id=0;Id<ALARM_COUNT;Id++)
+    if(!Alarms[Id].Used)
+      {
+      Alarms[Id].Time = Time;
+      Alarms[Id].Period = Period;
+      Alarms[Id].Event = Event;
+      Alarms[Id].Used = true;
+      Alarm_Sort();
+      Alarm_Save(Id);
+      Alarm_Wait = 0;
+      return(Id);
+      }
+  return(ALARM_NONE);
+}
 
-  // A few of these need masks because certain bits are control bits
-//  *second     = Wire.read() & 0x7f;
-//  *minute     = Wire.read();
-//  *hour       = Wire.read() & 0x3f;  // Need to change this if 12 hour am/pm
-//  *dayOfWeek  = Wire.read();
-//  *dayOfMonth = Wire.read();
-//  *month      = Wire.read();
-//  *year       = Wire.read();
-
-  *second     = BCD_To_Decimal(Wire.read() & 0x7f);
-  *minute     = BCD_To_Decimal(Wire.read());
-  *hour       = BCD_To_Decimal(Wire.read() & 0x3f);  // Need to change this if 12 hour am/pm
-  *dayOfWeek  = BCD_To_Decimal(Wire.read());
-  *dayOfMonth = BCD_To_Decimal(Wire.read());
-  *month      = BCD_To_Decimal(Wire.read());
-  *year       = BCD_To_Decimal(Wire.read());
+/*****************************************************************************
+ * void _Newton::Alarm_Sort()
+ * 
+ * Rebuilds Alarm_Order, soonest first (an insertion sort of a few entries).
+ */
+void _Newton::Alarm_Sort()
+{
+  Alarm_Active = 0;
+  for(byte Id=0;Id<ALARM_COUNT;Id++)
+    if(Alarms[Id].Used)
+      {
+      byte i = Alarm_Active++;
+      for(;i>0 && Alarms[Alarm_Order[i-1]].Time>Alarms[Id].Time;i--)
+        Alarm_Order[i] = Alarm_Order[i-1];
+      Alarm_Order[i] = Id;
+      }
 }
 
-void _Newton::Initialize_Time_Date()
+/*****************************************************************************
+ * void _Newton::Alarm_Save(byte Id)
+ * 
+ * Writes one alarm to the EEPROM copy of the table, if it is kept.
+ */
+void _Newton::Alarm_Save(byte Id)
 {
-  /* These functions use up memory and should be replaced by precompiler directives and macros.
-   * This function does not check for errors in the __DATE__ and __TIME__ macros. If there were
-   * errors, these would return all '?' characters.
-   */
-  int Compile_Hour = ((__TIME__[0] - '0') * 10 + __TIME__[1] - '0');
-  int Compile_Minute = ((__TIME__[3] - '0') * 10 + __TIME__[4] - '0');
-  int Compile_Second = ((__TIME__[6] - '0') * 10 + __TIME__[7] - '0');
-
-  int Compile_Month;
-  String Date = String(__DATE__);
-  if(Date.substring(0,3)=="Jan") Compile_Month = 1;
-  if(Date.substring(0,3)=="Feb") Compile_Month = 2;
-  if(Date.substring(0,3)=="Mar") Compile_Month = 3;
-  if(Date.substring(0,3)=="Apr") Compile_Month = 4;
-  if(Date.substring(0,3)=="May") Compile_Month = 5;
-  if(Date.substring(0,3)=="Jun") Compile_Month = 6;
-  if(Date.substring(0,3)=="Jul") Compile_Month = 7;
-  if(Date.substring(0,3)=="Aug") Compile_Month = 8;
-  if(Date.substring(0,3)=="Sep") Compile_Month = 9;
-  if(Date.substring(0,3)=="Oct") Compile_Month = 10;
-  if(Date.substring(0,3)=="Nov") Compile_Month = 11;
-  if(Date.substring(0,3)=="Dec") Compile_Month = 12;
-
-  int Compile_Day  =  ((__DATE__[4] >= '0') ? (__DATE__[4] - '0') * 10 : 0) + (__DATE__[5] - '0');
-  int Compile_Year =  (__DATE__[ 7] - '0') * 1000 + (__DATE__[ 8] - '0') *  100 + (__DATE__[ 9] - '0') *   10 + (__DATE__[10] - '0') ;
-
-  // The day of the week is not calculated by the DS1307.  It is arbitrarily set to 0 but will increment on 24h cycles.
-  Set_Current_Time_Values(Compile_Second, Compile_Minute, Compile_Hour, 0 , Compile_Day, Compile_Month, Compile_Year - 2000);
-  }
+  #ifndef __NO_EEPROM
+  if(!Alarm_Persist) return;
+  byte Record[10];
+  memcpy(Record,&Alarms[Id].Time,4);
+  memcpy(Record+4,&Alarms[Id].Period,4);
+  Record[8] = Alarms[Id].Event;
+  byte Check = 0xA5;
+  for(byte i=0;i<9;i++) Check ^= Record[i];
+  Record[9] = Alarms[Id].Used ? Check : ~Check;
+  Memory_Write_Block(Record,sizeof(Record),ALARM_EEPROM_ADDRESS+Id*sizeof(Record));
+  #else
+  (void)Id;
+  #endif
+}
+#endif
 
-void _Newton::Set_Time(char *Time_String){
-  // Time string format:
-  // MM/DD/YY HH:MM:SS
-  int Month, Day, Year;
-  int Hours, Minutes, Seconds;
-  
-  sscanf(Time_String,"%02d/%02d/%02d %02d:%02d:%02d",&Month, &Day, &Year, &Hours, &Minutes, &Seconds);
-  Set_Current_Time_Values((byte)Seconds, (byte)Minutes, (byte)Hours, 0 , (byte)Day, (byte)Month, (byte)Year);
-  Serial.print("Current Time Set: ");
-  Serial.print(Month);    Serial.print("/");
-  Serial.print(Day);      Serial.print("/");
-  Serial.print(Year);     Serial.print(" ");
-  Serial.print(Hours);    Serial.print(":");
-  Serial.print(Minutes);  Serial.print(":");
-  Serial.println(Seconds);
+/*****************************************************************************
+ * bool _Newton::Set_Time(const char *Time_String, byte Format)
+ * 
+ * Sets the RTC from a time in one of the text formats (TIME_FORMAT_US,
+ * "MM/DD/YY HH:MM:SS", unless another is given) or from the 4 bytes of
+ * TIME_FORMAT_BINARY.  Returns false, leaving the RTC alone, if it is not
+ * a valid time (see Parse_Time()).
+ */
+bool _Newton::Set_Time(const char *Time_String, byte Format){
+  STATS_CALL(STATS_RTC);
+  unsigned long Epoch;
+  size_t Length = Format==TIME_FORMAT_BINARY ? 4 : strlen(Time_String);
+
+  if(Parse_Time(Time_String,Length,Format,&Epoch)!=TIME_OK) return(false);
+  Set_Epoch(Epoch);
+  return(true);
 }
 
+/*****************************************************************************
+ * void _Newton::Get_Time(char *Time_String)
+ * bool _Newton::Get_Time(char *Time_String, size_t Size, byte Format)
+ * 
+ * Writes the time as "MM/DD/YY HH:MM:SS" (18 characters with the NUL), or
+ * in the given format into a buffer of Size characters.  The fields come
+ * from the RTC (or the cached time) and go straight into the text.
+ * Returns false if the buffer is too small or the RTC does not respond;
+ * Get_Time(Time_String) then leaves an empty string.
+ */
 void _Newton::Get_Time(char *Time_String){
-  // Time string format:
-  // MM/DD/YY HH:MM:SS
-  byte Month, Day, Year, DayOfWeek;
-  byte Hours, Minutes, Seconds;
-  
-  Get_Current_Time_Values(&Seconds, &Minutes, &Hours, &DayOfWeek, &Day, &Month, &Year);
-  sprintf(Time_String,"%02d/%02d/%02d %02d:%02d:%02d",Month, Day, Year, Hours, Minutes, Seconds);
-//  Serial.print("System Time: ");
-//  Serial.println(Time_String);
-//  Serial.print(Month);    Serial.print("/");
-//  Serial.print(Day);      Serial.print("/");
-//  Serial.print(Year);     Serial.print(" ");
-//  Serial.print(Hours);    Serial.print(":");
-//  Serial.print(Minutes);  Serial.print(":");
-//  Serial.println(Seconds);
+  if(!Get_Time(Time_String,18,TIME_FORMAT_US)) Time_String[0] = 0;
+}
+
+bool _Newton::Get_Time(char *Time_String, size_t Size, byte Format){
+  STATS_CALL(STATS_RTC);
+  byte Values[7];
+
+  if(Clock_Resync_Interval)
+    return(Update_Clock() && Format_Time(Clock_Epoch,Time_String,Size,Format)!=0);
+  if(!Read_Clock(Values)) return(false);
+  if(Format==TIME_FORMAT_BINARY)
+    return(Format_Time(Date_To_Epoch(Values[0],Values[1],Values[2],Values[4],Values[5],Values[6]),
+                       Time_String,Size,Format)!=0);
+  byte Fields[6] = {Values[5],Values[4],Values[6],Values[2],Values[1],Values[0]};
+  return(Time_Text(Time_String,Size,Format,Fields)!=0);
 }
 #endif
 
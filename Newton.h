@@ -34,27 +34,72 @@
 #ifndef NEWTON_H
 #define NEWTON_H
 
-#if !defined(__NO_RTC) || !defined(_NO_EEPROM)
-#include <Wire.h>
-#endif
-
-
 /************************************
  * Conditional Compilation
  * -----------------------
  * 
  * To reduce the codespace used, not all of this module is needed.  When 
- * these tokens are defined, specific hardware interfaces will not be used.
- * Users may uncomment those tokens here, or explicitly define them in their
- * code (recommended).  If defined, they should appear before "Newton.h" is  
- * included. Bear in mind that devices that are not being used still draw
- * power as they are still connected.  
+ * these tokens are defined, specific hardware interfaces will not be used:
+ * their functions, RAM and start-up code are left out, and the I2C (Wire)
+ * library is not linked at all when both the RTC and EEPROM are.  Bear in
+ * mind that devices that are not being used still draw power as they are
+ * still connected.
+ *
+ * Newton.cpp must be compiled with the same tokens as every file that
+ * includes this header, since they change the layout of the Newton object.
+ * The Arduino IDE compiles the library on its own, so tokens defined in a
+ * sketch do not reach it: uncomment them here instead (or pass them to the
+ * compiler with -D for every file).  A sketch built with different tokens
+ * fails to link, with an undefined reference to Newton_Features_ followed
+ * by one digit per feature (see NEWTON_SYMBOL below), rather than running
+ * with a corrupted object.  extras/size_report.sh lists the flash and RAM
+ * each combination uses.
  */
 //#define __NO_RTC
 //#define __NO_EEPROM
 //#define __NO_SWITCHES
 //#define __NO_LEDS
-//#define __NO_SPEAKER
+//#define __NO_SPEAKER        // Also frees Timer2 (for tone() and libraries that use it).
+//#define __NO_SLEEP          // Also frees the pin-change interrupts (for SoftwareSerial).
+//#define __NO_TIMERS         // Also frees Timer1 (for TimerOne, Servo ...).
+
+/*
+ * The subsystems below keep tables in the Newton object (or buffers beside
+ * it) that would take RAM whether or not a sketch uses them, so they are
+ * only built when their token is defined, in the same way as the tokens
+ * above.  extras/size_report.sh shows what each adds.
+ */
+//#define __NEWTON_LOG        // Begin_Log() ... (needs the EEPROM).
+//#define __NEWTON_CONFIG     // Begin_Config() ... (needs the EEPROM).
+//#define __NEWTON_ALARMS     // Begin_Alarms() ... (needs the RTC).
+//#define __NEWTON_ASYNC_BUS  // Memory_Read_Async() ..., Service_Bus() and Memory_Transfer.
+//#define __NEWTON_RADIO      // Begin_Radio() ... (needs the software timers).
+
+#if (defined(__NEWTON_LOG) || defined(__NEWTON_CONFIG)) && defined(__NO_EEPROM)
+#error "__NEWTON_LOG and __NEWTON_CONFIG keep their data in the EEPROM: they cannot be used with __NO_EEPROM"
+#endif
+#if defined(__NEWTON_ALARMS) && defined(__NO_RTC)
+#error "__NEWTON_ALARMS reads the time from the RTC: it cannot be used with __NO_RTC"
+#endif
+#if defined(__NEWTON_ASYNC_BUS) && defined(__NO_RTC) && defined(__NO_EEPROM)
+#error "__NEWTON_ASYNC_BUS needs the RTC or the EEPROM"
+#endif
+#if defined(__NEWTON_RADIO) && defined(__NO_TIMERS)
+#error "The radio is clocked by the software timers' Timer1 interrupt: __NEWTON_RADIO cannot be used with __NO_TIMERS"
+#endif
+
+#if !defined(__NO_RTC) || !defined(__NO_EEPROM)
+#include <Wire.h>
+#endif
+
+/* 
+ * __NEWTON_STATS does the opposite: it adds counters of the calls made to
+ * the EEPROM and RTC functions, the time they block and the I2C traffic
+ * they cause (see Get_Stats()).  Newton.cpp must be compiled with the same
+ * setting, so uncomment it here rather than defining it in a sketch.  When
+ * it is not defined the counters take no code, RAM or time at all.
+ */
+//#define __NEWTON_STATS
 
 // Definition of pin numbers.
 #define SW1          4
@@ -71,28 +116,291 @@
 #define OFF           LOW
 #define BEEP_FREQ     1500
 #define BEEP_TIME     100
-#define TIMER1_CTR    34286
-#define DEBOUNCE_TIME 25
+#define DEBOUNCE_TIME 25      // mS a switch must be stable before a change is accepted.
+#define LONG_PRESS_TIME 1000  // mS a switch must be held to report a long press.
+
+// The system tick is Timer0's compare-A interrupt, once per Timer0 cycle of
+// SYSTEM_TICK_CYCLES CPU cycles: 1.024 mS at 16 MHz (976.5625 Hz), not 1 mS.
+// The times in mS above and those given to the LED functions are counted
+// in ticks, converted (rounded) by MS_TO_TICKS().
+#define SYSTEM_TICK_CYCLES 16384UL
+#define MS_TO_TICKS(mS)    (((unsigned long)(mS)*(F_CPU/1000)+SYSTEM_TICK_CYCLES/2)/SYSTEM_TICK_CYCLES)
+
+// Software Timer Definitions
+#define TIMER_TICK_RATE   100   // Hz, used if Begin_Timers() is not called.
+#define TIMER_COUNT       8     // Timers that can be active at once.
+#define TIMER_WHEEL_SLOTS 16    // Must be a power of 2.
+#define TIMER_NONE        0xFF  // Returned by Timer_Start() when no timer is free.
+#define TIMER_ONE_SHOT    0x00
+#define TIMER_PERIODIC    0x01
+#define TIMER_IN_ISR      0x02  // Call from the interrupt instead of Service_Timers().
+#define ALARM_PERIOD      500   // mS between calls made by Set_Alarm_Time().
+
+// Alarm Scheduler Definitions
+#define ALARM_COUNT       8     // Alarms that can be set at once.
+#define ALARM_NONE        0xFF  // Returned by Alarm_At() etc. when no alarm is free.
+#define ALARM_RECHECK     60    // S between reads of the RTC while no alarm is due.
+#define ALARM_CATCH_UP    3600  // S, shortest repeat that is caught up after a reset.
+#define ALARM_EEPROM_ADDRESS 0x0040   // Saved alarm table (10 bytes per alarm).
+
+// LED Pattern Definitions
+#define FLASH_TIME    400     // mS the status LED is lit by Flash_Status_LED().
+#define PWM_BITS      6       // Duty resolution of the LED dimmer (64 steps).
+
+// Switch Event Definitions
+#define SW_PRESS       1
+#define SW_RELEASE     2
+#define SW_LONG_PRESS  3
+#define SWITCH_QUEUE_SIZE 8   // Events held until read (must be a power of 2).
 
 // Sound Effect Definitions
 #define UP_SQUEAK    0
 #define DOWN_SQUEAK  1
 #define ALARM        2
+#define TONE_QUEUE_SIZE 4     // Effects waiting to be played (must be a power of 2).
+#define SWEEP_LINEAR      1   // Tone_Step.Sweep: equal steps in Hz,
+#define SWEEP_EXPONENTIAL 2   // or equal steps in pitch (octaves per second).
+#define SWEEP_UPDATE      4096  // CPU cycles between frequency updates of a sweep (256 uS).
+#define SPEAKER_MIN_FREQ  31    // Hz, the lowest Timer2 can produce.
 
 // I2C Device numbers.
 #define EEPROM_ADDRESS   0x50
 #define RTC_ADDRESS      0x68
 
+// I2C bus speeds (see Set_Bus_Clock())
+#define I2C_STANDARD     100000UL   // Hz.
+#define I2C_FAST         400000UL
+#define I2C_MIN_CLOCK    31000UL    // Slowest the TWI can be set to at 16 MHz.
+#define EEPROM_MAX_CLOCK 400000UL   // 24LC256 at 4.5-5.5 V.
+#define RTC_MAX_CLOCK    100000UL   // DS1307.
+#define I2C_TIMEOUT      25000UL    // uS before a transaction is abandoned.
+
+// EEPROM geometry and timing (24LC256 class device).
+#define EEPROM_SIZE          32768
+#define EEPROM_PAGE_SIZE     64
+#define EEPROM_WRITE_TIMEOUT 10      // mS. Write cycles take at most 5 mS.
+
+// Asynchronous I2C Definitions (see Service_Bus())
+#define BUS_QUEUE_SIZE   4      // Transactions queued at once (must be a power of 2).
+#define BUS_NONE         0xFF   // Returned when a transaction cannot be queued.
+#define BUS_UNUSED       0      // Transaction states returned by Bus_Status().
+#define BUS_PENDING      1
+#define BUS_DONE         2
+#define BUS_FAILED       3
+
+// Packet Radio Definitions (see Begin_Radio())
+#define RADIO_BIT_RATE     2000   // Bits/S on air, used if Begin_Radio() is given none.
+#define RADIO_MIN_RATE     300
+#define RADIO_MAX_RATE     4000   // Each bit is sampled 8 times by the Timer1 interrupt.
+#define RADIO_MAX_PAYLOAD  32     // Bytes per packet.
+#define RADIO_TX_BUFFER    64     // Bytes queued for sending (must be a power of 2).
+#define RADIO_RX_BUFFER    64     // Bytes received and not yet read (must be a power of 2).
+
+// Bulk Transfer Definitions (see Memory_Transfer)
+#define TRANSFER_CHUNK    64    // Data bytes per frame (one EEPROM page).
+#define TRANSFER_SYNC     0x7E  // First byte of every frame.
+#define TRANSFER_READ     'R'   // Frame types from the host: read, write,
+#define TRANSFER_WRITE    'W'   // finish writing;
+#define TRANSFER_FINISH   'F'
+#define TRANSFER_DATA     'D'   // from the board: data, accepted, refused
+#define TRANSFER_ACK      'A'   // or failed.
+#define TRANSFER_NAK      'N'
+#define TRANSFER_TIMEOUT  100   // mS for a frame to arrive once started.
+
+// Sleep Definitions (see Sleep_Until_Event())
+#define SLEEP_IDLE        0     // CPU stopped; timers, tick and Serial keep running.
+#define SLEEP_POWER_DOWN  1     // All clocks stopped; millis() does not advance.
+#define WAKE_SWITCH       0x01  // Wake causes returned by Sleep_Until_Event().
+#define WAKE_CLOCK        0x02
+#define WAKE_TIMER        0x04
+#define WAKE_RADIO        0x08
+
+// DS1307 NVRAM Definitions (see NVRAM_Read() and NVRAM_Counters)
+#define NVRAM_START       0x08  // First RAM register of the RTC.
+#define NVRAM_SIZE        56    // Bytes, battery-backed (0x08-0x3F).
+#define NVRAM_SLOT_SIZE   6     // Bytes per counter: the value and its CRC.
+
+// Time is also kept as seconds since 2000-01-01 00:00:00 (the avr-libc
+// time_t epoch), which covers the DS1307's range of 2000-2099.
+#define SECONDS_PER_DAY  86400UL
+
+// Time Format Definitions (see Format_Time() and Parse_Time())
+#define TIME_FORMAT_US      0   // "MM/DD/YY HH:MM:SS" (as Get_Time() has always used).
+#define TIME_FORMAT_ISO     1   // "YYYY-MM-DDTHH:MM:SS" (ISO 8601).
+#define TIME_FORMAT_BINARY  2   // 4 bytes: epoch seconds, most significant first.
+#define TIME_TEXT_SIZE      20  // Buffer that holds any of them, with the NUL.
+#define TIME_OK             0   // Results of Parse_Time().
+#define TIME_TOO_SHORT      1   // Fewer characters (or bytes) than the format has.
+#define TIME_BAD_FORMAT     2   // A character that is not where the format has one.
+#define TIME_BAD_VALUE      3   // A field out of range (13/01/16, 02/30/16, 24:00:00).
+
+// Build timestamp, parsed from __DATE__ ("Mmm dd yyyy") and __TIME__
+// ("hh:mm:ss") by the compiler.  The year is 0-99 (2000-2099).
+#define BUILD_YEAR    ((__DATE__[9]-'0')*10 + (__DATE__[10]-'0'))
+#define BUILD_MONTH   _Newton::Month_From_Name(__DATE__)
+#define BUILD_DAY     ((__DATE__[4]==' ' ? 0 : (__DATE__[4]-'0')*10) + (__DATE__[5]-'0'))
+#define BUILD_HOUR    ((__TIME__[0]-'0')*10 + (__TIME__[1]-'0'))
+#define BUILD_MINUTE  ((__TIME__[3]-'0')*10 + (__TIME__[4]-'0'))
+#define BUILD_SECOND  ((__TIME__[6]-'0')*10 + (__TIME__[7]-'0'))
+#define BUILD_EPOCH   _Newton::Date_To_Epoch(BUILD_SECOND, BUILD_MINUTE, BUILD_HOUR, BUILD_DAY, BUILD_MONTH, BUILD_YEAR)
+
+// Data Log Definitions (a circular log of fixed-size records in the EEPROM)
+#define LOG_START        0x1000   // First byte of the log (page aligned).
+#define LOG_END          EEPROM_SIZE
+#define LOG_RECORD_SIZE  16       // Bytes per record (divides EEPROM_PAGE_SIZE).
+#define LOG_DATA_SIZE    6        // Bytes of data per record.
+
+// Config Store Definitions (named settings in the EEPROM)
+#define CONFIG_START      0x0100  // Two banks, each used in turn (page aligned).
+#define CONFIG_END        LOG_START
+#define CONFIG_KEYS       16      // Keys held at once (must be a power of 2).
+#define CONFIG_KEY_SIZE   8       // Longest key (characters).
+#define CONFIG_VALUE_SIZE 32      // Longest value (bytes).
+
+// Instrumentation subsystems (see Get_Stats()).
+#define STATS_EEPROM      0     // Memory_Read(), Memory_Write() ...
+#define STATS_LOG         1     // Begin_Log(), Log_Append() ...
+#define STATS_CONFIG      2     // Begin_Config(), Config_Get() ...
+#define STATS_RTC         3     // Get_Time(), Get_Epoch() ...
+#define STATS_ALARMS      4     // Begin_Alarms(), Service_Alarms() ...
+#define STATS_SUBSYSTEMS  5
+
+/************************************
+ * Fast Pin Access
+ * ---------------
+ * 
+ * digitalWrite() and digitalRead() look the pin's port and bit up in tables
+ * at run time, which takes around 50 cycles.  FastPin<PIN> resolves them
+ * when compiling instead (for the ATmega328P: pins 0-7 are PORTD, 8-13
+ * PORTB and 14-19 (A0-A5) PORTC), so that with a constant pin each access
+ * is a single instruction:
+ *
+ *   FastPin<LED1>::High();
+ *   if(!FastPin<SW1>::Read()) ...
+ *
+ * FastPins<PIN,...> writes several pins at once, one port write for each
+ * port they are on; bit 0 of Values is the first pin:
+ *
+ *   FastPins<LED1,LED2,LED_STATUS>::Write(0x05);   // LED1 and status on.
+ *
+ * Pins must already be set up with pinMode() (or Output()/Input()).
+ */
+template <byte PIN>
+struct FastPin{
+  static_assert(PIN<20,"FastPin: not a pin of the ATmega328P");
+  static constexpr char Port = (PIN<8) ? 'D' : ((PIN<14) ? 'B' : 'C');
+  static constexpr byte Mask = 1<<((PIN<8) ? PIN : ((PIN<14) ? PIN-8 : PIN-14));
+
+  static inline void High(){
+    if(Port=='D') PORTD |= Mask; else if(Port=='B') PORTB |= Mask; else PORTC |= Mask;
+    }
+  static inline void Low(){
+    if(Port=='D') PORTD &= (byte)~Mask; else if(Port=='B') PORTB &= (byte)~Mask; else PORTC &= (byte)~Mask;
+    }
+  static inline void Write(bool Value){
+    if(Value) High(); else Low();
+    }
+  // Writing a 1 to the input register toggles the output.
+  static inline void Toggle(){
+    if(Port=='D') PIND = Mask; else if(Port=='B') PINB = Mask; else PINC = Mask;
+    }
+  static inline bool Read(){
+    return(((Port=='D') ? PIND : ((Port=='B') ? PINB : PINC)) & Mask);
+    }
+  static inline void Output(){
+    if(Port=='D') DDRD |= Mask; else if(Port=='B') DDRB |= Mask; else DDRC |= Mask;
+    }
+  static inline void Input(bool Pullup){
+    if(Port=='D') DDRD &= (byte)~Mask; else if(Port=='B') DDRB &= (byte)~Mask; else DDRC &= (byte)~Mask;
+    Write(Pullup);
+    }
+  };
+
+template <byte... PINS>
+struct FastPins{
+  static constexpr byte Mask(char){ return(0); }
+  static inline byte Bits(char, byte){ return(0); }
+  };
+
+template <byte PIN, byte... MORE>
+struct FastPins<PIN,MORE...>{
+  // Bits of Port used by the pins, and those to set for Values.
+  static constexpr byte Mask(char Port){
+    return(((FastPin<PIN>::Port==Port) ? FastPin<PIN>::Mask : 0) | FastPins<MORE...>::Mask(Port));
+    }
+  static inline byte Bits(char Port, byte Values){
+    return(((FastPin<PIN>::Port==Port && (Values&1)) ? FastPin<PIN>::Mask : 0) |
+           FastPins<MORE...>::Bits(Port,Values>>1));
+    }
+  // Interrupts are held off so that an interrupt changing another pin of
+  // the same port between the read and the write is not undone.
+  static inline void Write(byte Values){
+    Write(Values,0xFF);
+    }
+  // Only the pins whose bits are set in Select are changed.
+  static inline void Write(byte Values, byte Select){
+    byte Status = SREG;
+    cli();
+    if(Mask('D')) PORTD = (PORTD & ~Bits('D',Select)) | Bits('D',Values & Select);
+    if(Mask('B')) PORTB = (PORTB & ~Bits('B',Select)) | Bits('B',Values & Select);
+    if(Mask('C')) PORTC = (PORTC & ~Bits('C',Select)) | Bits('C',Values & Select);
+    SREG = Status;
+    }
+  };
+
 // Macro definitions.
-#define _SW1_ACTIVE      !digitalRead(SW1)
-#define _SW2_ACTIVE      !digitalRead(SW2)
-#define _QUICK_BEEP      tone(SPKR,2000,20)
-#define _LED1_ON         digitalWrite(LED1,HIGH)
-#define _LED1_OFF        digitalWrite(LED1,LOW)
-#define _LED2_ON         digitalWrite(LED2,HIGH)
-#define _LED2_OFF        digitalWrite(LED2,LOW)
-#define _STATUS_ON       digitalWrite(LED_STATUS,HIGH)
-#define _STATUS_OFF      digitalWrite(LED_STATUS,LOW)
+#define _SW1_ACTIVE      !FastPin<SW1>::Read()
+#define _SW2_ACTIVE      !FastPin<SW2>::Read()
+#define _QUICK_BEEP      Newton.Beep(2000,20)
+#define _LED1_ON         FastPin<LED1>::High()
+#define _LED1_OFF        FastPin<LED1>::Low()
+#define _LED2_ON         FastPin<LED2>::High()
+#define _LED2_OFF        FastPin<LED2>::Low()
+#define _STATUS_ON       FastPin<LED_STATUS>::High()
+#define _STATUS_OFF      FastPin<LED_STATUS>::Low()
+
+#ifndef __NO_SPEAKER
+// One step of a sound effect.  Effects are arrays of steps stored in PROGMEM:
+//   const Tone_Step Chirp[] PROGMEM = {{2000,50}, {0,50}, {3000,50}};
+//   Newton.Play_Effect(Chirp,3,1);
+// A step can also sweep to another frequency, so that envelopes of several
+// segments take a step each:
+//   const Tone_Step Siren[] PROGMEM = {{600,400,1200,SWEEP_EXPONENTIAL}, {1200,400,600,SWEEP_EXPONENTIAL}};
+struct Tone_Step{
+  uint16_t Frequency;         // Hz, or 0 for silence.
+  uint16_t Duration;          // mS.
+  uint16_t Sweep_To;          // Hz reached at the end of the step (if Sweep is set).
+  byte Sweep;                 // 0 for a steady tone, SWEEP_LINEAR or SWEEP_EXPONENTIAL.
+  };
+#endif
+
+#ifdef __NEWTON_LOG
+// One record of the data log, as stored in the EEPROM.
+struct Log_Record{
+  uint32_t Sequence;          // Numbered from 1, never reused.
+  uint32_t Time;              // Epoch seconds (see Get_Epoch()).
+  byte Data[LOG_DATA_SIZE];
+  uint16_t CRC;               // CRC-16/CCITT of the bytes above.
+  };
+#endif
+
+#ifdef __NEWTON_STATS
+// Counters of one subsystem.  A call made from inside another library call
+// (Log_Flush() writing the EEPROM, say) is charged to the outer call only.
+struct Newton_Stats{
+  unsigned long Calls;
+  unsigned long Blocked;      // mS spent in calls.
+  unsigned long Worst;        // uS, the longest call.
+  unsigned long Transactions; // I2C transactions.
+  unsigned long Bytes;        // I2C bytes, including the address.
+  unsigned int Naks;          // Includes polls of a busy EEPROM.
+  unsigned int Timeouts;
+  };
+#endif
+
+typedef void (*Timer_Callback)();
+typedef void (*Alarm_Callback)(byte Event);
+typedef void (*Bus_Callback)(byte Handle, bool Ok);
 
 class _Newton{
   private:
@@ -100,8 +408,277 @@ class _Newton{
     byte Decimal_To_BCD(byte Value);
     byte BCD_To_Decimal(byte Value);
     #endif
+
+    #ifndef __NO_RTC
+    // Cached time, advanced locally between reads of the RTC.
+    unsigned long Clock_Epoch;
+    unsigned int Clock_Resync_Interval;   // S between reads of the RTC, 0 if not cached.
+    unsigned int Clock_Age;               // S since the last read of the RTC.
+    unsigned long Clock_Millis;           // millis() at the last second counted.
+    volatile unsigned long Clock_Edges;   // SQW falling edges.
+    unsigned long Clock_Edges_Counted;
+    bool Clock_Sqw;                       // Counting SQW edges rather than millis().
+    bool Clock_Valid;                     // The RTC has been read since Begin_Time_Cache().
+    int Clock_SQW_Pin;
+    unsigned long Clock_Resyncs;
+    long Clock_Drift;
+    bool Read_Clock(byte *Values);
+    bool Sync_Clock(bool Count_Drift);
+    bool Update_Clock();
+    static void Clock_Edge();
+    unsigned long Clock_Edge_Count();
+    #endif
+
+    #ifdef __NEWTON_ALARMS
+    // Alarm table.  Alarm_Order lists the alarms in use, soonest first, so
+    // only the first one needs to be compared with the time.
+    struct Alarm_Entry{
+      unsigned long Time;                 // Next expiry (epoch seconds).
+      unsigned long Period;               // S between expiries, 0 for a single alarm.
+      byte Event;                         // Passed to the handler.
+      bool Used;
+      };
+    Alarm_Entry Alarms[ALARM_COUNT];
+    byte Alarm_Order[ALARM_COUNT];
+    byte Alarm_Active;
+    Alarm_Callback Alarm_Handler;
+    bool Alarm_Persist;
+    unsigned long Alarm_Wait_Start;       // millis() at the last check.
+    unsigned long Alarm_Wait;             // mS until the next check.
+    byte Alarm_Add(unsigned long Time, unsigned long Period, byte Event);
+    void Alarm_Sort();
+    void Alarm_Save(byte Id);
+    #endif
+
+    #ifndef __NO_EEPROM
+    bool Memory_Wait_Ready();
+    #endif
+
+    #ifdef __NEWTON_LOG
+    // Data log.  The record numbered S is kept in slot (S-1) % Log_Capacity,
+    // so from slot 0 the slots hold consecutive numbers up to the newest
+    // record and the end of the log can be found by bisection.  New records
+    // are gathered in Log_Buffer and written a page at a time.
+    unsigned long Log_Start;
+    unsigned int Log_Capacity;            // Records, 0 until Begin_Log().
+    unsigned long Log_Next;               // Number of the next record.
+    Log_Record Log_Buffer[EEPROM_PAGE_SIZE/LOG_RECORD_SIZE];
+    byte Log_Pending;                     // Records in Log_Buffer.
+    bool Log_Slot_Read(unsigned int Slot, Log_Record *Record);
+    bool Log_Load(unsigned long Sequence, Log_Record *Record);
+    #endif
+
+    #ifdef __NEWTON_CONFIG
+    // Config store.  Entries (key length, value length, key, value, CRC)
+    // are appended to the active bank; a change appends a new entry and
+    // Config_Compact() copies the live entries to the other bank.  The CRC
+    // of each entry is seeded with the bank's generation, so entries left
+    // over from earlier generations end the bank when it is read.
+    struct Config_Slot{
+      uint16_t Offset;                    // In the bank; 0 if empty, 1 if removed.
+      uint16_t Hash;
+      byte Length;                        // Bytes in the entry.
+      };
+    Config_Slot Config_Index[CONFIG_KEYS];
+    byte Config_Bank;
+    uint16_t Config_Generation;           // 0 until Begin_Config().
+    uint16_t Config_Used;                 // Bytes written in the active bank.
+    unsigned long Config_Get_Max;         // uS.
+    unsigned long Config_Set_Max;         // uS.
+    unsigned long Config_Address(byte Bank, uint16_t Offset);
+    byte Config_Find(const char *Key, byte Key_Length, byte *Entry);
+    byte Config_Free_Slot(const char *Key, byte Key_Length);
+    bool Config_Read_Entry(byte Slot, byte *Entry);
+    bool Config_Append(byte *Entry, byte Slot);
+    bool Config_Scan();
+    static uint16_t Config_Hash(const char *Key, byte Length);
+    #endif
+
+    #if !defined(__NO_RTC) || !defined(__NO_EEPROM)
+    #ifdef __NEWTON_ASYNC_BUS
+    // Queue of asynchronous transactions.  Bus_Order lists the pending ones,
+    // oldest first; Service_Bus() advances the first by one bus transaction.
+    struct Bus_Transfer{
+      byte *Data;                         // Caller's buffer.
+      unsigned int Address;               // EEPROM address of the next byte.
+      unsigned int Remaining;             // Bytes left to transfer.
+      Bus_Callback Callback;
+      unsigned long Poll_Start;           // millis() at the last EEPROM write.
+      byte Type;                          // BUS_EEPROM_READ, BUS_EEPROM_WRITE, BUS_RTC_READ.
+      byte Phase;                         // BUS_ADDRESS, BUS_TRANSFER, BUS_POLL.
+      byte Status;                        // BUS_UNUSED ... BUS_FAILED.
+      };
+    Bus_Transfer Bus_Queue[BUS_QUEUE_SIZE];
+    byte Bus_Order[BUS_QUEUE_SIZE];
+    byte Bus_Head;
+    byte Bus_Tail;
+    byte Bus_Submit(byte Type, byte *Data, unsigned int Length, unsigned int Address, Bus_Callback Callback);
+    void Bus_Drain();
+    #else
+    void Bus_Drain(){}                    // Nothing is ever queued.
+    #endif
+    #endif
+
+    #ifndef __NO_TIMERS
+    // Software timer wheel, advanced by the Timer1 tick.  Each wheel slot
+    // heads a doubly linked list of the timers due in that slot.
+    struct Soft_Timer{
+      Timer_Callback Callback;            // NULL if the timer is free.
+      unsigned long Period;               // Ticks.
+      unsigned long Rounds;               // Turns of the wheel left before expiry.
+      byte Flags;                         // TIMER_PERIODIC, TIMER_IN_ISR.
+      volatile byte Pending;              // Expiries not yet passed to Service_Timers().
+      byte Slot;                          // TIMER_NONE if not scheduled.
+      byte Next;
+      byte Prev;
+      };
+    Soft_Timer Timers[TIMER_COUNT];
+    byte Timer_Wheel[TIMER_WHEEL_SLOTS];
+    byte Timer_Position;
+    unsigned int Timer_Rate;              // Hz, 0 until Begin_Timers().
+    unsigned int Timer1_Preload;
+    unsigned long Timer_Ticks(unsigned long Period);
+    void Timer_Insert(byte Id, unsigned long Ticks);
+    void Timer_Remove(byte Id);
+    #endif
+
+    #ifndef __NO_LEDS
+    // Pattern engine state, one channel per LED (LED1, LED2, LED_STATUS).
+    struct LED_Channel{
+      const unsigned int *Steps;          // On/off durations (mS), starting with on. NULL if idle.
+      byte Count;                         // Number of steps.
+      byte Index;                         // Step being shown.
+      bool Repeat;
+      unsigned int Remaining;             // Ticks left in the current step.
+      unsigned int Blink[2];              // Storage for LED_Blink() patterns.
+      unsigned int Level;                 // Brightness (0-255) in 8.8 fixed point.
+      unsigned int Step;                  // Change of Level per tick, 0 if not fading.
+      byte Target;                        // Brightness being faded to.
+      bool Breathe;                       // Fade back and forth between 0 and 255.
+      };
+    LED_Channel LED_Channels[3];
+    volatile byte LED_PWM;                // Channels dimmed by the software PWM (bit 0 = LED1).
+    byte LED_Planes[PWM_BITS];            // Channels lit during the segment of each duty bit.
+    byte LED_Segment;                     // PWM segment shown next.
+    byte LED_Index(byte Led);
+    void LED_Start(byte Index, const unsigned int *Steps, byte Count, bool Repeat);
+    void LED_Update(byte Index);
+    void LED_Write(byte Index, bool Value);
+    void LED_Fade_Start(byte Index, byte Level, unsigned int Time, bool Breathe);
+    void LED_Dim(byte Index);
+    #endif
+
+    #ifndef __NO_SPEAKER
+    // Sound effect player state, advanced by the Timer2 interrupt.
+    struct Tone_Effect{
+      const Tone_Step *Steps;             // In PROGMEM.
+      byte Count;
+      byte Repeat;                        // Times to play, 0 for ever.
+      };
+    Tone_Effect Tone_Queue[TONE_QUEUE_SIZE];
+    volatile byte Tone_Head;              // Written only by Play_Effect().
+    volatile byte Tone_Tail;              // Written by the interrupt (and Silence()).
+    Tone_Effect Tone_Playing;             // Steps is NULL when no effect is playing.
+    byte Tone_Index;                      // Step being played.
+    volatile bool Tone_Active;            // Timer2 is running (an effect or a tone).
+    bool Tone_Sounding;                   // The pin toggles (false during a rest).
+    byte Tone_Sweep;                      // Sweep of the current step, 0 if steady.
+    unsigned long Tone_Left;              // CPU cycles left in the step, 0 for ever.
+    unsigned long Tone_Interval;          // CPU cycles between interrupts (half a period).
+    unsigned long Tone_Value;             // Sweeps: Hz (16.16) or pitch x 256 (see Tone_Log2()).
+    long Tone_Slope;                      // Added to Tone_Value every SWEEP_UPDATE cycles.
+    long Tone_Wait;                       // CPU cycles to the next update.
+    void Tone_Play(int From, int To, int Duration, byte Sweep);
+    void Tone_Start(unsigned int From, unsigned int To, unsigned int Duration, byte Sweep);
+    void Tone_Next();
+    void Tone_Stop();
+    void Tone_Set_Interval(unsigned long Cycles);
+    #endif
+
+    #ifndef __NO_SWITCHES
+    // Debouncer state, updated from the system tick.
+    volatile byte Switch_Stable;          // Debounced state (bit 0: SW1, bit 1: SW2).
+    byte Switch_Count[2];                 // Ticks the input has differed from the stable state.
+    unsigned int Switch_Held[2];          // Ticks the switch has been held down.
+    volatile byte Switch_Queue[SWITCH_QUEUE_SIZE];
+    volatile byte Switch_Head;            // Written only by the tick.
+    volatile byte Switch_Tail;            // Written only by Get_Switch_Event().
+    void Debounce_Switch(byte Index, bool Active);
+    void Queue_Switch_Event(byte Index, byte Event);
+    #endif
+
+    #ifndef __NO_SLEEP
+    bool Tick_Busy();
+    bool Wake_Pins(bool Enable);
+    #endif
   public:
     _Newton();
+
+    // Called every SYSTEM_TICK_CYCLES from the Timer0 compare-A interrupt.
+    void Tick();
+
+    // Calendar conversions (year 0-99 is 2000-2099, day of week 1-7 from
+    // Sunday).  Date_To_Epoch() can be evaluated by the compiler.
+    static constexpr unsigned long Date_To_Epoch(byte second, byte minute, byte hour,
+                                                 byte dayOfMonth, byte month, byte year){
+      return(((Days_Before_Year(year)+Days_Before_Month(month,year)+dayOfMonth-1)*24UL
+              +hour)*3600UL+minute*60U+second);
+      }
+    static void Epoch_To_Date(unsigned long Epoch, byte *second, byte *minute, byte *hour,
+                              byte *dayOfWeek, byte *dayOfMonth, byte *month, byte *year);
+    static constexpr byte Day_Of_Week(unsigned long Epoch){
+      return((Epoch/SECONDS_PER_DAY+6)%7+1);    // 2000-01-01 was a Saturday.
+      }
+    static constexpr unsigned int Days_Before_Year(byte year){
+      return(year*365U+(year+3)/4);
+      }
+    static constexpr unsigned int Days_Before_Month(byte month, byte year){
+      return((367U*month-362)/12-(month>2 ? ((year%4) ? 2 : 1) : 0));
+      }
+    static constexpr byte Month_From_Name(const char *Name){
+      return(Name[0]=='J' ? (Name[1]=='a' ? 1 : (Name[2]=='n' ? 6 : 7)) :
+             Name[0]=='F' ? 2 :
+             Name[0]=='M' ? (Name[2]=='r' ? 3 : 5) :
+             Name[0]=='A' ? (Name[1]=='p' ? 4 : 8) :
+             Name[0]=='S' ? 9 :
+             Name[0]=='O' ? 10 :
+             Name[0]=='N' ? 11 : 12);
+      }
+
+    // Fixed-format time text (see TIME_FORMAT_*), without printf or scanf.
+    static byte Format_Time(unsigned long Epoch, char *Text, size_t Size, byte Format = TIME_FORMAT_US);
+    static byte Parse_Time(const char *Text, size_t Length, byte Format, unsigned long *Epoch);
+
+    #ifndef __NO_TIMERS
+    // Software Timers
+    bool Begin_Timers(unsigned int Tick_Rate);
+    byte Timer_Start(Timer_Callback Callback, unsigned long Period, byte Mode);
+    void Timer_Cancel(byte Id);
+    void Timer_Reschedule(byte Id, unsigned long Period);
+    void Service_Timers();
+    void Set_Alarm_Time();
+    byte Set_Alarm_Time(Timer_Callback Function, unsigned long Period);
+    void Timer_Tick();                    // Called from the Timer1 interrupt.
+    #endif
+
+    #ifdef __NEWTON_RADIO
+    // Packet radio (ASK/OOK transmitter on RF_TX, receiver on RF_RX)
+    bool Begin_Radio(unsigned int Bit_Rate = RADIO_BIT_RATE);
+    void End_Radio();
+    bool Radio_Send(const void *Data, byte Length);
+    byte Radio_Receive(void *Data, byte Size);
+    bool Radio_Busy();
+    void Get_Radio_Stats(unsigned long *Sent, unsigned long *Received, unsigned long *Errors,
+                         unsigned long *Overruns);
+    #endif
+
+    #ifndef __NO_SLEEP
+    // Low-power sleep
+    byte Sleep_Until_Event(byte Mode = SLEEP_IDLE);
+    void Get_Sleep_Stats(unsigned long *Awake, unsigned long *Asleep, unsigned long *Wakes);
+    void Reset_Sleep_Stats();
+    void Pin_Change();                    // Called from the pin-change interrupts.
+    #endif
   
     #ifndef __NO_LEDS
     // Indicators 
@@ -109,12 +686,26 @@ class _Newton{
     void LED2_Indicator(bool Value);
     void Status_Indicator(bool Value);
     void Flash_Status_LED();
+    void LED_Indicators(bool Led1, bool Led2, bool Status);
+
+    // Background patterns (Led is LED1, LED2 or LED_STATUS)
+    void LED_Blink(byte Led, unsigned int On_Time, unsigned int Off_Time);
+    void LED_Heartbeat(byte Led);
+    void LED_Pattern(byte Led, const unsigned int *Steps, byte Count, bool Repeat);
+    void LED_Stop(byte Led);
+
+    // Dimming (Level is 0-255, corrected for the eye's response)
+    void LED_Brightness(byte Led, byte Level);
+    void LED_Fade(byte Led, byte Level, unsigned int Time);
+    void LED_Breathe(byte Led, unsigned int Period);
+    void LED_PWM_Tick();                  // Called from the Timer0 compare-B interrupt.
     #endif
 
     #ifndef __NO_SWITCHES
     // Switches
     bool SW1_Status();
     bool SW2_Status();
+    bool Get_Switch_Event(byte *Switch, byte *Event);
     #endif
 
     #ifndef __NO_SPEAKER
@@ -123,10 +714,14 @@ class _Newton{
     void Beep(int Duration);
     void Beep(int Frequency,int Duration);
     void Sound_Effect(int Effect);
+    bool Play_Effect(const Tone_Step *Steps, byte Count, byte Repeat);
+    bool Sound_Playing();
     
     void Tone(int Frequency);
     void Tone(int Frequency,int Duration);
+    void Sweep(int From, int To, int Duration, byte Shape = SWEEP_EXPONENTIAL);
     void Silence();
+    void Speaker_Tick();                  // Called from the Timer2 compare-A interrupt.
     #endif
 
     #ifndef __NO_RTC
@@ -138,26 +733,598 @@ class _Newton{
                    byte dayOfMonth,       // 1-28/29/30/31
                    byte month,            // 1-12
                    byte year);            // 0-99
-    void Get_Current_Time_Values( byte *second,  // 0-59
+    bool Get_Current_Time_Values( byte *second,  // 0-59
                    byte *minute,          // 0-59
                    byte *hour,            // 1-23
                    byte *dayOfWeek,       // 1-7
                    byte *dayOfMonth,      // 1-28/29/30/31
                    byte *month,           // 1-12
                    byte *year);           // 0-99
-    void Set_Time(char *Time_String);
+    bool Set_Time(const char *Time_String, byte Format = TIME_FORMAT_US);
     void Get_Time(char *Time_String);
+    bool Get_Time(char *Time_String, size_t Size, byte Format = TIME_FORMAT_US);
     void Initialize_Time_Date();
-    void Set_Alarm_Time();
-    void *Alarm_Function;
+    unsigned long Get_Epoch();
+    void Set_Epoch(unsigned long Epoch);
+    void Begin_Time_Cache(unsigned int Resync_Interval, int SQW_Pin = -1);
+    void Get_Time_Cache_Stats(unsigned long *Resyncs, long *Drift);
+
+    // Battery-backed RAM of the RTC (Address 0 to NVRAM_SIZE-1)
+    bool NVRAM_Read(byte *Data, byte Length, byte Address);
+    bool NVRAM_Write(const byte *Data, byte Length, byte Address);
+    template <typename T> bool NVRAM_Get(T &Value, byte Address){
+      static_assert(sizeof(T)<=NVRAM_SIZE, "too large for the NVRAM");
+      return(NVRAM_Read((byte *)&Value,sizeof(T),Address));
+      }
+    template <typename T> bool NVRAM_Put(const T &Value, byte Address){
+      static_assert(sizeof(T)<=NVRAM_SIZE, "too large for the NVRAM");
+      return(NVRAM_Write((const byte *)&Value,sizeof(T),Address));
+      }
+    #endif
+
+    #ifdef __NEWTON_ALARMS
+    // Alarm Scheduler (Service_Alarms() calls Handler from loop())
+    void Begin_Alarms(Alarm_Callback Handler, bool Persist);
+    byte Alarm_At(unsigned long Epoch, byte Event);
+    byte Alarm_Daily(byte Hour, byte Minute, byte Event);
+    byte Alarm_Weekly(byte DayOfWeek, byte Hour, byte Minute, byte Event);
+    byte Alarm_Every(unsigned int Minutes, byte Event);
+    void Alarm_Cancel(byte Id);
+    void Service_Alarms();
     #endif
 
     #ifndef __NO_EEPROM
     // EEPROM Memory Commands
     byte Memory_Read(unsigned long Address);
     void Memory_Write(byte Data, unsigned long Address);
+    bool Memory_Read_Block(byte *Data, size_t Length, unsigned long Address);
+    bool Memory_Write_Block(const byte *Data, size_t Length, unsigned long Address);
+
+    // Load or store any variable or structure in a single call, for example:
+    //   Settings_t Settings;
+    //   if(!Newton.Memory_Get(Settings,0)) ...
+    template <typename T> bool Memory_Get(T &Value, unsigned long Address){
+      return(Memory_Read_Block((byte *)&Value,sizeof(T),Address));
+      }
+    template <typename T> bool Memory_Put(const T &Value, unsigned long Address){
+      return(Memory_Write_Block((const byte *)&Value,sizeof(T),Address));
+      }
+    static uint16_t Memory_CRC(const byte *Data, byte Length, uint16_t CRC = 0xFFFF);
+    #endif
+
+    #ifdef __NEWTON_LOG
+    // Data Log
+    bool Begin_Log(unsigned long Start = LOG_START, unsigned long End = LOG_END);
+    bool Log_Append(const void *Data, byte Length);
+    bool Log_Append(unsigned long Time, const void *Data, byte Length);
+    bool Log_Flush();
+    unsigned long Log_Count();
+    bool Log_Read(unsigned long Index, Log_Record *Record);
+    unsigned long Log_Find(unsigned long Time);
+    #endif
+
+    #ifdef __NEWTON_CONFIG
+    // Config Store
+    bool Begin_Config();
+    bool Config_Get(const char *Key, void *Value, byte Size);
+    bool Config_Set(const char *Key, const void *Value, byte Length);
+    bool Config_Remove(const char *Key);
+    bool Config_Compact();
+    unsigned int Config_Free();
+    void Get_Config_Stats(unsigned long *Get_Max, unsigned long *Set_Max);
+    template <typename T> bool Config_Get(const char *Key, T &Value){
+      return(Config_Get(Key,&Value,sizeof(T)));
+      }
+    template <typename T> bool Config_Put(const char *Key, const T &Value){
+      return(Config_Set(Key,&Value,sizeof(T)));
+      }
+    #endif
+
+    #if !defined(__NO_RTC) || !defined(__NO_EEPROM)
+    // I2C bus speed and recovery
+    bool Set_Bus_Clock(unsigned long Clock);
+    bool Bus_Recover();
+    unsigned int Get_Bus_Timeouts();
+    #endif
+
+    #ifdef __NEWTON_ASYNC_BUS
+    // Asynchronous I2C (Service_Bus() must be called from loop(); buffers
+    // must be kept until the transaction is done)
+    #ifndef __NO_EEPROM
+    byte Memory_Read_Async(byte *Data, unsigned int Length, unsigned long Address, Bus_Callback Done = NULL);
+    byte Memory_Write_Async(const byte *Data, unsigned int Length, unsigned long Address, Bus_Callback Done = NULL);
+    #endif
+    #ifndef __NO_RTC
+    byte Get_Current_Time_Values_Async(byte *Values, Bus_Callback Done = NULL);
+    #endif
+    byte Bus_Status(byte Handle);
+    bool Service_Bus();
+    #endif
+
+    #ifdef __NEWTON_STATS
+    // Instrumentation (Subsystem is STATS_EEPROM ... STATS_ALARMS)
+    bool Get_Stats(byte Subsystem, Newton_Stats *Stats);
+    void Reset_Stats();
+    void Print_Stats();
     #endif
     };
 
-extern _Newton Newton;
+/*
+ * The Newton object's symbol is named after the features it was built with
+ * (RTC, EEPROM, switches, LEDs, speaker, sleep, timers, log, config,
+ * alarms, asynchronous bus, radio; 1 if included), so that files built with
+ * different features cannot be linked
+ * together.  Only the name the linker sees changes: the object is still
+ * Newton in C++, and the check costs no code or RAM.
+ */
+#ifdef __NO_RTC
+#define NEWTON_HAS_RTC       0
+#else
+#define NEWTON_HAS_RTC       1
+#endif
+#ifdef __NO_EEPROM
+#define NEWTON_HAS_EEPROM    0
+#else
+#define NEWTON_HAS_EEPROM    1
+#endif
+#ifdef __NO_SWITCHES
+#define NEWTON_HAS_SWITCHES  0
+#else
+#define NEWTON_HAS_SWITCHES  1
+#endif
+#ifdef __NO_LEDS
+#define NEWTON_HAS_LEDS      0
+#else
+#define NEWTON_HAS_LEDS      1
+#endif
+#ifdef __NO_SPEAKER
+#define NEWTON_HAS_SPEAKER   0
+#else
+#define NEWTON_HAS_SPEAKER   1
+#endif
+#ifdef __NO_SLEEP
+#define NEWTON_HAS_SLEEP     0
+#else
+#define NEWTON_HAS_SLEEP     1
+#endif
+#ifdef __NO_TIMERS
+#define NEWTON_HAS_TIMERS    0
+#else
+#define NEWTON_HAS_TIMERS    1
+#endif
+#ifdef __NEWTON_LOG
+#define NEWTON_HAS_LOG       1
+#else
+#define NEWTON_HAS_LOG       0
+#endif
+#ifdef __NEWTON_CONFIG
+#define NEWTON_HAS_CONFIG    1
+#else
+#define NEWTON_HAS_CONFIG    0
+#endif
+#ifdef __NEWTON_ALARMS
+#define NEWTON_HAS_ALARMS    1
+#else
+#define NEWTON_HAS_ALARMS    0
+#endif
+#ifdef __NEWTON_ASYNC_BUS
+#define NEWTON_HAS_ASYNC_BUS 1
+#else
+#define NEWTON_HAS_ASYNC_BUS 0
+#endif
+#ifdef __NEWTON_RADIO
+#define NEWTON_HAS_RADIO     1
+#else
+#define NEWTON_HAS_RADIO     0
+#endif
+#define NEWTON_TEXT(X)                   #X
+#define NEWTON_STRING(X)                 NEWTON_TEXT(X)
+#define NEWTON_NAME(R,E,W,L,S,P,T,G,C,A,B,D)     Newton_Features_##R##E##W##L##S##P##T##G##C##A##B##D
+#define NEWTON_FEATURES(R,E,W,L,S,P,T,G,C,A,B,D) NEWTON_NAME(R,E,W,L,S,P,T,G,C,A,B,D)
+#define NEWTON_SYMBOL NEWTON_STRING(__USER_LABEL_PREFIX__) \
+                      NEWTON_STRING(NEWTON_FEATURES(NEWTON_HAS_RTC,NEWTON_HAS_EEPROM,NEWTON_HAS_SWITCHES,NEWTON_HAS_LEDS, \
+                                                    NEWTON_HAS_SPEAKER,NEWTON_HAS_SLEEP,NEWTON_HAS_TIMERS,NEWTON_HAS_LOG, \
+                                                    NEWTON_HAS_CONFIG,NEWTON_HAS_ALARMS,NEWTON_HAS_ASYNC_BUS,NEWTON_HAS_RADIO))
+
+extern _Newton Newton asm(NEWTON_SYMBOL);
+
+#ifndef __NO_EEPROM
+/************************************
+ * EEPROM Page Cache
+ * -----------------
+ * 
+ * An optional write-back cache of whole EEPROM pages held in RAM.  Reads of
+ * a cached page cost no bus traffic, writes are merged in RAM and only bytes
+ * whose value actually changes mark the page dirty.  Dirty pages are written
+ * back (as one block) when they are evicted to make room for another page or
+ * when Flush() is called.  This saves both time and EEPROM write cycles for
+ * frequently updated values such as counters and settings.
+ *
+ * The number of cached pages is a template parameter; each page costs
+ * EEPROM_PAGE_SIZE+6 bytes of RAM.  For example:
+ *
+ *   Memory_Cache<2> Cache;
+ *   byte Count = Cache.Read(0);
+ *   Cache.Write(Count+1,0);
+ *   Cache.Flush();            // Before power may be lost.
+ *
+ * Data written through the cache is not in the EEPROM until it has been
+ * flushed, and data written directly with Newton.Memory_Write() is not seen
+ * by the cache until Invalidate() is called.  Hits, Misses, Flushes (page
+ * write-backs) and Unchanged (bytes not rewritten because they already held
+ * the value) can be used to tune the number of pages.
+ */
+template <byte PAGES = 2>
+class Memory_Cache{
+  private:
+    struct Line{
+      unsigned int  Page;           // EEPROM page number, or NO_PAGE.
+      byte          Dirty_First;    // Range of modified bytes, valid if
+      byte          Dirty_Last;     // Dirty_First<=Dirty_Last.
+      uint16_t      Used;           // Access stamp for LRU replacement.
+      byte          Data[EEPROM_PAGE_SIZE];
+      };
+    static const unsigned int NO_PAGE = 0xFFFF;
+    Line Lines[PAGES];
+    uint16_t Clock;                 // 16 bits, as unsigned int is on AVR.
+
+    // Returns the next access stamp.  Before the clock wraps the lines are
+    // renumbered 1 to PAGES in the order they were used, so that the least
+    // recently used line is still the one with the smallest stamp.
+    uint16_t Stamp(){
+      if(Clock==0xFFFF)
+        {
+        bool Done[PAGES] = {};
+        for(Clock=0;Clock<PAGES;)
+          {
+          byte Oldest = PAGES;
+          for(byte i=0;i<PAGES;i++)
+            if(!Done[i] && (Oldest==PAGES || Lines[i].Used<Lines[Oldest].Used)) Oldest = i;
+          Done[Oldest] = true;
+          Lines[Oldest].Used = ++Clock;
+          }
+        }
+      return(++Clock);
+      }
+
+    bool Write_Back(Line &L){
+      if(L.Dirty_First>L.Dirty_Last) return(true);
+      Flushes++;
+      if(!Newton.Memory_Write_Block(L.Data+L.Dirty_First, L.Dirty_Last-L.Dirty_First+1,
+                                    (unsigned long)L.Page*EEPROM_PAGE_SIZE+L.Dirty_First))
+        return(false);
+      L.Dirty_First = EEPROM_PAGE_SIZE;
+      L.Dirty_Last = 0;
+      return(true);
+      }
+
+    // Returns the line holding the page containing Address, loading it (and
+    // evicting the least recently used line) if necessary.  NULL on error.
+    Line *Fetch(unsigned long Address){
+      unsigned int Page = Address/EEPROM_PAGE_SIZE;
+      Line *Victim = &Lines[0];
+      for(byte i=0;i<PAGES;i++)
+        {
+        if(Lines[i].Page==Page)
+          {
+          Hits++;
+          Lines[i].Used = Stamp();
+          return(&Lines[i]);
+          }
+        if(Lines[i].Page==NO_PAGE || (Victim->Page!=NO_PAGE && Lines[i].Used<Victim->Used))
+          Victim = &Lines[i];
+        }
+      Misses++;
+      if(Victim->Page!=NO_PAGE && !Write_Back(*Victim)) return(NULL);
+      Victim->Page = NO_PAGE;
+      if(!Newton.Memory_Read_Block(Victim->Data,EEPROM_PAGE_SIZE,(unsigned long)Page*EEPROM_PAGE_SIZE))
+        return(NULL);
+      Victim->Page = Page;
+      Victim->Used = Stamp();
+      return(Victim);
+      }
+
+  public:
+    unsigned long Hits;
+    unsigned long Misses;
+    unsigned long Flushes;
+    unsigned long Unchanged;
+
+    Memory_Cache(){
+      Invalidate();
+      Hits = Misses = Flushes = Unchanged = 0;
+      }
+
+    // Discards every cached page without writing anything back.
+    void Invalidate(){
+      for(byte i=0;i<PAGES;i++)
+        {
+        Lines[i].Page = NO_PAGE;
+        Lines[i].Used = 0;
+        Lines[i].Dirty_First = EEPROM_PAGE_SIZE;
+        Lines[i].Dirty_Last = 0;
+        }
+      Clock = 0;
+      }
+
+    // Writes every dirty page back to the EEPROM.
+    bool Flush(){
+      bool Ok = true;
+      for(byte i=0;i<PAGES;i++)
+        if(Lines[i].Page!=NO_PAGE && !Write_Back(Lines[i])) Ok = false;
+      return(Ok);
+      }
+
+    bool Read_Block(byte *Data, size_t Length, unsigned long Address){
+      while(Length>0)
+        {
+        Line *L = Fetch(Address);
+        if(!L) return(false);
+        byte Offset = Address%EEPROM_PAGE_SIZE;
+        size_t Count = EEPROM_PAGE_SIZE-Offset;
+        if(Count>Length) Count = Length;
+        memcpy(Data,L->Data+Offset,Count);
+        Data += Count; Address += Count; Length -= Count;
+        }
+      return(true);
+      }
+
+    bool Write_Block(const byte *Data, size_t Length, unsigned long Address){
+      while(Length>0)
+        {
+        Line *L = Fetch(Address);
+        if(!L) return(false);
+        byte Offset = Address%EEPROM_PAGE_SIZE;
+        size_t Count = EEPROM_PAGE_SIZE-Offset;
+        if(Count>Length) Count = Length;
+        for(byte i=Offset;i<Offset+Count;i++,Data++)
+          {
+          if(L->Data[i]==*Data) { Unchanged++; continue; }
+          L->Data[i] = *Data;
+          if(i<L->Dirty_First) L->Dirty_First = i;
+          if(i>L->Dirty_Last) L->Dirty_Last = i;
+          }
+        Address += Count; Length -= Count;
+        }
+      return(true);
+      }
+
+    // Returns 0xFF (the erased value) if the page could not be loaded.
+    byte Read(unsigned long Address){
+      byte Data;
+      if(!Read_Block(&Data,1,Address)) Data = 0xFF;
+      return(Data);
+      }
+
+    bool Write(byte Data, unsigned long Address){
+      return(Write_Block(&Data,1,Address));
+      }
+
+    template <typename T> bool Get(T &Value, unsigned long Address){
+      return(Read_Block((byte *)&Value,sizeof(T),Address));
+      }
+    template <typename T> bool Put(const T &Value, unsigned long Address){
+      return(Write_Block((const byte *)&Value,sizeof(T),Address));
+      }
+  };
+
+#ifdef __NEWTON_ASYNC_BUS
+/************************************
+ * EEPROM Bulk Transfer
+ * --------------------
+ * 
+ * Copies the EEPROM to and from a host computer over a serial port in
+ * binary frames, for getting logs off a unit or loading a configuration
+ * image.  Each frame is
+ *
+ *   TRANSFER_SYNC, type, address (2 bytes), length, data, CRC (2 bytes)
+ *
+ * with the address and CRC high byte first.  The CRC is Memory_CRC() of the
+ * type, address, length and data, and the data is at most TRANSFER_CHUNK
+ * bytes.  The host sends:
+ *
+ *   TRANSFER_READ    data = byte count (2 bytes): the board answers with
+ *                    TRANSFER_DATA frames covering the range, or a
+ *                    TRANSFER_NAK at the address the EEPROM failed.  A new
+ *                    read replaces one in progress, so a frame lost or
+ *                    damaged is asked for again from its address.
+ *   TRANSFER_WRITE   data to write: answered by TRANSFER_ACK (address
+ *                    echoed) once the board has room for the next frame, or
+ *                    TRANSFER_NAK if the frame was damaged, so the host
+ *                    sends one frame at a time.
+ *   TRANSFER_FINISH  answered once every write is done: TRANSFER_ACK, or
+ *                    TRANSFER_NAK if any of them failed (also if the
+ *                    FINISH was damaged, so it is worth sending again).
+ *
+ * The EEPROM is read and written through the asynchronous queue (see
+ * Service_Bus()) into two buffers, so one frame goes out over the serial
+ * port (as fast as its buffer allows, without blocking) while the next is
+ * read from or written to the EEPROM.  Writes use whole pages.  For example:
+ *
+ *   Memory_Transfer Transfer(Serial);
+ *   void setup() { Serial.begin(500000); }
+ *   void loop()  { Transfer.Service(); ... }
+ *
+ * extras/newton_transfer.py is the host side.  Above 500000 baud a frame can
+ * arrive faster than one EEPROM transaction (which blocks) and be lost.
+ * Costs 2*TRANSFER_CHUNK+67 bytes of RAM.
+ */
+class Memory_Transfer{
+  private:
+    Stream &Port;
+    byte Data[2][TRANSFER_CHUNK];
+    unsigned int Address[2];
+    byte Length[2];
+    byte State[2];                  // Buffer states (TRANSFER_FREE, ...).
+    byte Handle[2];                 // Bus transaction of each buffer.
+    byte Next_Read;                 // Buffer to read into next,
+    byte Next_Send;                 // to send next.
+    unsigned int Read_Address;      // Rest of the range being read.
+    unsigned int Read_Left;
+    unsigned int Request_Address;   // A read waiting to replace the last.
+    unsigned int Request_Left;
+    bool Request;
+    byte Reply;                     // Type of an ACK or NAK to send, or 0,
+    unsigned int Reply_Address;     // and its address.
+    byte Ack_Buffer;                // Buffer whose ACK waits for room, or 2.
+    bool Finish;                    // A FINISH is waiting for the writes,
+    bool Finished;                  // has been answered.
+    bool Write_Failed;
+    byte Tx_Header[5];              // Frame being sent, with data from
+    byte Tx_Buffer;                 // Data[Tx_Buffer] (2 for none).
+    byte Tx_Position;
+    byte Tx_Length;                 // Bytes in the frame, 0 if none.
+    uint16_t Tx_CRC;
+    byte Rx_Header[5];              // Frame being received (the CRC's
+    byte Rx_Buffer;                 // high byte in [0]) into Data[Rx_Buffer]
+    byte Rx_Position;               // (2 for none, the last 2 bytes of data
+    uint16_t Rx_Value;              // are kept in Rx_Value).
+    uint16_t Rx_CRC;
+    unsigned long Rx_Start;
+
+    void Receive(byte Value);
+    void Receive_Reset();
+    void Accept();
+    void Run_Bus();
+    bool Next_Frame();
+    void Start_Frame(byte Type, unsigned int Frame_Address, byte Buffer, byte Count);
+    void Send();
+
+  public:
+    unsigned long Frames_Sent;
+    unsigned long Frames_Received;
+    unsigned long Errors;           // Frames received damaged.
+
+    Memory_Transfer(Stream &Serial_Port);
+    bool Service();
+  };
+#endif
+#endif
+
+#if !defined(__NO_RTC) && !defined(__NO_EEPROM)
+/************************************
+ * NVRAM Counters
+ * --------------
+ * 
+ * Counters that change often (restarts, events, run time) kept in the RTC's
+ * battery-backed RAM, where a change is one short I2C write with no write
+ * cycle to wait for and no wear, and copied to the EEPROM (checkpointed) on
+ * a schedule in case the RTC's battery fails.  Each counter takes
+ * NVRAM_SLOT_SIZE bytes, its value followed by its Memory_CRC(), in both
+ * memories, so one damaged by a lost battery or a write cut short is
+ * recognised and reloaded from the checkpoint.  For example:
+ *
+ *   NVRAM_Counters<2> Counters(0,0x0080);   // NVRAM and EEPROM addresses.
+ *   void setup() { Counters.Begin(3600); Counters.Add(0); }
+ *   void loop()  { Counters.Service(); ... }
+ *
+ * Begin() loads the counters (from the NVRAM where it is intact, otherwise
+ * the last checkpoint, otherwise 0) and Service() checkpoints them, when
+ * any has changed, every Checkpoint_Interval seconds.  Costs 4*COUNT+19
+ * bytes of RAM.
+ */
+template <byte COUNT>
+class NVRAM_Counters{
+  private:
+    static_assert(COUNT>0 && COUNT*NVRAM_SLOT_SIZE<=NVRAM_SIZE, "counters do not fit in the NVRAM");
+    byte NVRAM_Address;
+    unsigned long EEPROM_Address;
+    unsigned long Interval;         // mS between checkpoints, 0 for none.
+    unsigned long Last;             // millis() at the last checkpoint.
+    bool Changed;                   // Since the last checkpoint.
+    uint32_t Values[COUNT];
+
+    static void Pack(uint32_t Value, byte *Slot){
+      memcpy(Slot,&Value,4);
+      uint16_t CRC = _Newton::Memory_CRC(Slot,4);
+      Slot[4] = CRC>>8;
+      Slot[5] = CRC;
+      }
+
+    static bool Unpack(const byte *Slot, uint32_t *Value){
+      uint16_t CRC = _Newton::Memory_CRC(Slot,4);
+      if(Slot[4]!=(byte)(CRC>>8) || Slot[5]!=(byte)CRC) return(false);
+      memcpy(Value,Slot,4);
+      return(true);
+      }
+
+  public:
+    unsigned long Checkpoints;      // EEPROM writes made.
+    byte Recovered;                 // Counters Begin() took from the EEPROM.
+
+    NVRAM_Counters(byte NVRAM_Start, unsigned long EEPROM_Start){
+      NVRAM_Address = NVRAM_Start;
+      EEPROM_Address = EEPROM_Start;
+      Interval = 0;
+      Changed = false;
+      Checkpoints = 0;
+      Recovered = 0;
+      memset(Values,0,sizeof(Values));
+      }
+
+    // Loads the counters and writes back any the NVRAM had lost.  Returns
+    // false if the NVRAM cannot be read or written.
+    bool Begin(unsigned int Checkpoint_Interval){
+      byte Saved[COUNT*NVRAM_SLOT_SIZE], Checkpoint[COUNT*NVRAM_SLOT_SIZE];
+      Interval = Checkpoint_Interval*1000UL;
+      Last = millis();
+      Changed = false;
+      Recovered = 0;
+      if(!Newton.NVRAM_Read(Saved,sizeof(Saved),NVRAM_Address)) return(false);
+      bool Read = false;
+      for(byte i=0;i<COUNT;i++)
+        {
+        if(Unpack(Saved+i*NVRAM_SLOT_SIZE,&Values[i])) continue;
+        if(!Read && !Newton.Memory_Read_Block(Checkpoint,sizeof(Checkpoint),EEPROM_Address))
+          memset(Checkpoint,0xFF,sizeof(Checkpoint));
+        Read = true;
+        if(!Unpack(Checkpoint+i*NVRAM_SLOT_SIZE,&Values[i])) Values[i] = 0;
+        Pack(Values[i],Saved+i*NVRAM_SLOT_SIZE);
+        Recovered++;
+        }
+      return(!Read || Newton.NVRAM_Write(Saved,sizeof(Saved),NVRAM_Address));
+      }
+
+    // Returns 0 for a counter out of range.
+    uint32_t Get(byte Index){
+      return(Index<COUNT ? Values[Index] : 0);
+      }
+
+    // Stores a counter in the NVRAM (one transaction of NVRAM_SLOT_SIZE+1
+    // bytes).  Returns false if the index is out of range or the RTC does
+    // not respond; the value is kept in RAM for the next try either way.
+    bool Set(byte Index, uint32_t Value){
+      byte Slot[NVRAM_SLOT_SIZE];
+      if(Index>=COUNT) return(false);
+      Values[Index] = Value;
+      Changed = true;
+      Pack(Value,Slot);
+      return(Newton.NVRAM_Write(Slot,sizeof(Slot),NVRAM_Address+Index*NVRAM_SLOT_SIZE));
+      }
+
+    bool Add(byte Index, uint32_t Amount = 1){
+      return(Set(Index,Get(Index)+Amount));
+      }
+
+    // Writes every counter to the EEPROM now (typically before a planned
+    // power down).
+    bool Checkpoint(){
+      byte Copy[COUNT*NVRAM_SLOT_SIZE];
+      for(byte i=0;i<COUNT;i++)
+        Pack(Values[i],Copy+i*NVRAM_SLOT_SIZE);
+      Last = millis();
+      if(!Newton.Memory_Write_Block(Copy,sizeof(Copy),EEPROM_Address)) return(false);
+      Changed = false;
+      Checkpoints++;
+      return(true);
+      }
+
+    // Call from loop().  Returns true if a checkpoint was written.
+    bool Service(){
+      if(!Changed || Interval==0 || millis()-Last<Interval) return(false);
+      return(Checkpoint());
+      }
+  };
+#endif
+
 #endif
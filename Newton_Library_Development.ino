@@ -5,21 +5,25 @@ LIBRARY DEVELOPMENT
 Newton v1.3
 
 *********************************************/
-#define __NO_RTC
-#define __NO_EEPROM
-#define __NO_SWITCHES
-#define __NO_LEDS
-#define __NO_SPEAKER
+// Features are left out by uncommenting the __NO_* tokens in Newton.h, and
+// the log, config store, alarms, asynchronous bus and radio added by
+// uncommenting the __NEWTON_* ones, as tokens defined here would not reach
+// Newton.cpp.
 #include "Newton.h"
 
+// The number of system restarts, kept in the RTC's NVRAM and checkpointed
+// to EEPROM[0x80] (see NVRAM_Counters).
+//NVRAM_Counters<1> Restarts(0,0x0080);
+
 void setup()
 {
   Newton.Set_Alarm_Time();
 //  Newton.Sound_Effect(UP_SQUEAK);
 //
-//  // EEPROM[0] contains the number of system restarts (autoincrementing).
-//  byte Count = Newton.Memory_Read(0);
-//  Newton.Memory_Write(Count+1,0);
+//  Restarts.Begin(3600);
+//  unsigned long Count = Restarts.Get(0);
+//  Restarts.Add(0);
+//  Restarts.Checkpoint();
 //
 //  //Newton.Initialize_Time_Date();
 //  //Newton.Set_Alarm_Time();
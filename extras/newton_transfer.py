@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+#
+# Host side of the Newton EEPROM bulk transfer (Memory_Transfer in Newton.h).
+# Copies the EEPROM of a board running Memory_Transfer::Service() to a file,
+# or loads a file into it:
+#
+#    python3 extras/newton_transfer.py /dev/ttyUSB0 dump eeprom.bin
+#    python3 extras/newton_transfer.py /dev/ttyUSB0 restore config.bin --start 0x100
+#
+# The library must be built with __NEWTON_ASYNC_BUS, and the baud rate must
+# match the sketch's Serial.begin() (500000 at most).
+# Needs pyserial (pip install pyserial).
+
+import argparse
+import sys
+import time
+
+EEPROM_SIZE = 32768
+CHUNK = 64                  # TRANSFER_CHUNK
+SYNC = 0x7E
+READ, WRITE, FINISH = b'R'[0], b'W'[0], b'F'[0]
+DATA, ACK, NAK = b'D'[0], b'A'[0], b'N'[0]
+TIMEOUT = 0.25              # S before a request or a frame is sent again.
+TRIES = 10
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT, as Memory_CRC()."""
+    for value in data:
+        crc ^= value << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+        crc &= 0xFFFF
+    return crc
+
+
+def frame(kind, address, data=b''):
+    body = bytes([kind, address >> 8, address & 0xFF, len(data)]) + data
+    crc = crc16(body)
+    return bytes([SYNC]) + body + bytes([crc >> 8, crc & 0xFF])
+
+
+class Link:
+    """Frames to and from the board; damaged frames are counted and dropped."""
+
+    def __init__(self, port):
+        self.port = port
+        self.buffer = bytearray()
+        self.errors = 0
+
+    def send(self, kind, address, data=b''):
+        self.port.write(frame(kind, address, data))
+
+    def receive(self, until):
+        """Returns (type, address, data) of the next intact frame, or None
+        if there is none by the time until."""
+        while True:
+            found = self.parse()
+            if found:
+                return found
+            if time.monotonic() >= until:
+                return None
+            self.buffer += self.port.read(max(1, self.port.in_waiting))
+
+    def parse(self):
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                self.buffer.clear()
+                return None
+            del self.buffer[:start]
+            if len(self.buffer) < 5:
+                return None
+            length = self.buffer[4]
+            if length > CHUNK:
+                self.errors += 1
+                del self.buffer[:1]
+                continue
+            if len(self.buffer) < length + 7:
+                return None
+            body = bytes(self.buffer[1:5 + length])
+            crc = self.buffer[5 + length] << 8 | self.buffer[6 + length]
+            if crc != crc16(body):
+                self.errors += 1
+                del self.buffer[:1]
+                continue
+            del self.buffer[:length + 7]
+            return body[0], body[1] << 8 | body[2], body[4:]
+
+
+def dump(link, start, count):
+    """Reads count bytes from start; the rest is asked for again after a
+    damaged or missing frame or a silence."""
+    image = bytearray()
+    expected, end = start, start + count
+    link.send(READ, expected, bytes([count >> 8, count & 0xFF]))
+    heard, errors, asked = time.monotonic(), link.errors, False
+    while expected < end:
+        found = link.receive(time.monotonic() + 0.01)
+        if found:
+            kind, address, data = found
+            if kind == NAK:
+                raise IOError('the EEPROM did not answer at 0x%04X' % address)
+            if kind == DATA and address == expected:
+                image += data
+                expected += len(data)
+                heard, asked = time.monotonic(), False
+            elif kind == DATA and not asked:
+                errors = -1                 # A frame is missing.
+        if (link.errors != errors and not asked) or time.monotonic() - heard > TIMEOUT:
+            left = end - expected
+            link.send(READ, expected, bytes([left >> 8, left & 0xFF]))
+            heard, errors, asked = time.monotonic(), link.errors, True
+    return bytes(image)
+
+
+def answer(link, address):
+    """1 for an ACK of address, 0 for a NAK and -1 for none."""
+    until = time.monotonic() + TIMEOUT
+    while True:
+        found = link.receive(until)
+        if not found:
+            return -1
+        kind, frame_address, _ = found
+        if frame_address == address and kind in (ACK, NAK):
+            return 1 if kind == ACK else 0
+
+
+def restore(link, start, image):
+    """Writes image from start, a frame at a time (split on pages), each
+    sent again until it is acknowledged, then waits for the writes."""
+    address = start
+    while address < start + len(image):
+        length = min(CHUNK - address % CHUNK, start + len(image) - address)
+        data = image[address - start:address - start + length]
+        for _ in range(TRIES):
+            link.send(WRITE, address, data)
+            if answer(link, address) == 1:
+                break
+        else:
+            raise IOError('the board did not accept the data at 0x%04X' % address)
+        address += length
+    for _ in range(3):                      # A NAK may be for a damaged FINISH.
+        link.send(FINISH, 0)
+        result = answer(link, 0)
+        if result == 1:
+            return
+    raise IOError('the EEPROM failed to write' if result == 0 else 'the board did not answer')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Copy the EEPROM of a Newton board to or from a file.')
+    parser.add_argument('port', help='serial port, e.g. /dev/ttyUSB0 or COM3')
+    parser.add_argument('command', choices=('dump', 'restore'))
+    parser.add_argument('file')
+    parser.add_argument('--baud', type=int, default=500000)
+    parser.add_argument('--start', type=lambda text: int(text, 0), default=0)
+    parser.add_argument('--length', type=lambda text: int(text, 0), default=None,
+                        help='bytes to dump (default: to the end of the EEPROM)')
+    parser.add_argument('--verify', action='store_true', help='read back after restoring')
+    args = parser.parse_args()
+
+    import serial
+    port = serial.Serial(args.port, args.baud, timeout=0.01)
+    time.sleep(2)                           # Opening the port resets most boards.
+    port.reset_input_buffer()
+    link = Link(port)
+    began = time.monotonic()
+
+    if args.command == 'dump':
+        length = args.length if args.length is not None else EEPROM_SIZE - args.start
+        image = dump(link, args.start, length)
+        with open(args.file, 'wb') as output:
+            output.write(image)
+    else:
+        with open(args.file, 'rb') as source:
+            image = source.read()
+        if args.start + len(image) > EEPROM_SIZE:
+            sys.exit('%s does not fit in the EEPROM from 0x%04X' % (args.file, args.start))
+        restore(link, args.start, image)
+        if args.verify and dump(link, args.start, len(image)) != image:
+            sys.exit('verify failed')
+
+    elapsed = time.monotonic() - began
+    print('%d bytes in %.2f S (%.1f kB/s), %d damaged frames'
+          % (len(image), elapsed, len(image) / elapsed / 1000, link.errors))
+
+
+if __name__ == '__main__':
+    main()
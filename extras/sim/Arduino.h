@@ -0,0 +1,220 @@
+/*
+ Host-side stand-in for the Arduino core.
+
+ Only the parts of the Arduino API used by the Newton library are provided.
+ Time is simulated: nothing here ever sleeps.  Calls that would block on the
+ board (delay(), bus transfers, ...) advance the simulated clock instead, so
+ the cost of a library call can be measured exactly and repeatably.  See
+ Newton_Sim.h for the controls exposed to benchmarks.
+*/
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#define F_CPU 16000000UL
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+#define HIGH          1
+#define LOW           0
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+
+// I2C pins (PC4 and PC5).
+static const uint8_t SDA = 18;
+static const uint8_t SCL = 19;
+
+// Digital I/O
+void pinMode(uint8_t Pin, uint8_t Mode);
+void digitalWrite(uint8_t Pin, uint8_t Value);
+int  digitalRead(uint8_t Pin);
+
+// Port registers (B: pins 8-13, C: pins 14-19, D: pins 0-7, as on the
+// ATmega328P), backed by the same pins as digitalWrite() and digitalRead().
+// PORTx is the output latch (the pull-up of an input), PINx reads the pins
+// (writing 1s toggles the latch) and DDRx sets the outputs.
+class Sim_Port_Register{
+  private:
+    uint8_t First_Pin;
+    char Kind;                  // 'O' (PORT), 'I' (PIN) or 'D' (DDR).
+  public:
+    constexpr Sim_Port_Register(uint8_t Pin, char Register) : First_Pin(Pin), Kind(Register) {}
+    operator uint8_t() const;
+    Sim_Port_Register &operator=(uint8_t Value);
+    Sim_Port_Register &operator|=(uint8_t Value) { return *this = *this | Value; }
+    Sim_Port_Register &operator&=(uint8_t Value) { return *this = *this & Value; }
+};
+extern Sim_Port_Register PORTB, PORTC, PORTD, PINB, PINC, PIND, DDRB, DDRC, DDRD;
+
+// External interrupts (INT0 on pin 2, INT1 on pin 3, as on the ATmega328P).
+#define NOT_AN_INTERRUPT  -1
+#define CHANGE   1
+#define FALLING  2
+#define RISING   3
+#define digitalPinToInterrupt(p)  ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+void attachInterrupt(uint8_t Interrupt, void (*Handler)(void), int Mode);
+void detachInterrupt(uint8_t Interrupt);
+
+// Pin-change interrupts (PCINT0_vect for pins 8-13, PCINT1_vect for pins
+// 14-19, PCINT2_vect for pins 0-7), with the core's mapping macros.  Only
+// changes of input levels are seen.
+extern volatile uint8_t PCICR;
+extern volatile uint8_t PCIFR;
+extern volatile uint8_t PCMSK0;
+extern volatile uint8_t PCMSK1;
+extern volatile uint8_t PCMSK2;
+#define PCIE0  0
+#define PCIE1  1
+#define PCIE2  2
+#define digitalPinToPCICR(p)     (((p) <= 19) ? (&PCICR) : ((volatile uint8_t *)0))
+#define digitalPinToPCICRbit(p)  (((p) <= 7) ? 2 : (((p) <= 13) ? 0 : 1))
+#define digitalPinToPCMSK(p)     (((p) <= 7) ? (&PCMSK2) : (((p) <= 13) ? (&PCMSK0) : (((p) <= 19) ? (&PCMSK1) : ((volatile uint8_t *)0))))
+#define digitalPinToPCMSKbit(p)  (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) - 14)))
+
+// ADC enable and power reduction registers (only stored).
+extern volatile uint8_t ADCSRA;
+extern volatile uint8_t PRR;
+#define ADEN    7
+#define PRADC   0
+#define PRUSART0 1
+#define PRSPI   2
+#define PRTIM1  3
+#define PRTIM0  5
+#define PRTIM2  6
+#define PRTWI   7
+
+// Time
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long Milliseconds);
+void delayMicroseconds(unsigned int Microseconds);
+
+// Speaker
+void tone(uint8_t Pin, unsigned int Frequency, unsigned long Duration = 0);
+void noTone(uint8_t Pin);
+
+// Interrupts
+void interrupts();
+void noInterrupts();
+#define ISR(vector) extern "C" void vector(void)
+
+// Status register: only the global interrupt flag (bit 7) is modelled.
+class Sim_Status_Register{
+  public:
+    operator uint8_t() const;
+    Sim_Status_Register &operator=(uint8_t Value);
+};
+extern Sim_Status_Register SREG;
+#define cli()  noInterrupts()
+#define sei()  interrupts()
+
+// Timer0 registers (Timer0 itself always runs, as set up by the core, and
+// counts at F_CPU/64 from 0 to 255).
+class Sim_Timer0_Counter{
+  public:
+    operator uint8_t() const;
+};
+extern Sim_Timer0_Counter TCNT0;
+extern volatile uint8_t  OCR0A;
+extern volatile uint8_t  OCR0B;
+extern volatile uint8_t  TIMSK0;
+#define TOIE0  0
+#define OCIE0A 1
+#define OCIE0B 2
+
+// Timer1 registers.
+extern volatile uint8_t  TCCR1A;
+extern volatile uint8_t  TCCR1B;
+extern volatile uint16_t TCNT1;
+extern volatile uint8_t  TIMSK1;
+#define CS10   0
+#define CS11   1
+#define CS12   2
+#define TOIE1  0
+
+// Timer2 registers.
+extern volatile uint8_t  TCCR2A;
+extern volatile uint8_t  TCCR2B;
+extern volatile uint8_t  TCNT2;
+extern volatile uint8_t  OCR2A;
+extern volatile uint8_t  TIMSK2;
+extern volatile uint8_t  TIFR2;
+#define WGM21  1
+#define CS20   0
+#define CS21   1
+#define CS22   2
+#define OCIE2A 1
+#define OCF2A  1
+
+// Program memory is ordinary memory on the host.
+#define PROGMEM
+static inline uint8_t  pgm_read_byte(const void *p)  { uint8_t  v; memcpy(&v, p, sizeof(v)); return v; }
+static inline uint16_t pgm_read_word(const void *p)  { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+static inline uint32_t pgm_read_dword(const void *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+static inline void    *pgm_read_ptr(const void *p)   { void    *v; memcpy(&v, p, sizeof(v)); return v; }
+#define F(s)               (s)
+
+// Minimal Arduino String (only what the library uses).
+class String{
+  private:
+    std::string Text;
+  public:
+    String(const char *Value = "") : Text(Value) {}
+    String(const std::string &Value) : Text(Value) {}
+    String substring(unsigned int From, unsigned int To) const { return String(Text.substr(From, To-From)); }
+    bool operator==(const char *Value) const { return Text == Value; }
+    const char *c_str() const { return Text.c_str(); }
+    unsigned int length() const { return Text.length(); }
+};
+
+// Serial port.  print() and println() go straight to stdout; write(),
+// read() and available() use a model of the UART (see Sim_Serial_Send()
+// and Sim_Serial_Receive() in Newton_Sim.h for the other end): each byte
+// takes 10 bit times at the rate given to begin(), write() waits while the
+// 64-byte transmit buffer is full and bytes arriving while the 64-byte
+// receive buffer is full are lost, as in the AVR core.
+class Stream{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual size_t write(uint8_t Data) = 0;
+    virtual size_t write(const uint8_t *Data, size_t Length) {
+      size_t n = 0;
+      while(Length--) n += write(*Data++);
+      return n;
+    }
+    virtual int availableForWrite() { return 0; }
+    virtual ~Stream() {}
+};
+
+class HardwareSerial : public Stream{
+  public:
+    void begin(unsigned long Baud);
+    int available();
+    int read();
+    size_t write(uint8_t Data);
+    using Stream::write;
+    int availableForWrite();
+    void flush();
+    size_t print(const char *Value)   { return printf("%s", Value); }
+    size_t print(char Value)          { return printf("%c", Value); }
+    size_t print(int Value)           { return printf("%d", Value); }
+    size_t print(unsigned int Value)  { return printf("%u", Value); }
+    size_t print(long Value)          { return printf("%ld", Value); }
+    size_t print(unsigned long Value) { return printf("%lu", Value); }
+    size_t print(const String &Value) { return printf("%s", Value.c_str()); }
+    size_t println()                  { return printf("\n"); }
+    template<typename T> size_t println(T Value) { size_t n = print(Value); return n + println(); }
+};
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ Newton API benchmark.
+
+ Calls each public function of the library once (after any setup it
+ needs) and reports the simulated time the caller is blocked, and the bus
+ transactions, bytes and NAKs it causes.  Each call has a budget; the
+ program exits with a non-zero status if any call takes longer or uses
+ more of the bus, so a change that slows the library down is caught by
+ running it:
+
+    g++ -std=gnu++11 -O2 -I . -I extras/sim Newton.cpp extras/sim/Newton_Sim.cpp \
+        extras/sim/Bench_API.cpp -o bench_api && ./bench_api
+
+ Built with -D__NEWTON_STATS (on Newton.cpp too), it also prints the
+ library's own counters (Print_Stats()) and checks that they agree with
+ the simulated bus.
+
+ The other Bench_*.cpp programs look at each feature in more depth.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+struct Measure{
+  unsigned long long Start;
+  Sim_Bus_Stats Bus;
+};
+
+static Measure Begin(){
+  Measure M = {Sim_Time_Micros(), Sim_Bus};
+  return M;
+}
+
+// Prints one row; Max_Time is in mS, Max_Transactions 0 for calls that
+// must not use the bus.  EEPROM writes are followed by acknowledge polls,
+// about one every 30 uS at 400 kHz for a write cycle of 3 mS.
+static void End(const Measure &M, const char *Name, double Max_Time, unsigned long Max_Transactions){
+  double Time = (Sim_Time_Micros() - M.Start) / 1000.0;
+  #ifdef __NEWTON_STATS
+  Max_Time += 0.008;          // The counters read micros() twice per call.
+  #endif
+  unsigned long Transactions = Sim_Bus.Transactions - M.Bus.Transactions;
+  bool Ok = Time <= Max_Time && Transactions <= Max_Transactions;
+  printf("%-28s %9.3f %7lu %7lu %5lu  %s\n", Name, Time, Transactions,
+         Sim_Bus.Bytes - M.Bus.Bytes, Sim_Bus.Naks - M.Bus.Naks, Ok ? "ok" : "OVER BUDGET");
+  if(!Ok) Sim_Failures++;
+}
+
+#define MEASURE(Name, Call, Max_Time, Max_Transactions) \
+  do { Measure M = Begin(); Call; End(M, Name, Max_Time, Max_Transactions); } while(0)
+
+static void Nothing() {}
+static void Alarm_Event(byte Event) { (void)Event; }
+
+int main(){
+  byte Data[64] = {0};
+  char Text[20];
+  byte second, minute, hour, dayOfWeek, dayOfMonth, month, year;
+  byte Switch, Event;
+  struct { unsigned long Count; int Offset; } Settings = {0, 0};
+  unsigned long Epoch;
+
+  printf("%-28s %9s %7s %7s %5s\n", "call", "time(ms)", "xfers", "bytes", "naks");
+  Sim_Reset();
+  #ifdef __NEWTON_STATS
+  Newton.Reset_Stats();
+  #endif
+
+  // EEPROM
+  MEASURE("Memory_Write", Newton.Memory_Write(1, 100), 5.0, 120);
+  MEASURE("Memory_Read", Newton.Memory_Read(100), 0.25, 2);
+  MEASURE("Memory_Read_Block (64)", Newton.Memory_Read_Block(Data, 64, 0), 2.0, 3);
+  MEASURE("Memory_Write_Block (64)", Newton.Memory_Write_Block(Data, 64, 0), 20.0, 360);
+  MEASURE("Memory_Put (8)", Newton.Memory_Put(Settings, 200), 6.0, 120);
+  MEASURE("Memory_Get (8)", Newton.Memory_Get(Settings, 200), 1.0, 2);
+
+  // Real-time clock
+  MEASURE("Set_Current_Time_Values", Newton.Set_Current_Time_Values(0, 30, 12, 2, 16, 5, 16), 1.0, 1);
+  MEASURE("Get_Current_Time_Values", Newton.Get_Current_Time_Values(&second, &minute, &hour, &dayOfWeek, &dayOfMonth, &month, &year), 1.0, 2);
+  MEASURE("Get_Time", Newton.Get_Time(Text), 1.0, 2);
+  MEASURE("Set_Time", Newton.Set_Time((char *)"05/16/16 13:08:00"), 1.0, 1);
+  MEASURE("Get_Epoch", Epoch = Newton.Get_Epoch(), 1.0, 2);
+  MEASURE("Set_Epoch", Newton.Set_Epoch(Epoch), 1.0, 1);
+  MEASURE("Initialize_Time_Date", Newton.Initialize_Time_Date(), 1.0, 1);
+  MEASURE("Begin_Time_Cache", Newton.Begin_Time_Cache(60), 1200.0, 3000);
+  MEASURE("Get_Time (cached)", Newton.Get_Time(Text), 0.01, 0);
+  Newton.Begin_Time_Cache(0);
+
+  // Switches, LEDs and speaker
+  MEASURE("SW1_Status", Newton.SW1_Status(), 0.01, 0);
+  MEASURE("SW2_Status", Newton.SW2_Status(), 0.01, 0);
+  MEASURE("Get_Switch_Event", Newton.Get_Switch_Event(&Switch, &Event), 0.01, 0);
+  MEASURE("LED1_Indicator", Newton.LED1_Indicator(ON), 0.01, 0);
+  MEASURE("Flash_Status_LED", Newton.Flash_Status_LED(), 0.01, 0);
+  MEASURE("LED_Heartbeat", Newton.LED_Heartbeat(LED2), 0.01, 0);
+  MEASURE("LED_Fade", Newton.LED_Fade(LED1, 128, 500), 0.01, 0);
+  MEASURE("Sound_Effect", Newton.Sound_Effect(UP_SQUEAK), 0.01, 0);
+  MEASURE("Beep", Newton.Beep(), 0.01, 0);
+  MEASURE("Silence", Newton.Silence(), 0.01, 0);
+
+  // Timers and alarms
+  MEASURE("Timer_Start", Newton.Timer_Start(Nothing, 100, TIMER_PERIODIC), 0.01, 0);
+  MEASURE("Service_Timers", Newton.Service_Timers(), 0.01, 0);
+  MEASURE("Set_Alarm_Time", Newton.Set_Alarm_Time(), 0.01, 0);
+  MEASURE("Begin_Alarms (saved)", Newton.Begin_Alarms(Alarm_Event, true), 15.0, 20);
+  MEASURE("Alarm_Daily (saved)", Newton.Alarm_Daily(7, 0, 1), 6.0, 120);
+  MEASURE("Service_Alarms (reads RTC)", Newton.Service_Alarms(), 1.0, 2);
+  MEASURE("Service_Alarms (not due)", Newton.Service_Alarms(), 0.01, 0);
+
+  // Data log
+  MEASURE("Begin_Log", Newton.Begin_Log(), 30.0, 120);
+  MEASURE("Log_Append", Newton.Log_Append(Data, LOG_DATA_SIZE), 1.0, 2);
+  MEASURE("Log_Flush", Newton.Log_Flush(), 6.0, 120);
+
+  // Config store
+  MEASURE("Begin_Config (new)", Newton.Begin_Config(), 6.0, 120);
+  MEASURE("Config_Put (8)", Newton.Config_Put("count", Settings), 8.0, 120);
+  MEASURE("Config_Get (8)", Newton.Config_Get("count", Settings), 1.0, 2);
+
+  // Asynchronous I2C
+  byte Handle;
+  MEASURE("Memory_Write_Async (64)", Handle = Newton.Memory_Write_Async(Data, 64, 0), 0.01, 0);
+  MEASURE("Service_Bus (a write)", Newton.Service_Bus(), 1.0, 1);
+  MEASURE("Service_Bus (a poll)", Newton.Service_Bus(), 0.2, 1);
+  while(Newton.Service_Bus()) ;
+  Newton.Bus_Status(Handle);
+  MEASURE("Get_Time_Values_Async", Handle = Newton.Get_Current_Time_Values_Async(Data), 0.01, 0);
+  while(Newton.Service_Bus()) ;
+  Newton.Bus_Status(Handle);
+
+  // Packet radio
+  MEASURE("Begin_Radio", Newton.Begin_Radio(), 0.01, 0);
+  MEASURE("Radio_Send (24)", Newton.Radio_Send(Data, 24), 0.01, 0);
+  MEASURE("Radio_Receive", Newton.Radio_Receive(Data, sizeof(Data)), 0.01, 0);
+  Newton.End_Radio();
+
+  #ifdef __NEWTON_STATS
+  Newton_Stats Total = {}, Stats;
+  for(byte i = 0; i < STATS_SUBSYSTEMS; i++)
+    {
+    Newton.Get_Stats(i, &Stats);
+    Total.Transactions += Stats.Transactions;
+    Total.Bytes += Stats.Bytes;
+    Total.Naks += Stats.Naks;
+    }
+  printf("\n");
+  Newton.Print_Stats();
+  bool Agree = Total.Transactions == Sim_Bus.Transactions && Total.Bytes == Sim_Bus.Bytes &&
+               Total.Naks == Sim_Bus.Naks;
+  printf("counters against the bus: %s\n", Agree ? "ok" : "WRONG");
+  if(!Agree) Sim_Failures++;
+  #endif
+
+  return Sim_Failures ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+/*
+ Alarm scheduler benchmark.
+
+ Runs the reference sketch's alarm logic for 90 simulated minutes: four
+ events at 13:15, 13:30, 13:45 and 14:00.  loop() runs every 500 mS, but
+ every seventh pass also does 900 mS of other work (a beep, a display
+ update ...), as real sketches do.  Two ways:
+
+    - Get_Time() and strcmp() against each "MM/DD/YY HH:MM:SS" string
+    - Alarm_At() once in setup(), then Service_Alarms() in loop()
+
+ and reports the events fired, how late, and the bus traffic.
+
+ The persistence of the alarm table is then checked: with alarms saved to
+ the EEPROM, the board is switched off for three hours and restarted.  A
+ daily alarm and a single alarm that fell due while it was off must be
+ called once each on restart, and a ten-minute alarm must resume without
+ being called for the repeats it missed.  Finally, with the RTC not
+ answering, the alarms set relative to now must be refused rather than
+ set for 2000-01-01 and fired as soon as the RTC is back.
+
+ The program exits with a non-zero status if any alarm is missed, called
+ twice or called late.
+*/
+
+#include <new>
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+#define LOOP_TIME     500UL       // mS.
+#define WORK_TIME     900UL       // mS, every WORK_PASS passes.
+#define WORK_PASS     7
+#define RUN_TIME      (90UL * 60UL * 1000UL)
+
+static const char *Times[4] = {"05/16/16 13:15:00", "05/16/16 13:30:00", "05/16/16 13:45:00", "05/16/16 14:00:00"};
+static const byte Minutes[4] = {15, 30, 45, 60};
+
+static int Fired[16];
+static unsigned long Late[16];       // mS.
+static unsigned long Due[16];        // Epoch.
+
+static void Note(byte Event){
+  Fired[Event]++;
+  unsigned long Now = Sim_RTC_Seconds();
+  unsigned long Lateness = (Now - Due[Event]) * 1000UL;
+  if(Lateness > Late[Event]) Late[Event] = Lateness;
+}
+
+static void Start(){
+  Sim_Reset();
+  Sim_RTC_Set(2016, 5, 16, 13, 0, 0);
+  memset(Fired, 0, sizeof(Fired));
+  memset(Late, 0, sizeof(Late));
+  for(int i = 0; i < 4; i++)
+    Due[i] = _Newton::Date_To_Epoch(0, Minutes[i] % 60, 13 + Minutes[i] / 60, 16, 5, 16);
+}
+
+static void Report(const char *Name, unsigned long Transactions){
+  int Count = 0;
+  unsigned long Worst = 0;
+  for(int i = 0; i < 4; i++)
+    {
+    Count += Fired[i] == 1;
+    if(Late[i] > Worst) Worst = Late[i];
+    }
+  printf("%-22s %4d of 4 %10lu %10lu\n", Name, Count, Worst, Transactions);
+}
+
+static void Loop_Delay(unsigned long Pass){
+  delay(LOOP_TIME);
+  if(Pass % WORK_PASS == 0) delay(WORK_TIME);
+}
+
+static void Persistence(){
+  Start();
+  Sim_RTC_Set(2016, 5, 16, 5, 0, 0);
+  Newton.Begin_Alarms(Note, true);
+  Newton.Alarm_Daily(7, 0, 4);
+  Newton.Alarm_At(_Newton::Date_To_Epoch(0, 30, 8, 16, 5, 16), 5);
+  Newton.Alarm_Every(10, 6);
+  Due[4] = _Newton::Date_To_Epoch(0, 0, 7, 16, 5, 16);
+  Due[5] = _Newton::Date_To_Epoch(0, 30, 8, 16, 5, 16);
+  Due[6] = 0;
+
+  // Run until 06:05, then switch off until 09:05.
+  for(unsigned long Pass = 0; Pass < 3900 * 2; Pass++)
+    {
+    Newton.Service_Alarms();
+    delay(LOOP_TIME);
+    }
+  int Before = Fired[6];
+  Sim_Check(Fired[4] == 0 && Fired[5] == 0 && Before == 6, "alarms before switching off");
+
+  Newton.~_Newton();
+  memset((void *)&Newton, 0, sizeof(Newton));
+  Sim_Advance(3ULL * 3600ULL * 1000000ULL);
+  new (&Newton) _Newton();
+
+  Newton.Begin_Alarms(Note, true);
+  Newton.Service_Alarms();
+  Sim_Check(Fired[4] == 1, "daily alarm caught up once");
+  Sim_Check(Fired[5] == 1, "single alarm caught up once");
+  Sim_Check(Fired[6] == Before, "ten-minute alarm resumed without catching up");
+
+  // The daily alarm is next due tomorrow; the ten-minute alarm carries on.
+  for(unsigned long Pass = 0; Pass < 1500 * 2; Pass++)
+    {
+    Newton.Service_Alarms();
+    delay(LOOP_TIME);
+    }
+  Sim_Check(Fired[4] == 1 && Fired[5] == 1, "caught-up alarms not repeated");
+  Sim_Check(Fired[6] == Before + 2, "ten-minute alarm after restart");
+  printf("\nalarms saved across a 3 h switch-off: %s\n", Sim_Failures ? "WRONG" : "ok");
+}
+
+static void No_RTC(){
+  Start();
+  Newton.Begin_Alarms(Note, false);
+  Sim_Check(Newton.Alarm_Daily(24, 0, 7) == ALARM_NONE && Newton.Alarm_Daily(13, 60, 7) == ALARM_NONE &&
+            Newton.Alarm_Weekly(0, 13, 30, 7) == ALARM_NONE && Newton.Alarm_Weekly(8, 13, 30, 7) == ALARM_NONE &&
+            Newton.Alarm_Weekly(2, 24, 30, 7) == ALARM_NONE, "times out of range refused");
+  Sim_RTC_Connect(false);
+  Sim_Check(Newton.Alarm_Daily(13, 30, 7) == ALARM_NONE && Newton.Alarm_Weekly(2, 13, 30, 7) == ALARM_NONE &&
+            Newton.Alarm_Every(10, 7) == ALARM_NONE, "alarms refused without the RTC");
+  Newton.Begin_Time_Cache(60);
+  delay(5000);
+  Sim_Check(Newton.Alarm_Every(10, 7) == ALARM_NONE, "alarms refused without the RTC, with the time cached");
+  Sim_RTC_Connect(true);
+  Newton.Begin_Time_Cache(0);
+  for(unsigned long Pass = 0; Pass < 10; Pass++)
+    {
+    Newton.Service_Alarms();
+    delay(LOOP_TIME);
+    }
+  Sim_Check(Fired[7] == 0, "nothing fired when the RTC is back");
+}
+
+int main(){
+  printf("4 alarms over %lu minutes, loop() every %lu mS (+%lu mS every %d passes)\n\n",
+         RUN_TIME / 60000, LOOP_TIME, WORK_TIME, WORK_PASS);
+  printf("%-22s %9s %10s %10s\n", "method", "fired", "late(ms)", "xfers");
+
+  Start();
+  char Time_String[18];
+  for(unsigned long Pass = 0; millis() < RUN_TIME; Pass++)
+    {
+    Newton.Get_Time(Time_String);
+    for(int i = 0; i < 4; i++)
+      if(strcmp(Time_String, Times[i]) == 0) Note(i);
+    Loop_Delay(Pass);
+    }
+  Report("Get_Time + strcmp", Sim_Bus.Transactions);
+
+  Start();
+  Newton.Begin_Alarms(Note, false);
+  for(int i = 0; i < 4; i++)
+    Newton.Alarm_At(Due[i], i);
+  for(unsigned long Pass = 0; millis() < RUN_TIME; Pass++)
+    {
+    Newton.Service_Alarms();
+    Loop_Delay(Pass);
+    }
+  Report("Alarm_At", Sim_Bus.Transactions);
+  for(int i = 0; i < 4; i++)
+    Sim_Check(Fired[i] == 1 && Late[i] <= LOOP_TIME + WORK_TIME + 1000, "Alarm_At fired once, on time");
+
+  Persistence();
+  No_RTC();
+  return Sim_Failures ? 1 : 0;
+}
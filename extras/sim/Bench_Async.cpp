@@ -0,0 +1,127 @@
+/*
+ Asynchronous I2C benchmark.
+
+ A sketch's loop() has 1 mS of its own work to do each pass and must also
+ save a 1 kB block to the EEPROM.  Two ways:
+
+    - Memory_Write_Block(): loop() stops until the whole block is written
+    - Memory_Write_Async() once, then Service_Bus() in every pass of loop()
+
+ For each it reports the time until the block is written, the passes of
+ loop() made meanwhile and the longest gap between two passes.
+
+ The queue is then checked: the block must read back through
+ Memory_Read_Async() (with a callback) and through Memory_Read_Block(),
+ which must first finish a write still queued; Get_Current_Time_Values_Async()
+ must agree with the RTC; a full queue must refuse a transaction; and a
+ write to a removed EEPROM must fail.
+
+ The program exits with a non-zero status if any check fails.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+#define BLOCK_SIZE  1024
+#define ADDRESS     0x2000
+#define WORK_TIME   1000ULL        // uS of other work per pass of loop().
+
+static byte Block[BLOCK_SIZE];
+static byte Copy[BLOCK_SIZE];
+static int Callbacks;
+static bool Callback_Ok;
+
+static void Done(byte Handle, bool Ok){
+  (void)Handle;
+  Callbacks++;
+  Callback_Ok = Ok;
+}
+
+static void Report(const char *Name, unsigned long long Start, unsigned long Passes, unsigned long long Longest){
+  printf("%-22s %10.1f %8lu %12.2f\n", Name, (Sim_Time_Micros() - Start) / 1000.0, Passes, Longest / 1000.0);
+}
+
+static void Writing(){
+  printf("%-22s %10s %8s %12s\n", "method", "time(ms)", "passes", "longest(ms)");
+  for(int i = 0; i < BLOCK_SIZE; i++)
+    Block[i] = (byte)(i * 7 + 3);
+
+  // Blocking: loop() makes no pass until the write is done.
+  Sim_Reset();
+  unsigned long long Start = Sim_Time_Micros();
+  Newton.Memory_Write_Block(Block, BLOCK_SIZE, ADDRESS);
+  unsigned long long Longest = Sim_Time_Micros() - Start + WORK_TIME;
+  Report("Memory_Write_Block", Start, 0, Longest);
+
+  // Queued: loop() runs Service_Bus() once per pass.
+  for(int i = 0; i < BLOCK_SIZE; i++)
+    Block[i] ^= 0xFF;
+  Sim_Reset();
+  Start = Sim_Time_Micros();
+  byte Handle = Newton.Memory_Write_Async(Block, BLOCK_SIZE, ADDRESS);
+  unsigned long Passes = 0;
+  Longest = 0;
+  while(Newton.Bus_Status(Handle) == BUS_PENDING)
+    {
+    unsigned long long Pass_Start = Sim_Time_Micros();
+    Newton.Service_Bus();
+    Sim_Advance(WORK_TIME);
+    if(Sim_Time_Micros() - Pass_Start > Longest) Longest = Sim_Time_Micros() - Pass_Start;
+    Passes++;
+    }
+  Report("Memory_Write_Async", Start, Passes, Longest);
+  Sim_Check(memcmp(Sim_EEPROM_Data() + ADDRESS, Block, BLOCK_SIZE) == 0, "queued write");
+  Sim_Check(Longest < WORK_TIME + 4000, "Service_Bus() blocks for one transaction at most");
+}
+
+static void Queue(){
+  // Read back with a callback.
+  memset(Copy, 0, sizeof(Copy));
+  Callbacks = 0;
+  Newton.Memory_Read_Async(Copy, BLOCK_SIZE, ADDRESS, Done);
+  while(Newton.Service_Bus()) ;
+  Sim_Check(Callbacks == 1 && Callback_Ok && memcmp(Copy, Block, BLOCK_SIZE) == 0, "queued read");
+
+  // A blocking read finishes the queued write before it.
+  byte Value[4] = {1, 2, 3, 4}, Back[4];
+  byte Write = Newton.Memory_Write_Async(Value, sizeof(Value), ADDRESS);
+  Sim_Check(Newton.Memory_Read_Block(Back, sizeof(Back), ADDRESS) && memcmp(Back, Value, 4) == 0 &&
+            Newton.Bus_Status(Write) == BUS_DONE, "blocking read after a queued write");
+
+  // The RTC.
+  Sim_RTC_Set(2024, 7, 14, 9, 26, 53);
+  byte Values[7], Expected[7];
+  byte Handle = Newton.Get_Current_Time_Values_Async(Values);
+  while(Newton.Service_Bus()) ;
+  Sim_Check(Newton.Bus_Status(Handle) == BUS_DONE && Newton.Bus_Status(Handle) == BUS_UNUSED, "handle states");
+  Newton.Get_Current_Time_Values(&Expected[0], &Expected[1], &Expected[2], &Expected[3],
+                                 &Expected[4], &Expected[5], &Expected[6]);
+  Sim_Check(memcmp(Values, Expected, 7) == 0 && Values[2] == 9 && Values[6] == 24, "queued RTC read");
+
+  // A full queue.
+  byte Handles[BUS_QUEUE_SIZE];
+  for(int i = 0; i < BUS_QUEUE_SIZE; i++)
+    Handles[i] = Newton.Memory_Read_Async(Copy + i * 8, 8, ADDRESS + i * 8);
+  Sim_Check(Newton.Memory_Read_Async(Copy, 8, ADDRESS, Done) == BUS_NONE, "full queue refused");
+  while(Newton.Service_Bus()) ;
+  for(int i = 0; i < BUS_QUEUE_SIZE; i++)
+    Sim_Check(Newton.Bus_Status(Handles[i]) == BUS_DONE, "every queued read done");
+
+  // A removed EEPROM.
+  Sim_EEPROM_Connect(false);
+  Callbacks = 0;
+  Newton.Memory_Write_Async(Value, sizeof(Value), ADDRESS, Done);
+  while(Newton.Service_Bus()) ;
+  Sim_Check(Callbacks == 1 && !Callback_Ok, "write to a removed EEPROM fails");
+  Sim_EEPROM_Connect(true);
+
+  printf("\nqueue checks: %s\n", Sim_Failures ? "WRONG" : "ok");
+}
+
+int main(){
+  printf("%d bytes written to the EEPROM, loop() does %llu uS of work per pass\n\n",
+         BLOCK_SIZE, WORK_TIME);
+  Writing();
+  Queue();
+  return Sim_Failures ? 1 : 0;
+}
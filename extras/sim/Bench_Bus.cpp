@@ -0,0 +1,117 @@
+/*
+ I2C bus benchmark.
+
+ Reads and writes a 4 kB block of the EEPROM, and reads the RTC, with the
+ bus clock set to I2C_STANDARD (100 kHz, Wire's default) and I2C_FAST
+ (400 kHz), and reports the simulated time of each and the transactions
+ clocked faster than the device allows (the DS1307 is only rated for
+ 100 kHz, so there must be none).
+
+ The bus is then hung, as by a reset part way through a read: a device
+ holds SDA low until it sees a few more clocks on SCL.  Each call must
+ fail after I2C_TIMEOUT, count the timeout and free the bus (with
+ Bus_Recover()), so that the next call works; a device needing more than
+ the recovery clocks must be freed by the calls after that.  Set_Bus_Clock()
+ must refuse clocks the devices are not rated for.
+
+ The program exits with a non-zero status if any check fails.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+#define BLOCK_SIZE  4096
+#define ADDRESS     0x2000
+#define RTC_READS   100
+
+static byte Block[BLOCK_SIZE];
+static byte Copy[BLOCK_SIZE];
+
+// Returns the time of the block read in mS, printing the row.
+static double Speed(const char *Name, unsigned long Clock){
+  Sim_Reset();
+  Sim_Check(Newton.Set_Bus_Clock(Clock), "clock accepted");
+  for(int i = 0; i < BLOCK_SIZE; i++)
+    Block[i] = (byte)(i * 13 + Clock / 1000);
+
+  unsigned long long Start = Sim_Time_Micros();
+  Sim_Check(Newton.Memory_Write_Block(Block, BLOCK_SIZE, ADDRESS), "block written");
+  double Write = (Sim_Time_Micros() - Start) / 1000.0;
+
+  Start = Sim_Time_Micros();
+  Sim_Check(Newton.Memory_Read_Block(Copy, BLOCK_SIZE, ADDRESS) && memcmp(Copy, Block, BLOCK_SIZE) == 0,
+            "block read back");
+  double Read = (Sim_Time_Micros() - Start) / 1000.0;
+
+  Start = Sim_Time_Micros();
+  byte second, minute, hour, dayOfWeek, dayOfMonth, month, year;
+  for(int i = 0; i < RTC_READS; i++)
+    Newton.Get_Current_Time_Values(&second, &minute, &hour, &dayOfWeek, &dayOfMonth, &month, &year);
+  double RTC = (Sim_Time_Micros() - Start) / 1000.0 / RTC_READS;
+
+  printf("%-22s %10.1f %10.1f %10.3f %9lu\n", Name, Write, Read, RTC, Sim_Bus.Too_Fast);
+  Sim_Check(Sim_Bus.Too_Fast == 0, "every device within its rated clock");
+  return Read;
+}
+
+// Reads through a hung bus; returns the time taken in uS.
+static unsigned long long Hung_Read(bool *Ok){
+  unsigned long long Start = Sim_Time_Micros();
+  *Ok = Newton.Memory_Read_Block(Copy, 16, ADDRESS);
+  return Sim_Time_Micros() - Start;
+}
+
+static void Hangs(){
+  Sim_Reset();
+  Sim_Check(!Newton.Set_Bus_Clock(1000000UL) && !Newton.Set_Bus_Clock(10000UL), "unrated clocks refused");
+  Sim_Check(Newton.Set_Bus_Clock(I2C_FAST), "400 kHz accepted");
+  Newton.Memory_Write_Block(Block, 16, ADDRESS);
+  unsigned int Timeouts = Newton.Get_Bus_Timeouts();
+
+  // A device freed by a few clocks: one failed call, then all is well.
+  bool Ok;
+  Sim_Bus_Hang(5);
+  unsigned long long Time = Hung_Read(&Ok);
+  printf("\nhung bus: read failed after %.1f ms, ", Time / 1000.0);
+  Sim_Check(!Ok && Time >= I2C_TIMEOUT && Time < 2 * I2C_TIMEOUT, "read fails after the timeout");
+  Sim_Check(Newton.Get_Bus_Timeouts() == Timeouts + 1, "timeout counted");
+  Hung_Read(&Ok);
+  Sim_Check(Ok && memcmp(Copy, Block, 16) == 0, "bus recovered");
+
+  // The RTC, through the queue.
+  byte Values[7];
+  Sim_Bus_Hang(3);
+  byte Handle = Newton.Get_Current_Time_Values_Async(Values);
+  while(Newton.Service_Bus()) ;
+  Sim_Check(Newton.Bus_Status(Handle) == BUS_FAILED, "queued RTC read fails");
+  Handle = Newton.Get_Current_Time_Values_Async(Values);
+  while(Newton.Service_Bus()) ;
+  Sim_Check(Newton.Bus_Status(Handle) == BUS_DONE, "queued RTC read after recovery");
+
+  // A device needing 20 clocks takes two recoveries (9 clocks and the
+  // STOP condition's each).
+  Sim_Bus_Hang(20);
+  int Failed = 0;
+  for(int i = 0; i < 5; i++)
+    {
+    Hung_Read(&Ok);
+    if(!Ok) Failed++;
+    }
+  printf("a longer hang took %d calls to clear\n", Failed);
+  Sim_Check(Failed == 2 && Ok, "longer hang freed by repeated recoveries");
+  Sim_Bus_Hang(12);
+  Sim_Check(!Newton.Bus_Recover() && Newton.Bus_Recover(), "Bus_Recover() reports a bus still held");
+
+  printf("timeouts and recovery: %s\n", Sim_Failures ? "WRONG" : "ok");
+}
+
+int main(){
+  printf("%d bytes written to and read from the EEPROM, RTC read %d times\n\n", BLOCK_SIZE, RTC_READS);
+  printf("%-22s %10s %10s %10s %9s\n", "bus clock", "write(ms)", "read(ms)", "RTC(ms)", "too fast");
+  double Standard = Speed("I2C_STANDARD", I2C_STANDARD);
+  double Fast = Speed("I2C_FAST", I2C_FAST);
+  printf("reads %.1f times faster at 400 kHz\n", Standard / Fast);
+  Sim_Check(Standard / Fast > 3.5, "fast mode speeds up EEPROM reads");
+  Hangs();
+  return Sim_Failures ? 1 : 0;
+}
@@ -0,0 +1,168 @@
+/*
+ Config store benchmark.
+
+ A sketch keeps a dozen settings.  They are first kept the usual way, at
+ hand-picked addresses read and written with Memory_Read()/Memory_Write(),
+ then in the config store with Config_Get()/Config_Set().  For each the
+ bus traffic and simulated time of a lookup and an update are reported,
+ with the longest Config_Get() and Config_Set() (the latter including
+ compactions) from Get_Config_Stats().
+
+ The store is then checked: 2000 updates spread over the keys (forcing
+ many compactions), removals, a reset (Begin_Config()) after which every
+ value must read back, a write torn by a power failure (the previous value
+ must survive) and a reset part way through a compaction.
+
+ The program exits with a non-zero status if any value is wrong.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+#define KEYS     12
+#define UPDATES  2000
+
+struct Setting { char Key[CONFIG_KEY_SIZE + 1]; byte Length; byte Value[CONFIG_VALUE_SIZE]; bool Present; };
+static Setting Settings[KEYS];
+
+static void Make_Value(int Key, int Version){
+  Setting &S = Settings[Key];
+  S.Length = 1 + (Key * 5 + Version) % CONFIG_VALUE_SIZE;
+  for(int i = 0; i < S.Length; i++)
+    S.Value[i] = (byte)(Key * 17 + Version * 3 + i);
+  S.Present = true;
+}
+
+static int Verify(){
+  int Errors = 0;
+  for(int Key = 0; Key < KEYS; Key++)
+    {
+    byte Value[CONFIG_VALUE_SIZE];
+    memset(Value, 0, sizeof(Value));
+    bool Found = Newton.Config_Get(Settings[Key].Key, Value, sizeof(Value));
+    if(Found != Settings[Key].Present ||
+       (Found && memcmp(Value, Settings[Key].Value, Settings[Key].Length) != 0))
+      Errors++;
+    }
+  return Errors;
+}
+
+static void Latency(){
+  printf("%-26s %8s %10s\n", "operation", "xfers", "time(ms)");
+
+  // The usual layout: a 16-byte setting at a fixed address.
+  byte Value[16] = {0};
+  Sim_Reset();
+  for(int i = 0; i < 16; i++)
+    Value[i] = Newton.Memory_Read(0x200 + i);
+  printf("%-26s %8lu %10.2f\n", "Memory_Read x 16", Sim_Bus.Transactions, Sim_Time_Micros() / 1000.0);
+  Sim_Reset();
+  for(int i = 0; i < 16; i++)
+    Newton.Memory_Write(Value[i], 0x200 + i);
+  printf("%-26s %8lu %10.2f\n", "Memory_Write x 16", Sim_Bus.Transactions, Sim_Time_Micros() / 1000.0);
+
+  Sim_Reset();
+  Newton.Begin_Config();
+  for(int Key = 0; Key < KEYS; Key++)
+    Newton.Config_Set(Settings[Key].Key, Value, sizeof(Value));
+  unsigned long Transactions = Sim_Bus.Transactions;
+  unsigned long long Start = Sim_Time_Micros();
+  Newton.Config_Get(Settings[7].Key, Value, sizeof(Value));
+  printf("%-26s %8lu %10.2f\n", "Config_Get (16 bytes)", Sim_Bus.Transactions - Transactions,
+         (Sim_Time_Micros() - Start) / 1000.0);
+  Value[0]++;
+  Transactions = Sim_Bus.Transactions;
+  Start = Sim_Time_Micros();
+  Newton.Config_Set(Settings[7].Key, Value, sizeof(Value));
+  printf("%-26s %8lu %10.2f\n", "Config_Set (16 bytes)", Sim_Bus.Transactions - Transactions,
+         (Sim_Time_Micros() - Start) / 1000.0);
+  Transactions = Sim_Bus.Transactions;
+  Start = Sim_Time_Micros();
+  Newton.Begin_Config();
+  printf("%-26s %8lu %10.2f\n", "Begin_Config (12 keys)", Sim_Bus.Transactions - Transactions,
+         (Sim_Time_Micros() - Start) / 1000.0);
+  Transactions = Sim_Bus.Transactions;
+  Start = Sim_Time_Micros();
+  Newton.Config_Compact();
+  printf("%-26s %8lu %10.2f\n", "Config_Compact (12 keys)", Sim_Bus.Transactions - Transactions,
+         (Sim_Time_Micros() - Start) / 1000.0);
+}
+
+static void Updates(){
+  Sim_Reset();
+  Newton.Begin_Config();
+  for(int Key = 0; Key < KEYS; Key++)
+    {
+    Make_Value(Key, 0);
+    Newton.Config_Set(Settings[Key].Key, Settings[Key].Value, Settings[Key].Length);
+    }
+
+  unsigned long Compactions = 0;
+  for(int n = 0; n < UPDATES; n++)
+    {
+    int Key = (n * 7) % KEYS;
+    unsigned int Free = Newton.Config_Free();
+    if(n % 97 == 0)
+      {
+      Newton.Config_Remove(Settings[Key].Key);
+      Settings[Key].Present = false;
+      }
+    else
+      {
+      Make_Value(Key, n);
+      Newton.Config_Set(Settings[Key].Key, Settings[Key].Value, Settings[Key].Length);
+      }
+    if(Newton.Config_Free() > Free) Compactions++;
+    }
+  Sim_Check(Verify() == 0, "values after updates");
+  Newton.Begin_Config();
+  Sim_Check(Verify() == 0, "values after a reset");
+
+  unsigned long Get_Max, Set_Max;
+  Newton.Get_Config_Stats(&Get_Max, &Set_Max);
+  printf("\n%d updates, %lu compactions: longest Config_Get %.2f ms, Config_Set %.2f ms\n",
+         UPDATES, Compactions, Get_Max / 1000.0, Set_Max / 1000.0);
+  Sim_Check(Compactions > 10, "compactions exercised");
+}
+
+// Start of the active bank in the EEPROM image.
+static byte *Active_Bank(){
+  byte *Bank[2] = {Sim_EEPROM_Data() + CONFIG_START,
+                   Sim_EEPROM_Data() + CONFIG_START + (CONFIG_END - CONFIG_START) / 2};
+  if(Bank[1][0] != 'K') return Bank[0];
+  if(Bank[0][0] != 'K') return Bank[1];
+  int16_t Newer = (Bank[1][2] | Bank[1][3] << 8) - (Bank[0][2] | Bank[0][3] << 8);
+  return Newer > 0 ? Bank[1] : Bank[0];
+}
+
+static void Power_Failures(){
+  // A torn update: the CRC of the last entry written is damaged.
+  int Key = 3;
+  Make_Value(Key, 1);
+  Newton.Config_Set(Settings[Key].Key, Settings[Key].Value, Settings[Key].Length);
+  if(Newton.Config_Free() < 16) Newton.Config_Compact();
+  byte New[4] = {1, 2, 3, 4};
+  Newton.Config_Set(Settings[Key].Key, New, sizeof(New));
+  unsigned int End = (CONFIG_END - CONFIG_START) / 2 - Newton.Config_Free();
+  Active_Bank()[End - 1] ^= 0x55;
+  Newton.Begin_Config();
+  Sim_Check(Verify() == 0, "old value kept after a torn update");
+
+  // A compaction that never wrote the new bank's header.
+  Newton.Config_Compact();
+  Sim_Check(Verify() == 0, "values after compaction");
+  Active_Bank()[0] = 0xFF;
+  Newton.Begin_Config();
+  Sim_Check(Verify() == 0, "values after an interrupted compaction");
+  printf("power failures: %s\n", Sim_Failures ? "WRONG" : "ok");
+}
+
+int main(){
+  for(int Key = 0; Key < KEYS; Key++)
+    snprintf(Settings[Key].Key, sizeof(Settings[Key].Key), "key%d", Key * 13);
+
+  Latency();
+  Updates();
+  Power_Failures();
+  return Sim_Failures ? 1 : 0;
+}
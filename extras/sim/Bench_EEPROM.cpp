@@ -0,0 +1,168 @@
+/*
+ EEPROM benchmark.
+
+ Writes a 1 KB record through the simulated bus three ways and reports the
+ simulated time blocked and the bus traffic of each:
+
+    - the original driver: one transaction per byte followed by delay(5)
+    - Memory_Write(): one transaction per byte with acknowledge polling
+    - Memory_Write_Block(): page-split transactions with acknowledge polling
+
+ The record is then read back with Memory_Read() and Memory_Read_Block(),
+ a structure is stored and loaded with Memory_Put()/Memory_Get(), and a
+ read from a missing EEPROM must report an error.
+
+ Finally a typical sketch workload (a counter and a settings structure
+ updated every pass of loop()) is run directly against the EEPROM and
+ through a Memory_Cache, and the cache counters are reported.
+
+ The program exits with a non-zero status if any data differs or an error
+ goes unreported.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+#define RECORD_SIZE     1024
+#define RECORD_ADDRESS  100      // Deliberately not page aligned.
+
+static byte Record[RECORD_SIZE];
+
+static void Legacy_Write(byte Data, unsigned long Address){
+  Wire.beginTransmission(EEPROM_ADDRESS);
+  Wire.write(Address>>8);
+  Wire.write(Address&0xFF);
+  Wire.write(Data);
+  Wire.endTransmission();
+  delay(5);
+}
+
+static void Report(const char *Name, const byte *Data){
+  bool Match = memcmp(Data, Record, RECORD_SIZE) == 0;
+  if(!Match)
+    Sim_Failures++;
+  printf("%-22s %10.1f %8lu %8lu %8lu %8lu  %s\n", Name,
+         Sim_Time_Micros() / 1000.0, Sim_Bus.Transactions, Sim_Bus.Bytes,
+         Sim_Bus.Naks, Sim_EEPROM_Write_Cycles, Match ? "ok" : "MISMATCH");
+}
+
+#define PASSES  1000
+
+struct Workload_Settings { byte Mode; byte Volume; unsigned int Interval; unsigned long Count; };
+
+static void Workload_Pass(Workload_Settings &S, int Pass){
+  S.Count++;
+  if(Pass % 100 == 0) S.Mode++;
+}
+
+static void Cache_Workload(){
+  Workload_Settings Direct = {1, 5, 500, 0}, Cached = Direct;
+
+  printf("\n%d passes updating a counter and a settings structure\n\n", PASSES);
+  printf("%-22s %10s %8s %8s %8s %8s %8s\n", "method", "time(ms)", "xfers", "cycles", "hits", "misses", "flushes");
+
+  Sim_Reset();
+  for(int Pass = 0; Pass < PASSES; Pass++)
+    {
+    byte Restarts = Newton.Memory_Read(0);
+    Newton.Memory_Write(Restarts, 0);
+    Workload_Pass(Direct, Pass);
+    Newton.Memory_Put(Direct, 8);
+    }
+  printf("%-22s %10.1f %8lu %8lu\n", "Memory_Read/Put", Sim_Time_Micros() / 1000.0,
+         Sim_Bus.Transactions, Sim_EEPROM_Write_Cycles);
+
+  Sim_Reset();
+  Memory_Cache<2> Cache;
+  for(int Pass = 0; Pass < PASSES; Pass++)
+    {
+    byte Restarts = Cache.Read(0);
+    Cache.Write(Restarts, 0);
+    Workload_Pass(Cached, Pass);
+    Cache.Put(Cached, 8);
+    if(Pass % 100 == 99) Cache.Flush();
+    }
+  printf("%-22s %10.1f %8lu %8lu %8lu %8lu %8lu\n", "Memory_Cache<2>", Sim_Time_Micros() / 1000.0,
+         Sim_Bus.Transactions, Sim_EEPROM_Write_Cycles, Cache.Hits, Cache.Misses, Cache.Flushes);
+
+  Workload_Settings Stored;
+  memcpy(&Stored, Sim_EEPROM_Data() + 8, sizeof(Stored));
+  if(memcmp(&Stored, &Cached, sizeof(Stored)) != 0 || Cache.Unchanged == 0)
+    {
+    printf("Memory_Cache: MISMATCH\n");
+    Sim_Failures++;
+    }
+
+  // The least recently used page is still the one evicted after the
+  // access stamps have wrapped (65536 accesses on AVR).
+  Memory_Cache<2> Long_Run;
+  for(long i = 0; i < 60000; i++) Long_Run.Read(0);
+  Long_Run.Read(EEPROM_PAGE_SIZE);
+  for(long i = 0; i < 10000; i++) Long_Run.Read(0);
+  Long_Run.Read(2 * EEPROM_PAGE_SIZE);
+  unsigned long Misses = Long_Run.Misses;
+  Long_Run.Read(0);
+  if(Long_Run.Misses != Misses)
+    {
+    printf("Memory_Cache: recently used page evicted after 70000 accesses\n");
+    Sim_Failures++;
+    }
+}
+
+int main(){
+  for(int i = 0; i < RECORD_SIZE; i++)
+    Record[i] = (byte)(i * 7 + 3);
+
+  printf("%d byte record at address %d\n\n", RECORD_SIZE, RECORD_ADDRESS);
+  printf("%-22s %10s %8s %8s %8s %8s\n", "method", "time(ms)", "xfers", "bytes", "naks", "cycles");
+
+  Sim_Reset();
+  for(int i = 0; i < RECORD_SIZE; i++)
+    Legacy_Write(Record[i], RECORD_ADDRESS + i);
+  Report("write + delay(5)", Sim_EEPROM_Data() + RECORD_ADDRESS);
+
+  Sim_Reset();
+  for(int i = 0; i < RECORD_SIZE; i++)
+    Newton.Memory_Write(Record[i], RECORD_ADDRESS + i);
+  Report("Memory_Write", Sim_EEPROM_Data() + RECORD_ADDRESS);
+
+  Sim_Reset();
+  if(!Newton.Memory_Write_Block(Record, RECORD_SIZE, RECORD_ADDRESS))
+    Sim_Failures++;
+  Report("Memory_Write_Block", Sim_EEPROM_Data() + RECORD_ADDRESS);
+
+  static byte Readback[RECORD_SIZE];
+  byte *Image = Sim_EEPROM_Data();
+
+  Sim_Reset();
+  memcpy(Image + RECORD_ADDRESS, Record, RECORD_SIZE);
+  for(int i = 0; i < RECORD_SIZE; i++)
+    Readback[i] = Newton.Memory_Read(RECORD_ADDRESS + i);
+  Report("Memory_Read", Readback);
+
+  Sim_Reset();
+  memcpy(Image + RECORD_ADDRESS, Record, RECORD_SIZE);
+  memset(Readback, 0, sizeof(Readback));
+  if(!Newton.Memory_Read_Block(Readback, RECORD_SIZE, RECORD_ADDRESS))
+    Sim_Failures++;
+  Report("Memory_Read_Block", Readback);
+
+  struct { unsigned long Serial; int Offset; byte Flags; } Settings = {123456UL, -42, 0x5A}, Loaded;
+  Sim_Reset();
+  if(!Newton.Memory_Put(Settings, 60) || !Newton.Memory_Get(Loaded, 60) ||
+     memcmp(&Settings, &Loaded, sizeof(Settings)) != 0)
+    {
+    printf("Memory_Put/Memory_Get: MISMATCH\n");
+    Sim_Failures++;
+    }
+
+  Sim_EEPROM_Connect(false);
+  if(Newton.Memory_Get(Loaded, 60) || Newton.Memory_Read(60) != 0xFF)
+    {
+    printf("missing EEPROM: error not reported\n");
+    Sim_Failures++;
+    }
+
+  Cache_Workload();
+  return Sim_Failures ? 1 : 0;
+}
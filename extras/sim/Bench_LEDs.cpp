@@ -0,0 +1,169 @@
+/*
+ LED benchmark.
+
+ Runs Set_Alarm_Time() (whose Timer1 interrupt flashes the status LED) for
+ five seconds under a loop() that only calls delay(1), and reports the
+ longest pass of the loop and the longest time blocked inside an interrupt
+ handler.  Background blink and one-shot patterns are sampled every mS and
+ checked against their expected timing, and LED_Indicators() and the
+ FastPin templates are checked against the pin levels.  Dimmed LEDs are
+ sampled every uS: the share of time lit must match the gamma curve, fades
+ must reach their target on time and breathing must sweep the full range.
+ The program exits with a non-zero status if any check fails.
+*/
+
+#include <math.h>
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+// Share of the time Pin is lit over Time uS, sampled every uS.
+static double Duty(byte Pin, unsigned long Time){
+  unsigned long Lit = 0;
+  for(unsigned long i = 0; i < Time; i++)
+    {
+    Sim_Advance(1);
+    Lit += digitalRead(Pin);
+    }
+  return (double)Lit / Time;
+}
+
+// Share of the time lit for a brightness: the gamma-corrected 6-bit duty,
+// each step lasting 4 of the 256 counts of a Timer0 cycle.
+static double Expected_Duty(byte Level){
+  return round(63.0 * pow(Level / 255.0, 2.2)) * 4 / 256;
+}
+
+static void Dimming(){
+  static const byte Levels[4] = {40, 100, 180, 254};
+  Sim_Reset();
+  Newton.LED_Indicators(OFF, OFF, OFF);
+  printf("\n%-26s %9s %9s\n", "dimming", "lit(%)", "expected");
+  for(int i = 0; i < 4; i++)
+    {
+    // LED2 is dimmed too, to a different level, and must not disturb LED1.
+    Newton.LED_Brightness(LED1, Levels[i]);
+    Newton.LED_Brightness(LED2, 255 - Levels[i]);
+    delay(2);
+    double Lit = Duty(LED1, 4096), Expected = Expected_Duty(Levels[i]);
+    printf("LED_Brightness(LED1, %3d) %9.1f %9.1f\n", Levels[i], 100.0 * Lit, 100.0 * Expected);
+    Sim_Check(fabs(Lit - Expected) < 0.01, "brightness follows the gamma curve");
+    }
+  Newton.LED_Brightness(LED2, 255);
+  Sim_Check(Duty(LED2, 2048) == 1.0, "full brightness lights the LED steadily");
+
+  // A fade from off to full over 500 mS.
+  Newton.LED_Brightness(LED1, 0);
+  Sim_Check(Duty(LED1, 2048) == 0.0, "zero brightness turns the LED off");
+  Newton.LED_Fade(LED1, 255, 500);
+  delay(256);
+  double Half = Duty(LED1, 1024);
+  delay(256);
+  double Full = Duty(LED1, 2048);
+  printf("LED_Fade(LED1, 255, 500): %.1f%% lit half way, %.1f%% at the end\n", 100.0 * Half, 100.0 * Full);
+  Sim_Check(Half >= Expected_Duty(124) && Half <= Expected_Duty(132) && Full == 1.0, "fade timing");
+
+  // Breathing once a second, measured in 16 mS windows over two seconds.
+  Newton.LED_Breathe(LED_STATUS, 1000);
+  double Least = 1.0, Most = 0.0;
+  unsigned long Rises = 0;
+  double Last = 0.0;
+  for(int i = 0; i < 125; i++)
+    {
+    double Lit = Duty(LED_STATUS, 16384);
+    if(Lit < Least) Least = Lit;
+    if(Lit > Most) Most = Lit;
+    if(Lit < 0.02 && Last >= 0.02) Rises++;
+    Last = Lit;
+    }
+  printf("LED_Breathe(LED_STATUS, 1000): %.1f%% to %.1f%% lit, %lu breaths in 2 S\n", 100.0 * Least, 100.0 * Most, Rises);
+  Sim_Check(Least < 0.02 && Most > 0.9 && Rises == 2, "breathing");
+  Sim_Check(TIMSK0 & (1 << OCIE0B), "PWM runs while an LED is dimmed");
+
+  // An indicator ends the dimming; the interrupt stops with the last LED.
+  Newton.Status_Indicator(ON);
+  Sim_Check(Duty(LED_STATUS, 2048) == 1.0, "indicator ends dimming");
+  Sim_Check(!(TIMSK0 & (1 << OCIE0B)), "PWM stopped with the last dimmed LED");
+  printf("dimming: %s\n", Sim_Failures ? "WRONG" : "ok");
+}
+
+int main(){
+  // Status LED flashing from the Timer1 interrupt.
+  Sim_Reset();
+  Newton.Set_Alarm_Time();
+  unsigned long Longest_Pass = 0, Lit = 0, Samples = 0;
+  while(Sim_Time_Micros() < 5000000ULL)
+    {
+    unsigned long long Start = Sim_Time_Micros();
+    delay(1);
+    unsigned long Pass = (unsigned long)(Sim_Time_Micros() - Start);
+    if(Pass > Longest_Pass) Longest_Pass = Pass;
+    Lit += digitalRead(LED_STATUS);
+    Samples++;
+    }
+  TIMSK1 = 0;
+  printf("Set_Alarm_Time: %lu interrupts, longest loop pass %lu uS, longest handler %lu uS, status LED lit %.0f%%\n",
+         Sim_ISR.Calls, Longest_Pass, Sim_ISR.Blocked_Max, 100.0 * Lit / Samples);
+  Sim_Check(Longest_Pass < 2000, "loop blocked by the Timer1 interrupt");
+  Sim_Check(Lit > Samples * 7 / 10 && Lit < Samples * 9 / 10, "status LED lit 400 of every 500 mS");
+
+  // A repeating 100/200 mS blink for three seconds.
+  Sim_Reset();
+  Newton.LED_Blink(LED1, 100, 200);
+  unsigned long Edges = 0;
+  Lit = Samples = 0;
+  int Last = digitalRead(LED1);
+  for(int i = 0; i < 3000; i++)
+    {
+    delay(1);
+    int Level = digitalRead(LED1);
+    if(Level != Last) Edges++;
+    Last = Level;
+    Lit += Level;
+    Samples++;
+    }
+  printf("LED_Blink(100,200): %lu edges in 3 S, lit %.0f%%\n", Edges, 100.0 * Lit / Samples);
+  Sim_Check(Edges >= 19 && Edges <= 21, "blink period");
+  Sim_Check(Lit > Samples * 30 / 100 && Lit < Samples * 37 / 100, "blink duty cycle");
+  Newton.LED_Stop(LED1);
+  Sim_Check(digitalRead(LED1) == LOW, "LED_Stop");
+
+  // A one-shot pattern ends with the LED off.
+  static const unsigned int Steps[3] = {10, 20, 30};
+  Newton.LED_Pattern(LED2, Steps, 3, false);
+  Sim_Check(digitalRead(LED2) == HIGH, "pattern starts on");
+  delay(100);
+  Sim_Check(digitalRead(LED2) == LOW, "one-shot pattern ends off");
+
+  // Steps last their time in mS, although the tick is 1.024 mS.
+  static const unsigned int Second[1] = {1000};
+  Newton.LED_Pattern(LED2, Second, 1, false);
+  unsigned long On = 0;
+  while(digitalRead(LED2) == HIGH && On < 2000)
+    {
+    delay(1);
+    On++;
+    }
+  printf("1000 mS pattern step: lit %lu mS\n", On);
+  Sim_Check(On >= 999 && On <= 1002, "pattern step length");
+
+  // All three LEDs at once, leaving SW1 (on the same port) pulled up and
+  // readable while it is held down.
+  Newton.LED_Blink(LED_STATUS, 100, 100);
+  Sim_Pin_Input(SW1, LOW);
+  Newton.LED_Indicators(ON, OFF, ON);
+  Sim_Check(digitalRead(LED1) == HIGH && digitalRead(LED2) == LOW && digitalRead(LED_STATUS) == HIGH,
+            "LED_Indicators");
+  delay(300);
+  Sim_Check(digitalRead(LED_STATUS) == HIGH, "LED_Indicators stops patterns");
+  Sim_Check((PORTD & FastPin<SW1>::Mask) && !FastPin<SW1>::Read() && Newton.SW1_Status(),
+            "SW1 unaffected by LED_Indicators");
+  Sim_Pin_Input(SW1, HIGH);
+  FastPin<LED2>::Toggle();
+  Sim_Check(digitalRead(LED2) == HIGH && FastPin<LED2>::Read(), "FastPin toggle");
+  FastPins<LED1, LED2, LED_STATUS>::Write(0);
+  Sim_Check(!digitalRead(LED1) && !digitalRead(LED2) && !digitalRead(LED_STATUS), "FastPins write");
+  printf("LED_Indicators and FastPin: %s\n", Sim_Failures ? "WRONG" : "ok");
+
+  Dimming();
+  return Sim_Failures ? 1 : 0;
+}
@@ -0,0 +1,194 @@
+/*
+ Data log benchmark.
+
+ Logs timestamped 6-byte sensor samples to the EEPROM two ways and reports
+ records per second of simulated time and EEPROM write cycles:
+
+    - the usual sketch: Memory_Write() of each byte of time and sample at
+      the next address
+    - Log_Append(): 16-byte records (number, time, sample, CRC) written a
+      page at a time (in three transactions, as the Wire buffer holds
+      only 30 bytes of data)
+
+ It then compares finding the end of the log after a reset (a scan of the
+ chip for the first blank sample against Begin_Log()'s bisection) with the
+ log half full, checks that three turns of the log wear every page
+ equally, that a record torn by a power failure is detected and
+ overwritten, and that Log_Find() returns the same records as a linear
+ search by time.
+
+ The program exits with a non-zero status if any check fails.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+#define SAMPLES     1500       // Fewer than the log holds.
+#define SAMPLE_SIZE 6
+#define START_TIME  500000000UL    // Epoch seconds (2015).
+
+static void Sample(unsigned long n, byte *Data){
+  for(int i = 0; i < SAMPLE_SIZE; i++)
+    Data[i] = (byte)(n * 31 + i);
+}
+
+static void Report(const char *Name, unsigned long Records){
+  double Seconds = Sim_Time_Micros() / 1e6;
+  printf("%-22s %8lu %10.1f %10.1f %8lu\n", Name, Records, Seconds * 1000.0,
+         Records / Seconds, Sim_EEPROM_Write_Cycles);
+}
+
+// Writes records until the log holds Count of them.
+static void Fill(unsigned long Count){
+  byte Data[SAMPLE_SIZE];
+  while(Newton.Log_Count() < Count)
+    {
+    unsigned long n = Newton.Log_Count();
+    Sample(n, Data);
+    Newton.Log_Append(START_TIME + n * 10, Data, SAMPLE_SIZE);
+    }
+  Newton.Log_Flush();
+}
+
+static void Appending(){
+  byte Data[SAMPLE_SIZE];
+
+  printf("%-22s %8s %10s %10s %8s\n", "method", "records", "time(ms)", "records/s", "cycles");
+
+  Sim_Reset();
+  unsigned long Address = LOG_START;
+  for(unsigned long n = 0; n < SAMPLES; n++)
+    {
+    unsigned long Time = START_TIME + n * 10;
+    Sample(n, Data);
+    for(int i = 0; i < 4; i++)
+      Newton.Memory_Write(Time >> (8 * i), Address++);
+    for(int i = 0; i < SAMPLE_SIZE; i++)
+      Newton.Memory_Write(Data[i], Address++);
+    }
+  Report("Memory_Write", SAMPLES);
+
+  Sim_Reset();
+  Newton.Begin_Log();
+  for(unsigned long n = 0; n < SAMPLES; n++)
+    {
+    Sample(n, Data);
+    Newton.Log_Append(START_TIME + n * 10, Data, SAMPLE_SIZE);
+    }
+  Newton.Log_Flush();
+  Report("Log_Append", SAMPLES);
+
+  // Every record must read back as written, before and after a reset.
+  for(int Pass = 0; Pass < 2; Pass++)
+    {
+    int Errors = 0;
+    Log_Record Record;
+    for(unsigned long n = 0; n < SAMPLES; n++)
+      {
+      Sample(n, Data);
+      if(!Newton.Log_Read(n, &Record) || Record.Sequence != n + 1 ||
+         Record.Time != START_TIME + n * 10 || memcmp(Record.Data, Data, SAMPLE_SIZE) != 0)
+        Errors++;
+      }
+    Sim_Check(Errors == 0 && Newton.Log_Count() == SAMPLES, "records read back");
+    Newton.Begin_Log();
+    }
+}
+
+static void Recovery(){
+  unsigned long Capacity = (LOG_END - LOG_START) / LOG_RECORD_SIZE;
+
+  printf("\nfinding the end of a log of %lu records\n\n", Capacity / 2);
+  printf("%-22s %10s %8s\n", "method", "time(ms)", "xfers");
+
+  Sim_Reset();
+  Newton.Begin_Log();
+  Fill(Capacity / 2);
+
+  // The usual sketch stores 10-byte samples and looks for the first blank one.
+  unsigned long long Start = Sim_Time_Micros();
+  unsigned long Transactions = Sim_Bus.Transactions;
+  unsigned long Address = LOG_START;
+  byte Data[10];
+  for(; Address < LOG_END; Address += sizeof(Data))
+    {
+    Newton.Memory_Read_Block(Data, sizeof(Data), Address);
+    bool Blank = true;
+    for(unsigned int i = 0; i < sizeof(Data); i++)
+      Blank = Blank && Data[i] == 0xFF;
+    if(Blank) break;
+    }
+  printf("%-22s %10.1f %8lu\n", "linear scan", (Sim_Time_Micros() - Start) / 1000.0,
+         Sim_Bus.Transactions - Transactions);
+
+  Start = Sim_Time_Micros();
+  Transactions = Sim_Bus.Transactions;
+  Newton.Begin_Log();
+  printf("%-22s %10.1f %8lu\n", "Begin_Log", (Sim_Time_Micros() - Start) / 1000.0,
+         Sim_Bus.Transactions - Transactions);
+  Sim_Check(Newton.Log_Count() == Capacity / 2, "end of a half-full log");
+
+  // A record torn by a power failure ends the log; the next record replaces it.
+  Sim_EEPROM_Data()[LOG_START + (Capacity / 2 - 1) * LOG_RECORD_SIZE + 9] ^= 0x55;
+  Newton.Begin_Log();
+  Sim_Check(Newton.Log_Count() == Capacity / 2 - 1, "torn record detected");
+  Fill(Capacity / 2);
+  Newton.Begin_Log();
+  Sim_Check(Newton.Log_Count() == Capacity / 2, "torn record replaced");
+}
+
+static void Wear(){
+  unsigned long Capacity = (LOG_END - LOG_START) / LOG_RECORD_SIZE;
+  byte Data[SAMPLE_SIZE] = {0};
+
+  Sim_Reset();
+  Newton.Begin_Log();
+  for(unsigned long n = 0; n < 3 * Capacity; n++)
+    Newton.Log_Append(START_TIME + n, Data, SAMPLE_SIZE);
+
+  unsigned long Least = ~0UL, Most = 0;
+  for(unsigned int Page = LOG_START / EEPROM_PAGE_SIZE; Page < LOG_END / EEPROM_PAGE_SIZE; Page++)
+    {
+    unsigned long Cycles = Sim_EEPROM_Page_Cycles(Page);
+    if(Cycles < Least) Least = Cycles;
+    if(Cycles > Most) Most = Cycles;
+    }
+  printf("\n%lu records (3 turns): %lu to %lu write cycles per page\n", 3 * Capacity, Least, Most);
+  Sim_Check(Least == Most, "even wear");
+
+  Newton.Begin_Log();
+  Log_Record Record;
+  Sim_Check(Newton.Log_Count() == Capacity && Newton.Log_Read(0, &Record) &&
+            Record.Sequence == 2 * Capacity + 1, "oldest record after wrapping");
+}
+
+static void Query(){
+  Sim_Reset();
+  Newton.Begin_Log();
+  Fill(1000);
+
+  int Errors = 0;
+  Log_Record Record;
+  for(unsigned long Time = START_TIME - 5; Time < START_TIME + 10005; Time += 7)
+    {
+    unsigned long Expected = 0;
+    while(Expected < 1000 && Newton.Log_Read(Expected, &Record) && Record.Time < Time)
+      Expected++;
+    if(Newton.Log_Find(Time) != Expected)
+      Errors++;
+    }
+
+  unsigned long long Start = Sim_Time_Micros();
+  unsigned long Index = Newton.Log_Find(START_TIME + 5000);
+  printf("Log_Find in 1000 records: %.1f ms\n", (Sim_Time_Micros() - Start) / 1000.0);
+  Sim_Check(Index == 500 && Errors == 0, "Log_Find");
+}
+
+int main(){
+  printf("%d samples of %d bytes\n\n", SAMPLES, SAMPLE_SIZE);
+  Appending();
+  Recovery();
+  Wear();
+  Query();
+  return Sim_Failures ? 1 : 0;
+}
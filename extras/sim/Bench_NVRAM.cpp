@@ -0,0 +1,179 @@
+/*
+ NVRAM benchmark.
+
+ Reports the time a counter update keeps the caller blocked, and what it
+ costs in bus traffic and EEPROM write cycles, when the counter is kept:
+
+    - in the EEPROM (Memory_Put(), which waits for the write cycle)
+    - in the RTC's NVRAM (NVRAM_Put())
+    - in an NVRAM_Counters, which also checkpoints it to the EEPROM
+
+ then runs a counter updated every LOOP_TIME mS for RUN_TIME seconds
+ through NVRAM_Counters and reports the checkpoints written against the
+ EEPROM writes the same counter would have made.
+
+ NVRAM_Read() and NVRAM_Write() must take a block of up to 31 bytes in one
+ transaction, keep to the NVRAM (never reaching the clock registers), and
+ report a missing RTC.  NVRAM_Counters must come back after a restart from
+ the NVRAM, after the RTC's battery is lost or a slot damaged from the
+ checkpoint, and from nothing as zeros.
+
+ The program exits with a non-zero status if any check fails.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+#define UPDATES      1000
+#define LOOP_TIME    100          // mS between counter updates.
+#define RUN_TIME     600          // S.
+#define CHECKPOINT   60           // S between checkpoints.
+#define COUNTERS     4
+#define NVRAM_AT     8            // Where the counters are kept in the NVRAM,
+#define EEPROM_AT    0x0080       // and checkpointed in the EEPROM.
+
+static void Blocks(){
+  byte Data[NVRAM_SIZE], Copy[NVRAM_SIZE];
+  for(int i = 0; i < NVRAM_SIZE; i++)
+    Data[i] = (byte)(i * 13 + 5);
+
+  Sim_Reset();
+  Sim_Check(Newton.NVRAM_Write(Data, 31, 0) && Sim_Bus.Transactions == 1, "31 bytes written in one transaction");
+  unsigned long Before = Sim_Bus.Transactions;
+  Sim_Check(Newton.NVRAM_Write(Data, NVRAM_SIZE, 0) && memcmp(Sim_RTC_RAM(), Data, NVRAM_SIZE) == 0, "block written");
+  unsigned long Written = Sim_Bus.Transactions - Before;
+  Before = Sim_Bus.Transactions;
+  Sim_Check(Newton.NVRAM_Read(Copy, NVRAM_SIZE, 0) && memcmp(Copy, Data, NVRAM_SIZE) == 0, "block read");
+  printf("%d bytes: written in %lu transactions, read in %lu\n", NVRAM_SIZE, Written, Sim_Bus.Transactions - Before);
+  Sim_Check(Written == 2, "56 bytes written in two transactions");
+
+  // Past the end the DS1307 would wrap round to the seconds register.
+  unsigned long Time = Sim_RTC_Seconds();
+  Sim_Check(!Newton.NVRAM_Write(Data, 2, NVRAM_SIZE - 1) && !Newton.NVRAM_Write(Data, 1, NVRAM_SIZE) &&
+            !Newton.NVRAM_Read(Copy, NVRAM_SIZE + 1, 0) && !Newton.NVRAM_Read(Copy, 1, 255),
+            "ranges past the NVRAM refused");
+  Sim_Check(Newton.NVRAM_Write(Data, 1, NVRAM_SIZE - 1) && Newton.NVRAM_Read(Copy, 1, NVRAM_SIZE - 1),
+            "ranges to the end accepted");
+  Sim_Check(Sim_RTC_Seconds() == Time && Newton.Get_Epoch() == Time, "clock registers left alone");
+
+  struct { unsigned long Serial; int Offset; byte Flags; } Settings = {123456UL, -42, 0x5A}, Loaded;
+  Sim_Check(Newton.NVRAM_Put(Settings, 40) && Newton.NVRAM_Get(Loaded, 40) &&
+            memcmp(&Settings, &Loaded, sizeof(Settings)) == 0, "NVRAM_Put() and NVRAM_Get()");
+
+  Sim_RTC_Connect(false);
+  Sim_Check(!Newton.NVRAM_Get(Loaded, 40) && !Newton.NVRAM_Put(Settings, 40), "missing RTC reported");
+}
+
+// Updates a counter UPDATES times one way; reports the time blocked per
+// update, the bus traffic and the EEPROM write cycles.
+static void Latency(const char *Name, int Method){
+  Sim_Reset();
+  NVRAM_Counters<COUNTERS> Counters(NVRAM_AT, EEPROM_AT);
+  Sim_Check(Counters.Begin(0), "counters begun");
+  unsigned long Transactions = Sim_Bus.Transactions, Bytes = Sim_Bus.Bytes;
+  unsigned long long Total = 0, Worst = 0;
+  unsigned long Count = 0;
+  for(int i = 0; i < UPDATES; i++)
+    {
+    unsigned long long Start = Sim_Time_Micros();
+    bool Ok;
+    Count++;
+    if(Method == 0)
+      Ok = Newton.Memory_Put(Count, EEPROM_AT);
+    else if(Method == 1)
+      Ok = Newton.NVRAM_Put(Count, NVRAM_AT);
+    else
+      Ok = Counters.Add(0);
+    unsigned long long Blocked = Sim_Time_Micros() - Start;
+    Sim_Check(Ok, Name);
+    Total += Blocked;
+    if(Blocked > Worst) Worst = Blocked;
+    Sim_Advance(1000);
+    }
+  printf("%-18s %10.1f %10llu %8.1f %8.1f %8lu\n", Name, (double)Total / UPDATES, Worst,
+         (double)(Sim_Bus.Transactions - Transactions) / UPDATES, (double)(Sim_Bus.Bytes - Bytes) / UPDATES,
+         Sim_EEPROM_Write_Cycles);
+  if(Method == 2)
+    Sim_Check(Counters.Get(0) == UPDATES && Sim_EEPROM_Write_Cycles == 0, "counter kept without the EEPROM");
+}
+
+// A counter updated every LOOP_TIME mS, checkpointed every CHECKPOINT S.
+static void Checkpoints(){
+  Sim_Reset();
+  NVRAM_Counters<COUNTERS> Counters(NVRAM_AT, EEPROM_AT);
+  Sim_Check(Counters.Begin(CHECKPOINT), "counters begun");
+  unsigned long Updates = 0;
+  unsigned long long Worst = 0;
+  for(unsigned long Time = 0; Time < RUN_TIME * 1000UL; Time += LOOP_TIME)
+    {
+    Counters.Add(1);
+    Updates++;
+    unsigned long long Start = Sim_Time_Micros();
+    if(Counters.Service() && Sim_Time_Micros() - Start > Worst)
+      Worst = Sim_Time_Micros() - Start;
+    Sim_Advance(LOOP_TIME * 1000UL - 1000);
+    }
+  printf("\n%lu updates in %d S, checkpoint every %d S: %lu checkpoints (%lu EEPROM write cycles"
+         ", at most %llu uS each) rather than %lu\n", Updates, RUN_TIME, CHECKPOINT, Counters.Checkpoints,
+         Sim_EEPROM_Write_Cycles, Worst, Updates);
+  Sim_Check(Counters.Checkpoints >= RUN_TIME / CHECKPOINT - 1 && Counters.Checkpoints <= RUN_TIME / CHECKPOINT,
+            "checkpoints on schedule");
+  for(int i = 0; i < 100; i++)
+    Sim_Advance(CHECKPOINT * 20000UL);
+  unsigned long Written = Counters.Checkpoints;
+  Counters.Service();
+  Sim_Check(Counters.Checkpoints == Written + 1, "last change checkpointed");
+  Sim_Advance(CHECKPOINT * 2000000UL);
+  Sim_Check(!Counters.Service() && Counters.Checkpoints == Written + 1, "no checkpoint without a change");
+}
+
+static void Recovery(){
+  Sim_Reset();
+  {
+  NVRAM_Counters<COUNTERS> Fresh(NVRAM_AT, EEPROM_AT);
+  Sim_Check(Fresh.Begin(CHECKPOINT) && Fresh.Recovered == COUNTERS && Fresh.Get(0) == 0 && Fresh.Get(3) == 0,
+            "a new board starts from zero");
+  for(byte i = 0; i < COUNTERS; i++)
+    Fresh.Set(i, 1000 * (i + 1));
+  Sim_Check(Fresh.Checkpoint(), "checkpoint written");
+  Fresh.Add(0, 5);
+  Sim_Check(!Fresh.Set(COUNTERS, 1) && Fresh.Get(COUNTERS) == 0, "counter out of range refused");
+  }
+
+  NVRAM_Counters<COUNTERS> Restart(NVRAM_AT, EEPROM_AT);
+  Sim_Check(Restart.Begin(CHECKPOINT) && Restart.Recovered == 0 && Restart.Get(0) == 1005 && Restart.Get(3) == 4000,
+            "restart from the NVRAM");
+
+  memset(Sim_RTC_RAM(), 0x5A, NVRAM_SIZE);
+  NVRAM_Counters<COUNTERS> Lost(NVRAM_AT, EEPROM_AT);
+  Sim_Check(Lost.Begin(CHECKPOINT) && Lost.Recovered == COUNTERS && Lost.Get(0) == 1000 && Lost.Get(3) == 4000,
+            "battery lost: back to the checkpoint");
+  NVRAM_Counters<COUNTERS> Again(NVRAM_AT, EEPROM_AT);
+  Sim_Check(Again.Begin(CHECKPOINT) && Again.Recovered == 0 && Again.Get(0) == 1000, "NVRAM rewritten");
+
+  Again.Add(2);
+  Sim_RTC_RAM()[NVRAM_AT + 2 * NVRAM_SLOT_SIZE] ^= 0x04;
+  NVRAM_Counters<COUNTERS> Damaged(NVRAM_AT, EEPROM_AT);
+  Sim_Check(Damaged.Begin(CHECKPOINT) && Damaged.Recovered == 1 && Damaged.Get(2) == 3000 && Damaged.Get(0) == 1000,
+            "damaged slot taken from the checkpoint");
+
+  Sim_RTC_Connect(false);
+  NVRAM_Counters<COUNTERS> Missing(NVRAM_AT, EEPROM_AT);
+  Sim_Check(!Missing.Begin(CHECKPOINT) && !Missing.Add(0), "missing RTC reported");
+  Sim_RTC_Connect(true);
+  printf("\nrestart, lost battery, damaged slot and missing RTC: %s\n", Sim_Failures ? "WRONG" : "ok");
+}
+
+int main(){
+  Blocks();
+
+  printf("\n%d updates of a 4-byte counter\n\n", UPDATES);
+  printf("%-18s %10s %10s %8s %8s %8s\n", "method", "mean(uS)", "worst(uS)", "xfers", "bytes", "cycles");
+  Latency("Memory_Put", 0);
+  Latency("NVRAM_Put", 1);
+  Latency("NVRAM_Counters", 2);
+
+  Checkpoints();
+  Recovery();
+  return Sim_Failures ? 1 : 0;
+}
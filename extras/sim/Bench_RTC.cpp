@@ -0,0 +1,145 @@
+/*
+ RTC benchmark.
+
+ Reads the time four times a second for four simulated hours, as a clock
+ display would, with the RTC crystal running 100 ppm fast, three ways:
+
+    - uncached: every Get_Time() reads the DS1307 over the bus
+    - Begin_Time_Cache(60): a RAM copy advanced by millis(), resynced
+      every minute
+    - Begin_Time_Cache(60, 3): the same, advanced by the RTC's 1 Hz SQW
+      output on pin 3 (INT1)
+
+ For each it reports the bus traffic and the simulated time spent on the
+ bus, the largest error of the time returned against the RTC, and the
+ resync and drift counters of the cache.
+
+ The epoch conversions are then checked: Date_To_Epoch() and
+ Epoch_To_Date() must agree for every day from 2000 to 2099 (and with the
+ simulated DS1307, which counts from the same epoch), and Set_Epoch() and
+ Get_Epoch() must round-trip through the RTC.
+
+ The program exits with a non-zero status if the cached time is ever more
+ than one second out (none at all with SQW), if the cache does not cut the
+ bus traffic, or if any conversion is wrong.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+#define READ_INTERVAL  250UL                // mS between reads.
+#define RUN_TIME       (4UL * 3600UL)       // S.
+#define RTC_ERROR      100                  // ppm.
+
+// Cached time against the RTC, in seconds (within the same day is enough).
+static long Time_Error(){
+  byte Second, Minute, Hour, Day_Of_Week, Day, Month, Year;
+  Newton.Get_Current_Time_Values(&Second, &Minute, &Hour, &Day_Of_Week, &Day, &Month, &Year);
+  long Error = ((long)Hour * 3600 + Minute * 60 + Second) - (long)(Sim_RTC_Seconds() % 86400);
+  if(Error > 43200) Error -= 86400;
+  if(Error < -43200) Error += 86400;
+  return Error;
+}
+
+static unsigned long Run(const char *Name, int Resync, int SQW_Pin, long Max_Error){
+  Sim_Reset();
+  Sim_RTC_Set(2023, 12, 31, 22, 59, 30);      // Runs over the new year.
+  Sim_RTC_Set_Error(RTC_ERROR);
+  if(SQW_Pin >= 0) Sim_RTC_SQW_Pin(SQW_Pin);
+  Sim_Advance(123456);                        // Not aligned with the RTC.
+  Newton.Begin_Time_Cache(Resync, SQW_Pin);
+
+  unsigned long Transactions = Sim_Bus.Transactions;
+  unsigned long long Bus_Time = 0;
+  unsigned long Reads = 0, Wrong = 0;
+  long Worst = 0;
+  char Text[20];
+  for(unsigned long Pass = 0; Pass < RUN_TIME * 1000 / READ_INTERVAL; Pass++)
+    {
+    unsigned long long Start = Sim_Time_Micros();
+    Newton.Get_Time(Text);
+    Bus_Time += Sim_Time_Micros() - Start;
+    Reads++;
+
+    long Error = Time_Error();
+    if(Error) Wrong++;
+    if(labs(Error) > labs(Worst)) Worst = Error;
+    delay(READ_INTERVAL);
+    }
+  Transactions = Sim_Bus.Transactions - Transactions;
+
+  unsigned long Resyncs;
+  long Drift;
+  Newton.Get_Time_Cache_Stats(&Resyncs, &Drift);
+  printf("%-22s %8lu %10.1f %8.3f %6ld %6.2f%% %8lu %6ld  %s\n", Name, Transactions,
+         Bus_Time / 1000.0, Bus_Time / 1000.0 / Reads, Worst, 100.0 * Wrong / Reads,
+         Resyncs, Drift, labs(Worst) <= Max_Error ? "ok" : "WRONG");
+  if(labs(Worst) > Max_Error)
+    Sim_Failures++;
+  Newton.Begin_Time_Cache(0);
+  return Transactions;
+}
+
+static void Check_Calendar(){
+  static const byte Days_In_Month[12] = {31,28,31,30,31,30,31,31,30,31,30,31};
+  unsigned long Expected = 0;
+  byte Expected_Day_Of_Week = 7;              // 2000-01-01 was a Saturday.
+  int Errors = 0;
+
+  for(byte Year = 0; Year < 100; Year++)
+    for(byte Month = 1; Month <= 12; Month++)
+      for(byte Day = 1; Day <= Days_In_Month[Month-1] + (Month == 2 && Year % 4 == 0); Day++)
+        {
+        byte Second, Minute, Hour, Day_Of_Week, D, M, Y;
+        unsigned long Epoch = _Newton::Date_To_Epoch(59, 59, 23, Day, Month, Year);
+        _Newton::Epoch_To_Date(Epoch, &Second, &Minute, &Hour, &Day_Of_Week, &D, &M, &Y);
+        if(Epoch != Expected + 86399 || Second != 59 || Minute != 59 || Hour != 23 ||
+           D != Day || M != Month || Y != Year || Day_Of_Week != Expected_Day_Of_Week ||
+           _Newton::Day_Of_Week(Epoch) != Day_Of_Week)
+          Errors++;
+        Expected += 86400;
+        Expected_Day_Of_Week = Expected_Day_Of_Week % 7 + 1;
+        }
+
+  Sim_Reset();
+  Sim_RTC_Set(2024, 2, 29, 12, 34, 56);
+  unsigned long Epoch = Newton.Get_Epoch();
+  if(Epoch != Sim_RTC_Seconds() || Epoch != _Newton::Date_To_Epoch(56, 34, 12, 29, 2, 24))
+    Errors++;
+  Newton.Set_Epoch(Epoch + 86400UL * 365);
+  if(Sim_RTC_Seconds() != Epoch + 86400UL * 365)
+    Errors++;
+  byte Second, Minute, Hour, Day_Of_Week, Day, Month, Year;
+  Newton.Get_Current_Time_Values(&Second, &Minute, &Hour, &Day_Of_Week, &Day, &Month, &Year);
+  if(Day != 28 || Month != 2 || Year != 25 || Day_Of_Week != 6)      // A Friday.
+    Errors++;
+  Sim_RTC_Connect(false);
+  if(Newton.Get_Current_Time_Values(&Second, &Minute, &Hour, &Day_Of_Week, &Day, &Month, &Year) ||
+     Second || Minute || Hour || Day_Of_Week || Day || Month || Year)
+    Errors++;                                                       // No RTC: false and zeros.
+  Sim_RTC_Connect(true);
+
+  static_assert(BUILD_MONTH >= 1 && BUILD_MONTH <= 12 && BUILD_DAY >= 1 && BUILD_DAY <= 31,
+                "build date not parsed");
+  printf("\nepoch conversions, %lu days: %s\n", Expected / 86400, Errors ? "WRONG" : "ok");
+  Sim_Failures += Errors;
+}
+
+int main(){
+  printf("Get_Time() every %lu mS for %lu h, RTC %+d ppm\n\n", READ_INTERVAL, RUN_TIME / 3600, RTC_ERROR);
+  printf("%-22s %8s %10s %8s %6s %7s %8s %6s\n", "method", "xfers", "bus(ms)", "ms/read",
+         "worst", "wrong", "resyncs", "drift");
+
+  unsigned long Uncached = Run("uncached", 0, -1, 0);
+  unsigned long Millis = Run("cache, millis()", 60, -1, 1);
+  unsigned long SQW = Run("cache, SQW on pin 3", 60, 3, 0);
+
+  if(Millis * 50 > Uncached || SQW * 50 > Uncached)
+    {
+    printf("cache did not reduce bus traffic\n");
+    Sim_Failures++;
+    }
+
+  Check_Calendar();
+  return Sim_Failures ? 1 : 0;
+}
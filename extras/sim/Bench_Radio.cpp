@@ -0,0 +1,216 @@
+/*
+ Packet radio benchmark.
+
+ RF_TX is wired to RF_RX (Sim_Pin_Link()), so every packet sent comes back
+ to the same board, and loop() sends numbered packets of PAYLOAD bytes as
+ fast as Radio_Send() takes them while reading the ones that arrive.  For
+ each bit rate it reports the payload throughput, the share of the raw bit
+ rate that is payload, the packets lost, and the cost of the Timer1
+ interrupt that clocks the bits: the interrupts it adds to those of the
+ system tick, and the CPU time they take at an estimated TICK_CYCLES each
+ (the simulator cannot count cycles).
+ Neither Radio_Send() nor Radio_Receive() may take any time.
+
+ The link is then made noisy (one sample in N read wrong) to show how
+ packet loss grows with noise, and no damaged packet may be delivered.
+ Finally the software timers must keep time while the radio runs, a full
+ receive buffer must count its overruns, and a packet must wake the CPU
+ from Sleep_Until_Event().
+
+ The program exits with a non-zero status if any check fails.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+#define PACKETS      200
+#define PAYLOAD      24
+#define LOOP_TIME    200            // uS taken by the rest of loop().
+#define TICK_CYCLES  150            // Estimate: interrupt entry and exit and Radio_Tick().
+
+struct Result{
+  unsigned long Received;
+  unsigned long Damaged;        // Delivered with the wrong contents.
+  double Seconds;
+  unsigned long Interrupts;
+  unsigned long long Blocked;   // uS spent inside the library's calls.
+  unsigned long Errors;
+};
+
+static void Fill(byte *Data, unsigned int Number){
+  Data[0] = Number >> 8;
+  Data[1] = Number;
+  for(int i = 2; i < PAYLOAD; i++)
+    Data[i] = (byte)(Number * 7 + i);
+}
+
+// Sends PACKETS packets around the loop and collects what comes back.
+static Result Run(unsigned int Bit_Rate, unsigned long Noise){
+  Sim_Reset();
+  Sim_Pin_Link(RF_TX, RF_RX, Noise);
+  Sim_Check(Newton.Begin_Radio(Bit_Rate), "bit rate accepted");
+  unsigned long Sent0, Received0, Errors0, Overruns0;
+  Newton.Get_Radio_Stats(&Sent0, &Received0, &Errors0, &Overruns0);
+
+  Result Out = {};
+  byte Data[PAYLOAD], Copy[RADIO_MAX_PAYLOAD];
+  unsigned int Next = 0;
+  unsigned long Calls = Sim_ISR.Calls;
+  unsigned long long Start = Sim_Time_Micros();
+  while(Next < PACKETS || Newton.Radio_Busy())
+    {
+    unsigned long long Before = Sim_Time_Micros();
+    Fill(Data, Next);
+    if(Next < PACKETS && Newton.Radio_Send(Data, PAYLOAD))
+      Next++;
+    byte Length;
+    while((Length = Newton.Radio_Receive(Copy, sizeof(Copy))) != 0)
+      {
+      Fill(Data, Copy[0] << 8 | Copy[1]);
+      if(Length == PAYLOAD && memcmp(Copy, Data, PAYLOAD) == 0)
+        Out.Received++;
+      else
+        Out.Damaged++;
+      }
+    Out.Blocked += Sim_Time_Micros() - Before;
+    Sim_Advance(LOOP_TIME);
+    }
+  Sim_Advance(20000);                   // The last packet's bits.
+  while(Newton.Radio_Receive(Copy, sizeof(Copy)))
+    Out.Received++;
+  Out.Seconds = (Sim_Time_Micros() - Start) / 1e6;
+  Out.Interrupts = Sim_ISR.Calls - Calls;
+
+  unsigned long Sent, Received, Errors, Overruns;
+  Newton.Get_Radio_Stats(&Sent, &Received, &Errors, &Overruns);
+  Sim_Check(Sent - Sent0 == PACKETS, "every packet sent");
+  Sim_Check(Received - Received0 == Out.Received + Out.Damaged, "received packets counted");
+  Sim_Check(Overruns == Overruns0, "no overruns while loop() reads");
+  Out.Errors = Errors - Errors0;
+  Newton.End_Radio();
+  return Out;
+}
+
+// Interrupts per second without the radio (the system tick's).
+static double Base_Rate(){
+  Sim_Reset();
+  unsigned long Calls = Sim_ISR.Calls;
+  Sim_Advance(1000000);
+  return Sim_ISR.Calls - Calls;
+}
+
+static void Speed(unsigned int Bit_Rate, double Base){
+  Result Out = Run(Bit_Rate, 0);
+  double Bytes = Out.Received * (double)PAYLOAD / Out.Seconds;
+  double Rate = Out.Interrupts / Out.Seconds - Base;
+  printf("%8u %10.0f %9.1f %7lu %12.0f %9.1f %11llu\n", Bit_Rate, Bytes, 100.0 * Bytes * 8 / Bit_Rate,
+         PACKETS - Out.Received, Rate, 100.0 * Rate * TICK_CYCLES / F_CPU, Out.Blocked);
+  Sim_Check(Out.Received == PACKETS && Out.Damaged == 0, "every packet delivered on a clean link");
+  Sim_Check(Out.Blocked == 0, "sending and receiving never block");
+  Sim_Check(Sim_ISR.Blocked_Max == 0, "interrupt never blocks");
+}
+
+static void Noise(unsigned long Every){
+  Result Out = Run(RADIO_BIT_RATE, Every);
+  printf("%8lu %9.1f %9lu %10lu\n", Every, 100.0 * (PACKETS - Out.Received) / PACKETS, Out.Errors, Out.Damaged);
+  Sim_Check(Out.Damaged == 0, "no damaged packet delivered");
+}
+
+static unsigned int Ticks;
+
+static void Tick(){
+  Ticks++;
+}
+
+static void Other_Checks(){
+  // The software timers keep their rate while the radio clocks Timer1.
+  Sim_Reset();
+  byte Timer = Newton.Timer_Start(Tick, 100, TIMER_PERIODIC);
+  Sim_Check(Newton.Begin_Radio(2000), "radio started with the timers running");
+  Sim_Check(!Newton.Begin_Timers(300), "tick rate that does not divide the sample rate refused");
+  Sim_Check(!Newton.Begin_Radio(RADIO_MAX_RATE + 1) && !Newton.Begin_Radio(RADIO_MIN_RATE - 1),
+            "bit rates out of range refused");
+  Ticks = 0;
+  for(int i = 0; i < 2000; i++)
+    {
+    Sim_Advance(1000);
+    Newton.Service_Timers();
+    }
+  Sim_Check(Ticks >= 19 && Ticks <= 21, "timers keep time with the radio on");
+  Newton.End_Radio();
+  Ticks = 0;
+  for(int i = 0; i < 1000; i++)
+    {
+    Sim_Advance(1000);
+    Newton.Service_Timers();
+    }
+  Sim_Check(Ticks >= 9 && Ticks <= 11, "timers keep time after End_Radio()");
+  Newton.Timer_Cancel(Timer);
+
+  // Called with interrupts off, they are left off.
+  noInterrupts();
+  bool Started = Newton.Begin_Radio(2000);
+  bool Off = !(SREG & 0x80);
+  Newton.End_Radio();
+  Off = Off && !(SREG & 0x80);
+  Newton.Begin_Timers(TIMER_TICK_RATE);
+  Off = Off && !(SREG & 0x80);
+  interrupts();
+  Sim_Check(Started && Off, "interrupts left off by Begin_Radio(), End_Radio() and Begin_Timers()");
+
+  // Nothing read: packets that do not fit are counted, the rest are intact.
+  Sim_Reset();
+  Sim_Pin_Link(RF_TX, RF_RX, 0);
+  Newton.Begin_Radio(4000);
+  unsigned long Sent0, Received0, Errors0, Overruns0, Sent, Received, Errors, Overruns;
+  Newton.Get_Radio_Stats(&Sent0, &Received0, &Errors0, &Overruns0);
+  byte Data[PAYLOAD], Copy[RADIO_MAX_PAYLOAD];
+  for(unsigned int i = 0; i < 5; i++)
+    {
+    Fill(Data, i);
+    Newton.Radio_Send(Data, PAYLOAD);
+    while(Newton.Radio_Busy())
+      Sim_Advance(1000);
+    }
+  Sim_Advance(20000);
+  Newton.Get_Radio_Stats(&Sent, &Received, &Errors, &Overruns);
+  int Intact = 0;
+  for(unsigned int i = 0; Newton.Radio_Receive(Copy, sizeof(Copy)) == PAYLOAD; i++)
+    {
+    Fill(Data, i);
+    Intact += memcmp(Copy, Data, PAYLOAD) == 0;
+    }
+  Sim_Check(Received - Received0 == 2 && Overruns - Overruns0 == 3 && Intact == 2, "full receive buffer counts overruns");
+
+  // A packet wakes the CPU; power-down is not used while the radio runs.
+  Newton.Sleep_Until_Event(SLEEP_IDLE);
+  Sim_Sleep = Sim_Sleep_Stats();
+  Newton.Radio_Send(Data, PAYLOAD);
+  byte Events = Newton.Sleep_Until_Event(SLEEP_POWER_DOWN);
+  Sim_Check((Events & WAKE_RADIO) && Newton.Radio_Receive(Copy, sizeof(Copy)) == PAYLOAD, "packet wakes the CPU");
+  Sim_Check(Sim_Sleep.Power_Down == 0 && Sim_Sleep.Idle > 0, "idle rather than power-down with the radio on");
+  Newton.End_Radio();
+  printf("\ntimers, overruns and sleep: %s\n", Sim_Failures ? "WRONG" : "ok");
+}
+
+int main(){
+  printf("%d packets of %d bytes from RF_TX to RF_RX, loop() taking %d uS\n\n", PACKETS, PAYLOAD, LOOP_TIME);
+  printf("%8s %10s %9s %7s %12s %9s %11s\n", "bits/s", "bytes/s", "payload%", "lost", "radio int/s", "CPU(%)", "blocked(uS)");
+  double Base = Base_Rate();
+  Speed(1000, Base);
+  Speed(2000, Base);
+  Speed(4000, Base);
+
+  printf("\nnoise at %u bits/s (one sample in N read wrong)\n", RADIO_BIT_RATE);
+  printf("%8s %9s %9s %10s\n", "N", "lost(%)", "rejected", "delivered");
+  printf("%8s %9s %9s %10s\n", "", "", "", "damaged");
+  Noise(0);
+  Noise(200);
+  Noise(50);
+  Noise(20);
+  Noise(10);
+  Noise(5);
+
+  Other_Checks();
+  return Sim_Failures ? 1 : 0;
+}
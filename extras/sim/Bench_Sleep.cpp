@@ -0,0 +1,162 @@
+/*
+ Sleep benchmark.
+
+ A battery-powered sketch counts presses of SW1 and updates a clock display
+ once a second, for one simulated minute with three presses.  Three ways:
+
+    - the usual loop(): poll Get_Switch_Event() and Get_Time() until the
+      time string changes
+    - Sleep_Until_Event(SLEEP_IDLE), woken by the RTC's SQW output
+    - Sleep_Until_Event(SLEEP_POWER_DOWN), the same
+
+ For each it reports the presses and seconds seen, the share of the time
+ the CPU was awake and the resulting average current of the ATmega328P
+ (typical datasheet figures at 16 MHz and 5 V).
+
+ Sleep_Until_Event() is then checked: Get_Sleep_Stats() must agree with
+ the simulator, a software timer must wake the CPU from idle, and an LED
+ pattern (which needs the system tick) must keep it out of power-down.
+
+ The program exits with a non-zero status if any check fails.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+#define RUN_TIME      60000000ULL     // uS.
+#define SQW_PIN       2
+#define ACTIVE_MA     9.0             // Active, idle and power-down (BOD off) current.
+#define IDLE_MA       2.6
+#define POWER_DOWN_MA 0.0001
+
+static const unsigned long long Presses[3] = {10200000ULL, 25700000ULL, 40100000ULL};
+
+// Starts a run at 12:00:00 with the SQW output counted by the time cache
+// and three presses of SW1 (150 mS each) scheduled.
+static unsigned long long Start(){
+  Sim_Reset();
+  Sim_RTC_Set(2016, 5, 16, 12, 0, 0);
+  Sim_RTC_SQW_Pin(SQW_PIN);
+  Newton.Begin_Time_Cache(60, SQW_PIN);
+  byte Switch, Event;
+  while(Newton.Get_Switch_Event(&Switch, &Event)) ;
+  Newton.Sleep_Until_Event(SLEEP_IDLE);      // Forget the events so far.
+  unsigned long long Now = Sim_Time_Micros();
+  for(int i = 0; i < 3; i++)
+    {
+    Sim_Pin_Input_At(SW1, LOW, Now + Presses[i]);
+    Sim_Pin_Input_At(SW1, HIGH, Now + Presses[i] + 150000ULL);
+    }
+  Sim_Sleep = Sim_Sleep_Stats();
+  Newton.Reset_Sleep_Stats();
+  return Now;
+}
+
+static int Count_Presses(){
+  int Count = 0;
+  byte Switch, Event;
+  while(Newton.Get_Switch_Event(&Switch, &Event))
+    Count += Switch == SW1 && Event == SW_PRESS;
+  return Count;
+}
+
+static void Report(const char *Name, unsigned long long Begin, int Pressed, int Seconds){
+  double Total = Sim_Time_Micros() - Begin;
+  double Idle = Sim_Sleep.Idle / Total, Power_Down = Sim_Sleep.Power_Down / Total;
+  double Awake = 1.0 - Idle - Power_Down;
+  printf("%-28s %7d %7d %9.2f %9lu %9.3f\n", Name, Pressed, Seconds, 100.0 * Awake, Sim_Sleep.Sleeps,
+         Awake * ACTIVE_MA + Idle * IDLE_MA + Power_Down * POWER_DOWN_MA);
+  Sim_Check(Pressed == 3, "every press seen");
+  Sim_Check(Seconds >= 59 && Seconds <= 61, "every second seen");
+}
+
+static void Polling(){
+  unsigned long long Begin = Start();
+  Newton.Begin_Time_Cache(0);                // Every Get_Time() reads the RTC.
+  char Text[18], Last[18] = "";
+  int Pressed = 0, Seconds = 0;
+  while(Sim_Time_Micros() - Begin < RUN_TIME)
+    {
+    Pressed += Count_Presses();
+    Newton.Get_Time(Text);
+    if(strcmp(Text, Last) != 0)
+      {
+      strcpy(Last, Text);
+      Seconds++;
+      }
+    }
+  Report("polling", Begin, Pressed, Seconds - 1);
+}
+
+static void Sleeping(const char *Name, byte Mode){
+  unsigned long long Begin = Start();
+  char Text[18];
+  int Pressed = 0, Seconds = 0;
+  unsigned long Millis = millis();
+  while(Sim_Time_Micros() - Begin < RUN_TIME)
+    {
+    byte Events = Newton.Sleep_Until_Event(Mode);
+    if(Events & WAKE_CLOCK)
+      {
+      Newton.Get_Time(Text);
+      Seconds++;
+      }
+    if(Events & WAKE_SWITCH)
+      Pressed += Count_Presses();
+    }
+  Report(Name, Begin, Pressed, Seconds);
+
+  // The library's own account of the time asleep.
+  unsigned long Awake, Asleep, Wakes;
+  Newton.Get_Sleep_Stats(&Awake, &Asleep, &Wakes);
+  double Simulated = (Sim_Sleep.Idle + Sim_Sleep.Power_Down) / 1000.0;
+  Sim_Check(Wakes == Sim_Sleep.Sleeps, "wake-ups counted");
+  if(Mode == SLEEP_IDLE)
+    Sim_Check(Asleep > Simulated * 0.99 && Asleep < Simulated * 1.01, "time asleep in idle");
+  else
+    {
+    Sim_Check(Asleep > Simulated - 1500 && Asleep < Simulated + 1500, "time asleep in power-down (to the second)");
+    Sim_Check(millis() - Millis < 2000, "millis() stands still in power-down");
+    }
+}
+
+static void Nothing() {}
+
+static void Fallbacks(){
+  // A software timer wakes the CPU from idle.
+  Sim_Reset();
+  byte Timer = Newton.Timer_Start(Nothing, 100, TIMER_PERIODIC);
+  Newton.Sleep_Until_Event(SLEEP_IDLE);
+  int Timers = 0;
+  unsigned long long Begin = Sim_Time_Micros();
+  while(Sim_Time_Micros() - Begin < 1000000ULL)
+    if(Newton.Sleep_Until_Event(SLEEP_IDLE) & WAKE_TIMER)
+      Timers++;
+  Newton.Service_Timers();
+  Newton.Timer_Cancel(Timer);
+  Sim_Check(Timers >= 9 && Timers <= 11, "software timer wakes the CPU");
+
+  // An LED pattern needs the tick, so power-down is not used until it ends.
+  static const unsigned int Steps[2] = {300, 300};
+  Sim_Reset();
+  Sim_RTC_SQW_Pin(SQW_PIN);
+  Newton.Begin_Time_Cache(60, SQW_PIN);
+  Newton.Sleep_Until_Event(SLEEP_IDLE);
+  Newton.LED_Pattern(LED1, Steps, 2, false);
+  Sim_Sleep = Sim_Sleep_Stats();
+  Newton.Sleep_Until_Event(SLEEP_POWER_DOWN);
+  Sim_Check(Sim_Sleep.Idle >= 590000 && Sim_Sleep.Idle < 700000, "idle while an LED pattern runs");
+  Sim_Check(Sim_Sleep.Power_Down > 0 && digitalRead(LED1) == LOW, "power-down once the pattern ends");
+  Newton.Begin_Time_Cache(0);
+  printf("\nwake sources and fallbacks: %s\n", Sim_Failures ? "WRONG" : "ok");
+}
+
+int main(){
+  printf("SW1 pressed 3 times in %llu S, clock updated every second\n\n", RUN_TIME / 1000000ULL);
+  printf("%-28s %7s %7s %9s %9s %9s\n", "method", "presses", "seconds", "awake(%)", "wake-ups", "MCU(mA)");
+  Polling();
+  Sleeping("Sleep_Until_Event(IDLE)", SLEEP_IDLE);
+  Sleeping("Sleep_Until_Event(POWER)", SLEEP_POWER_DOWN);
+  Fallbacks();
+  return Sim_Failures ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+/*
+ Sound effect benchmark.
+
+ Reports how long Sound_Effect() keeps the caller blocked with the original
+ tone() loops and with the background player, then samples the speaker
+ every 100 uS while the effects play to check their content and duration.
+ For each effect it also reports the cost of playing it: the tone() calls
+ (there must be none), the Timer2 interrupts (one per edge on the speaker
+ pin), the ones that reloaded the timer for a sweep, and the CPU time they
+ take at an estimated EDGE_CYCLES and UPDATE_CYCLES each (the simulator
+ cannot count cycles).
+
+ Linear and exponential sweeps must follow their curves (counted in edges)
+ and never step back, and Sweep() must make a chirp.  Queueing, Silence(), Beep() and a
+ user-defined effect with a sweep in it are also checked.  The program
+ exits with a non-zero status if any check fails.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+#include <math.h>
+
+#define SAMPLE         100          // uS between samples of the speaker.
+#define EDGE_CYCLES    90           // Estimate: interrupt entry and exit, toggle and count down.
+#define UPDATE_CYCLES  400          // Estimate: a sweep update (Tone_Log2() and Tone_Half_Cycles()).
+
+// Within the resolution of Timer2 (its prescaler steps).
+static bool Near(double Frequency, double Expected, double Percent){
+  return Frequency >= Expected * (1 - Percent / 100) && Frequency <= Expected * (1 + Percent / 100);
+}
+
+// The original implementation of ALARM.
+static void Legacy_Alarm(){
+  for(int i=1;i<=10;i++)
+    {
+      for(int f=100;f<=10000;f+=100)
+        tone(SPKR,f,20);
+      for(int f=10000;f>=500;f-=50)
+        tone(SPKR,f,30);
+      delay(250);
+    }
+}
+
+// Plays until silent; returns the duration in mS and the highest frequency.
+static unsigned long Play_Out(unsigned int *Highest){
+  unsigned long long Start = Sim_Time_Micros();
+  *Highest = 0;
+  while(Newton.Sound_Playing() || Sim_Speaker_Frequency())
+    {
+    if(Sim_Speaker_Frequency() > *Highest) *Highest = Sim_Speaker_Frequency();
+    delayMicroseconds(SAMPLE);
+    }
+  return (Sim_Time_Micros() - Start + 500) / 1000;
+}
+
+static void Effect(const char *Name, int Number, unsigned long Expected_Min, unsigned long Expected_Max){
+  Sim_Reset();
+  Newton.Sound_Effect(Number);
+  unsigned long long Blocked = Sim_Time_Micros();
+  unsigned int Highest;
+  unsigned long Duration = Play_Out(&Highest);
+  double CPU = 100.0 * (Sim_Speaker.Edges * EDGE_CYCLES + Sim_Speaker.Changes * UPDATE_CYCLES) / (Duration * (F_CPU / 1000.0));
+  printf("%-12s %8llu %8lu %6lu %7u %8lu %8lu %7.1f\n",
+         Name, Blocked, Duration, Sim_Speaker.Calls, Highest, Sim_Speaker.Edges, Sim_Speaker.Changes, CPU);
+  Sim_Check(Duration >= Expected_Min && Duration <= Expected_Max, Name);
+  Sim_Check(Highest == 10000, "effect reaches 10 kHz");
+  Sim_Check(Sim_Speaker.Calls == 0, "no tone() calls");
+  Sim_Check(Sim_ISR.Blocked_Max == 0, "interrupt never blocks");
+}
+
+// Cycles of a sweep from 200 Hz to 3200 Hz over 400 mS up to Time mS.
+static double Sweep_Cycles(byte Shape, double Time){
+  double Seconds = Time / 1000;
+  if(Shape == SWEEP_LINEAR)
+    return 200 * Seconds + 3750 * Seconds * Seconds;
+  return 200 * (pow(2, 10 * Seconds) - 1) / (10 * log(2));
+}
+
+// Plays Sweep() from 200 Hz to 3200 Hz and counts the edges made in each
+// 25 mS against those of the ideal curve (within one edge and 1%), which
+// checks the frequency and the timing of the sweep together.  The
+// frequency is also sampled every mS and must never go down.
+static void Sweep_Check(const char *Name, byte Shape){
+  Sim_Reset();
+  Newton.Sweep(200, 3200, 400, Shape);
+  double Worst = 0;
+  unsigned int Last = 0;
+  unsigned long Edges = 0;
+  bool Steady = true, Close = true;
+  for(int Time = 1; Time <= 400; Time++)
+    {
+    delay(1);
+    unsigned int Frequency = Sim_Speaker_Frequency();
+    if(Time < 400)
+      Steady = Steady && Frequency >= Last;
+    Last = Frequency;
+    if(Time % 25)
+      continue;
+    double Expected = 2 * (Sweep_Cycles(Shape, Time) - Sweep_Cycles(Shape, Time - 25));
+    double Error = fabs(Sim_Speaker.Edges - Edges - Expected);
+    Close = Close && Error <= 1 + Expected / 100;
+    if(Error > Worst) Worst = Error;
+    Edges = Sim_Speaker.Edges;
+    }
+  delay(5);
+  printf("%-12s %5lu edges (%.0f expected), 25 mS windows at most %.1f edges out, %lu updates\n",
+         Name, Sim_Speaker.Edges, 2 * Sweep_Cycles(Shape, 400), Worst, Sim_Speaker.Changes);
+  Sim_Check(Close, "sweep follows its curve");
+  Sim_Check(Steady, "sweep never steps back");
+  Sim_Check(!Newton.Sound_Playing() && Sim_Speaker_Frequency() == 0, "silent after the sweep");
+}
+
+int main(){
+  Sim_Reset();
+  Legacy_Alarm();
+  printf("%-12s blocked %6llu uS, %lu tone() calls\n\n", "ALARM (old)", Sim_Time_Micros(), Sim_Speaker.Calls);
+
+  printf("%-12s %8s %8s %6s %7s %8s %8s %7s\n", "effect", "blocked", "played", "tone()", "peak", "Timer2", "sweep", "CPU");
+  printf("%-12s %8s %8s %6s %7s %8s %8s %7s\n", "", "(uS)", "(mS)", "calls", "(Hz)", "int.", "updates", "(%)");
+  Effect("UP_SQUEAK", UP_SQUEAK, 140, 165);
+  Effect("DOWN_SQUEAK", DOWN_SQUEAK, 140, 165);
+  Effect("ALARM", ALARM, 2900, 3200);
+  printf("\n");
+
+  Sweep_Check("linear", SWEEP_LINEAR);
+  Sweep_Check("exponential", SWEEP_EXPONENTIAL);
+
+  // A chirp: a short sweep, then silence.
+  Sim_Reset();
+  Newton.Sweep(2000, 4000, 20);
+  unsigned int Highest;
+  unsigned long Chirp = Play_Out(&Highest);
+  Sim_Check(Chirp >= 19 && Chirp <= 22 && Near(Highest, 4000, 3), "chirp");
+
+  // Effects queue behind each other.
+  Sim_Reset();
+  Newton.Sound_Effect(UP_SQUEAK);
+  Newton.Sound_Effect(DOWN_SQUEAK);
+  unsigned long Both = Play_Out(&Highest);
+  Sim_Check(Both >= 290 && Both <= 320, "queued effects play in turn");
+
+  // Silence() cancels the effect playing and the queue.
+  Newton.Sound_Effect(ALARM);
+  Newton.Sound_Effect(UP_SQUEAK);
+  delay(500);
+  Newton.Silence();
+  delay(5);
+  Sim_Check(!Newton.Sound_Playing() && Sim_Speaker_Frequency() == 0, "Silence() cancels effects");
+
+  // Beep() plays for its time, then falls silent.
+  Newton.Beep();
+  unsigned long Beep = Play_Out(&Highest);
+  Sim_Check(Beep >= BEEP_TIME && Beep <= BEEP_TIME + 2 && Near(Highest, BEEP_FREQ, 0.5), "Beep()");
+
+  // A user-defined effect with a rest and a sweep, played twice.
+  static const Tone_Step Chirp_Effect[] PROGMEM = {
+    {2000, 50, 0, 0}, {0, 50, 0, 0}, {1500, 50, 3000, SWEEP_EXPONENTIAL}
+    };
+  Sim_Check(Newton.Play_Effect(Chirp_Effect, 3, 2), "Play_Effect() accepted");
+  unsigned long Chirps = Play_Out(&Highest);
+  Sim_Check(Chirps >= 295 && Chirps <= 310 && Near(Highest, 3000, 3), "user-defined effect");
+
+  printf("chirp, queue, Silence(), Beep() and user effect: %s\n", Sim_Failures ? "WRONG" : "ok");
+  return Sim_Failures ? 1 : 0;
+}
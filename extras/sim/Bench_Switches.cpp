@@ -0,0 +1,95 @@
+/*
+ Switch benchmark.
+
+ Measures the simulated time a loop() that polls both switches spends per
+ pass, with the original delay(DEBOUNCE_TIME) reads and with the background
+ debouncer.  A bouncing press held past LONG_PRESS_TIME and a short press
+ made while the loop is busy must each produce the expected events, and a
+ long press must be reported within 10 mS of LONG_PRESS_TIME.  The program
+ exits with a non-zero status if they do not.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+#define PASSES 1000
+
+static bool Legacy_Status(byte Pin){
+  delay(DEBOUNCE_TIME);
+  return(!digitalRead(Pin));
+}
+
+static void Bounce(byte Pin, byte Final){
+  for(int i = 0; i < 6; i++)
+    {
+    Sim_Pin_Input(Pin, (i & 1) ? Final : !Final);
+    delay(1);
+    }
+  Sim_Pin_Input(Pin, Final);
+}
+
+static void Expect(byte Switch, byte Event){
+  byte S, E;
+  if(!Newton.Get_Switch_Event(&S, &E) || S != Switch || E != Event)
+    {
+    printf("expected event %d on pin %d\n", Event, Switch);
+    Sim_Failures++;
+    }
+}
+
+int main(){
+  printf("%-22s %14s\n", "method", "uS per pass");
+
+  Sim_Reset();
+  for(int i = 0; i < PASSES; i++)
+    {
+    Legacy_Status(SW1);
+    Legacy_Status(SW2);
+    }
+  printf("%-22s %14.1f\n", "delay() + digitalRead", (double)Sim_Time_Micros() / PASSES);
+
+  Sim_Reset();
+  for(int i = 0; i < PASSES; i++)
+    {
+    Newton.SW1_Status();
+    Newton.SW2_Status();
+    }
+  printf("%-22s %14.1f\n", "SW1/SW2_Status", (double)Sim_Time_Micros() / PASSES);
+
+  // A bouncing press held for 1.5 S, then a bouncing release.
+  Sim_Reset();
+  Bounce(SW1, LOW);
+  delay(DEBOUNCE_TIME + 5);
+  if(!Newton.SW1_Status()) { printf("SW1 press not seen\n"); Sim_Failures++; }
+  delay(1500);
+  Bounce(SW1, HIGH);
+  delay(DEBOUNCE_TIME + 5);
+  if(Newton.SW1_Status()) { printf("SW1 release not seen\n"); Sim_Failures++; }
+
+  // A 60 mS press while the loop is busy elsewhere.
+  Sim_Pin_Input(SW2, LOW);
+  delay(60);
+  Sim_Pin_Input(SW2, HIGH);
+  delay(100);
+
+  Expect(SW1, SW_PRESS);
+  Expect(SW1, SW_LONG_PRESS);
+  Expect(SW1, SW_RELEASE);
+  Expect(SW2, SW_PRESS);
+  Expect(SW2, SW_RELEASE);
+  byte S, E;
+  if(Newton.Get_Switch_Event(&S, &E)) { printf("unexpected event\n"); Sim_Failures++; }
+
+  // The tick is 1.024 mS, so the times are kept in mS rather than in ticks.
+  Sim_Pin_Input(SW2, LOW);
+  delay(DEBOUNCE_TIME + LONG_PRESS_TIME - 10);
+  Expect(SW2, SW_PRESS);
+  Sim_Check(!Newton.Get_Switch_Event(&S, &E), "no long press before LONG_PRESS_TIME");
+  delay(20);
+  Expect(SW2, SW_LONG_PRESS);
+  Sim_Pin_Input(SW2, HIGH);
+  delay(100);
+  Expect(SW2, SW_RELEASE);
+
+  return Sim_Failures ? 1 : 0;
+}
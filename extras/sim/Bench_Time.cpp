@@ -0,0 +1,208 @@
+/*
+ Time text benchmark.
+
+ Compares the library's fixed-format time text (Format_Time(),
+ Parse_Time(), and Get_Time() and Set_Time() through them) with the
+ sprintf() and sscanf() path Get_Time() and Set_Time() used before:
+
+    - the text must be the same as sprintf() makes, for a time on every
+      day from 2000 to 2099, and must read back (in all three formats) to
+      the same time
+    - every malformed or out-of-range time must be refused with the right
+      error, and no buffer may be written past its size
+    - Get_Time() and Set_Time() must round-trip through the RTC, and a bad
+      time must leave the RTC alone
+
+ It also reports the time each path takes per call on this host.  The
+ simulator cannot count AVR cycles, so these are only a guide to how the
+ two compare; extras/time_size.sh gives the flash each path takes.
+
+ The program exits with a non-zero status if any check fails.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+#include <chrono>
+
+#define TIMING_CALLS  200000
+
+// The old Get_Time() and Set_Time() (less the bus and the Serial output).
+static void Old_Format(unsigned long Epoch, char *Text){
+  byte Second, Minute, Hour, Day_Of_Week, Day, Month, Year;
+  _Newton::Epoch_To_Date(Epoch, &Second, &Minute, &Hour, &Day_Of_Week, &Day, &Month, &Year);
+  sprintf(Text, "%02d/%02d/%02d %02d:%02d:%02d", Month, Day, Year, Hour, Minute, Second);
+}
+
+static unsigned long Old_Parse(const char *Text){
+  int Month, Day, Year, Hours, Minutes, Seconds;
+  sscanf(Text, "%02d/%02d/%02d %02d:%02d:%02d", &Month, &Day, &Year, &Hours, &Minutes, &Seconds);
+  return _Newton::Date_To_Epoch(Seconds, Minutes, Hours, Day, Month, Year);
+}
+
+static void Round_Trips(){
+  unsigned long Days = 0, Same = 0, Back = 0;
+  for(unsigned long Day = 0; Day < 36525; Day++)
+    {
+    unsigned long Epoch = Day * SECONDS_PER_DAY + (Day * 7919) % SECONDS_PER_DAY;
+    char Old[TIME_TEXT_SIZE], New[TIME_TEXT_SIZE];
+    Old_Format(Epoch, Old);
+    byte Length = _Newton::Format_Time(Epoch, New, sizeof(New));
+    Same += Length == 17 && strcmp(Old, New) == 0;
+
+    bool Ok = true;
+    for(byte Format = TIME_FORMAT_US; Format <= TIME_FORMAT_BINARY; Format++)
+      {
+      unsigned long Read = 0;
+      Length = _Newton::Format_Time(Epoch, New, sizeof(New), Format);
+      Ok = Ok && Length && _Newton::Parse_Time(New, Length, Format, &Read) == TIME_OK && Read == Epoch;
+      }
+    Back += Ok;
+    Days++;
+    }
+  printf("%lu days: same text as sprintf() on %lu, read back in all formats on %lu\n", Days, Same, Back);
+  Sim_Check(Same == Days, "text as sprintf() makes it");
+  Sim_Check(Back == Days, "round trips");
+
+  char Text[TIME_TEXT_SIZE];
+  _Newton::Format_Time(_Newton::Date_To_Epoch(5, 4, 3, 29, 2, 24), Text, sizeof(Text), TIME_FORMAT_ISO);
+  Sim_Check(strcmp(Text, "2024-02-29T03:04:05") == 0, "ISO 8601 text");
+  _Newton::Format_Time(0x12345678UL, Text, sizeof(Text), TIME_FORMAT_BINARY);
+  Sim_Check(memcmp(Text, "\x12\x34\x56\x78", 4) == 0, "binary is most significant byte first");
+}
+
+struct Bad_Time{
+  const char *Text;
+  byte Format;
+  byte Result;
+};
+
+static const Bad_Time Bad_Times[] = {
+  {"05/16/16 13:08:00",    TIME_FORMAT_US,  TIME_OK},
+  {"05/16/16 13:08",       TIME_FORMAT_US,  TIME_TOO_SHORT},
+  {"05/16/16 13:08:00 ",   TIME_FORMAT_US,  TIME_BAD_FORMAT},
+  {"05-16-16 13:08:00",    TIME_FORMAT_US,  TIME_BAD_FORMAT},
+  {"5/16/16 13:08:00 ",    TIME_FORMAT_US,  TIME_BAD_FORMAT},
+  {"05/16/16 1a:08:00",    TIME_FORMAT_US,  TIME_BAD_FORMAT},
+  {"13/16/16 13:08:00",    TIME_FORMAT_US,  TIME_BAD_VALUE},
+  {"00/16/16 13:08:00",    TIME_FORMAT_US,  TIME_BAD_VALUE},
+  {"04/31/16 13:08:00",    TIME_FORMAT_US,  TIME_BAD_VALUE},
+  {"02/29/17 13:08:00",    TIME_FORMAT_US,  TIME_BAD_VALUE},
+  {"02/29/16 13:08:00",    TIME_FORMAT_US,  TIME_OK},
+  {"05/00/16 13:08:00",    TIME_FORMAT_US,  TIME_BAD_VALUE},
+  {"05/16/16 24:00:00",    TIME_FORMAT_US,  TIME_BAD_VALUE},
+  {"05/16/16 13:60:00",    TIME_FORMAT_US,  TIME_BAD_VALUE},
+  {"05/16/16 13:08:60",    TIME_FORMAT_US,  TIME_BAD_VALUE},
+  {"2016-05-16T13:08:00",  TIME_FORMAT_ISO, TIME_OK},
+  {"2016-05-16 13:08:00",  TIME_FORMAT_ISO, TIME_OK},
+  {"2016-05-16T13:08:00Z", TIME_FORMAT_ISO, TIME_OK},
+  {"2016-05-16T13:08:00+", TIME_FORMAT_ISO, TIME_BAD_FORMAT},
+  {"1999-12-31T23:59:59",  TIME_FORMAT_ISO, TIME_BAD_FORMAT},
+  {"2100-01-01T00:00:00",  TIME_FORMAT_ISO, TIME_BAD_FORMAT},
+  {"2016/05/16T13:08:00",  TIME_FORMAT_ISO, TIME_BAD_FORMAT},
+  {"2016-02-30T13:08:00",  TIME_FORMAT_ISO, TIME_BAD_VALUE},
+  {"05/16/16 13:08:00",    TIME_FORMAT_ISO, TIME_TOO_SHORT},
+  {"05/16/16 13:08:00",    7,               TIME_BAD_FORMAT},
+};
+
+static void Errors(){
+  int Right = 0, Count = sizeof(Bad_Times) / sizeof(Bad_Times[0]);
+  for(int i = 0; i < Count; i++)
+    {
+    unsigned long Epoch = 12345;
+    byte Result = _Newton::Parse_Time(Bad_Times[i].Text, strlen(Bad_Times[i].Text), Bad_Times[i].Format, &Epoch);
+    bool Ok = Result == Bad_Times[i].Result && (Result == TIME_OK || Epoch == 12345);
+    if(!Ok)
+      printf("  \"%s\": %d, expected %d\n", Bad_Times[i].Text, Result, Bad_Times[i].Result);
+    Right += Ok;
+    }
+  unsigned long Epoch;
+  Right += _Newton::Parse_Time("\x00\x01\x02", 3, TIME_FORMAT_BINARY, &Epoch) == TIME_TOO_SHORT;
+  Right += _Newton::Parse_Time("\xFF\x00\x00\x00", 4, TIME_FORMAT_BINARY, &Epoch) == TIME_BAD_VALUE;
+  Count += 2;
+
+  // Too small a buffer is refused without a byte written.
+  char Text[TIME_TEXT_SIZE + 1];
+  memset(Text, '*', sizeof(Text));
+  bool Kept = _Newton::Format_Time(0, Text, 17, TIME_FORMAT_US) == 0 &&
+              _Newton::Format_Time(0, Text, 19, TIME_FORMAT_ISO) == 0 &&
+              _Newton::Format_Time(0, Text, 3, TIME_FORMAT_BINARY) == 0 &&
+              _Newton::Format_Time(0xFFFFFFFFUL, Text, sizeof(Text), TIME_FORMAT_US) == 0;
+  for(size_t i = 0; i < sizeof(Text); i++)
+    Kept = Kept && Text[i] == '*';
+  Kept = Kept && _Newton::Format_Time(0, Text, 18, TIME_FORMAT_US) == 17 && Text[18] == '*';
+  printf("%d of %d bad and edge-case times given the right result, buffers %s\n", Right, Count, Kept ? "kept" : "OVERRUN");
+  Sim_Check(Right == Count, "errors reported");
+  Sim_Check(Kept, "buffer sizes kept");
+}
+
+static void Through_The_RTC(){
+  Sim_Reset();
+  char Text[TIME_TEXT_SIZE];
+  Sim_Check(Newton.Set_Time("05/16/16 13:08:00"), "Set_Time()");
+  Newton.Get_Time(Text);
+  Sim_Check(strcmp(Text, "05/16/16 13:08:00") == 0, "Get_Time()");
+  Sim_Check(!Newton.Set_Time("05/16/16 25:08:00") && !Newton.Set_Time("garbage"), "bad times refused");
+  Newton.Get_Time(Text);
+  Sim_Check(strcmp(Text, "05/16/16 13:08:00") == 0, "RTC left alone by a bad time");
+  Sim_Check(Newton.Set_Time("2024-02-29T23:59:58", TIME_FORMAT_ISO), "Set_Time() ISO 8601");
+  Sim_Check(Newton.Get_Time(Text, sizeof(Text), TIME_FORMAT_ISO) && strcmp(Text, "2024-02-29T23:59:58") == 0,
+            "Get_Time() ISO 8601");
+  Sim_Check(!Newton.Get_Time(Text, 19, TIME_FORMAT_ISO), "Get_Time() refuses a small buffer");
+  byte Stamp[4];
+  Sim_Check(Newton.Get_Time((char *)Stamp, sizeof(Stamp), TIME_FORMAT_BINARY) &&
+            Newton.Set_Time((const char *)Stamp, TIME_FORMAT_BINARY), "binary through the RTC");
+  Newton.Begin_Time_Cache(60);
+  // The bus transfers above take time, so the clock may have moved on a second.
+  Sim_Check(Newton.Get_Time(Text, sizeof(Text)) && strncmp(Text, "02/29/24 23:59:5", 16) == 0, "Get_Time() from the cache");
+  Sim_RTC_Connect(false);
+  Newton.Begin_Time_Cache(0);
+  Newton.Get_Time(Text);
+  Sim_Check(Text[0] == 0, "empty string when the RTC does not answer");
+
+  // The cache does not count up from nothing when the RTC never answered.
+  Newton.Begin_Time_Cache(60);
+  Sim_Advance(5000000);
+  byte Values[7];
+  Sim_Check(Newton.Get_Epoch() == 0 && !Newton.Get_Time(Text, sizeof(Text)) &&
+            !Newton.Get_Current_Time_Values(&Values[0], &Values[1], &Values[2], &Values[3], &Values[4], &Values[5], &Values[6]) &&
+            Values[6] == 0, "no time from the cache before the RTC answers");
+  Sim_RTC_Connect(true);
+  Sim_Check(Newton.Get_Epoch() == Sim_RTC_Seconds(), "cached time once the RTC answers");
+  Newton.Begin_Time_Cache(0);
+  printf("Get_Time() and Set_Time() through the RTC: %s\n", Sim_Failures ? "WRONG" : "ok");
+}
+
+// Host nS per call, over TIMING_CALLS different times.
+template <typename Function> static double Time_Calls(Function Call){
+  auto Start = std::chrono::steady_clock::now();
+  for(unsigned long i = 0; i < TIMING_CALLS; i++)
+    Call(i * 15467UL);
+  auto Time = std::chrono::steady_clock::now() - Start;
+  return std::chrono::duration<double, std::nano>(Time).count() / TIMING_CALLS;
+}
+
+static volatile unsigned long Sink;
+
+static void Speed(){
+  static char Texts[64][TIME_TEXT_SIZE];
+  for(int i = 0; i < 64; i++)
+    Old_Format(i * 15467UL * 1001, Texts[i]);
+
+  double Old_Write = Time_Calls([](unsigned long Epoch){ char Text[TIME_TEXT_SIZE]; Old_Format(Epoch, Text); Sink += Text[16]; });
+  double New_Write = Time_Calls([](unsigned long Epoch){ char Text[TIME_TEXT_SIZE]; _Newton::Format_Time(Epoch, Text, sizeof(Text)); Sink += Text[16]; });
+  double Old_Read = Time_Calls([](unsigned long i){ Sink += Old_Parse(Texts[i & 63]); });
+  double New_Read = Time_Calls([](unsigned long i){ unsigned long Epoch = 0; _Newton::Parse_Time(Texts[i & 63], 17, TIME_FORMAT_US, &Epoch); Sink += Epoch; });
+
+  printf("\nhost time per call (a guide only; see extras/time_size.sh for flash)\n");
+  printf("%-10s %14s %14s %8s\n", "", "sprintf/sscanf", "Format/Parse", "faster");
+  printf("%-10s %11.0f nS %11.0f nS %7.1fx\n", "write", Old_Write, New_Write, Old_Write / New_Write);
+  printf("%-10s %11.0f nS %11.0f nS %7.1fx\n", "read", Old_Read, New_Read, Old_Read / New_Read);
+}
+
+int main(){
+  Round_Trips();
+  Errors();
+  Through_The_RTC();
+  Speed();
+  return Sim_Failures ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+/*
+ Software timer benchmark.
+
+ Checks that Begin_Timers() produces the requested tick rate without drift,
+ that deferred periodic and one-shot timers are called from Service_Timers()
+ the right number of times, and that cancelling, rescheduling and running
+ out of timers behave as documented.  The program exits with a non-zero
+ status if any check fails.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+static unsigned long long Seconds[11];
+static int Second_Count;
+static void Each_Second() { if(Second_Count < 11) Seconds[Second_Count++] = Sim_Time_Micros(); }
+
+static unsigned long Fast_Calls, Once_Calls;
+static void Fast() { Fast_Calls++; }
+static void Once() { Once_Calls++; }
+static void Nothing() {}
+
+static void Run(unsigned long Milliseconds){
+  for(unsigned long i = 0; i < Milliseconds; i++)
+    {
+    delay(1);
+    Newton.Service_Timers();
+    }
+}
+
+int main(){
+  Sim_Check(!Newton.Begin_Timers(0), "a rate of 0 Hz is refused");
+
+  static const unsigned int Rates[] = {2, 100, 1000, 10000};
+  printf("%-8s %14s %14s\n", "rate", "mean period", "drift/10 S");
+  for(unsigned int r = 0; r < sizeof(Rates)/sizeof(Rates[0]); r++)
+    {
+    Sim_Reset();
+    Sim_Check(Newton.Begin_Timers(Rates[r]), "Begin_Timers()");
+    Second_Count = 0;
+    byte Id = Newton.Timer_Start(Each_Second, 1000, TIMER_PERIODIC | TIMER_IN_ISR);
+    delay(11500);
+    Newton.Timer_Cancel(Id);
+    long Drift = (long)(Seconds[10] - Seconds[0]) - 10000000L;
+    printf("%-8u %11.1f uS %11ld uS\n", Rates[r], (Seconds[10] - Seconds[0]) / 10.0, Drift);
+    Sim_Check(Second_Count == 11, "periodic timer count");
+    Sim_Check(Drift > -100 && Drift < 100, "tick drift");
+    }
+
+  // Deferred timers at 1 kHz.
+  Sim_Reset();
+  Newton.Begin_Timers(1000);
+  byte Fast_Id = Newton.Timer_Start(Fast, 7, TIMER_PERIODIC);
+  byte Once_Id = Newton.Timer_Start(Once, 250, TIMER_ONE_SHOT);
+  Run(1000);
+  printf("7 mS periodic: %lu calls in 1 S, 250 mS one-shot: %lu call\n", Fast_Calls, Once_Calls);
+  Sim_Check(Fast_Calls >= 142 && Fast_Calls <= 143, "7 mS periodic timer");
+  Sim_Check(Once_Calls == 1, "one-shot timer");
+
+  // A deferred call is not lost if loop() is late.
+  Fast_Calls = 0;
+  delay(70);
+  Newton.Service_Timers();
+  Sim_Check(Fast_Calls == 10, "expiries accumulate until serviced");
+
+  Newton.Timer_Cancel(Fast_Id);
+  Fast_Calls = 0;
+  Run(100);
+  Sim_Check(Fast_Calls == 0, "cancelled timer stops");
+
+  // The one-shot timer was released after it ran.
+  Newton.Timer_Reschedule(Once_Id, 100);
+  Run(200);
+  Sim_Check(Once_Calls == 1, "released one-shot timer is not rearmed");
+
+  byte Again = Newton.Timer_Start(Once, 300, TIMER_ONE_SHOT);
+  Run(200);
+  Newton.Timer_Reschedule(Again, 100);
+  Run(90);
+  Sim_Check(Once_Calls == 1, "reschedule restarts the period");
+  Run(20);
+  Sim_Check(Once_Calls == 2, "rescheduled one-shot timer");
+
+  // Running out of timers.
+  byte Ids[TIMER_COUNT];
+  for(byte i = 0; i < TIMER_COUNT; i++)
+    Ids[i] = Newton.Timer_Start(Nothing, 1000, TIMER_PERIODIC);
+  Sim_Check(Ids[TIMER_COUNT-1] != TIMER_NONE, "all timers can be used");
+  Sim_Check(Newton.Timer_Start(Nothing, 1000, TIMER_PERIODIC) == TIMER_NONE, "TIMER_NONE when full");
+
+  return Sim_Failures ? 1 : 0;
+}
@@ -0,0 +1,364 @@
+/*
+ Bulk transfer benchmark.
+
+ Copies the whole EEPROM (32 kB) to the host over the serial port, then
+ loads a new image into it, and reports the simulated time and throughput
+ of:
+
+    - the usual sketch: Memory_Read() of each address, printed as text
+    - blocking frames: Memory_Read_Block() of 64 bytes, then the frame
+      written to Serial (waiting for room), one after the other
+    - Memory_Transfer at several baud rates, with the host below (the
+      same protocol as extras/newton_transfer.py)
+    - for loading: Memory_Write() of each address (the bus time alone)
+
+ With the EEPROM read while the last frame goes out, Memory_Transfer must
+ take no longer than the serial line or the bus (whichever is slower)
+ would on its own; the bus alone is shown by Memory_Read_Block() and
+ Memory_Write_Block() of every page.  The copies must be exact, also with noise on the serial line (a bit
+ flipped every few thousand bytes each way), which the CRCs must catch and
+ the host must recover from by asking again.  No byte may be lost to a
+ full receive buffer.
+
+ The program exits with a non-zero status if any check fails.
+*/
+
+#include "Newton.h"
+#include "Newton_Sim.h"
+
+#define LOOP_TIME    20ULL        // uS of other work per pass of loop().
+#define HOST_TIMEOUT 50000ULL     // uS before the host asks again.
+
+static byte Image[EEPROM_SIZE];
+static byte Copy[EEPROM_SIZE];
+static Memory_Transfer Transfer(Serial);
+
+// Baud 0 for no serial port.
+static void Report(const char *Name, unsigned long Baud, unsigned long long Start){
+  double Time = (Sim_Time_Micros() - Start) / 1e6;
+  char Rate[24] = "-";
+  if(Baud) snprintf(Rate, sizeof(Rate), "%lu", Baud);
+  printf("%-26s %8s %10.2f %10.1f\n", Name, Rate, Time, EEPROM_SIZE / Time / 1000.0);
+}
+
+// Time to send the whole EEPROM in frames at Baud, in S.
+static double Line_Time(unsigned long Baud){
+  return (double)EEPROM_SIZE / TRANSFER_CHUNK * (TRANSFER_CHUNK + 7) * 10 / Baud;
+}
+
+static double Slowest(double A, double B){
+  return A > B ? A : B;
+}
+
+/*
+ The host: frames are parsed from the bytes that have arrived; a damaged
+ frame is dropped and the search for TRANSFER_SYNC starts again after its
+ first byte.
+*/
+static byte Host_Buffer[1024];
+static size_t Host_Length;
+static unsigned long Host_Errors, Host_Requests;
+
+static uint16_t CRC16(const byte *Data, size_t Length, uint16_t CRC = 0xFFFF){
+  while(Length--)
+    {
+    CRC ^= (uint16_t)(*Data++) << 8;
+    for(int Bit = 0; Bit < 8; Bit++)
+      CRC = (CRC & 0x8000) ? (CRC << 1) ^ 0x1021 : CRC << 1;
+    }
+  return CRC;
+}
+
+static void Host_Send(byte Type, unsigned int Address, const byte *Data, byte Count){
+  byte Frame[TRANSFER_CHUNK + 7] = {TRANSFER_SYNC, Type, (byte)(Address >> 8), (byte)Address, Count};
+  if(Count)
+    memcpy(Frame + 5, Data, Count);
+  uint16_t CRC = CRC16(Frame + 1, 4 + Count);
+  Frame[5 + Count] = CRC >> 8;
+  Frame[6 + Count] = CRC & 0xFF;
+  Sim_Serial_Send(Frame, Count + 7);
+}
+
+static void Host_Read(unsigned int Address, unsigned int Count){
+  byte Data[2] = {(byte)(Count >> 8), (byte)Count};
+  Host_Send(TRANSFER_READ, Address, Data, 2);
+  Host_Requests++;
+}
+
+// Returns true with the next intact frame, if one has arrived.
+static bool Host_Frame(byte *Type, unsigned int *Address, byte *Data, byte *Count){
+  Host_Length += Sim_Serial_Receive(Host_Buffer + Host_Length, sizeof(Host_Buffer) - Host_Length);
+  size_t Start = 0;
+  bool Found = false;
+  while(!Found)
+    {
+    while(Start < Host_Length && Host_Buffer[Start] != TRANSFER_SYNC) Start++;
+    if(Host_Length - Start < 5) break;
+    byte *Frame = Host_Buffer + Start;
+    if(Frame[4] > TRANSFER_CHUNK) { Start++; Host_Errors++; continue; }
+    if(Host_Length - Start < (size_t)Frame[4] + 7u) break;
+    uint16_t CRC = CRC16(Frame + 1, 4 + Frame[4]);
+    if(Frame[5 + Frame[4]] != CRC >> 8 || Frame[6 + Frame[4]] != (CRC & 0xFF))
+      {
+      Start++;
+      Host_Errors++;
+      continue;
+      }
+    *Type = Frame[1];
+    *Address = Frame[2] << 8 | Frame[3];
+    *Count = Frame[4];
+    memcpy(Data, Frame + 5, Frame[4]);
+    Start += Frame[4] + 7;
+    Found = true;
+    }
+  memmove(Host_Buffer, Host_Buffer + Start, Host_Length - Start);
+  Host_Length -= Start;
+  return Found;
+}
+
+static void Pass(){
+  Transfer.Service();
+  Sim_Advance(LOOP_TIME);
+}
+
+// Lets the board finish (frames still under way are thrown away).
+static void Settle(){
+  unsigned long long Start = Sim_Time_Micros();
+  while(Sim_Time_Micros() - Start < 20000) Pass();
+  byte Type, Count, Data[TRANSFER_CHUNK];
+  unsigned int Address;
+  while(Host_Frame(&Type, &Address, Data, &Count)) ;
+  Host_Length = 0;
+}
+
+// Copies Count bytes from Start into Copy: frames are taken in order and
+// the rest of the range is asked for again after a gap or a silence.
+static bool Host_Dump(unsigned int Start, unsigned int Count){
+  unsigned int Expected = Start, End = Start + Count;
+  unsigned long Errors = Host_Errors;
+  unsigned long long Heard = Sim_Time_Micros();
+  bool Asked = false;
+  Host_Read(Start, Count);
+  while(Expected < End)
+    {
+    Pass();
+    byte Type, Length, Data[TRANSFER_CHUNK];
+    unsigned int Address;
+    while(Host_Frame(&Type, &Address, Data, &Length))
+      {
+      if(Type == TRANSFER_NAK) return false;
+      if(Type != TRANSFER_DATA) continue;
+      if(Address == Expected)
+        {
+        memcpy(Copy + Address, Data, Length);
+        Expected += Length;
+        Heard = Sim_Time_Micros();
+        Asked = false;
+        }
+      else if(!Asked)
+        Errors = Host_Errors + 1;     // A frame is missing.
+      }
+    if((Host_Errors != Errors && !Asked) || Sim_Time_Micros() - Heard > HOST_TIMEOUT)
+      {
+      Host_Read(Expected, End - Expected);
+      Heard = Sim_Time_Micros();
+      Errors = Host_Errors;
+      Asked = true;
+      }
+    }
+  Settle();
+  return true;
+}
+
+// Waits for the answer to a frame for Address: 1 for an ACK, 0 for a NAK
+// and -1 if none came.
+static int Host_Answer(unsigned int Address){
+  unsigned long long Start = Sim_Time_Micros();
+  while(Sim_Time_Micros() - Start < HOST_TIMEOUT)
+    {
+    Pass();
+    byte Type, Count, Data[TRANSFER_CHUNK];
+    unsigned int Frame_Address;
+    while(Host_Frame(&Type, &Frame_Address, Data, &Count))
+      if(Frame_Address == Address && (Type == TRANSFER_ACK || Type == TRANSFER_NAK))
+        return Type == TRANSFER_ACK;
+    }
+  return -1;
+}
+
+// Writes Image into the EEPROM one page at a time, each sent again until
+// it is acknowledged, then finishes (a NAK may be for a damaged FINISH,
+// so it is asked again).
+static bool Host_Restore(){
+  for(unsigned int Address = 0; Address < EEPROM_SIZE; Address += TRANSFER_CHUNK)
+    {
+    int Tries = 0;
+    do
+      {
+      if(++Tries > 10) return false;
+      Host_Send(TRANSFER_WRITE, Address, Image + Address, TRANSFER_CHUNK);
+      }
+    while(Host_Answer(Address) != 1);
+    }
+  int Answer = -1;
+  for(int Tries = 0; Tries < 3 && Answer != 1; Tries++)
+    {
+    Host_Send(TRANSFER_FINISH, 0, NULL, 0);
+    Answer = Host_Answer(0);
+    }
+  Settle();
+  return Answer == 1;
+}
+
+static void Start(unsigned long Baud){
+  Sim_Reset();
+  Serial.begin(Baud);
+  memcpy(Sim_EEPROM_Data(), Image, EEPROM_SIZE);
+  memset(Copy, 0, sizeof(Copy));
+  Host_Length = 0;
+  Host_Errors = Host_Requests = 0;
+  Transfer.Errors = 0;
+}
+
+static void Dumps(){
+  printf("%-26s %8s %10s %10s\n", "copy to the host", "baud", "time(s)", "kB/s");
+
+  // The usual sketch: each byte read and printed as a decimal number.
+  Start(115200);
+  unsigned long long Begin = Sim_Time_Micros();
+  for(unsigned int Address = 0; Address < EEPROM_SIZE; Address++)
+    {
+    char Text[8];
+    int Length = snprintf(Text, sizeof(Text), "%u\r\n", Newton.Memory_Read(Address));
+    Serial.write((const byte *)Text, Length);
+    Sim_Serial_Receive(Host_Buffer, sizeof(Host_Buffer));
+    }
+  Serial.flush();
+  Report("Memory_Read + print", 115200, Begin);
+
+  // Frames, reading and sending in turn (the transmit buffer still lets
+  // the UART send the end of a frame while the next chunk is read).
+  static const unsigned long Bauds[3] = {115200, 250000, 500000};
+  for(int i = 0; i < 3; i++)
+    {
+    Start(Bauds[i]);
+    Begin = Sim_Time_Micros();
+    for(unsigned int Address = 0; Address < EEPROM_SIZE; Address += TRANSFER_CHUNK)
+      {
+      byte Frame[TRANSFER_CHUNK + 7] = {TRANSFER_SYNC, TRANSFER_DATA, (byte)(Address >> 8), (byte)Address, TRANSFER_CHUNK};
+      Newton.Memory_Read_Block(Frame + 5, TRANSFER_CHUNK, Address);
+      uint16_t CRC = CRC16(Frame + 1, 4 + TRANSFER_CHUNK);
+      Frame[5 + TRANSFER_CHUNK] = CRC >> 8;
+      Frame[6 + TRANSFER_CHUNK] = CRC & 0xFF;
+      Serial.write(Frame, sizeof(Frame));
+      Sim_Serial_Receive(Host_Buffer, sizeof(Host_Buffer));
+      }
+    Serial.flush();
+    Report("blocking frames", Bauds[i], Begin);
+    }
+
+  // The bus alone, for the bound on Memory_Transfer.
+  Start(115200);
+  Begin = Sim_Time_Micros();
+  for(unsigned int Address = 0; Address < EEPROM_SIZE; Address += TRANSFER_CHUNK)
+    Newton.Memory_Read_Block(Copy + Address, TRANSFER_CHUNK, Address);
+  double Bus = (Sim_Time_Micros() - Begin) / 1e6;
+  Report("Memory_Read_Block (bus)", 0, Begin);
+
+  for(int i = 0; i < 3; i++)
+    {
+    Start(Bauds[i]);
+    Begin = Sim_Time_Micros();
+    Sim_Check(Host_Dump(0, EEPROM_SIZE) && memcmp(Copy, Image, EEPROM_SIZE) == 0, "copy to the host");
+    double Time = (Sim_Time_Micros() - Begin) / 1e6;
+    Report("Memory_Transfer", Bauds[i], Begin);
+    Sim_Check(Sim_Serial.Overruns == 0, "no bytes lost");
+    Sim_Check(Time < 1.1 * Slowest(Line_Time(Bauds[i]), Bus), "copy as fast as the line or the bus allows");
+    }
+
+  // A noisy line.
+  Start(500000);
+  Sim_Serial_Noise(3000);
+  Begin = Sim_Time_Micros();
+  Sim_Check(Host_Dump(0, EEPROM_SIZE) && memcmp(Copy, Image, EEPROM_SIZE) == 0, "copy over a noisy line");
+  Report("Memory_Transfer (noise)", 500000, Begin);
+  printf("  %lu damaged frames, %lu requests\n", Host_Errors, Host_Requests);
+  Sim_Check(Host_Errors > 0, "noise caught by the CRC");
+}
+
+static void Restores(){
+  printf("\n%-26s %8s %10s %10s\n", "load from the host", "baud", "time(s)", "kB/s");
+  for(int i = 0; i < EEPROM_SIZE; i++)
+    Image[i] = (byte)(i * 5 + (i >> 8));
+
+  // Memory_Write() of each byte, not counting the serial port at all.
+  Start(115200);
+  unsigned long long Begin = Sim_Time_Micros();
+  for(unsigned int Address = 0; Address < EEPROM_SIZE; Address++)
+    Newton.Memory_Write(Image[Address], Address);
+  Report("Memory_Write (bus only)", 0, Begin);
+
+  // Whole pages, the bus alone.
+  Start(115200);
+  Begin = Sim_Time_Micros();
+  for(unsigned int Address = 0; Address < EEPROM_SIZE; Address += TRANSFER_CHUNK)
+    Newton.Memory_Write_Block(Image + Address, TRANSFER_CHUNK, Address);
+  double Bus = (Sim_Time_Micros() - Begin) / 1e6;
+  Report("Memory_Write_Block (bus)", 0, Begin);
+
+  static const unsigned long Bauds[2] = {115200, 500000};
+  for(int i = 0; i < 2; i++)
+    {
+    Start(Bauds[i]);
+    memset(Sim_EEPROM_Data(), 0xFF, EEPROM_SIZE);
+    Begin = Sim_Time_Micros();
+    Sim_Check(Host_Restore() && memcmp(Sim_EEPROM_Data(), Image, EEPROM_SIZE) == 0, "load from the host");
+    double Time = (Sim_Time_Micros() - Begin) / 1e6;
+    Report("Memory_Transfer", Bauds[i], Begin);
+    Sim_Check(Sim_Serial.Overruns == 0, "no bytes lost");
+    Sim_Check(Time < 1.1 * Slowest(Line_Time(Bauds[i]), Bus), "load as fast as the line or the bus allows");
+    }
+
+  Start(500000);
+  memset(Sim_EEPROM_Data(), 0xFF, EEPROM_SIZE);
+  Sim_Serial_Noise(3000);
+  Begin = Sim_Time_Micros();
+  Sim_Check(Host_Restore() && memcmp(Sim_EEPROM_Data(), Image, EEPROM_SIZE) == 0, "load over a noisy line");
+  Report("Memory_Transfer (noise)", 500000, Begin);
+  printf("  %lu damaged frames seen by the board, %lu by the host\n", Transfer.Errors, Host_Errors);
+
+  // A short read after a write: only the bytes asked for come back.
+  Start(500000);
+  Host_Send(TRANSFER_WRITE, 0, Image, TRANSFER_CHUNK);
+  Host_Answer(0);
+  Settle();
+  Host_Read(0x100, 16);
+  unsigned int Received = 0;
+  Begin = Sim_Time_Micros();
+  while(Sim_Time_Micros() - Begin < HOST_TIMEOUT)
+    {
+    Pass();
+    byte Type, Count, Data[TRANSFER_CHUNK];
+    unsigned int Address;
+    while(Host_Frame(&Type, &Address, Data, &Count))
+      if(Type == TRANSFER_DATA) Received += Count;
+    }
+  Sim_Check(Received == 16, "read length taken from the read alone");
+
+  // A removed EEPROM fails the copy and the load.
+  Start(500000);
+  Sim_EEPROM_Connect(false);
+  Sim_Check(!Host_Dump(0, 256), "copy from a removed EEPROM fails");
+  Settle();
+  Sim_Check(!Host_Restore(), "load into a removed EEPROM fails");
+  Sim_EEPROM_Connect(true);
+  printf("\nerrors: %s\n", Sim_Failures ? "WRONG" : "ok");
+}
+
+int main(){
+  for(int i = 0; i < EEPROM_SIZE; i++)
+    Image[i] = (byte)(i * 7 + 3);
+  Dumps();
+  Restores();
+  return Sim_Failures ? 1 : 0;
+}
@@ -0,0 +1,1199 @@
+/*
+ Newton host-side simulation backend (see Newton_Sim.h).
+*/
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "Newton_Sim.h"
+#include "avr/sleep.h"
+#include <deque>
+
+HardwareSerial Serial;
+TwoWire Wire;
+Sim_Bus_Stats Sim_Bus;
+Sim_ISR_Stats Sim_ISR;
+Sim_Speaker_Stats Sim_Speaker;
+Sim_Sleep_Stats Sim_Sleep;
+Sim_Serial_Stats Sim_Serial;
+unsigned long Sim_EEPROM_Write_Cycles;
+
+volatile uint8_t  OCR0A;
+volatile uint8_t  OCR0B;
+Sim_Timer0_Counter TCNT0;
+volatile uint8_t  TIMSK0;
+volatile uint8_t  TCCR1A;
+volatile uint8_t  TCCR1B;
+volatile uint16_t TCNT1;
+volatile uint8_t  TIMSK1;
+volatile uint8_t  TCCR2A;
+volatile uint8_t  TCCR2B;
+volatile uint8_t  TCNT2;
+volatile uint8_t  OCR2A;
+volatile uint8_t  TIMSK2;
+volatile uint8_t  TIFR2;
+volatile uint8_t  PCICR;
+volatile uint8_t  PCIFR;
+volatile uint8_t  PCMSK0;
+volatile uint8_t  PCMSK1;
+volatile uint8_t  PCMSK2;
+volatile uint8_t  ADCSRA;
+volatile uint8_t  PRR;
+
+// Interrupt vectors are only called if the library defines them.
+extern "C" void TIMER0_COMPA_vect(void) __attribute__((weak));
+extern "C" void TIMER0_COMPB_vect(void) __attribute__((weak));
+extern "C" void TIMER1_OVF_vect(void) __attribute__((weak));
+extern "C" void TIMER2_COMPA_vect(void) __attribute__((weak));
+extern "C" void PCINT0_vect(void) __attribute__((weak));
+extern "C" void PCINT1_vect(void) __attribute__((weak));
+extern "C" void PCINT2_vect(void) __attribute__((weak));
+
+/*****************************************************************************
+ * Simulated clock and interrupts
+ */
+static unsigned long long Now;              // uS since reset.
+static unsigned long long Clock_Stopped;    // uS of it spent in power-down.
+static bool Power_Down;                     // Asleep with the timers stopped.
+static bool Interrupts_Enabled = true;
+static bool In_ISR;
+
+// Timer0 counts at F_CPU/64 and wraps every 256 counts (1024 uS); the
+// compare-A interrupt fires once per wrap when TCNT0 passes OCR0A.  The
+// compare-B interrupt fires when TCNT0 reaches OCR0B, which its handler
+// may move on within the same wrap.
+#define TIMER0_PERIOD  1024
+#define TIMER0_COUNT   4            // uS per count.
+static unsigned long long Timer0_Next_Compare = TIMER0_PERIOD / 2;
+static bool Timer0_Pending;
+static unsigned long long Timer0B_Synced;   // Matches up to this time have been seen.
+static bool Timer0B_Pending;
+
+static unsigned long long Timer1_Synced;    // Time Timer1 was last brought up to date.
+static unsigned long Timer1_Residue;        // CPU cycles not yet counted by Timer1.
+static bool Timer1_Pending;
+
+// Timer2 counts CPU cycles divided by its prescaler up to OCR2A (CTC mode)
+// and interrupts at each match.  Matches are kept in CPU cycles, so that a
+// waveform made by its handler has the exact frequency; a new OCR2A or
+// prescaler applies from the last match on.  Like Timer0 it stops in
+// power-down.
+static unsigned long long Timer2_Match;     // MCU cycle of the last match, or of the start.
+static bool Timer2_Running;
+static bool Timer2_Pending;
+static bool In_Timer2;
+
+static unsigned long Timer1_Prescaler(){
+  static const unsigned long Prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+  return Prescalers[TCCR1B & 0x07];
+}
+
+static void Timer1_Sync(unsigned long long To){
+  unsigned long Prescaler = Timer1_Prescaler();
+  if(Prescaler)
+    {
+    unsigned long long Cycles = (To - Timer1_Synced) * (SIM_F_CPU / 1000000UL) + Timer1_Residue;
+    unsigned long long Count = TCNT1 + Cycles / Prescaler;
+    Timer1_Residue = Cycles % Prescaler;
+    if(Count > 0xFFFF)
+      Timer1_Pending = true;
+    TCNT1 = (uint16_t)Count;
+    }
+  Timer1_Synced = To;
+}
+
+static void Timer0_Sync(unsigned long long To){
+  while(Timer0_Next_Compare <= To)
+    {
+    if(TIMSK0 & (1 << OCIE0A))
+      Timer0_Pending = true;
+    Timer0_Next_Compare += TIMER0_PERIOD;
+    }
+}
+
+// Time of the next Timer0 compare match, or 0 if the interrupt is off.
+static unsigned long long Timer0_Next(){
+  if(!(TIMSK0 & (1 << OCIE0A)) || !TIMER0_COMPA_vect)
+    return 0;
+  return Timer0_Next_Compare;
+}
+
+// First time after Timer0B_Synced at which TCNT0 reaches OCR0B.
+static unsigned long long Timer0B_Match(){
+  unsigned long long Match = Timer0B_Synced / TIMER0_PERIOD * TIMER0_PERIOD + OCR0B * TIMER0_COUNT;
+  if(Match <= Timer0B_Synced)
+    Match += TIMER0_PERIOD;
+  return Match;
+}
+
+static void Timer0B_Sync(unsigned long long To){
+  if(Timer0B_Match() <= To && (TIMSK0 & (1 << OCIE0B)))
+    Timer0B_Pending = true;
+  Timer0B_Synced = To;
+}
+
+static unsigned long long Timer0B_Next(){
+  if(!(TIMSK0 & (1 << OCIE0B)) || !TIMER0_COMPB_vect)
+    return 0;
+  return Timer0B_Match();
+}
+
+// Time of the next Timer1 overflow, or 0 if the overflow interrupt is off.
+static unsigned long long Timer1_Next_Overflow(){
+  unsigned long Prescaler = Timer1_Prescaler();
+  if(!Prescaler || !(TIMSK1 & (1 << TOIE1)) || !TIMER1_OVF_vect)
+    return 0;
+  unsigned long long Cycles = (0x10000ULL - TCNT1) * Prescaler - Timer1_Residue;
+  unsigned long long Cycles_Per_uS = SIM_F_CPU / 1000000UL;
+  return Timer1_Synced + (Cycles + Cycles_Per_uS - 1) / Cycles_Per_uS;
+}
+
+// As on the AVR, the global interrupt flag is cleared while a handler runs.
+static void Call_ISR(void (*Vector)(void)){
+  unsigned long long Start = Now;
+  In_ISR = true;
+  Interrupts_Enabled = false;
+  Vector();
+  Interrupts_Enabled = true;
+  In_ISR = false;
+  unsigned long Blocked = (unsigned long)(Now - Start);
+  Sim_ISR.Calls++;
+  Sim_ISR.Blocked_Total += Blocked;
+  if(Blocked > Sim_ISR.Blocked_Max)
+    Sim_ISR.Blocked_Max = Blocked;
+}
+
+// External interrupts INT0/INT1.
+static void (*Ext_Handler[2])(void);
+static int Ext_Mode[2];
+static bool Ext_Pending[2];
+
+// Pin-change interrupts, one per port.
+static bool PCINT_Pending[3];
+static void (*const PCINT_Vector[3])(void) = {PCINT0_vect, PCINT1_vect, PCINT2_vect};
+
+// Input changes scheduled by Sim_Pin_Input_At().
+#define SIM_SCHEDULED  8
+struct Sim_Input{
+  unsigned long long At;
+  uint8_t Pin;
+  uint8_t Level;
+};
+static Sim_Input Scheduled[SIM_SCHEDULED];
+static int Scheduled_Count;
+static void Input_Level(uint8_t Pin, uint8_t Level);
+
+// The DS1307 square-wave output is an event source (see the RTC model).
+static unsigned long long RTC_Next_Edge();
+static void RTC_Sync(unsigned long long To);
+
+static void Service_Interrupts(){
+  if(!Interrupts_Enabled || In_ISR)
+    return;
+  for(int i = 0; i < 2; i++)
+    if(Ext_Pending[i] && Ext_Handler[i])
+      {
+      Ext_Pending[i] = false;
+      Call_ISR(Ext_Handler[i]);
+      }
+  for(int i = 0; i < 3; i++)
+    if(PCINT_Pending[i] && (PCICR & (1 << i)) && PCINT_Vector[i])
+      {
+      PCINT_Pending[i] = false;
+      Call_ISR(PCINT_Vector[i]);
+      }
+  if(Timer0_Pending && (TIMSK0 & (1 << OCIE0A)) && TIMER0_COMPA_vect)
+    {
+    Timer0_Pending = false;
+    Call_ISR(TIMER0_COMPA_vect);
+    }
+  if(Timer0B_Pending && (TIMSK0 & (1 << OCIE0B)) && TIMER0_COMPB_vect)
+    {
+    Timer0B_Pending = false;
+    Call_ISR(TIMER0_COMPB_vect);
+    }
+  if(Timer1_Pending && (TIMSK1 & (1 << TOIE1)) && TIMER1_OVF_vect)
+    {
+    Timer1_Pending = false;
+    Call_ISR(TIMER1_OVF_vect);
+    }
+  if(Timer2_Pending && (TIMSK2 & (1 << OCIE2A)) && TIMER2_COMPA_vect)
+    {
+    uint8_t Compare = OCR2A, Control = TCCR2B;
+    Timer2_Pending = false;
+    In_Timer2 = true;
+    Call_ISR(TIMER2_COMPA_vect);
+    In_Timer2 = false;
+    if(OCR2A != Compare || TCCR2B != Control)
+      Sim_Speaker.Changes++;
+    }
+}
+
+// The timers run on the MCU clock, which stops in power-down.
+static unsigned long long MCU_Time(){
+  return Now - Clock_Stopped;
+}
+
+static unsigned long long MCU_Cycles(){
+  return MCU_Time() * (SIM_F_CPU / 1000000UL);
+}
+
+static unsigned long long Timer2_Period(){
+  static const unsigned long Prescalers[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+  if(!(TIMSK2 & (1 << OCIE2A)) || !TIMER2_COMPA_vect)
+    return 0;
+  return (OCR2A + 1ULL) * Prescalers[TCCR2B & 0x07];
+}
+
+// Notices the timer being started or stopped, and the matches up to now
+// (several missed while interrupts were off make one interrupt).
+static void Timer2_Sync(){
+  unsigned long long Period = Timer2_Period(), Cycles = MCU_Cycles();
+  if(!Period)
+    Timer2_Running = false;
+  else if(!Timer2_Running)
+    {
+    Timer2_Running = true;
+    Timer2_Match = Cycles;
+    }
+  else if(Timer2_Match + Period <= Cycles)
+    {
+    Timer2_Match += (Cycles - Timer2_Match) / Period * Period;
+    Timer2_Pending = true;
+    }
+}
+
+// Time of the next Timer2 match, or 0 if it is not running.
+static unsigned long long Timer2_Next(){
+  unsigned long long Period = Timer2_Period();
+  if(!Period || !Timer2_Running)
+    return 0;
+  unsigned long long Cycles_Per_uS = SIM_F_CPU / 1000000UL;
+  return (Timer2_Match + Period + Cycles_Per_uS - 1) / Cycles_Per_uS;
+}
+
+// An interrupt that wakes the MCU from power-down restarts its clock.
+static void Wake_Check(){
+  if(!Power_Down)
+    return;
+  bool Wake = false;
+  for(int i = 0; i < 2; i++)
+    Wake = Wake || (Ext_Pending[i] && Ext_Handler[i]);
+  for(int i = 0; i < 3; i++)
+    Wake = Wake || (PCINT_Pending[i] && (PCICR & (1 << i)) && PCINT_Vector[i]);
+  if(Wake)
+    {
+    Power_Down = false;
+    Timer1_Synced = Now;
+    }
+}
+
+// Moves the clock to the next event, or to Target if there is none before.
+static void Advance_Step(unsigned long long Target){
+  unsigned long long Next = Target;
+  if(!Power_Down)
+    Timer2_Sync();
+  if(Interrupts_Enabled && !In_ISR && !Power_Down)
+    {
+    unsigned long long Event = Timer0_Next();
+    if(Event && Event + Clock_Stopped < Next)
+      Next = Event + Clock_Stopped;
+    Event = Timer0B_Next();
+    if(Event && Event + Clock_Stopped < Next)
+      Next = Event + Clock_Stopped;
+    Event = Timer1_Next_Overflow();
+    if(Event && Event < Next)
+      Next = Event;
+    Event = Timer2_Next();
+    if(Event && Event + Clock_Stopped < Next)
+      Next = Event + Clock_Stopped;
+    }
+  // SQW edges and scheduled inputs change a pin level, so they are
+  // followed even when interrupts are off.
+  unsigned long long Edge = RTC_Next_Edge();
+  if(Edge && Edge < Next)
+    Next = Edge;
+  for(int i = 0; i < Scheduled_Count; i++)
+    if(Scheduled[i].At < Next)
+      Next = Scheduled[i].At;
+  if(Power_Down)
+    Clock_Stopped += Next - Now;
+  Now = Next;
+  if(!Power_Down)
+    {
+    Timer0_Sync(MCU_Time());
+    Timer0B_Sync(MCU_Time());
+    Timer1_Sync(Now);
+    Timer2_Sync();
+    }
+  RTC_Sync(Now);
+  for(int i = 0; i < Scheduled_Count; i++)
+    if(Scheduled[i].At <= Now)
+      {
+      Input_Level(Scheduled[i].Pin, Scheduled[i].Level);
+      Scheduled[i--] = Scheduled[--Scheduled_Count];
+      }
+  Wake_Check();
+  Service_Interrupts();
+}
+
+void Sim_Advance(unsigned long long Microseconds){
+  unsigned long long Target = Now + Microseconds;
+  while(Now < Target)
+    Advance_Step(Target);
+}
+
+/*****************************************************************************
+ * Sleep
+ *
+ * sleep_cpu() runs the clock on until an interrupt handler has been
+ * called.  Nothing may wake the MCU for a simulated day, which is taken to
+ * mean it never would.
+ */
+#define SIM_SLEEP_LIMIT  (24ULL * 3600ULL * 1000000ULL)
+
+static uint8_t Sleep_Mode = SLEEP_MODE_IDLE;
+static bool Sleep_Enabled;
+
+void set_sleep_mode(uint8_t Mode){
+  Sleep_Mode = Mode;
+}
+
+void sleep_enable(){
+  Sleep_Enabled = true;
+}
+
+void sleep_disable(){
+  Sleep_Enabled = false;
+}
+
+void sleep_cpu(){
+  if(!Sleep_Enabled)
+    return;
+  if(!Interrupts_Enabled || In_ISR)
+    {
+    fprintf(stderr, "sleep_cpu() with interrupts off would never wake\n");
+    abort();
+    }
+  unsigned long long Start = Now;
+  unsigned long Calls = Sim_ISR.Calls;
+  Power_Down = Sleep_Mode == SLEEP_MODE_PWR_DOWN;
+  bool Deep = Power_Down;
+  while(Sim_ISR.Calls == Calls)
+    {
+    if(Now - Start >= SIM_SLEEP_LIMIT)
+      {
+      fprintf(stderr, "sleep_cpu(): nothing woke the MCU\n");
+      abort();
+      }
+    Advance_Step(Start + SIM_SLEEP_LIMIT);
+    }
+  Power_Down = false;
+  Sim_Sleep.Sleeps++;
+  if(Deep)
+    Sim_Sleep.Power_Down += Now - Start;
+  else
+    Sim_Sleep.Idle += Now - Start;
+}
+
+unsigned long long Sim_Time_Micros(){
+  return Now;
+}
+
+Sim_Timer0_Counter::operator uint8_t() const{
+  return (uint8_t)(MCU_Time() / TIMER0_COUNT);
+}
+
+/*****************************************************************************
+ * Arduino core
+ */
+static uint8_t Pin_Mode[32];
+static uint8_t Pin_Level[32];
+static uint8_t Pin_Latch[32];       // PORTx bit: output level, or pull-up.
+
+static uint8_t Bus_Hang_Clocks;     // SCL pulses until SDA is released.
+
+// The speaker is modelled by the edges on its pin (or, after tone(), as the
+// frequency tone() was given).
+static unsigned long long Speaker_Edge_At;  // MCU cycle of the last edge.
+static unsigned long long Speaker_Half;     // Cycles between the last two edges, 0 if unknown.
+static void Speaker_Edge();
+
+static uint8_t Link_From = 0xFF;    // Output wired to Link_To (see Sim_Pin_Link()).
+static uint8_t Link_To = 0xFF;
+static unsigned long Link_Noise;
+static uint32_t Link_Random = 1;
+
+// The level an input is read at: that of the pin linked to it, if any.
+static uint8_t Pin_Read(int Pin){
+  if(Pin != Link_To)
+    return Pin_Level[Pin];
+  uint8_t Level = Pin_Level[Link_From];
+  if(Link_Noise)
+    {
+    Link_Random = Link_Random * 1103515245UL + 12345;
+    if((Link_Random >> 8) % Link_Noise == 0)
+      Level = !Level;
+    }
+  return Level;
+}
+
+void pinMode(uint8_t Pin, uint8_t Mode){
+  // SCL released after being driven low: a clock pulse for a hung device.
+  if(Pin == SCL && Mode != OUTPUT && Pin_Mode[Pin] == OUTPUT && !Pin_Latch[Pin] && Bus_Hang_Clocks)
+    Bus_Hang_Clocks--;
+  Pin_Mode[Pin & 31] = Mode;
+  Pin_Latch[Pin & 31] = Mode == INPUT_PULLUP;
+  if(Mode == INPUT_PULLUP)
+    Pin_Level[Pin & 31] = HIGH;
+}
+
+void digitalWrite(uint8_t Pin, uint8_t Value){
+  uint8_t Old = Pin_Level[Pin & 31];
+  Pin_Latch[Pin & 31] = Value ? HIGH : LOW;
+  Pin_Level[Pin & 31] = Value ? HIGH : LOW;
+  if((Pin & 31) == SIM_SPEAKER_PIN && Pin_Level[Pin & 31] != Old)
+    Speaker_Edge();
+}
+
+Sim_Port_Register PORTB(8, 'O'), PORTC(14, 'O'), PORTD(0, 'O');
+Sim_Port_Register PINB(8, 'I'), PINC(14, 'I'), PIND(0, 'I');
+Sim_Port_Register DDRB(8, 'D'), DDRC(14, 'D'), DDRD(0, 'D');
+
+Sim_Port_Register::operator uint8_t() const{
+  uint8_t Value = 0;
+  for(int Bit = 0; Bit < 8; Bit++)
+    {
+    int Pin = (First_Pin + Bit) & 31;
+    bool Set = Kind == 'O' ? Pin_Latch[Pin] : (Kind == 'I' ? Pin_Read(Pin) : Pin_Mode[Pin] == OUTPUT);
+    Value |= Set << Bit;
+    }
+  return Value;
+}
+
+Sim_Port_Register &Sim_Port_Register::operator=(uint8_t Value){
+  for(int Bit = 0; Bit < 8; Bit++)
+    {
+    int Pin = (First_Pin + Bit) & 31;
+    bool Set = (Value >> Bit) & 1;
+    if(Kind == 'I')
+      {
+      if(!Set) continue;
+      Set = !Pin_Latch[Pin];
+      }
+    if(Kind == 'D')
+      Pin_Mode[Pin] = Set ? OUTPUT : (Pin_Latch[Pin] ? INPUT_PULLUP : INPUT);
+    else
+      Pin_Latch[Pin] = Set;
+    uint8_t Old = Pin_Level[Pin];
+    if(Pin_Mode[Pin] == OUTPUT)        // Inputs keep the level driven on them.
+      Pin_Level[Pin] = Pin_Latch[Pin];
+    if(Pin == SIM_SPEAKER_PIN && Pin_Level[Pin] != Old)
+      Speaker_Edge();
+    }
+  return *this;
+}
+
+int digitalRead(uint8_t Pin){
+  if(Pin == SDA && Bus_Hang_Clocks)
+    return LOW;
+  return Pin_Read(Pin & 31);
+}
+
+// An input changing level, as seen by the external interrupt logic.
+static void Input_Level(uint8_t Pin, uint8_t Level){
+  Level = Level ? HIGH : LOW;
+  uint8_t Old = Pin_Level[Pin & 31];
+  Pin_Level[Pin & 31] = Level;
+  if(Level != Old && Pin <= 19 && (*digitalPinToPCMSK(Pin) & (1 << digitalPinToPCMSKbit(Pin))))
+    PCINT_Pending[digitalPinToPCICRbit(Pin)] = true;
+  // Edges are detected with the I/O clock, which stops in power-down.
+  int Interrupt = digitalPinToInterrupt(Pin);
+  if(Interrupt == NOT_AN_INTERRUPT || Level == Old || !Ext_Handler[Interrupt] || Power_Down)
+    return;
+  if(Ext_Mode[Interrupt] == CHANGE ||
+     (Ext_Mode[Interrupt] == FALLING && Level == LOW) ||
+     (Ext_Mode[Interrupt] == RISING && Level == HIGH))
+    Ext_Pending[Interrupt] = true;
+}
+
+void Sim_Pin_Input(uint8_t Pin, uint8_t Level){
+  Input_Level(Pin, Level);
+  Service_Interrupts();
+}
+
+void Sim_Pin_Input_At(uint8_t Pin, uint8_t Level, unsigned long long At){
+  if(At <= Now)
+    Sim_Pin_Input(Pin, Level);
+  else if(Scheduled_Count < SIM_SCHEDULED)
+    Scheduled[Scheduled_Count++] = {At, Pin, Level};
+}
+
+void Sim_Pin_Link(uint8_t From, uint8_t To, unsigned long Every){
+  Link_From = From;
+  Link_To = To;
+  Link_Noise = Every;
+  Link_Random = 1;
+}
+
+void attachInterrupt(uint8_t Interrupt, void (*Handler)(void), int Mode){
+  if(Interrupt > 1)
+    return;
+  Ext_Handler[Interrupt] = Handler;
+  Ext_Mode[Interrupt] = Mode;
+  Ext_Pending[Interrupt] = false;
+}
+
+void detachInterrupt(uint8_t Interrupt){
+  if(Interrupt > 1)
+    return;
+  Ext_Handler[Interrupt] = NULL;
+  Ext_Pending[Interrupt] = false;
+}
+
+// Reading the clock is not free on the board either (about 4 uS for micros()).
+unsigned long millis(){
+  Sim_Advance(4);
+  return (unsigned long)(MCU_Time() / 1000);
+}
+
+unsigned long micros(){
+  Sim_Advance(4);
+  return (unsigned long)MCU_Time();
+}
+
+void delay(unsigned long Milliseconds){
+  Sim_Advance(Milliseconds * 1000ULL);
+}
+
+void delayMicroseconds(unsigned int Microseconds){
+  Sim_Advance(Microseconds);
+}
+
+// tone() is modelled as the frequency it is producing.
+static unsigned long long Tone_Ends;      // 0 for a continuous tone.
+
+void tone(uint8_t Pin, unsigned int Frequency, unsigned long Duration){
+  (void)Pin;
+  Sim_Speaker.Calls++;
+  Sim_Speaker.Frequency = Frequency;
+  Tone_Ends = Duration ? Now + Duration * 1000ULL : 0;
+}
+
+void noTone(uint8_t Pin){
+  (void)Pin;
+  Sim_Speaker.Frequency = 0;
+}
+
+// Edges made by the Timer2 handler are timed at the match that called it.
+// A half period over four times the one before (after a rest, or a jump
+// in frequency) makes the frequency unknown until the next edge.
+static void Speaker_Edge(){
+  unsigned long long At = In_Timer2 ? Timer2_Match : MCU_Cycles();
+  unsigned long long Half = At - Speaker_Edge_At;
+  Speaker_Half = Speaker_Half && Half > 4 * Speaker_Half ? 0 : Half;
+  Speaker_Edge_At = At;
+  Sim_Speaker.Edges++;
+}
+
+unsigned int Sim_Speaker_Frequency(){
+  if(Tone_Ends && Now >= Tone_Ends)
+    Sim_Speaker.Frequency = 0;
+  if(Sim_Speaker.Frequency)
+    return Sim_Speaker.Frequency;
+  // Silent once the pin has stopped changing for two half periods.
+  if(!Speaker_Half || !Timer2_Period() || MCU_Cycles() - Speaker_Edge_At > 2 * Speaker_Half)
+    return 0;
+  return (unsigned int)((SIM_F_CPU + Speaker_Half) / (2 * Speaker_Half));
+}
+
+Sim_Status_Register SREG;
+
+Sim_Status_Register::operator uint8_t() const{
+  return Interrupts_Enabled ? 0x80 : 0;
+}
+
+Sim_Status_Register &Sim_Status_Register::operator=(uint8_t Value){
+  if(Value & 0x80)
+    interrupts();
+  else
+    noInterrupts();
+  return *this;
+}
+
+void interrupts(){
+  Interrupts_Enabled = true;
+  Service_Interrupts();
+}
+
+void noInterrupts(){
+  Interrupts_Enabled = false;
+}
+
+/*****************************************************************************
+ * 24LC256 EEPROM model
+ */
+#define SIM_EEPROM_ADDRESS  0x50
+#define SIM_EEPROM_SIZE     32768
+#define SIM_EEPROM_PAGE     64
+
+static byte EEPROM_Array[SIM_EEPROM_SIZE];
+static unsigned long EEPROM_Page_Cycles[SIM_EEPROM_SIZE / SIM_EEPROM_PAGE];
+static unsigned int EEPROM_Pointer;
+static unsigned long long EEPROM_Busy_Until;
+static unsigned long EEPROM_Write_Cycle = SIM_EEPROM_WRITE_CYCLE;
+static bool EEPROM_Removed;
+
+byte *Sim_EEPROM_Data(){
+  return EEPROM_Array;
+}
+
+unsigned long Sim_EEPROM_Page_Cycles(unsigned int Page){
+  return Page < SIM_EEPROM_SIZE / SIM_EEPROM_PAGE ? EEPROM_Page_Cycles[Page] : 0;
+}
+
+void Sim_EEPROM_Set_Write_Cycle(unsigned long Microseconds){
+  EEPROM_Write_Cycle = Microseconds;
+}
+
+void Sim_EEPROM_Connect(bool Connected){
+  EEPROM_Removed = !Connected;
+}
+
+static bool EEPROM_Ack(){
+  return !EEPROM_Removed && Now >= EEPROM_Busy_Until;
+}
+
+// A write transaction: two address bytes followed by data that is latched
+// into the page buffer (wrapping within the page) and programmed at STOP.
+static void EEPROM_Write(const uint8_t *Data, uint8_t Length){
+  if(Length < 2)
+    return;
+  EEPROM_Pointer = ((Data[0] << 8) | Data[1]) & (SIM_EEPROM_SIZE - 1);
+  if(Length == 2)
+    return;
+  unsigned int Page = EEPROM_Pointer & ~(SIM_EEPROM_PAGE - 1);
+  unsigned int Offset = EEPROM_Pointer & (SIM_EEPROM_PAGE - 1);
+  for(uint8_t i = 2; i < Length; i++)
+    {
+    EEPROM_Array[Page + Offset] = Data[i];
+    Offset = (Offset + 1) & (SIM_EEPROM_PAGE - 1);
+    }
+  EEPROM_Pointer = Page + Offset;
+  EEPROM_Busy_Until = Now + EEPROM_Write_Cycle;
+  Sim_EEPROM_Write_Cycles++;
+  EEPROM_Page_Cycles[Page / SIM_EEPROM_PAGE]++;
+}
+
+static uint8_t EEPROM_Read(){
+  uint8_t Data = EEPROM_Array[EEPROM_Pointer];
+  EEPROM_Pointer = (EEPROM_Pointer + 1) & (SIM_EEPROM_SIZE - 1);
+  return Data;
+}
+
+/*****************************************************************************
+ * DS1307 RTC model
+ *
+ * The time is kept as seconds since 2000-01-01 at the moment the time
+ * registers were last written, plus the (scaled) simulated time since then.
+ * Registers 0x00-0x06 are computed when read; 0x07 is the control register
+ * and 0x08-0x3F are RAM.  SQW/OUT at 1 Hz falls on each seconds update and
+ * rises half a second later.
+ */
+#define SIM_RTC_ADDRESS  0x68
+
+static byte RTC_Regs[64];
+static byte RTC_Pointer;
+static unsigned long RTC_Base;              // Seconds since 2000 at RTC_Set_At.
+static byte RTC_Base_Day_Of_Week;
+static unsigned long long RTC_Set_At;
+static unsigned long long RTC_Half;         // Half seconds elapsed at the last edge.
+static long RTC_PPM;
+static bool RTC_Removed;
+static int RTC_SQW = -1;                    // MCU pin wired to SQW/OUT, or -1.
+
+static byte To_BCD(byte Value)   { return (Value / 10) << 4 | (Value % 10); }
+static byte From_BCD(byte Value) { return (Value >> 4) * 10 + (Value & 0x0F); }
+
+// Days since 2000-01-01 (H. Hinnant's days_from_civil, rebased).
+static long Days_From_Civil(int Year, int Month, int Day){
+  Year -= Month <= 2;
+  long Era = Year / 400;
+  long Year_Of_Era = Year - Era * 400;
+  long Day_Of_Year = (153 * (Month + (Month > 2 ? -3 : 9)) + 2) / 5 + Day - 1;
+  long Day_Of_Era = Year_Of_Era * 365 + Year_Of_Era / 4 - Year_Of_Era / 100 + Day_Of_Year;
+  return Era * 146097 + Day_Of_Era - 730425;
+}
+
+static void Civil_From_Days(long Days, int *Year, int *Month, int *Day){
+  Days += 730425;
+  long Era = Days / 146097;
+  long Day_Of_Era = Days - Era * 146097;
+  long Year_Of_Era = (Day_Of_Era - Day_Of_Era / 1460 + Day_Of_Era / 36524 - Day_Of_Era / 146096) / 365;
+  long Day_Of_Year = Day_Of_Era - (365 * Year_Of_Era + Year_Of_Era / 4 - Year_Of_Era / 100);
+  long Mp = (5 * Day_Of_Year + 2) / 153;
+  *Day = Day_Of_Year - (153 * Mp + 2) / 5 + 1;
+  *Month = Mp < 10 ? Mp + 3 : Mp - 9;
+  *Year = Year_Of_Era + Era * 400 + (*Month <= 2);
+}
+
+static bool RTC_Running(){
+  return !(RTC_Regs[0] & 0x80);
+}
+
+// Microseconds counted by the RTC since RTC_Set_At.
+static unsigned long long RTC_Elapsed(unsigned long long At){
+  if(!RTC_Running() || At < RTC_Set_At)
+    return 0;
+  return (unsigned long long)((At - RTC_Set_At) * (1.0 + RTC_PPM / 1e6));
+}
+
+unsigned long Sim_RTC_Seconds(){
+  return RTC_Base + (unsigned long)(RTC_Elapsed(Now) / 1000000ULL);
+}
+
+// Copies the running time into registers 0x00-0x06.
+static void RTC_Latch(){
+  unsigned long Seconds = Sim_RTC_Seconds();
+  long Days = Seconds / 86400;
+  int Year, Month, Day;
+  Civil_From_Days(Days, &Year, &Month, &Day);
+  RTC_Regs[0] = (RTC_Regs[0] & 0x80) | To_BCD(Seconds % 60);
+  RTC_Regs[1] = To_BCD(Seconds / 60 % 60);
+  RTC_Regs[2] = To_BCD(Seconds / 3600 % 24);
+  RTC_Regs[3] = (RTC_Base_Day_Of_Week + 6 + (Days - (long)(RTC_Base / 86400))) % 7 + 1;
+  RTC_Regs[4] = To_BCD(Day);
+  RTC_Regs[5] = To_BCD(Month);
+  RTC_Regs[6] = To_BCD(Year % 100);
+}
+
+// Restarts the time base from registers 0x00-0x06.
+static void RTC_Load(){
+  long Days = Days_From_Civil(2000 + From_BCD(RTC_Regs[6]), From_BCD(RTC_Regs[5]), From_BCD(RTC_Regs[4]));
+  RTC_Base = Days * 86400 + From_BCD(RTC_Regs[2] & 0x3F) * 3600UL +
+             From_BCD(RTC_Regs[1]) * 60 + From_BCD(RTC_Regs[0] & 0x7F);
+  RTC_Base_Day_Of_Week = RTC_Regs[3] ? RTC_Regs[3] : 1;
+  RTC_Set_At = Now;
+  RTC_Half = 0;
+}
+
+static bool RTC_SQW_Enabled(){
+  return RTC_SQW >= 0 && RTC_Running() && (RTC_Regs[7] & 0x13) == 0x10;
+}
+
+static unsigned long long RTC_Next_Edge(){
+  if(!RTC_SQW_Enabled())
+    return 0;
+  double At = (RTC_Half + 1) * 500000.0 / (1.0 + RTC_PPM / 1e6);
+  return RTC_Set_At + (unsigned long long)At + 1;
+}
+
+static void RTC_Sync(unsigned long long To){
+  if(!RTC_SQW_Enabled())
+    return;
+  unsigned long long Half = RTC_Elapsed(To) / 500000ULL;
+  while(RTC_Half < Half)
+    {
+    RTC_Half++;
+    Input_Level(RTC_SQW, (RTC_Half & 1) ? HIGH : LOW);
+    }
+}
+
+void Sim_RTC_Set(int Year, byte Month, byte Day, byte Hour, byte Minute, byte Second){
+  long Days = Days_From_Civil(Year, Month, Day);
+  RTC_Regs[0] = To_BCD(Second);
+  RTC_Regs[1] = To_BCD(Minute);
+  RTC_Regs[2] = To_BCD(Hour);
+  RTC_Regs[3] = (Days + 6) % 7 + 1;           // 2000-01-01 was a Saturday (day 7).
+  RTC_Regs[4] = To_BCD(Day);
+  RTC_Regs[5] = To_BCD(Month);
+  RTC_Regs[6] = To_BCD(Year % 100);
+  RTC_Load();
+}
+
+void Sim_RTC_Connect(bool Connected){
+  RTC_Removed = !Connected;
+}
+
+void Sim_RTC_Set_Error(long PPM){
+  RTC_Latch();
+  RTC_Load();
+  RTC_PPM = PPM;
+}
+
+void Sim_RTC_SQW_Pin(int Pin){
+  RTC_SQW = Pin;
+  if(Pin >= 0)
+    Input_Level(Pin, HIGH);
+}
+
+byte *Sim_RTC_RAM(){
+  return RTC_Regs + 8;
+}
+
+static bool RTC_Ack(){
+  return !RTC_Removed;
+}
+
+static void RTC_Write(const uint8_t *Data, uint8_t Length){
+  if(Length < 1)
+    return;
+  RTC_Pointer = Data[0] & 0x3F;
+  if(Length == 1)
+    return;
+  RTC_Latch();
+  bool Time_Written = false;
+  for(uint8_t i = 1; i < Length; i++)
+    {
+    if(RTC_Pointer < 7)
+      Time_Written = true;
+    RTC_Regs[RTC_Pointer] = Data[i];
+    RTC_Pointer = (RTC_Pointer + 1) & 0x3F;
+    }
+  if(Time_Written)
+    RTC_Load();
+}
+
+static uint8_t RTC_Read(){
+  if(RTC_Pointer < 7)
+    RTC_Latch();
+  uint8_t Data = RTC_Regs[RTC_Pointer];
+  RTC_Pointer = (RTC_Pointer + 1) & 0x3F;
+  return Data;
+}
+
+/*****************************************************************************
+ * Serial port
+ */
+#define SERIAL_BUFFER  64
+
+struct Serial_Byte{
+  unsigned long long Arrives;       // nS.
+  uint8_t Value;
+};
+
+static unsigned long Serial_Baud = 115200;
+static unsigned long long Serial_Tx_Done;     // nS: the UART has sent all it holds.
+static unsigned long long Serial_Host_Done;   // nS: the host has sent all it holds.
+static std::deque<Serial_Byte> Serial_To_Host, Serial_To_Sketch;
+static std::deque<uint8_t> Serial_Rx_Buffer;
+static unsigned long Serial_Noise, Serial_Noise_Count;
+
+static unsigned long long Serial_Byte_Time(){
+  return 10000000000ULL / Serial_Baud;
+}
+
+static uint8_t Serial_Line(uint8_t Value){
+  if(Serial_Noise && ++Serial_Noise_Count % Serial_Noise == 0)
+    Value ^= 1 << (Serial_Noise_Count % 8);
+  return Value;
+}
+
+// Bytes still in the transmit buffer (including the one being sent).
+static unsigned long Serial_Tx_Queued(){
+  unsigned long long Now_Ns = Now * 1000;
+  if(Serial_Tx_Done <= Now_Ns)
+    return 0;
+  return (Serial_Tx_Done - Now_Ns + Serial_Byte_Time() - 1) / Serial_Byte_Time();
+}
+
+// Moves the bytes that have arrived from the host into the receive buffer.
+static void Serial_Deliver(){
+  while(!Serial_To_Sketch.empty() && Serial_To_Sketch.front().Arrives <= Now * 1000)
+    {
+    if(Serial_Rx_Buffer.size() < SERIAL_BUFFER - 1)
+      Serial_Rx_Buffer.push_back(Serial_To_Sketch.front().Value);
+    else
+      Sim_Serial.Overruns++;
+    Serial_To_Sketch.pop_front();
+    }
+}
+
+void HardwareSerial::begin(unsigned long Baud){
+  Serial_Baud = Baud;
+}
+
+int HardwareSerial::available(){
+  Serial_Deliver();
+  return Serial_Rx_Buffer.size();
+}
+
+int HardwareSerial::read(){
+  if(!available())
+    return -1;
+  uint8_t Value = Serial_Rx_Buffer.front();
+  Serial_Rx_Buffer.pop_front();
+  Sim_Serial.Received++;
+  return Value;
+}
+
+int HardwareSerial::availableForWrite(){
+  unsigned long Queued = Serial_Tx_Queued();
+  return Queued >= SERIAL_BUFFER - 1 ? 0 : SERIAL_BUFFER - 1 - Queued;
+}
+
+size_t HardwareSerial::write(uint8_t Data){
+  while(availableForWrite() == 0)
+    Sim_Advance((Serial_Tx_Done - Now * 1000 - (SERIAL_BUFFER - 2) * Serial_Byte_Time() + 999) / 1000);
+  if(Serial_Tx_Done < Now * 1000)
+    Serial_Tx_Done = Now * 1000;
+  Serial_Tx_Done += Serial_Byte_Time();
+  Serial_Byte Byte = {Serial_Tx_Done, Serial_Line(Data)};
+  Serial_To_Host.push_back(Byte);
+  Sim_Serial.Sent++;
+  return 1;
+}
+
+void HardwareSerial::flush(){
+  if(Serial_Tx_Done > Now * 1000)
+    Sim_Advance((Serial_Tx_Done - Now * 1000 + 999) / 1000);
+}
+
+void Sim_Serial_Send(const byte *Data, size_t Length){
+  if(Serial_Host_Done < Now * 1000)
+    Serial_Host_Done = Now * 1000;
+  while(Length--)
+    {
+    Serial_Host_Done += Serial_Byte_Time();
+    Serial_Byte Byte = {Serial_Host_Done, Serial_Line(*Data++)};
+    Serial_To_Sketch.push_back(Byte);
+    }
+}
+
+size_t Sim_Serial_Receive(byte *Data, size_t Max){
+  size_t Count = 0;
+  while(Count < Max && !Serial_To_Host.empty() && Serial_To_Host.front().Arrives <= Now * 1000)
+    {
+    Data[Count++] = Serial_To_Host.front().Value;
+    Serial_To_Host.pop_front();
+    }
+  return Count;
+}
+
+void Sim_Serial_Noise(unsigned long Every){
+  Serial_Noise = Every;
+  Serial_Noise_Count = 0;
+}
+
+/*****************************************************************************
+ * I2C bus
+ */
+struct Sim_Device{
+  uint8_t Address;
+  uint32_t Max_Clock;           // Hz.
+  bool    (*Ack)();
+  void    (*Write)(const uint8_t *Data, uint8_t Length);
+  uint8_t (*Read)();
+};
+
+static const Sim_Device Devices[] = {
+  {SIM_EEPROM_ADDRESS, 400000UL, EEPROM_Ack, EEPROM_Write, EEPROM_Read},
+  {SIM_RTC_ADDRESS,    100000UL, RTC_Ack,    RTC_Write,    RTC_Read},
+};
+
+static const Sim_Device *Find_Device(uint8_t Address){
+  for(size_t i = 0; i < sizeof(Devices)/sizeof(Devices[0]); i++)
+    if(Devices[i].Address == Address && Devices[i].Ack())
+      return &Devices[i];
+  return NULL;
+}
+
+static uint32_t Bus_Clock = SIM_I2C_CLOCK;
+
+// START + 9 clocks per byte (8 data + ACK) + STOP.
+static void Bus_Time(unsigned int Bytes){
+  Sim_Bus.Transactions++;
+  Sim_Bus.Bytes += Bytes;
+  Sim_Advance(((unsigned long long)(9 * Bytes + 2) * 1000000ULL + Bus_Clock - 1) / Bus_Clock);
+}
+
+static void Bus_Check_Clock(const Sim_Device *Device){
+  if(Bus_Clock > Device->Max_Clock)
+    Sim_Bus.Too_Fast++;
+}
+
+// A transaction on a hung bus: the TWI waits for SDA until the timeout.
+// On the board a bus without a timeout never recovers.
+static void Bus_Timeout(uint32_t Timeout){
+  if(Timeout == 0)
+    {
+    fprintf(stderr, "Newton_Sim: the I2C bus is hung and Wire has no timeout\n");
+    exit(1);
+    }
+  Sim_Bus.Transactions++;
+  Sim_Bus.Bytes++;
+  Sim_Bus.Naks++;
+  Sim_Advance(Timeout);
+}
+
+void Sim_Bus_Hang(byte Clocks){
+  Bus_Hang_Clocks = Clocks;
+}
+
+void TwoWire::begin(){
+  Tx_Length = Rx_Length = Rx_Index = 0;
+  Transmitting = false;
+  Bus_Clock = SIM_I2C_CLOCK;
+}
+
+void TwoWire::end(){
+  Transmitting = false;
+}
+
+void TwoWire::setClock(uint32_t Clock){
+  Bus_Clock = Clock;
+}
+
+void TwoWire::setWireTimeout(uint32_t Timeout, bool Reset_With_Timeout){
+  (void)Reset_With_Timeout;
+  this->Timeout = Timeout;
+  Timeout_Flag = false;
+}
+
+void TwoWire::beginTransmission(uint8_t Address){
+  Tx_Address = Address;
+  Tx_Length = 0;
+  Transmitting = true;
+}
+
+size_t TwoWire::write(uint8_t Data){
+  if(!Transmitting || Tx_Length >= BUFFER_LENGTH)
+    return 0;
+  Tx_Buffer[Tx_Length++] = Data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *Data, size_t Quantity){
+  size_t Written = 0;
+  while(Quantity-- && write(*Data++))
+    Written++;
+  return Written;
+}
+
+uint8_t TwoWire::endTransmission(uint8_t Send_Stop){
+  (void)Send_Stop;
+  Transmitting = false;
+  if(Bus_Hang_Clocks)
+    {
+    Bus_Timeout(Timeout);
+    Timeout_Flag = true;
+    return 5;
+    }
+  const Sim_Device *Device = Find_Device(Tx_Address);
+  if(!Device)
+    {
+    Sim_Bus.Naks++;
+    Bus_Time(1);
+    return 2;
+    }
+  Bus_Check_Clock(Device);
+  Bus_Time(1 + Tx_Length);
+  Device->Write(Tx_Buffer, Tx_Length);
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t Address, uint8_t Quantity, uint8_t Send_Stop){
+  (void)Send_Stop;
+  Rx_Length = Rx_Index = 0;
+  if(Quantity > BUFFER_LENGTH)
+    Quantity = BUFFER_LENGTH;
+  if(Bus_Hang_Clocks)
+    {
+    Bus_Timeout(Timeout);
+    Timeout_Flag = true;
+    return 0;
+    }
+  const Sim_Device *Device = Find_Device(Address);
+  if(!Device)
+    {
+    Sim_Bus.Naks++;
+    Bus_Time(1);
+    return 0;
+    }
+  Bus_Check_Clock(Device);
+  Bus_Time(1 + Quantity);
+  while(Rx_Length < Quantity)
+    Rx_Buffer[Rx_Length++] = Device->Read();
+  return Rx_Length;
+}
+
+int TwoWire::available(){
+  return Rx_Length - Rx_Index;
+}
+
+int TwoWire::read(){
+  if(Rx_Index >= Rx_Length)
+    return -1;
+  return Rx_Buffer[Rx_Index++];
+}
+
+/*****************************************************************************
+ * Benchmark checks
+ */
+int Sim_Failures;
+
+void Sim_Check(bool Condition, const char *Message){
+  if(!Condition)
+    {
+    printf("FAILED: %s\n", Message);
+    Sim_Failures++;
+    }
+}
+
+/*****************************************************************************
+ * void Sim_Reset()
+ *
+ * Returns the clock, the bus counters and every device to power-up state.
+ * The EEPROM is erased to 0xFF and the RTC is set to 01/01/00 00:00:00 with
+ * SQW/OUT disconnected.  The MCU registers (and the I2C clock) are left
+ * as configured by the library (its constructor only runs once).
+ */
+void Sim_Reset(){
+  Now = 0;
+  Clock_Stopped = 0;
+  Power_Down = false;
+  Interrupts_Enabled = true;
+  In_ISR = false;
+  Timer0_Next_Compare = TIMER0_PERIOD / 2;
+  Timer0_Pending = false;
+  Timer0B_Synced = 0;
+  Timer0B_Pending = false;
+  Timer1_Synced = 0;
+  Timer1_Residue = 0;
+  Timer1_Pending = false;
+  Timer2_Running = false;
+  Timer2_Pending = false;
+  memset(&Sim_Bus, 0, sizeof(Sim_Bus));
+  memset(&Sim_ISR, 0, sizeof(Sim_ISR));
+  memset(&Sim_Speaker, 0, sizeof(Sim_Speaker));
+  Tone_Ends = 0;
+  Speaker_Edge_At = 0;
+  Speaker_Half = 0;
+  memset(EEPROM_Array, 0xFF, sizeof(EEPROM_Array));
+  EEPROM_Pointer = 0;
+  EEPROM_Busy_Until = 0;
+  EEPROM_Write_Cycle = SIM_EEPROM_WRITE_CYCLE;
+  EEPROM_Removed = false;
+  Sim_EEPROM_Write_Cycles = 0;
+  memset(EEPROM_Page_Cycles, 0, sizeof(EEPROM_Page_Cycles));
+  Bus_Hang_Clocks = 0;
+  Link_From = Link_To = 0xFF;
+  Link_Noise = 0;
+  memset(RTC_Regs, 0, sizeof(RTC_Regs));
+  RTC_Pointer = 0;
+  RTC_PPM = 0;
+  RTC_Removed = false;
+  RTC_SQW = -1;
+  Sim_RTC_Set(2000, 1, 1, 0, 0, 0);
+  for(int i = 0; i < 2; i++)
+    Ext_Pending[i] = false;
+  for(int i = 0; i < 3; i++)
+    PCINT_Pending[i] = false;
+  Scheduled_Count = 0;
+  memset(&Sim_Sleep, 0, sizeof(Sim_Sleep));
+  memset(&Sim_Serial, 0, sizeof(Sim_Serial));
+  Serial_Tx_Done = Serial_Host_Done = 0;
+  Serial_To_Host.clear();
+  Serial_To_Sketch.clear();
+  Serial_Rx_Buffer.clear();
+  Serial_Noise = 0;
+}
@@ -0,0 +1,141 @@
+/*
+ Newton host-side simulation backend.
+
+ Builds the Newton library on a desktop machine against simulated versions
+ of the Arduino core (Arduino.h) and the Wire library (Wire.h).  All time is
+ simulated: delay() and bus transfers advance a virtual clock rather than
+ sleeping, so benchmarks are exact and repeatable.  The I2C bus carries a
+ model of the on-board 32k EEPROM (24LC256 class, address 0x50, rated for
+ 400 kHz) including its 64-byte page buffer and its self-timed write
+ cycle, during which the device does not acknowledge its address, and a
+ model of the DS1307 RTC (address 0x68, rated for 100 kHz) with its time
+ registers, its 1 Hz square-wave output and a configurable crystal error.
+
+ A benchmark is built by compiling it together with the library and this
+ backend, with every optional subsystem, for example from the repository
+ root:
+
+    FEATURES="-D__NEWTON_LOG -D__NEWTON_CONFIG -D__NEWTON_ALARMS -D__NEWTON_ASYNC_BUS -D__NEWTON_RADIO"
+    g++ -std=gnu++11 -O2 $FEATURES -I . -I extras/sim Newton.cpp extras/sim/Newton_Sim.cpp \
+        extras/sim/Bench_EEPROM.cpp -o bench_eeprom
+
+ Bench_API.cpp measures every public call against a budget and the other
+ Bench_*.cpp programs look at one feature each.  Every benchmark exits
+ with a non-zero status when a check fails, so the whole suite can be run
+ as a regression test:
+
+    for b in extras/sim/Bench_*.cpp; do
+      g++ -std=gnu++11 -O2 $FEATURES -I . -I extras/sim Newton.cpp extras/sim/Newton_Sim.cpp $b \
+          -o bench && ./bench > /dev/null || echo "$b failed"
+    done
+*/
+
+#ifndef NEWTON_SIM_H
+#define NEWTON_SIM_H
+
+#include "Arduino.h"
+
+// Simulated clock.
+#define SIM_F_CPU               F_CPU
+#define SIM_I2C_CLOCK           100000UL    // Wire.begin() default.
+#define SIM_EEPROM_WRITE_CYCLE  3000UL      // uS, typical (5 mS worst case).
+
+struct Sim_Bus_Stats{
+  unsigned long Transactions;   // START conditions issued.
+  unsigned long Bytes;          // Bytes clocked, including address bytes.
+  unsigned long Naks;           // Transactions not acknowledged by the slave (or timed out).
+  unsigned long Too_Fast;       // Transactions clocked faster than the device is rated for.
+};
+
+// Simulated time spent blocked inside interrupt handlers.  Only blocking
+// calls (delay(), bus transfers) take simulated time; ordinary code is free.
+struct Sim_ISR_Stats{
+  unsigned long Calls;
+  unsigned long long Blocked_Total;   // uS.
+  unsigned long Blocked_Max;          // uS, longest single handler.
+};
+
+struct Sim_Speaker_Stats{
+  unsigned long Calls;          // tone() calls.
+  unsigned int  Frequency;      // Last frequency started by tone(), 0 if silent.
+  unsigned long Edges;          // Level changes on the speaker pin.
+  unsigned long Changes;        // Timer2 interrupts that changed its period.
+};
+
+struct Sim_Serial_Stats{
+  unsigned long Sent;           // Bytes written by the sketch,
+  unsigned long Received;       // read by the sketch,
+  unsigned long Overruns;       // lost because its receive buffer was full.
+};
+
+// Time spent asleep (sleep_cpu()); the timers stop in power-down.
+struct Sim_Sleep_Stats{
+  unsigned long Sleeps;
+  unsigned long long Idle;            // uS.
+  unsigned long long Power_Down;      // uS.
+};
+
+extern Sim_Bus_Stats Sim_Bus;
+extern Sim_ISR_Stats Sim_ISR;
+extern Sim_Speaker_Stats Sim_Speaker;
+extern Sim_Sleep_Stats Sim_Sleep;
+extern Sim_Serial_Stats Sim_Serial;
+extern unsigned long Sim_EEPROM_Write_Cycles;
+
+void Sim_Reset();
+unsigned long long Sim_Time_Micros();
+void Sim_Advance(unsigned long long Microseconds);
+
+// Frequency the speaker is producing now (0 if silent), from tone() or
+// from the last two edges on SIM_SPEAKER_PIN.
+#define SIM_SPEAKER_PIN  2
+unsigned int Sim_Speaker_Frequency();
+
+// Drives an input pin from outside (a switch pulls its pin LOW when pressed),
+// now or at a later simulated time (up to 8 changes can be waiting).
+void Sim_Pin_Input(uint8_t Pin, uint8_t Level);
+void Sim_Pin_Input_At(uint8_t Pin, uint8_t Level, unsigned long long At);
+
+// Wires output pin From to input pin To, as through a radio link (or a
+// wire when Every is 0): To reads the level From drives, except that one
+// read in Every, at random, gives the other level.  A To of 0xFF removes
+// the link.
+void Sim_Pin_Link(uint8_t From, uint8_t To, unsigned long Every);
+
+// The host end of the serial port: bytes sent here reach the sketch one
+// byte time after another (at the rate given to Serial.begin()), and bytes
+// the sketch writes can be collected once they have arrived.  Noise flips
+// a bit of every Every'th byte in either direction (0 for none).
+void Sim_Serial_Send(const byte *Data, size_t Length);
+size_t Sim_Serial_Receive(byte *Data, size_t Max);
+void Sim_Serial_Noise(unsigned long Every);
+
+// Direct access to the simulated EEPROM array (no bus traffic).
+byte *Sim_EEPROM_Data();
+unsigned long Sim_EEPROM_Page_Cycles(unsigned int Page);   // Write cycles of one 64-byte page.
+void Sim_EEPROM_Set_Write_Cycle(unsigned long Microseconds);
+void Sim_EEPROM_Connect(bool Connected);     // A removed device never ACKs.
+
+// A device holds SDA low (as after a reset part way through a read) until
+// it has seen Clocks more pulses on SCL; 0 frees the bus.  Transactions
+// time out meanwhile.
+void Sim_Bus_Hang(byte Clocks);
+
+// DS1307: set the time directly (year 2000-2099), unplug the device, set
+// the RTC crystal error relative to the MCU clock, wire SQW/OUT to an MCU
+// pin (pulled up, so it can drive an external interrupt), and reach its 56
+// bytes of RAM directly (no bus traffic).
+void Sim_RTC_Set(int Year, byte Month, byte Day, byte Hour, byte Minute, byte Second);
+void Sim_RTC_Connect(bool Connected);
+void Sim_RTC_Set_Error(long PPM);
+void Sim_RTC_SQW_Pin(int Pin);
+unsigned long Sim_RTC_Seconds();     // Seconds since 2000-01-01 00:00:00.
+byte *Sim_RTC_RAM();
+
+// Shared by the benchmarks: a check that does not hold is reported as
+// "FAILED: Message" and counted in Sim_Failures (not cleared by
+// Sim_Reset()), from which main() sets the exit status.
+extern int Sim_Failures;
+void Sim_Check(bool Condition, const char *Message);
+
+#endif
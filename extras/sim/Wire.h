@@ -0,0 +1,53 @@
+/*
+ Host-side stand-in for the Arduino Wire (I2C) library.
+
+ Transactions are delivered to the simulated devices in Newton_Sim.cpp and
+ the bus time they would take on the board is added to the simulated clock.
+ Return codes follow the AVR Wire library: endTransmission() returns 0 on
+ success, 2 when the address is not acknowledged and 3 when data is not
+ acknowledged; requestFrom() returns the number of bytes received.  A bus
+held low by a device (see Sim_Bus_Hang()) makes both time out as set by
+setWireTimeout(): endTransmission() returns 5, requestFrom() 0 and the
+timeout flag is set.
+*/
+
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH 32
+#define WIRE_HAS_TIMEOUT
+
+class TwoWire{
+  private:
+    uint8_t Tx_Address;
+    uint8_t Tx_Buffer[BUFFER_LENGTH];
+    uint8_t Tx_Length;
+    uint8_t Rx_Buffer[BUFFER_LENGTH];
+    uint8_t Rx_Length;
+    uint8_t Rx_Index;
+    bool    Transmitting;
+    uint32_t Timeout;           // uS, 0 for none.
+    bool    Timeout_Flag;
+  public:
+    void begin();
+    void end();
+    void setClock(uint32_t Clock);
+    void setWireTimeout(uint32_t Timeout = 25000, bool Reset_With_Timeout = false);
+    bool getWireTimeoutFlag() { return Timeout_Flag; }
+    void clearWireTimeoutFlag() { Timeout_Flag = false; }
+    void beginTransmission(uint8_t Address);
+    void beginTransmission(int Address) { beginTransmission((uint8_t)Address); }
+    uint8_t endTransmission(uint8_t Send_Stop = true);
+    uint8_t requestFrom(uint8_t Address, uint8_t Quantity, uint8_t Send_Stop = true);
+    uint8_t requestFrom(int Address, int Quantity) { return requestFrom((uint8_t)Address, (uint8_t)Quantity); }
+    size_t write(uint8_t Data);
+    size_t write(const uint8_t *Data, size_t Quantity);
+    int available();
+    int read();
+};
+
+extern TwoWire Wire;
+
+#endif
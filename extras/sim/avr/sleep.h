@@ -0,0 +1,21 @@
+/*
+ Host-side stand-in for avr-libc's <avr/sleep.h>.
+
+ sleep_cpu() advances the simulated clock until an interrupt wakes the MCU
+ (see Newton_Sim.cpp).  In SLEEP_MODE_PWR_DOWN the timers stop, as on the
+ board, so only pin changes and the external interrupts can wake it.
+*/
+
+#ifndef SIM_AVR_SLEEP_H
+#define SIM_AVR_SLEEP_H
+
+#define SLEEP_MODE_IDLE      0
+#define SLEEP_MODE_PWR_DOWN  2
+
+void set_sleep_mode(uint8_t Mode);
+void sleep_enable();
+void sleep_disable();
+void sleep_cpu();
+static inline void sleep_bod_disable() {}
+
+#endif
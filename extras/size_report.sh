@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# Size report: compiles Newton.cpp with each combination of the __NO_* and
+# __NEWTON_* tokens below and lists the code (text), initialised data and
+# zeroed RAM (bss) it adds.  "default" is what a sketch gets with no token
+# defined; each with_ line adds one of the opt-in subsystems to it.  Run
+# from the library folder:
+#
+#    sh extras/size_report.sh
+#
+# By default the host compiler is used with the simulator's headers, which
+# shows how the sizes change between combinations.  For the real AVR
+# figures give it the Arduino toolchain and the core's include folders:
+#
+#    CXX=avr-g++ SIZE=avr-size \
+#    CXXFLAGS="-mmcu=atmega328p -DF_CPU=16000000L -I<core> -I<variant> -I<Wire/src>" \
+#    sh extras/size_report.sh
+
+CXX=${CXX:-g++}
+SIZE=${SIZE:-size}
+CXXFLAGS=${CXXFLAGS:--I extras/sim}
+OBJECT=${TMPDIR:-/tmp}/newton_size.o
+
+printf "%-40s %8s %8s %8s\n" "configuration" "text" "data" "bss"
+while read -r NAME TOKENS; do
+  DEFINES=""
+  for TOKEN in $TOKENS; do
+    [ "$TOKEN" = "-" ] || DEFINES="$DEFINES -D$TOKEN"
+  done
+  if ! $CXX -std=gnu++11 -Os $CXXFLAGS -I . $DEFINES -c Newton.cpp -o "$OBJECT"; then
+    echo "$NAME: does not compile" >&2
+    exit 1
+  fi
+  $SIZE "$OBJECT" | awk -v Name="$NAME" 'NR==2 { printf "%-40s %8d %8d %8d\n", Name, $1, $2, $3 }'
+done <<EOF
+default -
+with_log __NEWTON_LOG
+with_config __NEWTON_CONFIG
+with_alarms __NEWTON_ALARMS
+with_async_bus __NEWTON_ASYNC_BUS
+with_radio __NEWTON_RADIO
+everything __NEWTON_LOG __NEWTON_CONFIG __NEWTON_ALARMS __NEWTON_ASYNC_BUS __NEWTON_RADIO
+no_RTC __NO_RTC
+no_EEPROM __NO_EEPROM
+no_I2C __NO_RTC __NO_EEPROM
+no_switches __NO_SWITCHES
+no_LEDs __NO_LEDS
+no_speaker __NO_SPEAKER
+no_sleep __NO_SLEEP
+no_timers __NO_TIMERS
+I2C_only __NO_SWITCHES __NO_LEDS __NO_SPEAKER __NO_TIMERS
+nothing __NO_RTC __NO_EEPROM __NO_SWITCHES __NO_LEDS __NO_SPEAKER __NO_SLEEP __NO_TIMERS
+EOF
+rm -f "$OBJECT"
@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# Time text size: the flash taken by the library's time text (Format_Time(),
+# Parse_Time() and what they use) against that of the sprintf() and sscanf()
+# calls Get_Time() and Set_Time() made before.  Run from the library folder:
+#
+#    sh extras/time_size.sh
+#
+# By default the host compiler is used with the simulator's headers; its C
+# library is shared, so the printf() and scanf() code does not show up and
+# only the calls are counted.  For the real AVR figures (where vfprintf()
+# and vfscanf() are linked in) give it the Arduino toolchain as for
+# extras/size_report.sh:
+#
+#    CXX=avr-g++ NM=avr-nm SIZE=avr-size \
+#    CXXFLAGS="-mmcu=atmega328p -DF_CPU=16000000L -I<core> -I<variant> -I<Wire/src>" \
+#    sh extras/time_size.sh
+
+CXX=${CXX:-g++}
+NM=${NM:-nm}
+SIZE=${SIZE:-size}
+CXXFLAGS=${CXXFLAGS:--I extras/sim}
+DIR=${TMPDIR:-/tmp}
+TOKENS="-D__NO_EEPROM -D__NO_SWITCHES -D__NO_LEDS -D__NO_SPEAKER -D__NO_SLEEP -D__NO_TIMERS"
+
+if ! $CXX -std=gnu++11 -Os $CXXFLAGS -I . $TOKENS -c Newton.cpp -o "$DIR/newton_time.o"; then
+  echo "Newton.cpp does not compile" >&2
+  exit 1
+fi
+$NM -S -t d -C "$DIR/newton_time.o" | awk '
+  /Format_Time|Parse_Time|Time_Text|Time_Layouts|Epoch_To_Date/ { Total += $2; printf "  %6d %s\n", $2, substr($0, index($0, $4)) }
+  END { printf "%-40s %8d\n", "library time text", Total }'
+
+# The old calls, in a program of their own against one without them.
+cat > "$DIR/newton_time_old.c" <<END
+#include <stdio.h>
+char Text[20];
+int Month, Day, Year, Hours, Minutes, Seconds;
+int main(void){
+#ifdef OLD
+  sprintf(Text, "%02d/%02d/%02d %02d:%02d:%02d", Month, Day, Year, Hours, Minutes, Seconds);
+  sscanf(Text, "%02d/%02d/%02d %02d:%02d:%02d", &Month, &Day, &Year, &Hours, &Minutes, &Seconds);
+#endif
+  return Text[0];
+}
+END
+CC=$(echo "$CXX" | sed 's/++$/cc/')
+CFLAGS=$(echo "$CXXFLAGS" | sed 's/-I *[^ ]*//g')
+$CC -Os $CFLAGS "$DIR/newton_time_old.c" -o "$DIR/newton_time_none" &&
+$CC -Os $CFLAGS -DOLD "$DIR/newton_time_old.c" -o "$DIR/newton_time_old" || exit 1
+NONE=$($SIZE "$DIR/newton_time_none" | awk 'NR==2 { print $1 }')
+OLD=$($SIZE "$DIR/newton_time_old" | awk 'NR==2 { print $1 }')
+printf "%-40s %8d\n" "sprintf() and sscanf()" $((OLD - NONE))
+rm -f "$DIR"/newton_time*